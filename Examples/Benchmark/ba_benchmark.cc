@@ -0,0 +1,180 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2020 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include<iostream>
+#include<iomanip>
+#include<chrono>
+#include<vector>
+#include<string>
+
+#include<BundleAdjuster.h>
+#include<OptimizableTypes.h>
+
+#include "Thirdparty/g2o/g2o/core/block_solver.h"
+#include "Thirdparty/g2o/g2o/core/optimization_algorithm_levenberg.h"
+#include "Thirdparty/g2o/g2o/solvers/linear_solver_eigen.h"
+#include "Thirdparty/g2o/g2o/types/types_six_dof_expmap.h"
+#include "Thirdparty/g2o/g2o/core/robust_kernel_impl.h"
+
+using namespace std;
+
+// Solves the problem with the g2o graph Optimizer builds for it. Returns the final robust chi2.
+double SolveG2o(const ORB_SLAM3::BundleAdjuster &problem, int nIterations, double &time)
+{
+    g2o::SparseOptimizer optimizer;
+    g2o::BlockSolver_6_3::LinearSolverType * linearSolver = new g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType>();
+    g2o::BlockSolver_6_3 * solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
+    g2o::OptimizationAlgorithmLevenberg* solver = new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
+    optimizer.setAlgorithm(solver);
+    optimizer.setVerbose(false);
+
+    const int nKFs = problem.NumKeyFrames();
+    for(int i=0; i<nKFs; i++)
+    {
+        g2o::VertexSE3Expmap * vSE3 = new g2o::VertexSE3Expmap();
+        vSE3->setEstimate(problem.GetPose(i));
+        vSE3->setId(i);
+        vSE3->setFixed(problem.IsFixed(i));
+        optimizer.addVertex(vSE3);
+    }
+
+    for(int j=0; j<problem.NumMapPoints(); j++)
+    {
+        g2o::VertexSBAPointXYZ* vPoint = new g2o::VertexSBAPointXYZ();
+        vPoint->setEstimate(problem.GetMapPoint(j));
+        vPoint->setId(nKFs+j);
+        vPoint->setMarginalized(true);
+        optimizer.addVertex(vPoint);
+    }
+
+    for(int i=0; i<problem.NumObservations(); i++)
+    {
+        const ORB_SLAM3::BundleAdjuster::Observation obs = problem.GetObservation(i);
+
+        g2o::OptimizableGraph::Edge* e;
+        if(obs.nDim==3)
+        {
+            g2o::EdgeStereoSE3ProjectXYZ* eStereo = new g2o::EdgeStereoSE3ProjectXYZ();
+            eStereo->setMeasurement(obs.obs);
+            eStereo->setInformation(Eigen::Matrix3d::Identity()*obs.invSigma2);
+            eStereo->fx = obs.fx;
+            eStereo->fy = obs.fy;
+            eStereo->cx = obs.cx;
+            eStereo->cy = obs.cy;
+            eStereo->bf = obs.bf;
+            e = eStereo;
+        }
+        else if(obs.bRight)
+        {
+            ORB_SLAM3::EdgeSE3ProjectXYZToBody* eBody = new ORB_SLAM3::EdgeSE3ProjectXYZToBody();
+            eBody->setMeasurement(obs.obs.head<2>());
+            eBody->setInformation(Eigen::Matrix2d::Identity()*obs.invSigma2);
+            eBody->pCamera = obs.pCamera;
+            eBody->mTrl = obs.Trl;
+            e = eBody;
+        }
+        else
+        {
+            ORB_SLAM3::EdgeSE3ProjectXYZ* eMono = new ORB_SLAM3::EdgeSE3ProjectXYZ();
+            eMono->setMeasurement(obs.obs.head<2>());
+            eMono->setInformation(Eigen::Matrix2d::Identity()*obs.invSigma2);
+            eMono->pCamera = obs.pCamera;
+            e = eMono;
+        }
+
+        e->setVertex(0, optimizer.vertex(nKFs+obs.nMP));
+        e->setVertex(1, optimizer.vertex(obs.nKF));
+        if(obs.thHuber>0)
+        {
+            g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
+            rk->setDelta(obs.thHuber);
+            e->setRobustKernel(rk);
+        }
+        optimizer.addEdge(e);
+    }
+
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    optimizer.initializeOptimization();
+    optimizer.optimize(nIterations);
+    std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+    time = std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(t1 - t0).count();
+
+    optimizer.computeActiveErrors();
+    return optimizer.activeRobustChi2();
+}
+
+// Compares the specialized bundle adjuster with g2o on problems exported by a running system
+// (Optimizer.exportDir in the settings)
+int main(int argc, char **argv)
+{
+    if(argc < 2)
+    {
+        cerr << endl << "Usage: ./ba_benchmark [-i iterations] path_to_problem_1 (path_to_problem_2 ... path_to_problem_N)" << endl;
+        return 1;
+    }
+
+    int nIterations = 10;
+    int first = 1;
+    if(string(argv[1]) == "-i" && argc > 3)
+    {
+        nIterations = atoi(argv[2]);
+        first = 3;
+    }
+
+    double totalAdjuster = 0, totalG2o = 0;
+    int nProblems = 0;
+
+    cout << fixed << setprecision(4);
+    for(int ni=first; ni<argc; ni++)
+    {
+        ORB_SLAM3::BundleAdjuster adjuster;
+        if(!adjuster.Load(argv[ni]))
+        {
+            cerr << "ERROR: Failed to load " << argv[ni] << endl;
+            continue;
+        }
+
+        double timeG2o;
+        const double iniChi2 = adjuster.GetRobustChi2();
+        const double chi2G2o = SolveG2o(adjuster, nIterations, timeG2o);
+
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        adjuster.Optimize(nIterations);
+        std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+        const double timeAdjuster = std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(t1 - t0).count();
+        const double chi2Adjuster = adjuster.GetRobustChi2();
+
+        cout << argv[ni] << ": " << adjuster.NumKeyFrames() << " KFs, " << adjuster.NumMapPoints() << " MPs, "
+             << adjuster.NumObservations() << " obs, initial chi2 " << iniChi2 << endl;
+        cout << "  g2o:              chi2 " << chi2G2o << ", " << timeG2o << " ms" << endl;
+        cout << "  BundleAdjuster:   chi2 " << chi2Adjuster << ", " << timeAdjuster << " ms" << endl;
+
+        totalG2o += timeG2o;
+        totalAdjuster += timeAdjuster;
+        nProblems++;
+    }
+
+    if(nProblems == 0)
+        return 1;
+
+    cout << "-------" << endl << endl;
+    cout << nProblems << " problems, mean time g2o: " << totalG2o/nProblems << " ms, BundleAdjuster: "
+         << totalAdjuster/nProblems << " ms, speedup " << totalG2o/totalAdjuster << endl;
+
+    return 0;
+}
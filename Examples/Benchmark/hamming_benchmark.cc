@@ -0,0 +1,118 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2020 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Google Benchmark comparison of the Hamming distance kernels. Every kernel the CPU supports is timed
+// on one pair, one query against a batch, and a batch against a batch. The default batch size is the
+// feature count of a frame.
+//
+//   ./hamming_benchmark [--benchmark_filter=<regex>] [other Google Benchmark flags]
+
+#include<random>
+#include<string>
+#include<vector>
+
+#include<benchmark/benchmark.h>
+
+#include<HammingDistance.h>
+
+using namespace std;
+using ORB_SLAM3::HammingDistance;
+using ORB_SLAM3::ORBDescriptor;
+
+vector<ORBDescriptor> RandomDescriptors(size_t n)
+{
+    mt19937_64 rng(n);
+    vector<ORBDescriptor> vDescriptors(n);
+    for(ORBDescriptor &d : vDescriptors)
+    {
+        for(int i=0; i<4; i++)
+            d.bits[i] = rng();
+    }
+    return vDescriptors;
+}
+
+void BM_Distance(benchmark::State &state, HammingDistance::Kernel kernel)
+{
+    HammingDistance::SetKernel(kernel);
+    const vector<ORBDescriptor> vD = RandomDescriptors(2);
+
+    for(auto _ : state)
+    {
+        benchmark::DoNotOptimize(&vD[0]);
+        benchmark::DoNotOptimize(HammingDistance::Distance(vD[0], vD[1]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_OneToMany(benchmark::State &state, HammingDistance::Kernel kernel)
+{
+    HammingDistance::SetKernel(kernel);
+    const size_t n = state.range(0);
+    const vector<ORBDescriptor> vQuery = RandomDescriptors(1);
+    const vector<ORBDescriptor> vTargets = RandomDescriptors(n);
+    vector<int> vDist(n);
+
+    for(auto _ : state)
+    {
+        HammingDistance::OneToMany(vQuery[0], vTargets.data(), n, vDist.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations()*n);
+}
+
+void BM_ManyToMany(benchmark::State &state, HammingDistance::Kernel kernel)
+{
+    HammingDistance::SetKernel(kernel);
+    const size_t nQueries = state.range(0), nTargets = state.range(1);
+    const vector<ORBDescriptor> vQueries = RandomDescriptors(nQueries);
+    const vector<ORBDescriptor> vTargets = RandomDescriptors(nTargets);
+    vector<int> vDist(nQueries*nTargets);
+
+    for(auto _ : state)
+    {
+        HammingDistance::ManyToMany(vQueries.data(), nQueries, vTargets.data(), nTargets, vDist.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations()*nQueries*nTargets);
+}
+
+int main(int argc, char **argv)
+{
+    const HammingDistance::Kernel vKernels[] = {HammingDistance::SCALAR, HammingDistance::POPCNT,
+                                                HammingDistance::AVX2, HammingDistance::AVX512,
+                                                HammingDistance::NEON};
+    for(HammingDistance::Kernel kernel : vKernels)
+    {
+        if(!HammingDistance::IsSupported(kernel))
+            continue;
+
+        const string name = HammingDistance::GetKernelName(kernel);
+        benchmark::RegisterBenchmark(("Distance/" + name).c_str(), BM_Distance, kernel);
+        benchmark::RegisterBenchmark(("OneToMany/" + name).c_str(), BM_OneToMany, kernel)
+            ->Arg(8)->Arg(64)->Arg(1500);
+        benchmark::RegisterBenchmark(("ManyToMany/" + name).c_str(), BM_ManyToMany, kernel)
+            ->Args({64, 64})->Args({1500, 1500});
+    }
+
+    benchmark::Initialize(&argc, argv);
+    if(benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
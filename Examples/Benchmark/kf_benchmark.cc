@@ -0,0 +1,184 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2020 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include<iostream>
+#include<iomanip>
+#include<chrono>
+#include<thread>
+#include<vector>
+#include<string>
+#include<algorithm>
+
+#include<opencv2/core/core.hpp>
+
+#include<MapSegment.h>
+#include<KeyFrame.h>
+#include<Frame.h>
+#include<Map.h>
+
+#include <boost/interprocess/shared_memory_object.hpp>
+
+using namespace std;
+
+// Frame with nFeatures keypoints spread over the grid, as Tracking hands it to the KeyFrame constructor
+void MakeFrame(ORB_SLAM3::Frame &F, int nFeatures)
+{
+    F.mnId = 0;
+    F.mTimeStamp = 0;
+    F.mpORBvocabulary = nullptr;
+    F.mpCamera = F.mpCamera2 = nullptr;
+    F.fx = F.fy = 500.f;
+    F.cx = 320.f;
+    F.cy = 240.f;
+    F.invfx = F.invfy = 1.f/500.f;
+    F.mbf = F.mb = F.mThDepth = 0;
+    F.mnScaleLevels = 8;
+    F.mfScaleFactor = 1.2f;
+    F.mfLogScaleFactor = log(1.2f);
+    F.mvScaleFactors.assign(8, 1.f);
+    F.mvLevelSigma2.assign(8, 1.f);
+    F.mvInvLevelSigma2.assign(8, 1.f);
+    F.mnMinX = F.mnMinY = 0;
+    F.mnMaxX = 640;
+    F.mnMaxY = 480;
+    F.mfGridElementWidthInv = static_cast<float>(FRAME_GRID_COLS)/640.f;
+    F.mfGridElementHeightInv = static_cast<float>(FRAME_GRID_ROWS)/480.f;
+    F.mnDataset = 0;
+    F.Nleft = F.Nright = -1;
+
+    F.N = nFeatures;
+    F.mvKeys.resize(nFeatures);
+    for(int i=0; i<nFeatures; i++)
+    {
+        F.mvKeys[i].pt = cv::Point2f((i*37)%640, (i*91)%480);
+        F.mvKeys[i].octave = i%8;
+        const int col = static_cast<int>(F.mvKeys[i].pt.x*F.mfGridElementWidthInv);
+        const int row = static_cast<int>(F.mvKeys[i].pt.y*F.mfGridElementHeightInv);
+        F.mGrid[col][row].push_back(i);
+    }
+    F.mvKeysUn = F.mvKeys;
+    F.mvuRight.assign(nFeatures, -1.f);
+    F.mvDepth.assign(nFeatures, -1.f);
+    F.mvpMapPoints.assign(nFeatures, static_cast<boost::interprocess::offset_ptr<ORB_SLAM3::MapPoint> >(nullptr));
+    F.mDescriptors = cv::Mat(nFeatures, 32, CV_8U);
+    cv::randu(F.mDescriptors, cv::Scalar(0), cv::Scalar(256));
+
+    F.mK = cv::Mat::eye(3,3,CV_32F);
+    F.mTcw = cv::Mat::eye(4,4,CV_32F);
+    F.mTlr = cv::Mat::eye(4,4,CV_32F);
+    F.mTrl = cv::Mat::eye(4,4,CV_32F);
+}
+
+// Creates nKeyFrames keyframes in each of nThreads threads, returns the creation time of every keyframe in us
+vector<double> CreateKeyFrames(ORB_SLAM3::Frame &F, boost::interprocess::offset_ptr<ORB_SLAM3::Map> pMap,
+                               int nThreads, int nKeyFrames, double &wallTime)
+{
+    vector<vector<double> > vvTimes(nThreads, vector<double>(nKeyFrames));
+    vector<thread> vThreads;
+
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    for(int t=0; t<nThreads; t++)
+    {
+        vThreads.emplace_back([&, t]{
+            // Every thread builds its keyframes from its own copy of the frame, as Tracking and LocalMapping do
+            ORB_SLAM3::Frame frame(F);
+            for(int i=0; i<nKeyFrames; i++)
+            {
+                std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+                ORB_SLAM3::map_segment.Construct<ORB_SLAM3::KeyFrame>(frame, pMap, nullptr);
+                std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+                vvTimes[t][i] = std::chrono::duration_cast<std::chrono::duration<double,std::micro> >(t2 - t1).count();
+            }
+        });
+    }
+    for(thread &th : vThreads)
+        th.join();
+    std::chrono::steady_clock::time_point t3 = std::chrono::steady_clock::now();
+    wallTime = std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(t3 - t0).count();
+
+    vector<double> vTimes;
+    for(const vector<double> &v : vvTimes)
+        vTimes.insert(vTimes.end(), v.begin(), v.end());
+    sort(vTimes.begin(), vTimes.end());
+    return vTimes;
+}
+
+// Keyframe creation latency with 1, 2 and 4 threads allocating from the map segment, with and without
+// the per-thread slabs (SharedMemory.slabKB)
+int main(int argc, char **argv)
+{
+    int nKeyFrames = 2000;
+    int nFeatures = 1000;
+    if(argc > 1)
+        nKeyFrames = atoi(argv[1]);
+    if(argc > 2)
+        nFeatures = atoi(argv[2]);
+    if(nKeyFrames <= 0 || nFeatures <= 0)
+    {
+        cerr << endl << "Usage: ./kf_benchmark [keyframes_per_thread] [features_per_keyframe]" << endl;
+        return 1;
+    }
+
+    ORB_SLAM3::Frame F;
+    MakeFrame(F, nFeatures);
+
+    ORB_SLAM3::MapSegment::Settings settings;
+    settings.name = "kf_benchmark";
+    settings.size = 1024*1024*1024;
+
+    // The KeyFrame constructor logs every keyframe
+    std::streambuf* pCoutBuffer = cout.rdbuf();
+
+    const int vSlabKB[] = {static_cast<int>(settings.slabSize/1024), 0};
+    const int vThreads[] = {1, 2, 4};
+    for(int slabKB : vSlabKB)
+    {
+        for(int nThreads : vThreads)
+        {
+            settings.slabSize = static_cast<std::size_t>(slabKB)*1024;
+            boost::interprocess::shared_memory_object::remove(settings.name.c_str());
+
+            cout.rdbuf(nullptr);
+            if(!ORB_SLAM3::map_segment.Open(settings))
+            {
+                cout.rdbuf(pCoutBuffer);
+                cerr << "ERROR: Failed to open the map segment" << endl;
+                return 1;
+            }
+            boost::interprocess::offset_ptr<ORB_SLAM3::Map> pMap = ORB_SLAM3::map_segment.Construct<ORB_SLAM3::Map>(0);
+
+            double wallTime;
+            const vector<double> vTimes = CreateKeyFrames(F, pMap, nThreads, nKeyFrames, wallTime);
+            ORB_SLAM3::map_segment.Close();
+            boost::interprocess::shared_memory_object::remove(settings.name.c_str());
+            cout.rdbuf(pCoutBuffer);
+
+            double mean = 0;
+            for(double t : vTimes)
+                mean += t;
+            mean /= vTimes.size();
+
+            cout << fixed << setprecision(1);
+            cout << (slabKB > 0 ? "slabs " + to_string(slabKB) + " KB" : "no slabs   ") << ", " << nThreads << " threads: "
+                 << "mean " << mean << " us, median " << vTimes[vTimes.size()/2] << " us, p99 "
+                 << vTimes[vTimes.size()*99/100] << " us, " << vTimes.size()/wallTime << " KFs/ms" << endl;
+        }
+    }
+
+    return 0;
+}
@@ -25,52 +25,18 @@
 
 #include<opencv2/core/core.hpp>
 
-//For use in sockets
-#include <boost/asio.hpp>
+// Frames come from a camera over the network (see NetworkFrameSource.h) instead of the image folder
 #define SOCKET_PROGRAM
 
-using namespace boost::asio;
-using ip::tcp;
-
 
 #include"System.h"
 #include "Converter.h"
-#include "send_file_cpp.h"
+#include "NetworkFrameSource.h"
 
 using namespace std;
 
-void rec_data(void)
-{
-      try
-    {
-      {
-        boost::mutex::scoped_lock lk(debug_mutex);
-        //std::lock_guard<std::mutex> lk(debug_mutex);
-        std::cout << "Receiving data...\n";
-      }
-      async_tcp_server recv_file_tcp_server(65000);
-      if(debugmode)
-        {
-          boost::mutex::scoped_lock lk(debug_mutex);
-          //std::lock_guard<std::mutex> lk(debug_mutex);
-          debug_global << "Received\n";
-        }
-    }
-      catch(std::exception const& e)
-    {
-      std::cerr << "Exception in " << __PRETTY_FUNCTION__ << ": " << e.what() << "\n";
-    };
-};
-
-string read_(tcp::socket & socket) {
-       boost::asio::streambuf buf;
-       boost::asio::read_until( socket, buf, "\n" );
-
-       std::istream is(&buf);
-       std::string data;
-       std::getline(is, data);
-       return data;
-}
+// Port the camera connects to
+const unsigned short FRAME_PORT = 65000;
 
 void LoadImages(const string &strImagePath, const string &strPathTimes,
                 vector<string> &vstrImages, vector<double> &vTimeStamps);
@@ -78,9 +44,15 @@ void LoadImages(const string &strImagePath, const string &strPathTimes,
 double ttrack_tot = 0;
 int main(int argc, char **argv)
 {
+#ifdef SOCKET_PROGRAM
+    // The frames come from the camera, as a single sequence
+    const int num_seq = 1;
+    bool bFileName= argc > 3;
+#else //SOCKET_PROGRAM
     const int num_seq = (argc-3)/2;
-    cout << "num_seq = " << num_seq << endl;
     bool bFileName= (((argc-3) % 2) == 1);
+#endif //SOCKET_PROGRAM
+    cout << "num_seq = " << num_seq << endl;
 
     string file_name;
     if (bFileName)
@@ -90,11 +62,19 @@ int main(int argc, char **argv)
     }
 
 
+#ifdef SOCKET_PROGRAM
+    if(argc < 3)
+    {
+        cerr << endl << "Usage: ./mono_tum_vi path_to_vocabulary path_to_settings (trajectory_file_name)" << endl;
+        return 1;
+    }
+#else //SOCKET_PROGRAM
     if(argc < 4)
     {
         cerr << endl << "Usage: ./mono_tum_vi path_to_vocabulary path_to_settings path_to_image_folder_1 path_to_times_file_1 (path_to_image_folder_2 path_to_times_file_2 ... path_to_image_folder_N path_to_times_file_N) (trajectory_file_name)" << endl;
         return 1;
     }
+#endif //SOCKET_PROGRAM
 
     // Load all sequences:
     int seq;
@@ -107,7 +87,7 @@ int main(int argc, char **argv)
     nImages.resize(num_seq);
 
     int tot_images = 0;
-    //#ifndef SOCKET_PROGRAM
+#ifndef SOCKET_PROGRAM
     for (seq = 0; seq<num_seq; seq++)
     {
         cout << "Loading images for sequence " << seq << "...";
@@ -124,10 +104,10 @@ int main(int argc, char **argv)
         }
 
     }
-    //#endif //socket_program
-    // Vector for tracking time statistics
+#endif //SOCKET_PROGRAM
+    // Vector for tracking time statistics, one entry per tracked frame
     vector<float> vTimesTrack;
-    vTimesTrack.resize(tot_images);
+    vTimesTrack.reserve(tot_images);
 
     cout << endl << "-------" << endl;
     cout.precision(17);
@@ -136,89 +116,46 @@ int main(int argc, char **argv)
     ORB_SLAM3::System SLAM(argv[1],argv[2],ORB_SLAM3::System::MONOCULAR,true);
 
 #ifdef SOCKET_PROGRAM
-    /*
-    //Aditya setup the sockets for file transfer
-    boost::asio::io_context io_service;
-    //listen for new connection
-    //tcp::acceptor acceptor_(io_service, tcp::endpoint(tcp::v4(), 65000 ));
-    boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::address::from_string("127.0.0.1"),65000);
-    //socket creation 
-    tcp::socket socket_(io_service);
-    socket_.connect(endpoint);
-    */
-#endif //SOCKET_PROGRAM  
-
-    int proccIm = 0;
+    ORB_SLAM3::NetworkFrameSource frameSource(FRAME_PORT);
+#endif //SOCKET_PROGRAM
+
     for (seq = 0; seq<num_seq; seq++)
     {
 
         // Main loop
         cv::Mat im;
-        proccIm = 0;
         cv::Ptr<cv::CLAHE> clahe = cv::createCLAHE(3.0, cv::Size(8, 8));
-        //for(int ni=0; ni<nImages[seq]; ni++, proccIm++)
-        for(int ni=0; ni<num_seq; ni++, proccIm++)
-        {
-
 #ifdef SOCKET_PROGRAM
-	  /*
-            //fetch a file from file server.
-            // request/message from client
-            //waiting for connection
-            //acceptor_.accept(socket_);
-            boost::system::error_code error;
-            
-            std::string message ="Hello From SLAM";
-            boost::array<char, 128>buf;
-            std::copy(message.begin(),message.end(),buf.begin());
-            socket_.write_some(boost::asio::buffer(buf, message.size()), error);
-            // getting response from server
-            boost::asio::streambuf receive_buffer;
-            size_t file_size  = boost::asio::read(socket_, receive_buffer, boost::asio::transfer_all(), error);
-            const uchar* file_data;
-            if( error && error != boost::asio::error::eof ) {
-                cout << "receive failed: " << error.message() << endl;
-            }
-            else {
-                file_data = boost::asio::buffer_cast<const uchar*>(receive_buffer.data());
-                //cout << data << endl;
-            }
-            cout<<"Size of received file: "<<file_size<<endl;
-            //Need little elbow grease to make this buffer acceptable to imdecode
-            cv::Mat pngData(1,file_size,CV_8UC1);
-            pngData.data = const_cast<uchar*>(file_data);
-            cv::InputArray data(pngData);
-            //im = cv::imdecode(cv::Mat(1,file_size,CV_8UC1, const_cast<void*>(file_data), steps), cv::IMREAD_UNCHANGED);
-            im = cv::imdecode(data,cv::IMREAD_UNCHANGED);
-	    if(im.data==NULL)
-	      cout<<"im is NULL\n";
-	    else
-	      cout<<"im = "<<endl<<im<<endl<<endl;
-           */
-          rec_data();
-	  im = cv::imread("test.txt",cv::IMREAD_UNCHANGED);
-	  if(im.data==NULL)
-	    cout<<"im is NULL\n";
-	  else
-	    cout<<"im = not null"<<endl;
+        // The frame is received into a buffer of the source, nothing is written to disk. The loop ends when the
+        // camera disconnects.
+        double tframe;
+        while(frameSource.Next(im,tframe))
+        {
 #else //SOCKET_PROGRAM
+        for(int ni=0; ni<nImages[seq]; ni++)
+        {
+
             // Read image from file
             im = cv::imread(vstrImageFilenames[seq][ni],cv::IMREAD_UNCHANGED);
-#endif //SOCKET_PROGRAM  
-
-            // clahe
-            clahe->apply(im,im);
-
-
-            // cout << "mat type: " << im.type() << endl;
             double tframe = vTimestampsCam[seq][ni];
+#endif //SOCKET_PROGRAM
 
+#ifdef SOCKET_PROGRAM
+            // A frame that could not be decoded is skipped
+            if(im.empty())
+                continue;
+#else //SOCKET_PROGRAM
             if(im.empty())
             {
                 cerr << endl << "Failed to load image at: "
                      <<  vstrImageFilenames[seq][ni] << endl;
                 return 1;
             }
+#endif //SOCKET_PROGRAM
+
+            // clahe
+            clahe->apply(im,im);
+
     #ifdef COMPILEDWITHC11
             std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
     #else
@@ -239,9 +176,10 @@ int main(int argc, char **argv)
             double ttrack= std::chrono::duration_cast<std::chrono::duration<double> >(t2 - t1).count();
             ttrack_tot += ttrack;
 
-            vTimesTrack[ni]=ttrack;
+            vTimesTrack.push_back(ttrack);
 
-            // Wait to load the next frame
+#ifndef SOCKET_PROGRAM
+            // Wait to load the next frame, the camera already sends them at its rate
             double T=0;
             if(ni<nImages[seq]-1)
                 T = vTimestampsCam[seq][ni+1]-tframe;
@@ -250,6 +188,7 @@ int main(int argc, char **argv)
 
             if(ttrack<T)
                 usleep((T-ttrack)*1e6);
+#endif //SOCKET_PROGRAM
 
         }
         if(seq < num_seq - 1)
@@ -261,6 +200,10 @@ int main(int argc, char **argv)
 
     }
 
+#ifdef SOCKET_PROGRAM
+    cout << "Frames dropped while tracking: " << frameSource.GetDroppedFrames() << endl;
+#endif //SOCKET_PROGRAM
+
     // Stop all threads
     SLAM.Shutdown();
 
@@ -279,15 +222,21 @@ int main(int argc, char **argv)
         SLAM.SaveKeyFrameTrajectoryEuRoC("KeyFrameTrajectory.txt");
     }
 
+    if(vTimesTrack.empty())
+    {
+        cerr << "No frame was tracked" << endl;
+        return 1;
+    }
+
     sort(vTimesTrack.begin(),vTimesTrack.end());
     float totaltime = 0;
-    for(int ni=0; ni<nImages[0]; ni++)
+    for(size_t ni=0; ni<vTimesTrack.size(); ni++)
     {
         totaltime+=vTimesTrack[ni];
     }
     cout << "-------" << endl << endl;
-    cout << "median tracking time: " << vTimesTrack[nImages[0]/2] << endl;
-    cout << "mean tracking time: " << totaltime/proccIm << endl;
+    cout << "median tracking time: " << vTimesTrack[vTimesTrack.size()/2] << endl;
+    cout << "mean tracking time: " << totaltime/vTimesTrack.size() << endl;
 
 
     return 0;
@@ -0,0 +1,267 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2020 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include<iostream>
+#include<algorithm>
+#include<fstream>
+#include<sstream>
+
+#include<opencv2/core/core.hpp>
+#include<opencv2/imgproc/imgproc.hpp>
+#include<System.h>
+#include<DatasetReplay.h>
+#include "ImuTypes.h"
+
+using namespace std;
+
+void LoadImages(const string &strPathLeft, const string &strPathRight, const string &strPathTimes,
+                vector<string> &vstrImageLeft, vector<string> &vstrImageRight, vector<double> &vTimeStamps);
+
+void LoadIMU(const string &strImuPath, vector<double> &vTimeStamps, vector<cv::Point3f> &vAcc, vector<cv::Point3f> &vGyro);
+
+// Offline replay of EuRoC sequences as fast as they are tracked, for regression runs
+int main(int argc, char **argv)
+{
+    if(argc < 6 || (argc-4) % 2 != 0)
+    {
+        cerr << endl << "Usage: ./replay_euroc path_to_vocabulary path_to_settings mono|stereo|mono_inertial|stereo_inertial path_to_sequence_folder_1 path_to_times_file_1 (path_to_image_folder_2 path_to_times_file_2 ... path_to_image_folder_N path_to_times_file_N)" << endl;
+        return 1;
+    }
+
+    const string strMode(argv[3]);
+    ORB_SLAM3::System::eSensor sensor;
+    if(strMode == "mono")
+        sensor = ORB_SLAM3::System::MONOCULAR;
+    else if(strMode == "stereo")
+        sensor = ORB_SLAM3::System::STEREO;
+    else if(strMode == "mono_inertial")
+        sensor = ORB_SLAM3::System::IMU_MONOCULAR;
+    else if(strMode == "stereo_inertial")
+        sensor = ORB_SLAM3::System::IMU_STEREO;
+    else
+    {
+        cerr << "ERROR: Unknown sensor " << strMode << endl;
+        return 1;
+    }
+    const bool bStereo = sensor == ORB_SLAM3::System::STEREO || sensor == ORB_SLAM3::System::IMU_STEREO;
+    const bool bInertial = sensor == ORB_SLAM3::System::IMU_MONOCULAR || sensor == ORB_SLAM3::System::IMU_STEREO;
+
+    const int num_seq = (argc-4)/2;
+    cout << "num_seq = " << num_seq << endl;
+
+    // Stereo images are rectified on the I/O threads
+    cv::Mat M1l,M2l,M1r,M2r;
+    if(bStereo)
+    {
+        cv::FileStorage fsSettings(argv[2], cv::FileStorage::READ);
+        if(!fsSettings.isOpened())
+        {
+            cerr << "ERROR: Wrong path to settings" << endl;
+            return -1;
+        }
+
+        cv::Mat K_l, K_r, P_l, P_r, R_l, R_r, D_l, D_r;
+        fsSettings["LEFT.K"] >> K_l;
+        fsSettings["RIGHT.K"] >> K_r;
+
+        fsSettings["LEFT.P"] >> P_l;
+        fsSettings["RIGHT.P"] >> P_r;
+
+        fsSettings["LEFT.R"] >> R_l;
+        fsSettings["RIGHT.R"] >> R_r;
+
+        fsSettings["LEFT.D"] >> D_l;
+        fsSettings["RIGHT.D"] >> D_r;
+
+        int rows_l = fsSettings["LEFT.height"];
+        int cols_l = fsSettings["LEFT.width"];
+        int rows_r = fsSettings["RIGHT.height"];
+        int cols_r = fsSettings["RIGHT.width"];
+
+        if(K_l.empty() || K_r.empty() || P_l.empty() || P_r.empty() || R_l.empty() || R_r.empty() || D_l.empty() || D_r.empty() ||
+                rows_l==0 || rows_r==0 || cols_l==0 || cols_r==0)
+        {
+            cerr << "ERROR: Calibration parameters to rectify stereo are missing!" << endl;
+            return -1;
+        }
+
+        cv::initUndistortRectifyMap(K_l,D_l,R_l,P_l.rowRange(0,3).colRange(0,3),cv::Size(cols_l,rows_l),CV_32F,M1l,M2l);
+        cv::initUndistortRectifyMap(K_r,D_r,R_r,P_r.rowRange(0,3).colRange(0,3),cv::Size(cols_r,rows_r),CV_32F,M1r,M2r);
+    }
+
+    cout.precision(17);
+
+    // Create SLAM system. It initializes all system threads and gets ready to process frames.
+    ORB_SLAM3::System SLAM(argv[1],argv[2],sensor,false);
+
+    ORB_SLAM3::DatasetReplay replay(&SLAM,sensor);
+    if(bStereo)
+    {
+        replay.SetPreprocess([&](cv::Mat &imLeft, cv::Mat &imRight)
+        {
+            cv::Mat imLeftRect, imRightRect;
+            cv::remap(imLeft,imLeftRect,M1l,M2l,cv::INTER_LINEAR);
+            cv::remap(imRight,imRightRect,M1r,M2r,cv::INTER_LINEAR);
+            imLeft = imLeftRect;
+            imRight = imRightRect;
+        });
+    }
+
+    int nTotalFrames = 0;
+    double tTotal = 0;
+    for(int seq = 0; seq<num_seq; seq++)
+    {
+        cout << "Loading images for sequence " << seq << "...";
+
+        string pathSeq(argv[(2*seq) + 4]);
+        string pathTimeStamps(argv[(2*seq) + 5]);
+
+        vector<string> vstrImageLeft, vstrImageRight;
+        vector<double> vTimestampsCam;
+        LoadImages(pathSeq + "/mav0/cam0/data", pathSeq + "/mav0/cam1/data", pathTimeStamps, vstrImageLeft, vstrImageRight, vTimestampsCam);
+        cout << "LOADED!" << endl;
+
+        if(vstrImageLeft.empty())
+        {
+            cerr << "ERROR: Failed to load images for sequence" << seq << endl;
+            return 1;
+        }
+
+        // Measurements between each frame and the previous one
+        vector<vector<ORB_SLAM3::IMU::Point> > vvImuMeas;
+        if(bInertial)
+        {
+            cout << "Loading IMU for sequence " << seq << "...";
+            vector<double> vTimestampsImu;
+            vector<cv::Point3f> vAcc, vGyro;
+            LoadIMU(pathSeq + "/mav0/imu0/data.csv", vTimestampsImu, vAcc, vGyro);
+            cout << "LOADED!" << endl;
+
+            if(vTimestampsImu.empty())
+            {
+                cerr << "ERROR: Failed to load IMU for sequence" << seq << endl;
+                return 1;
+            }
+
+            // Find first imu to be considered, supposing imu measurements start first
+            int first_imu = 0;
+            while(vTimestampsImu[first_imu]<=vTimestampsCam[0])
+                first_imu++;
+            first_imu--;
+
+            vvImuMeas.resize(vstrImageLeft.size());
+            for(size_t ni=1; ni<vstrImageLeft.size(); ni++)
+            {
+                while(first_imu < (int)vTimestampsImu.size() && vTimestampsImu[first_imu]<=vTimestampsCam[ni])
+                {
+                    vvImuMeas[ni].push_back(ORB_SLAM3::IMU::Point(vAcc[first_imu].x,vAcc[first_imu].y,vAcc[first_imu].z,
+                                                                  vGyro[first_imu].x,vGyro[first_imu].y,vGyro[first_imu].z,
+                                                                  vTimestampsImu[first_imu]));
+                    first_imu++;
+                }
+            }
+        }
+
+        if(!replay.Run(vstrImageLeft, bStereo ? vstrImageRight : vector<string>(), vTimestampsCam, vvImuMeas))
+            return 1;
+
+        nTotalFrames += replay.GetNumFrames();
+        tTotal += replay.GetTime();
+
+        if(seq < num_seq - 1)
+        {
+            cout << "Changing the dataset" << endl;
+
+            SLAM.ChangeDataset();
+        }
+    }
+
+    if(tTotal > 0)
+        cout << "Replayed " << nTotalFrames << " frames: " << nTotalFrames/tTotal << " frames/s" << endl;
+
+    // Stop all threads
+    SLAM.Shutdown();
+
+    // Save camera trajectory
+    SLAM.SaveTrajectoryEuRoC("CameraTrajectory.txt");
+    SLAM.SaveKeyFrameTrajectoryEuRoC("KeyFrameTrajectory.txt");
+
+    return 0;
+}
+
+void LoadImages(const string &strPathLeft, const string &strPathRight, const string &strPathTimes,
+                vector<string> &vstrImageLeft, vector<string> &vstrImageRight, vector<double> &vTimeStamps)
+{
+    ifstream fTimes;
+    fTimes.open(strPathTimes.c_str());
+    vTimeStamps.reserve(5000);
+    vstrImageLeft.reserve(5000);
+    vstrImageRight.reserve(5000);
+    while(!fTimes.eof())
+    {
+        string s;
+        getline(fTimes,s);
+        if(!s.empty())
+        {
+            stringstream ss;
+            ss << s;
+            vstrImageLeft.push_back(strPathLeft + "/" + ss.str() + ".png");
+            vstrImageRight.push_back(strPathRight + "/" + ss.str() + ".png");
+            double t;
+            ss >> t;
+            vTimeStamps.push_back(t/1e9);
+
+        }
+    }
+}
+
+void LoadIMU(const string &strImuPath, vector<double> &vTimeStamps, vector<cv::Point3f> &vAcc, vector<cv::Point3f> &vGyro)
+{
+    ifstream fImu;
+    fImu.open(strImuPath.c_str());
+    vTimeStamps.reserve(5000);
+    vAcc.reserve(5000);
+    vGyro.reserve(5000);
+
+    while(!fImu.eof())
+    {
+        string s;
+        getline(fImu,s);
+        if (s[0] == '#')
+            continue;
+
+        if(!s.empty())
+        {
+            string item;
+            size_t pos = 0;
+            double data[7];
+            int count = 0;
+            while ((pos = s.find(',')) != string::npos) {
+                item = s.substr(0, pos);
+                data[count++] = stod(item);
+                s.erase(0, pos + 1);
+            }
+            item = s.substr(0, pos);
+            data[6] = stod(item);
+
+            vTimeStamps.push_back(data[0]/1e9);
+            vAcc.push_back(cv::Point3f(data[4],data[5],data[6]));
+            vGyro.push_back(cv::Point3f(data[1],data[2],data[3]));
+        }
+    }
+}
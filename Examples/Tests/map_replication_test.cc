@@ -0,0 +1,214 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2020 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Replicates a map segment to a replication server on the loopback while writer threads change it. Each writer
+// fills the pages of its own block with the same counter inside a MapSegment::WriteScope, and allocates from the
+// segment, which makes it grow up to 32 MB. Half of the writers run frame units back to back like the tracking,
+// the others background units with a pause in between like the local mapping. Every state of the replica seen under
+// the replica lock must hold blocks with a single value, and once the writers stop the replica must hold their last
+// values.
+
+#include<atomic>
+#include<chrono>
+#include<cstdint>
+#include<iostream>
+#include<string>
+#include<thread>
+#include<vector>
+#include<unistd.h>
+
+#include<boost/interprocess/shared_memory_object.hpp>
+#include<boost/interprocess/mapped_region.hpp>
+
+#include<MapSegment.h>
+#include<MapReplication.h>
+#include<Server.h>
+
+using namespace std;
+using namespace ORB_SLAM3;
+
+namespace
+{
+
+const int nWriters = 4;
+// Every block spans 16 pages
+const size_t nBlockValues = 16*Replication::PAGE_SIZE/sizeof(uint64_t);
+
+struct Block
+{
+    uint64_t values[nBlockValues];
+};
+
+// Checks the blocks in the replica. False if the replica is not there yet or does not hold the blocks.
+bool ReadReplica(const string &name, const vector<uint64_t> &vOffsets, vector<uint64_t> &vValues, bool &bTorn)
+{
+    using namespace boost::interprocess;
+
+    Replication::ReplicaLock lock(name);
+    try
+    {
+        shared_memory_object shm(open_only, name.c_str(), read_only);
+        offset_t size = 0;
+        shm.get_size(size);
+        for(uint64_t offset : vOffsets)
+            if(offset + sizeof(Block) > static_cast<uint64_t>(size))
+                return false;
+
+        mapped_region region(shm, read_only);
+        const char* pReplica = static_cast<const char*>(region.get_address());
+        vValues.resize(vOffsets.size());
+        for(size_t i=0; i<vOffsets.size(); i++)
+        {
+            const Block* pBlock = reinterpret_cast<const Block*>(pReplica + vOffsets[i]);
+            vValues[i] = pBlock->values[0];
+            for(size_t j=1; j<nBlockValues; j++)
+                bTorn = bTorn || pBlock->values[j] != vValues[i];
+        }
+    }
+    catch(interprocess_exception &)
+    {
+        return false;
+    }
+    return true;
+}
+
+}
+
+int main()
+{
+    // The client and the server have their own segment names, so that the replica does not take the name of the
+    // segment it replicates
+    const string strId = to_string(getpid());
+    MapSegment::Settings serverSettings;
+    serverSettings.name = "replication_test_server_" + strId;
+    serverSettings.size = 8*1024*1024;
+    serverSettings.maxSize = 256*1024*1024;
+    serverSettings.growStep = 4*1024*1024;
+    serverSettings.growThreshold = 1024*1024;
+    serverSettings.baseAddress = reinterpret_cast<void*>(0x300000000ULL);
+
+    MapSegment::Settings clientSettings = serverSettings;
+    clientSettings.name = "replication_test_client_" + strId;
+    clientSettings = clientSettings.ForClient(0);
+    const string strReplica = serverSettings.ForClient(0).name;
+
+    MapSegment clientSegment;
+    if(!clientSegment.Open(clientSettings))
+        return 1;
+
+    const char* pBase = static_cast<const char*>(clientSegment.GetManaged().get_address());
+    vector<Block*> vpBlocks;
+    vector<uint64_t> vOffsets;
+    for(int i=0; i<nWriters; i++)
+    {
+        Block* pBlock = static_cast<Block*>(clientSegment.GetManaged().allocate_aligned(sizeof(Block), Replication::PAGE_SIZE));
+        for(size_t j=0; j<nBlockValues; j++)
+            pBlock->values[j] = 0;
+        vpBlocks.push_back(pBlock);
+        vOffsets.push_back(reinterpret_cast<const char*>(pBlock) - pBase);
+    }
+
+    const short port = 20000 + getpid()%10000;
+    boost::asio::io_context ioContext;
+    Server server(ioContext, port, serverSettings);
+    thread serverThread([&ioContext]{ ioContext.run(); });
+
+    atomic<bool> bStop(false);
+    atomic<long> longestFrameWaitUs(0);
+    vector<thread> vWriters;
+    for(int i=0; i<nWriters; i++)
+    {
+        vWriters.emplace_back([&, i]
+        {
+            const bool bFrames = i%2 == 0;
+            for(uint64_t counter=1; !bStop; counter++)
+            {
+                {
+                    const chrono::steady_clock::time_point tBegin = chrono::steady_clock::now();
+                    MapSegment::WriteScope scope(clientSegment, bFrames ? MapSegment::FRAME_UNIT : MapSegment::BACKGROUND_UNIT);
+                    if(bFrames)
+                    {
+                        const long waitUs = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now()-tBegin).count();
+                        long longest = longestFrameWaitUs;
+                        while(waitUs > longest && !longestFrameWaitUs.compare_exchange_weak(longest, waitUs));
+                    }
+
+                    for(size_t j=0; j<nBlockValues; j++)
+                        vpBlocks[i]->values[j] = counter;
+                    clientSegment.Construct<uint64_t>(counter);
+                    if(clientSegment.GetSize() < 32*1024*1024)
+                        clientSegment.Allocate(sizeof(Block));
+                }
+                if(!bFrames)
+                    usleep(1000);
+            }
+        });
+    }
+
+    MapReplicator replicator(&clientSegment, "127.0.0.1:" + to_string(port), 1);
+    int nBatches = 0, nChecks = 0;
+    bool bTorn = false;
+    vector<uint64_t> vValues;
+    const chrono::steady_clock::time_point tEnd = chrono::steady_clock::now() + chrono::seconds(2);
+    while(chrono::steady_clock::now() < tEnd)
+    {
+        if(replicator.Replicate())
+            nBatches++;
+        if(ReadReplica(strReplica, vOffsets, vValues, bTorn))
+            nChecks++;
+    }
+
+    bStop = true;
+    for(thread &writer : vWriters)
+        writer.join();
+
+    // The last batch holds the final values, the server applies it asynchronously
+    bool bFinal = replicator.Replicate();
+    for(int i=0; i<500 && bFinal; i++)
+    {
+        bFinal = ReadReplica(strReplica, vOffsets, vValues, bTorn);
+        for(int j=0; j<nWriters && bFinal; j++)
+            bFinal = vValues[j] == vpBlocks[j]->values[0];
+        if(bFinal)
+            break;
+        usleep(10000);
+    }
+
+    ioContext.stop();
+    serverThread.join();
+
+    cout << nBatches << " batches while writing, segment of " << clientSegment.GetSize()/(1024*1024) << " MB, replica checked "
+         << nChecks << " times, frames held back for up to " << longestFrameWaitUs/1000.0 << " ms" << endl;
+
+    clientSegment.Close();
+    boost::interprocess::shared_memory_object::remove(clientSettings.name.c_str());
+    boost::interprocess::shared_memory_object::remove(strReplica.c_str());
+    Replication::ReplicaLock::Remove(strReplica);
+
+    if(bTorn)
+    {
+        cerr << "The replica holds a block written in part" << endl;
+        return 1;
+    }
+    if(nBatches == 0 || nChecks == 0 || !bFinal)
+    {
+        cerr << "The replica does not hold the final state of the segment" << endl;
+        return 1;
+    }
+    return 0;
+}
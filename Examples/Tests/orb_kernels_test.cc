@@ -0,0 +1,136 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2020 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Checks that the vectorized orientation and descriptor kernels of ORBextractor give bit-exact the
+// same keypoints and descriptors as the scalar code. FAST is not part of the check, cv::FAST is used
+// for detection in both runs and is vectorized inside OpenCV.
+//
+//   ./orb_kernels_test [image ...]
+//
+// Without images, synthetic textured images are used. Returns 0 if every image matches.
+
+#include<iostream>
+#include<string>
+#include<vector>
+
+#include<opencv2/core/core.hpp>
+#include<opencv2/highgui/highgui.hpp>
+#include<opencv2/imgproc/imgproc.hpp>
+
+#include<ORBextractor.h>
+
+using namespace std;
+
+// Random blurred rectangles and circles over noise, enough corners at every pyramid level
+cv::Mat SyntheticImage(int seed)
+{
+    cv::RNG rng(seed);
+    cv::Mat im(480, 752, CV_8UC1);
+    rng.fill(im, cv::RNG::UNIFORM, 0, 64);
+    for(int i=0; i<300; i++)
+    {
+        const cv::Point p(rng.uniform(0, im.cols), rng.uniform(0, im.rows));
+        const int size = rng.uniform(4, 60);
+        const cv::Scalar color(rng.uniform(0, 256));
+        if(rng.uniform(0, 2))
+            cv::rectangle(im, p, p + cv::Point(size, rng.uniform(4, 60)), color, cv::FILLED);
+        else
+            cv::circle(im, p, size/2, color, cv::FILLED);
+    }
+    cv::GaussianBlur(im, im, cv::Size(3,3), 0);
+    return im;
+}
+
+void Extract(ORB_SLAM3::ORBextractor &extractor, const cv::Mat &im, bool bVector,
+             vector<cv::KeyPoint> &vKeys, cv::Mat &descriptors)
+{
+    ORB_SLAM3::ORBextractor::SetVectorKernels(bVector);
+    vector<int> vLapping = {0, 0};
+    extractor(im, cv::Mat(), vKeys, descriptors, vLapping);
+}
+
+// Number of keypoints whose position, octave, angle or descriptor differ
+int CountMismatches(const vector<cv::KeyPoint> &vKeys1, const cv::Mat &desc1,
+                    const vector<cv::KeyPoint> &vKeys2, const cv::Mat &desc2)
+{
+    if(vKeys1.size() != vKeys2.size() || desc1.rows != desc2.rows)
+        return (int)max(vKeys1.size(), vKeys2.size());
+
+    int nMismatches = 0;
+    for(size_t i=0; i<vKeys1.size(); i++)
+    {
+        const cv::KeyPoint &kp1 = vKeys1[i], &kp2 = vKeys2[i];
+        const bool bSameKey = kp1.pt == kp2.pt && kp1.octave == kp2.octave && kp1.angle == kp2.angle;
+        const bool bSameDesc = cv::countNonZero(desc1.row((int)i) != desc2.row((int)i)) == 0;
+        if(!bSameKey || !bSameDesc)
+            nMismatches++;
+    }
+    return nMismatches;
+}
+
+int main(int argc, char **argv)
+{
+    vector<cv::Mat> vImages;
+    vector<string> vNames;
+    for(int i=1; i<argc; i++)
+    {
+        cv::Mat im = cv::imread(argv[i], cv::IMREAD_GRAYSCALE);
+        if(im.empty())
+        {
+            cerr << "Failed to load image at: " << argv[i] << endl;
+            return 1;
+        }
+        vImages.push_back(im);
+        vNames.push_back(argv[i]);
+    }
+    if(vImages.empty())
+    {
+        for(int seed=1; seed<=5; seed++)
+        {
+            vImages.push_back(SyntheticImage(seed));
+            vNames.push_back("synthetic " + to_string(seed));
+        }
+    }
+
+    // Settings of the TUM-VI and EuRoC examples
+    ORB_SLAM3::ORBextractor extractor(1500, 1.2f, 8, 20, 7);
+
+    int nFailed = 0;
+    for(size_t i=0; i<vImages.size(); i++)
+    {
+        vector<cv::KeyPoint> vKeysScalar, vKeysVector;
+        cv::Mat descScalar, descVector;
+        Extract(extractor, vImages[i], false, vKeysScalar, descScalar);
+        Extract(extractor, vImages[i], true, vKeysVector, descVector);
+
+        const int nMismatches = CountMismatches(vKeysScalar, descScalar, vKeysVector, descVector);
+        cout << vNames[i] << ": " << vKeysVector.size() << " keypoints, " << nMismatches << " mismatches" << endl;
+        if(nMismatches > 0 || vKeysVector.empty())
+            nFailed++;
+    }
+
+    ORB_SLAM3::ORBextractor::SetVectorKernels(true);
+
+    if(nFailed > 0)
+    {
+        cerr << nFailed << " of " << vImages.size() << " images differ between the scalar and vector kernels" << endl;
+        return 1;
+    }
+    cout << "Scalar and vector kernels match" << endl;
+    return 0;
+}
@@ -0,0 +1,108 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2020 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Counts the heap allocations made by ImagePyramid::Compute once the pyramid is allocated. Every
+// frame after the first one must not allocate. The extraction of the whole frame is counted as well
+// and reported, keypoint vectors and descriptor matrices are still sized per frame.
+//
+// Allocations are counted in the global operator new. This also sees every cv::Mat allocation, as
+// OpenCV creates the UMatData header of the matrix with new, but not the scratch buffers OpenCV takes
+// internally with cv::fastMalloc.
+
+#include<atomic>
+#include<cstdlib>
+#include<iostream>
+#include<new>
+#include<vector>
+
+#include<opencv2/core/core.hpp>
+
+#include<ORBextractor.h>
+
+using namespace std;
+
+static atomic<int> nAllocations(0);
+
+void* operator new(size_t size)
+{
+    nAllocations++;
+    void* p = malloc(size ? size : 1);
+    if(!p)
+        throw bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+int main()
+{
+    const int nFrames = 20, nLevels = 8, border = 19;
+    const float scaleFactor = 1.2f;
+
+    // The thread pool of OpenCV allocates a job for every parallel call, inside resize
+    cv::setNumThreads(0);
+
+    vector<float> vInvScaleFactor(nLevels, 1.f);
+    for(int level=1; level<nLevels; level++)
+        vInvScaleFactor[level] = vInvScaleFactor[level-1]/scaleFactor;
+
+    // Frames are filled before counting, so the allocation of the images is not counted
+    cv::Mat im(480, 752, CV_8UC1);
+    cv::RNG rng(1);
+
+    ORB_SLAM3::ImagePyramid pyramid(vInvScaleFactor, border);
+    ORB_SLAM3::ORBextractor extractor(1500, scaleFactor, nLevels, 20, 7);
+    vector<cv::KeyPoint> vKeys;
+    cv::Mat descriptors;
+    vector<int> vLapping = {0, 0};
+
+    int nPyramidAllocations = 0, nExtractorAllocations = 0;
+    for(int i=0; i<nFrames; i++)
+    {
+        rng.fill(im, cv::RNG::UNIFORM, 0, 256);
+
+        nAllocations = 0;
+        pyramid.Compute(im);
+        if(i > 0)
+            nPyramidAllocations += nAllocations;
+
+        nAllocations = 0;
+        extractor(im, cv::Mat(), vKeys, descriptors, vLapping);
+        if(i > 0)
+            nExtractorAllocations += nAllocations;
+    }
+
+    cout << "Allocations per frame after the first one:" << endl;
+    cout << "  ImagePyramid::Compute: " << (double)nPyramidAllocations/(nFrames-1) << endl;
+    cout << "  ORBextractor: " << (double)nExtractorAllocations/(nFrames-1) << endl;
+
+    if(nPyramidAllocations > 0)
+    {
+        cerr << "The image pyramid allocates on every frame" << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,114 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2020 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include<iostream>
+#include<chrono>
+#include<string>
+
+#include<opencv2/core/core.hpp>
+
+#include"ORBVocabulary.h"
+
+using namespace std;
+
+// Converts a text vocabulary (ORBvoc.txt) into the binary format that System maps when the vocabulary
+// path ends in .bin, and checks that both give the same words and BoW vectors.
+int main(int argc, char **argv)
+{
+    if(argc != 3)
+    {
+        cerr << endl << "Usage: ./bin_vocabulary path_to_text_vocabulary path_to_binary_vocabulary" << endl;
+        return 1;
+    }
+
+    ORB_SLAM3::ORBVocabulary textVoc;
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    if(!textVoc.loadFromTextFile(argv[1]))
+    {
+        cerr << "Failed to open the text vocabulary at: " << argv[1] << endl;
+        return 1;
+    }
+    std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+    cout << "Text vocabulary loaded in " << std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(t1 - t0).count() << " ms" << endl;
+
+    if(!textVoc.saveToBinaryFile(argv[2]))
+    {
+        cerr << "Failed to write the binary vocabulary at: " << argv[2] << endl;
+        return 1;
+    }
+
+    ORB_SLAM3::ORBVocabulary binaryVoc;
+    t0 = std::chrono::steady_clock::now();
+    if(!binaryVoc.loadFromBinaryFile(argv[2]))
+    {
+        cerr << "Failed to load the binary vocabulary back" << endl;
+        return 1;
+    }
+    t1 = std::chrono::steady_clock::now();
+    cout << "Binary vocabulary loaded in " << std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(t1 - t0).count() << " ms" << endl;
+
+    bool bEqual = textVoc.size() == binaryVoc.size() && textVoc.getBranchingFactor() == binaryVoc.getBranchingFactor() &&
+                  textVoc.getDepthLevels() == binaryVoc.getDepthLevels() &&
+                  textVoc.getScoringType() == binaryVoc.getScoringType() && textVoc.getWeightingType() == binaryVoc.getWeightingType();
+
+    for(unsigned int wid=0; wid<textVoc.size() && bEqual; wid++)
+    {
+        bEqual = textVoc.getWordWeight(wid) == binaryVoc.getWordWeight(wid) &&
+                 cv::norm(textVoc.getWord(wid), binaryVoc.getWord(wid), cv::NORM_HAMMING) == 0;
+    }
+
+    // The whole tree is walked by the transform of random descriptors
+    cv::RNG rng(0);
+    for(int i=0; i<10000 && bEqual; i++)
+    {
+        cv::Mat descriptor(1, 32, CV_8U);
+        rng.fill(descriptor, cv::RNG::UNIFORM, 0, 256);
+        bEqual = textVoc.transform(descriptor) == binaryVoc.transform(descriptor);
+    }
+
+    // Frames are transformed in blocks, which descend the breadth-first layout mapped from the file. They must
+    // give the vectors of the DBoW2 tree of the text vocabulary.
+    const int nFrames = 20, nFeatures = 1000, levelsUp = 4;
+    for(int f=0; f<nFrames && bEqual; f++)
+    {
+        cv::Mat descriptors(nFeatures, ORB_SLAM3::ORBDescriptor::bytes, CV_8U);
+        rng.fill(descriptors, cv::RNG::UNIFORM, 0, 256);
+
+        vector<cv::Mat> vDescriptors;
+        for(int i=0; i<nFeatures; i++)
+            vDescriptors.push_back(descriptors.row(i));
+
+        DBoW2::BowVector textBow, binaryBow;
+        DBoW2::FeatureVector textFeat, binaryFeat;
+        textVoc.ORB_SLAM3::ORBVocabulary::Base::transform(vDescriptors, textBow, textFeat, levelsUp);
+
+        vector<ORB_SLAM3::ORBDescriptor> vStorage;
+        binaryVoc.transform(ORB_SLAM3::DescriptorSpan::Aligned(descriptors, vStorage), binaryBow, binaryFeat, levelsUp);
+        bEqual = textBow == binaryBow && textFeat == binaryFeat;
+    }
+
+    if(!bEqual)
+    {
+        cerr << "The binary vocabulary differs from the text one" << endl;
+        return 1;
+    }
+
+    cout << "Binary vocabulary with " << binaryVoc.size() << " words written to " << argv[2] << endl;
+
+    return 0;
+}
@@ -3,6 +3,8 @@
  * Added functions: Save and Load from text files without using cv::FileStorage.
  * Date: August 2015
  * Raúl Mur-Artal
+ *
+ * Added functions: Save and Load from memory-mappable binary files.
  */
 
 /**
@@ -26,6 +28,13 @@
 #include <algorithm>
 #include <opencv2/core/core.hpp>
 #include <limits>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 
 #include "FeatureVector.h"
 #include "BowVector.h"
@@ -257,6 +266,24 @@ public:
    */
   void saveToTextFile(const std::string &filename) const;  
 
+  /**
+   * Loads the vocabulary from a binary file written by saveToBinaryFile.
+   * The file is mapped read-only and kept as the binary layout of the
+   * vocabulary. The node descriptors point into the mapping, so the
+   * processes that load the same file share its pages
+   * @param filename
+   * @return false if the file cannot be mapped or is not a binary vocabulary
+   */
+  bool loadFromBinaryFile(const std::string &filename);
+
+  /**
+   * Saves the vocabulary into a binary file that loadFromBinaryFile maps.
+   * Only descriptors stored as single-row CV_8U matrices are supported
+   * @param filename
+   * @return false if the file cannot be written
+   */
+  bool saveToBinaryFile(const std::string &filename) const;
+
   /**
    * Saves the vocabulary into a file
    * @param filename
@@ -304,6 +331,79 @@ protected:
   /// Pointer to descriptor
   typedef const TDescriptor *pDescriptor;
 
+  /// Header of the binary vocabulary files. It is followed by the arrays
+  /// it points to, each one aligned to BINARY_ALIGNMENT bytes. The arrays
+  /// hold the tree in breadth-first order: the root is entry 0 and the
+  /// children of every node are contiguous. Padding entries are inserted
+  /// before each block of children, so that the descriptors of the block
+  /// start on a BINARY_ALIGNMENT boundary
+  struct BinaryHeader
+  {
+    /// BINARY_MAGIC
+    char magic[8];
+    /// BINARY_VERSION
+    uint32_t version;
+    int32_t k;
+    int32_t L;
+    int32_t scoring;
+    int32_t weighting;
+    uint32_t nNodes;
+    uint32_t nWords;
+    /// Bytes of each node descriptor
+    uint32_t descriptorBytes;
+    /// Entries of the arrays, the nodes and the padding
+    uint32_t nEntries;
+    /// BinaryNode[nEntries]
+    uint64_t nodesOffset;
+    /// double[nEntries], node weights
+    uint64_t weightsOffset;
+    /// uint8_t[nEntries*descriptorBytes], node descriptors (zero for the
+    /// root and the padding)
+    uint64_t descriptorsOffset;
+    /// Size of the whole file
+    uint64_t fileSize;
+  };
+
+  /// Entry of the breadth-first arrays of a binary file
+  struct BinaryNode
+  {
+    /// Children, at [childrenBegin, childrenBegin+nChildren) of the arrays
+    uint32_t childrenBegin;
+    uint32_t nChildren;
+    /// Node id, BINARY_PADDING for the padding entries
+    uint32_t nodeId;
+    /// Word id if the node is a leaf
+    uint32_t wordId;
+  };
+
+  /// Binary file of a vocabulary, mapped or built in memory
+  struct BinaryLayout
+  {
+    /// File the arrays are mapped from
+    std::shared_ptr<boost::interprocess::mapped_region> mapping;
+    /// Memory the arrays were built in, if they are not mapped
+    struct alignas(64) Block { uint8_t bytes[64]; };
+    std::vector<Block> storage;
+
+    uint32_t nEntries;
+    uint32_t descriptorBytes;
+    const BinaryNode* nodes;
+    const double* weights;
+    const uint8_t* descriptors;
+  };
+
+  static const char* binaryMagic() { return "DBoW2BIN"; }
+  static const uint32_t BINARY_VERSION = 2;
+  static const uint64_t BINARY_ALIGNMENT = 64;
+  static const uint32_t BINARY_PADDING = 0xFFFFFFFF;
+
+  /**
+   * Lays out the tree as in the binary files
+   * @return the layout, null if the descriptors are not single-row CV_8U
+   *   matrices of the same size
+   */
+  std::shared_ptr<const BinaryLayout> makeBinaryLayout() const;
+
   /// Tree node
   struct Node 
   {
@@ -436,6 +536,10 @@ protected:
   /// Words of the vocabulary (tree leaves)
   /// this condition holds: m_words[wid]->word_id == wid
   std::vector<Node*> m_words;
+
+  /// Binary file the vocabulary was loaded from, the node descriptors point
+  /// into it. Null if it was loaded otherwise
+  std::shared_ptr<const BinaryLayout> m_binary;
   
 };
 
@@ -558,6 +662,7 @@ TemplatedVocabulary<TDescriptor,F>::operator=
   this->m_words.clear();
   
   this->m_nodes = voc.m_nodes;
+  this->m_binary = voc.m_binary;
   this->createWords();
   
   return *this;
@@ -571,6 +676,7 @@ void TemplatedVocabulary<TDescriptor,F>::create(
 {
   m_nodes.clear();
   m_words.clear();
+  m_binary.reset();
   
   // expected_nodes = Sum_{i=0..L} ( k^i )
 	int expected_nodes = 
@@ -1366,6 +1472,7 @@ bool TemplatedVocabulary<TDescriptor,F>::loadFromTextFile(const std::string &fil
 
     m_words.clear();
     m_nodes.clear();
+    m_binary.reset();
 
     string s;
     getline(f,s);
@@ -1471,6 +1578,279 @@ void TemplatedVocabulary<TDescriptor,F>::saveToTextFile(const std::string &filen
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F>
+bool TemplatedVocabulary<TDescriptor,F>::loadFromBinaryFile(const std::string &filename)
+{
+    std::shared_ptr<BinaryLayout> binary = std::make_shared<BinaryLayout>();
+    try
+    {
+        boost::interprocess::file_mapping file(filename.c_str(), boost::interprocess::read_only);
+        binary->mapping = std::make_shared<boost::interprocess::mapped_region>(file, boost::interprocess::read_only);
+    }
+    catch(const boost::interprocess::interprocess_exception &e)
+    {
+        std::cerr << "Vocabulary loading failure: " << e.what() << endl;
+        return false;
+    }
+
+    const uint8_t* pData = static_cast<const uint8_t*>(binary->mapping->get_address());
+    const uint64_t size = binary->mapping->get_size();
+
+    BinaryHeader header;
+    if(size < sizeof(header))
+    {
+        std::cerr << "Vocabulary loading failure: This is not a correct binary file!" << endl;
+        return false;
+    }
+    memcpy(&header, pData, sizeof(header));
+
+    const uint64_t nNodes = header.nNodes;
+    const uint64_t nWords = header.nWords;
+    const uint64_t nEntries = header.nEntries;
+
+    // Whether an array of n elements of elemSize bytes at offset lies in the file and is aligned.
+    // Written so that no sum or product of values read from the file can wrap around.
+    auto fits = [size](uint64_t offset, uint64_t n, uint64_t elemSize)
+    {
+        return offset % BINARY_ALIGNMENT == 0 && offset <= size && n <= (size - offset)/elemSize;
+    };
+
+    if(memcmp(header.magic, binaryMagic(), sizeof(header.magic)) != 0 || header.version != BINARY_VERSION ||
+       header.fileSize != size || nNodes == 0 || nWords == 0 || nWords > nNodes || nEntries < nNodes ||
+       header.k<0 || header.k>20 || header.L<1 || header.L>10 || header.scoring<0 || header.scoring>5 ||
+       header.weighting<0 || header.weighting>3 || header.descriptorBytes != (uint32_t)F::L ||
+       !fits(header.nodesOffset, nEntries, sizeof(BinaryNode)) ||
+       !fits(header.weightsOffset, nEntries, sizeof(double)) ||
+       !fits(header.descriptorsOffset, nEntries, header.descriptorBytes))
+    {
+        std::cerr << "Vocabulary loading failure: This is not a correct binary file!" << endl;
+        return false;
+    }
+
+    binary->nEntries = nEntries;
+    binary->descriptorBytes = header.descriptorBytes;
+    binary->nodes = reinterpret_cast<const BinaryNode*>(pData + header.nodesOffset);
+    binary->weights = reinterpret_cast<const double*>(pData + header.weightsOffset);
+    binary->descriptors = pData + header.descriptorsOffset;
+
+    // The tree is rebuilt by walking the entries breadth-first from the root. Every node and every word
+    // must be reached exactly once: a cycle or a shared child would make transform loop forever.
+    std::vector<Node> vNodes(nNodes);
+    std::vector<Node*> vWords(nWords, static_cast<Node*>(NULL));
+    std::vector<bool> vbNodeReached(nNodes, false), vbEntryReached(nEntries, false);
+    std::vector<uint32_t> vQueue(1, 0);
+    vbEntryReached[0] = true;
+
+    bool bCorrect = binary->nodes[0].nodeId == 0;
+    for(size_t i=0; i<vQueue.size() && bCorrect; i++)
+    {
+        const uint32_t e = vQueue[i];
+        const BinaryNode &entry = binary->nodes[e];
+        if(entry.nodeId >= nNodes || vbNodeReached[entry.nodeId] ||
+           entry.childrenBegin > nEntries || entry.nChildren > nEntries - entry.childrenBegin)
+        {
+            bCorrect = false;
+            break;
+        }
+        vbNodeReached[entry.nodeId] = true;
+
+        Node &node = vNodes[entry.nodeId];
+        node.id = entry.nodeId;
+        node.weight = binary->weights[e];
+
+        // The descriptors are not copied, the mapping is never written
+        if(e>0)
+            node.descriptor = cv::Mat(1, header.descriptorBytes, CV_8U,
+                                      const_cast<uint8_t*>(binary->descriptors + (uint64_t)e*header.descriptorBytes));
+
+        for(uint32_t c=entry.childrenBegin; c<entry.childrenBegin+entry.nChildren && bCorrect; c++)
+        {
+            const uint32_t child = binary->nodes[c].nodeId;
+            bCorrect = !vbEntryReached[c] && child < nNodes;
+            if(bCorrect)
+            {
+                vbEntryReached[c] = true;
+                vQueue.push_back(c);
+                node.children.push_back(child);
+                vNodes[child].parent = node.id;
+            }
+        }
+
+        // The leaves are the words
+        if(entry.nChildren == 0 && e>0 && bCorrect)
+        {
+            bCorrect = entry.wordId < nWords && !vWords[entry.wordId];
+            if(bCorrect)
+            {
+                node.word_id = entry.wordId;
+                vWords[entry.wordId] = &node;
+            }
+        }
+    }
+
+    bCorrect = bCorrect && vQueue.size() == nNodes;
+    for(uint64_t wid=0; wid<nWords && bCorrect; wid++)
+        bCorrect = vWords[wid] != NULL;
+
+    if(!bCorrect)
+    {
+        std::cerr << "Vocabulary loading failure: This is not a correct binary file!" << endl;
+        return false;
+    }
+
+    m_k = header.k;
+    m_L = header.L;
+    m_scoring = (ScoringType)header.scoring;
+    m_weighting = (WeightingType)header.weighting;
+    createScoringObject();
+
+    // Swapping keeps the word pointers valid
+    m_nodes.swap(vNodes);
+    m_words.swap(vWords);
+    m_binary = binary;
+
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+std::shared_ptr<const typename TemplatedVocabulary<TDescriptor,F>::BinaryLayout>
+TemplatedVocabulary<TDescriptor,F>::makeBinaryLayout() const
+{
+    if(m_nodes.empty())
+        return std::shared_ptr<const BinaryLayout>();
+
+    const uint64_t nNodes = m_nodes.size();
+    const uint32_t descriptorBytes = nNodes>1 ? m_nodes[1].descriptor.cols*m_nodes[1].descriptor.elemSize() : 0;
+
+    // Breadth-first order, the children of a node are appended together after the padding that aligns
+    // their descriptors
+    BinaryNode padding;
+    padding.childrenBegin = 0;
+    padding.nChildren = 0;
+    padding.nodeId = BINARY_PADDING;
+    padding.wordId = 0;
+
+    std::vector<BinaryNode> vEntries;
+    vEntries.reserve(nNodes + nNodes/2);
+    BinaryNode root = padding;
+    root.nodeId = 0;
+    vEntries.push_back(root);
+
+    for(size_t e=0; e<vEntries.size(); e++)
+    {
+        if(vEntries[e].nodeId == BINARY_PADDING)
+            continue;
+
+        const Node &node = m_nodes[vEntries[e].nodeId];
+        vEntries[e].wordId = node.isLeaf() ? node.word_id : 0;
+        vEntries[e].nChildren = node.children.size();
+        if(node.isLeaf())
+            continue;
+
+        while((vEntries.size()*descriptorBytes) % BINARY_ALIGNMENT != 0)
+            vEntries.push_back(padding);
+
+        vEntries[e].childrenBegin = vEntries.size();
+        for(NodeId child : node.children)
+        {
+            BinaryNode entry = padding;
+            entry.nodeId = child;
+            vEntries.push_back(entry);
+        }
+    }
+
+    const uint64_t nEntries = vEntries.size();
+
+    BinaryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, binaryMagic(), sizeof(header.magic));
+    header.version = BINARY_VERSION;
+    header.k = m_k;
+    header.L = m_L;
+    header.scoring = m_scoring;
+    header.weighting = m_weighting;
+    header.nNodes = nNodes;
+    header.nWords = m_words.size();
+    header.descriptorBytes = descriptorBytes;
+    header.nEntries = nEntries;
+
+    uint64_t offset = sizeof(header);
+    auto next = [&offset](uint64_t bytes)
+    {
+        offset = (offset + BINARY_ALIGNMENT - 1)/BINARY_ALIGNMENT*BINARY_ALIGNMENT;
+        const uint64_t arrayOffset = offset;
+        offset += bytes;
+        return arrayOffset;
+    };
+    header.nodesOffset = next(nEntries*sizeof(BinaryNode));
+    header.weightsOffset = next(nEntries*sizeof(double));
+    header.descriptorsOffset = next(nEntries*descriptorBytes);
+    header.fileSize = offset;
+
+    std::shared_ptr<BinaryLayout> binary = std::make_shared<BinaryLayout>();
+    binary->storage.resize((header.fileSize + BINARY_ALIGNMENT - 1)/BINARY_ALIGNMENT);
+    uint8_t* pData = binary->storage[0].bytes;
+    memset(pData, 0, binary->storage.size()*sizeof(typename BinaryLayout::Block));
+    memcpy(pData, &header, sizeof(header));
+
+    BinaryNode* pNodes = reinterpret_cast<BinaryNode*>(pData + header.nodesOffset);
+    double* pWeights = reinterpret_cast<double*>(pData + header.weightsOffset);
+    uint8_t* pDescriptors = pData + header.descriptorsOffset;
+
+    for(uint64_t e=0; e<nEntries; e++)
+    {
+        pNodes[e] = vEntries[e];
+        if(vEntries[e].nodeId == BINARY_PADDING)
+            continue;
+
+        const Node &node = m_nodes[vEntries[e].nodeId];
+        pWeights[e] = node.weight;
+        if(e>0)
+        {
+            if(node.descriptor.type() != CV_8U || node.descriptor.rows != 1 ||
+               node.descriptor.cols*node.descriptor.elemSize() != descriptorBytes)
+                return std::shared_ptr<const BinaryLayout>();
+            memcpy(pDescriptors + e*descriptorBytes, node.descriptor.ptr(), descriptorBytes);
+        }
+    }
+
+    binary->nEntries = nEntries;
+    binary->descriptorBytes = descriptorBytes;
+    binary->nodes = pNodes;
+    binary->weights = pWeights;
+    binary->descriptors = pDescriptors;
+
+    return binary;
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+bool TemplatedVocabulary<TDescriptor,F>::saveToBinaryFile(const std::string &filename) const
+{
+    std::shared_ptr<const BinaryLayout> binary = makeBinaryLayout();
+    if(!binary)
+    {
+        std::cerr << "Vocabulary saving failure: Unsupported descriptor" << endl;
+        return false;
+    }
+
+    BinaryHeader header;
+    const uint8_t* pData = binary->storage[0].bytes;
+    memcpy(&header, pData, sizeof(header));
+
+    ofstream f(filename.c_str(), ios_base::out | ios_base::binary);
+    if(!f.is_open())
+        return false;
+    f.write(reinterpret_cast<const char*>(pData), header.fileSize);
+
+    return f.good();
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F>
 void TemplatedVocabulary<TDescriptor,F>::save(const std::string &filename) const
 {
@@ -1596,6 +1976,7 @@ void TemplatedVocabulary<TDescriptor,F>::load(const cv::FileStorage &fs,
 {
   m_words.clear();
   m_nodes.clear();
+  m_binary.reset();
   
   cv::FileNode fvoc = fs[name];
   
@@ -67,8 +67,7 @@ void BaseBinaryEdge<D, E, VertexXiType, VertexXjType>::constructQuadraticForm()
 
   if (fromNotFixed || toNotFixed) {
 #ifdef G2O_OPENMP
-    from->lockQuadraticForm();
-    to->lockQuadraticForm();
+    OptimizableGraph::Vertex::lockQuadraticForms(from, to);
 #endif
     const InformationType& omega = _information;
     Matrix<double, D, 1> omega_r = - omega * _error;
@@ -113,8 +112,7 @@ void BaseBinaryEdge<D, E, VertexXiType, VertexXjType>::constructQuadraticForm()
       }
     }
 #ifdef G2O_OPENMP
-    to->unlockQuadraticForm();
-    from->unlockQuadraticForm();
+    OptimizableGraph::Vertex::unlockQuadraticForms(from, to);
 #endif
   }
 }
@@ -140,8 +138,7 @@ void BaseBinaryEdge<D, E, VertexXiType, VertexXjType>::linearizeOplus()
     return;
 
 #ifdef G2O_OPENMP
-  vi->lockQuadraticForm();
-  vj->lockQuadraticForm();
+  OptimizableGraph::Vertex::lockQuadraticForms(vi, vj);
 #endif
 
   const double delta = 1e-9;
@@ -199,8 +196,7 @@ void BaseBinaryEdge<D, E, VertexXiType, VertexXjType>::linearizeOplus()
 
   _error = errorBeforeNumeric;
 #ifdef G2O_OPENMP
-  vj->unlockQuadraticForm();
-  vi->unlockQuadraticForm();
+  OptimizableGraph::Vertex::unlockQuadraticForms(vi, vj);
 #endif
 }
 
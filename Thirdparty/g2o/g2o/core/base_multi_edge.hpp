@@ -189,15 +189,18 @@ void BaseMultiEdge<D, E>::computeQuadraticForm(const InformationType& omega, con
 #endif
       fromMap.noalias() += AtO * A;
       fromB.noalias() += A.transpose() * weightedError;
+#ifdef G2O_OPENMP
+      from->unlockQuadraticForm();
+#endif
 
-      // compute the off-diagonal blocks ij for all j
+      // compute the off-diagonal blocks ij for all j, holding the locks of one pair at a time
       for (size_t j = i+1; j < _vertices.size(); ++j) {
         OptimizableGraph::Vertex* to = static_cast<OptimizableGraph::Vertex*>(_vertices[j]);
-#ifdef G2O_OPENMP
-        to->lockQuadraticForm();
-#endif
         bool jstatus = !(to->fixed());
         if (jstatus) {
+#ifdef G2O_OPENMP
+          OptimizableGraph::Vertex::lockQuadraticForms(from, to);
+#endif
           const MatrixXd& B = _jacobianOplus[j];
           int idx = internal::computeUpperTriangleIndex(i, j);
           assert(idx < (int)_hessian.size());
@@ -207,15 +210,11 @@ void BaseMultiEdge<D, E>::computeQuadraticForm(const InformationType& omega, con
           } else {
             hhelper.matrix.noalias() += AtO * B;
           }
-        }
 #ifdef G2O_OPENMP
-        to->unlockQuadraticForm();
+          OptimizableGraph::Vertex::unlockQuadraticForms(from, to);
 #endif
+        }
       }
-
-#ifdef G2O_OPENMP
-      from->unlockQuadraticForm();
-#endif
     }
 
   }
@@ -86,7 +86,8 @@ void BlockSolver<Traits>::resize(int* blockPoseIndices, int numPoseBlocks,
     _HplCCS = new SparseBlockMatrixCCS<PoseLandmarkMatrixType>(_Hpl->rowBlockIndices(), _Hpl->colBlockIndices());
     _HschurTransposedCCS = new SparseBlockMatrixCCS<PoseMatrixType>(_Hschur->colBlockIndices(), _Hschur->rowBlockIndices());
 #ifdef G2O_OPENMP
-    _coefficientsMutex.resize(numPoseBlocks);
+    // fresh locks in place, resizing would copy the ones of the previous structure
+    std::vector<OpenMPMutex>(numPoseBlocks).swap(_coefficientsMutex);
 #endif
   }
 }
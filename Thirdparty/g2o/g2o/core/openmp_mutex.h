@@ -78,6 +78,25 @@ namespace g2o {
 
 #endif
 
+  /**
+   * \brief set the number of threads of the OpenMP regions the calling thread starts within a scope
+   */
+  class ScopedOpenMPThreads
+  {
+    public:
+#ifdef G2O_OPENMP
+      explicit ScopedOpenMPThreads(int numThreads) : _previous(omp_get_max_threads()) { omp_set_num_threads(numThreads > 0 ? numThreads : 1); }
+      ~ScopedOpenMPThreads() { omp_set_num_threads(_previous); }
+    private:
+      int _previous;
+#else
+      explicit ScopedOpenMPThreads(int) {}
+    private:
+#endif
+      ScopedOpenMPThreads(const ScopedOpenMPThreads&);
+      void operator=(const ScopedOpenMPThreads&);
+  };
+
   /**
    * \brief lock a mutex within a scope
    */
@@ -335,6 +335,21 @@ namespace g2o {
          * unlock the block of the hessian and the b vector associated with this vertex
          */
         void unlockQuadraticForm() { _quadraticFormMutex.unlock();}
+        /**
+         * lock the blocks of two vertices in the order of their addresses, edges listing
+         * the same vertices in another order then cannot deadlock against each other
+         */
+        static void lockQuadraticForms(Vertex* v1, Vertex* v2)
+        {
+          if (v2 < v1) { Vertex* t = v1; v1 = v2; v2 = t; }
+          v1->lockQuadraticForm();
+          v2->lockQuadraticForm();
+        }
+        static void unlockQuadraticForms(Vertex* v1, Vertex* v2)
+        {
+          v1->unlockQuadraticForm();
+          v2->unlockQuadraticForm();
+        }
 
         //! read the vertex from a stream, i.e., the internal state of the vertex
         virtual bool read(std::istream& is) = 0;
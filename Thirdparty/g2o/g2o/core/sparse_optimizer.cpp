@@ -36,6 +36,7 @@
 #include "estimate_propagator.h"
 #include "optimization_algorithm.h"
 #include "batch_stats.h"
+#include "openmp_mutex.h"
 #include "hyper_graph_action.h"
 #include "robust_kernel.h"
 #include "../stuff/timeutil.h"
@@ -48,7 +49,7 @@ namespace g2o{
 
 
   SparseOptimizer::SparseOptimizer() :
-    _forceStopFlag(0), _verbose(false), _algorithm(0), _computeBatchStatistics(false)
+    _forceStopFlag(0), _verbose(false), _numThreads(1), _algorithm(0), _computeBatchStatistics(false)
   {
     _graphActions.resize(AT_NUM_ELEMENTS);
   }
@@ -67,6 +68,7 @@ namespace g2o{
         (*(*it))(this);
     }
 
+    ScopedOpenMPThreads threads(_numThreads);
 #   ifdef G2O_OPENMP
 #   pragma omp parallel for default (shared) if (_activeEdges.size() > 50)
 #   endif
@@ -362,6 +364,9 @@ namespace g2o{
     double cumTime=0;
     bool ok=true;
 
+    // the parallel regions of the solver are started from this thread
+    ScopedOpenMPThreads threads(_numThreads);
+
     ok = _algorithm->init(online);
     if (! ok) {
       cerr << __PRETTY_FUNCTION__ << " Error while initializing" << endl;
@@ -576,6 +581,11 @@ namespace g2o{
     _forceStopFlag=flag;
   }
 
+  void SparseOptimizer::setNumThreads(int numThreads)
+  {
+    _numThreads = numThreads > 0 ? numThreads : 1;
+  }
+
   bool SparseOptimizer::removeVertex(HyperGraph::Vertex* v)
   {
     OptimizableGraph::Vertex* vv = static_cast<OptimizableGraph::Vertex*>(v);
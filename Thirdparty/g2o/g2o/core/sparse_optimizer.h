@@ -187,6 +187,14 @@ namespace g2o {
     //! if external stop flag is given, return its state. False otherwise
     bool terminate() {return _forceStopFlag ? (*_forceStopFlag) : false; }
 
+    /**
+     * number of threads computing the errors, linearizing the edges and building the Schur complement
+     * during optimize(). It has only an effect if g2o is built with OpenMP, and requires edges with
+     * analytic Jacobians: the numeric ones perturb the estimates the other edges read concurrently.
+     */
+    void setNumThreads(int numThreads);
+    int numThreads() const { return _numThreads;}
+
     //! the index mapping of the vertices
     const VertexContainer& indexMapping() const {return _ivMap;}
     //! the vertices active in the current optimization
@@ -289,6 +297,7 @@ namespace g2o {
     protected:
     bool* _forceStopFlag;
     bool _verbose;
+    int _numThreads;
 
     VertexContainer _ivMap;
     VertexContainer _activeVertices;   ///< sorted according to VertexIDCompare
@@ -32,6 +32,7 @@
 #include <boost/serialization/vector.hpp>
 #include <boost/serialization/export.hpp>
 #include <boost/interprocess/managed_shared_memory.hpp>
+#include "MapSegment.h"
 
 
 namespace ORB_SLAM3
@@ -122,7 +123,7 @@ public:
 
     //for managed shared memory converted
     //boost::interprocess::fixed_managed_shared_memory *segment;
-    boost::interprocess::managed_shared_memory *segment;
+    managed_map_segment *segment;
 
     //process num
     int processnum;
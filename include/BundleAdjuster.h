@@ -0,0 +1,190 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2020 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BUNDLEADJUSTER_H
+#define BUNDLEADJUSTER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+
+#include "Thirdparty/g2o/g2o/types/se3quat.h"
+#include "GeometricCamera.h"
+
+namespace ORB_SLAM3
+{
+
+class Pinhole;
+class KannalaBrandt8;
+
+// Bundle adjustment of keyframe poses and 3D points specialized for the reprojection errors of the
+// visual bundle adjustments: monocular (left or right camera of a rig) and rectified stereo observations
+// with isotropic information and Huber kernels. The variables and observations live in contiguous
+// arrays, the Jacobians are fixed-size and the points are eliminated into a dense reduced camera system.
+// Poses are parametrized as g2o's VertexSE3Expmap and the damping follows OptimizationAlgorithmLevenberg,
+// so that it solves the same problems as the g2o graphs of Optimizer. Solving the dense system is cubic in
+// the number of free poses, so it is only meant for local BAs.
+class BundleAdjuster
+{
+public:
+    // An observation as it was added. Stereo observations have nDim==3 and use the intrinsics
+    // fx,fy,cx,cy,bf, monocular ones pCamera and, in the right camera of a rig, Trl.
+    struct Observation
+    {
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        int nKF;
+        int nMP;
+        int nDim;
+        Eigen::Vector3d obs;
+        double invSigma2;
+        double thHuber;
+        GeometricCamera* pCamera;
+        bool bRight;
+        g2o::SE3Quat Trl;
+        double fx, fy, cx, cy, bf;
+    };
+
+    BundleAdjuster();
+    ~BundleAdjuster();
+
+    // Variables, indexed in insertion order. Fixed keyframes are not optimized.
+    int AddKeyFrame(const g2o::SE3Quat &Tcw, bool bFixed);
+    int AddMapPoint(const Eigen::Vector3d &x3Dw);
+
+    // Observations with information invSigma2*I and a Huber kernel of width thHuber (none if thHuber<=0).
+    // Right observations are made by the camera Trl maps the keyframe frame to.
+    int AddMonoObservation(int nKF, int nMP, const Eigen::Vector2d &obs, double invSigma2, double thHuber,
+                           GeometricCamera* pCamera);
+    int AddRightObservation(int nKF, int nMP, const Eigen::Vector2d &obs, double invSigma2, double thHuber,
+                            GeometricCamera* pCamera, const g2o::SE3Quat &Trl);
+    int AddStereoObservation(int nKF, int nMP, const Eigen::Vector3d &obs, double invSigma2, double thHuber,
+                             double fx, double fy, double cx, double cy, double bf);
+
+    // Damping of the first iteration. By default 1e-5 times the largest diagonal entry of the system.
+    void SetInitialLambda(double lambda);
+
+    // Levenberg-Marquardt iterations, with the stop criteria of OptimizationAlgorithmLevenberg. Each call
+    // starts again from the initial damping. Returns the number of iterations done.
+    int Optimize(int nIterations, bool *pbStopFlag=NULL);
+
+    int NumKeyFrames() const {return (int)mvTcw.size();}
+    int NumMapPoints() const {return (int)mvPoints.size();}
+    int NumObservations() const {return (int)mvnObsKF.size();}
+
+    const g2o::SE3Quat& GetPose(int nKF) const {return mvTcw[nKF];}
+    bool IsFixed(int nKF) const {return mvbFixed[nKF];}
+    const Eigen::Vector3d& GetMapPoint(int nMP) const {return mvPoints[nMP];}
+    Observation GetObservation(int nObs) const;
+
+    // Unweighted chi2 of an observation and the sign of its depth, at the current estimate
+    double GetChi2(int nObs) const;
+    bool IsDepthPositive(int nObs) const;
+
+    // Sum of the robust chi2 of all observations at the current estimate
+    double GetRobustChi2() const;
+
+    // Text exchange format of problems, to export them from a running system and benchmark them offline.
+    // Loaded cameras are owned by the adjuster.
+    bool Save(const std::string &filename) const;
+    bool Load(const std::string &filename);
+
+protected:
+
+    typedef std::vector<g2o::SE3Quat, Eigen::aligned_allocator<g2o::SE3Quat> > PoseVector;
+    typedef Eigen::Matrix<double,6,6> Matrix6d;
+    typedef Eigen::Matrix<double,6,1> Vector6d;
+    typedef Eigen::Matrix<double,6,3> Matrix63d;
+
+    // Observation models
+    enum {PINHOLE_MONO=0, CAMERA_MONO=1, STEREO=2};
+
+    void Clear();
+    int AddObservation(int nKF, int nMP, int nModel, int nParam, double invSigma2, double thHuber);
+    int AddRig(const g2o::SE3Quat &Trl);
+
+    // Error of observation i at the current estimate in its first entries, returns their number.
+    // x3Dc is the point in the camera of the observation.
+    int ComputeError(int i, Eigen::Vector3d &e, Eigen::Vector3d &x3Dc) const;
+
+    // Point to observation index and free pose columns, built once per Optimize
+    void BuildStructure();
+    void BuildSystem();
+    double MaxDiagonal() const;
+    bool SolveSystem(double lambda);
+    double ComputeScale(double lambda) const;
+    void Update();
+    void Restore();
+
+    // Variables
+    PoseVector mvTcw;
+    std::vector<bool> mvbFixed;
+    std::vector<Eigen::Vector3d> mvPoints;
+
+    // Observations, with their model parameters in the arrays of the model
+    std::vector<int> mvnObsKF;
+    std::vector<int> mvnObsMP;
+    std::vector<int> mvnObsModel;
+    std::vector<int> mvnObsParam;
+    std::vector<double> mvObsInvSigma2;
+    std::vector<double> mvObsHuber;
+
+    std::vector<Eigen::Vector2d> mvMonoObs;
+    std::vector<GeometricCamera*> mvpMonoCamera;
+    std::vector<Eigen::Vector4d, Eigen::aligned_allocator<Eigen::Vector4d> > mvMonoK;
+    std::vector<int> mvnMonoRig;
+    PoseVector mvRigs;
+
+    std::vector<Eigen::Vector3d> mvStereoObs;
+    std::vector<Eigen::Matrix<double,5,1> > mvStereoK;
+
+    double mInitialLambda;
+
+    // Structure
+    std::vector<int> mvnPoseCol;
+    int mnFreePoses;
+    std::vector<int> mvnPointObsBegin;
+    std::vector<int> mvnPointObs;
+
+    // Normal equations. Hpl is kept per observation, the reduced camera system is dense.
+    std::vector<Matrix6d, Eigen::aligned_allocator<Matrix6d> > mvHpp;
+    std::vector<Eigen::Matrix3d> mvHll;
+    std::vector<Matrix63d, Eigen::aligned_allocator<Matrix63d> > mvHpl;
+    Eigen::VectorXd mbp;
+    std::vector<Eigen::Vector3d> mvbl;
+    std::vector<Eigen::Matrix3d> mvHllInv;
+    Eigen::MatrixXd mS;
+    Eigen::VectorXd mbs;
+    Eigen::VectorXd mxp;
+    std::vector<Eigen::Vector3d> mvxl;
+
+    // Estimate before the last update, restored if the step is rejected
+    PoseVector mvTcwBackup;
+    std::vector<Eigen::Vector3d> mvPointsBackup;
+
+    // Cameras created by Load
+    std::vector<std::unique_ptr<Pinhole> > mvpPinholes;
+    std::vector<std::unique_ptr<KannalaBrandt8> > mvpKannalaBrandts;
+};
+
+} //namespace ORB_SLAM3
+
+#endif // BUNDLEADJUSTER_H
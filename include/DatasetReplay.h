@@ -0,0 +1,93 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2020 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DATASETREPLAY_H
+#define DATASETREPLAY_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "System.h"
+#include "ImuTypes.h"
+
+namespace ORB_SLAM3
+{
+
+// Replays a recorded sequence as fast as the system tracks it, instead of at the camera rate.
+// I/O threads read and decode the images ahead, and the frames go through the asynchronous calls of
+// System in replay mode, so Local Mapping still gets every keyframe as with real-time input.
+class DatasetReplay
+{
+public:
+    // Run on the I/O threads on every decoded frame, e.g. to rectify stereo images
+    typedef std::function<void(cv::Mat &im, cv::Mat &im2)> Preprocess;
+
+    // nPrefetch frames at most are decoded ahead of the one being tracked
+    DatasetReplay(System* pSystem, const System::eSensor sensor, int nIOThreads = 2, int nPrefetch = 8);
+
+    void SetPreprocess(const Preprocess &preprocess);
+
+    // Tracks a sequence and returns once all of its frames have been tracked. vstrImages2 are the right
+    // images (stereo) or the depthmaps (RGB-D), and vvImuMeas the measurements given with each frame
+    // (inertial sensors). Returns false if an image could not be read.
+    bool Run(const std::vector<std::string> &vstrImages, const std::vector<std::string> &vstrImages2,
+             const std::vector<double> &vTimestamps,
+             const std::vector<std::vector<IMU::Point> > &vvImuMeas = std::vector<std::vector<IMU::Point> >());
+
+    // Throughput of the last Run, from the first read to the last tracked frame
+    int GetNumFrames() const;
+    double GetTime() const;
+    double GetFramesPerSecond() const;
+
+protected:
+    struct Slot
+    {
+        int index;
+        bool bFailed;
+        cv::Mat im;
+        cv::Mat im2;
+    };
+
+    void Load(const std::vector<std::string> &vstrImages, const std::vector<std::string> &vstrImages2);
+
+    System* mpSystem;
+    System::eSensor mSensor;
+    int mnIOThreads;
+    int mnPrefetch;
+    Preprocess mPreprocess;
+
+    // Frame i is decoded into mvSlots[i % mnPrefetch], once frame i-mnPrefetch has been tracked
+    std::vector<Slot> mvSlots;
+    int mnNextLoad;
+    int mnNextTrack;
+    bool mbAbort;
+    std::mutex mMutexSlots;
+    std::condition_variable mcvSlots;
+
+    int mnFrames;
+    double mTime;
+};
+
+} //namespace ORB_SLAM3
+
+#endif // DATASETREPLAY_H
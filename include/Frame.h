@@ -64,6 +64,10 @@ public:
     // Extract ORB on the image. 0 for left image and 1 for right image.
     void ExtractORB(int flag, const cv::Mat &im, const int x0, const int x1);
 
+    // Extract ORB on both images at the same time, on the extraction pool of the tracker if there is one.
+    void ExtractORBStereo(const cv::Mat &imLeft, const cv::Mat &imRight, const int x0Left, const int x1Left,
+                          const int x0Right, const int x1Right);
+
     // Compute Bag of Words representation.
     void ComputeBoW();
 
@@ -217,6 +221,11 @@ public:
     static long unsigned int nNextId;
     long unsigned int mnId;
 
+    // Frames built on a thread that sets sbDeferId (the feature thread of TrackingFrontEnd) take no id,
+    // AssignId() numbers them when they are tracked so the ids follow the tracking order.
+    static thread_local bool sbDeferId;
+    void AssignId();
+
     // Reference Keyframe.
     boost::interprocess::offset_ptr<KeyFrame>  mpReferenceKF;
 
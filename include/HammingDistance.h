@@ -0,0 +1,87 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2020 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef HAMMINGDISTANCE_H
+#define HAMMINGDISTANCE_H
+
+#include <cstddef>
+
+#include "ORBDescriptor.h"
+
+namespace ORB_SLAM3
+{
+
+// Hamming distance kernels for 256 bit descriptors. The kernel is chosen once at runtime from the
+// instructions the CPU supports, so the library is still built for the baseline architecture.
+class HammingDistance
+{
+public:
+    enum Kernel
+    {
+        SCALAR=0,
+        POPCNT=1,
+        AVX2=2,
+        AVX512=3,
+        NEON=4
+    };
+
+    // Distance between two descriptors
+    static int Distance(const ORBDescriptor &a, const ORBDescriptor &b)
+    {
+        return GetKernels().distance(a, b);
+    }
+
+    // Distances from one descriptor to n descriptors, written to pDist[0..n)
+    static void OneToMany(const ORBDescriptor &query, const ORBDescriptor* pTargets, std::size_t n, int* pDist)
+    {
+        GetKernels().oneToMany(query, pTargets, n, pDist);
+    }
+
+    // Distances from nQueries descriptors to nTargets descriptors, written row by row to
+    // pDist[0..nQueries*nTargets)
+    static void ManyToMany(const ORBDescriptor* pQueries, std::size_t nQueries,
+                           const ORBDescriptor* pTargets, std::size_t nTargets, int* pDist);
+
+    static Kernel GetKernel();
+    static const char* GetKernelName(Kernel kernel);
+
+    static bool IsSupported(Kernel kernel);
+
+    // Forces a kernel, for testing and timing. Returns false if the CPU does not support it.
+    static bool SetKernel(Kernel kernel);
+
+protected:
+    typedef int (*DistanceFunc)(const ORBDescriptor&, const ORBDescriptor&);
+    typedef void (*OneToManyFunc)(const ORBDescriptor&, const ORBDescriptor*, std::size_t, int*);
+
+    struct Kernels
+    {
+        Kernel kernel;
+        DistanceFunc distance;
+        OneToManyFunc oneToMany;
+    };
+
+    static Kernels MakeKernels(Kernel kernel);
+    static Kernels& GetKernels();
+};
+
+} //namespace ORB_SLAM3
+
+#endif // HAMMINGDISTANCE_H
@@ -29,6 +29,10 @@
 #include "KeyFrameDatabase.h"
 #include "ImuTypes.h"
 #include "Converter.h"
+#include "MapSegment.h"
+#include "ShmMat.h"
+#include "ORBDescriptor.h"
+#include "SharedBoW.h"
 
 #include "GeometricCamera.h"
 
@@ -103,6 +107,9 @@ public:
     // Bag of Words Representation
     void ComputeBoW();
 
+    // Descriptors of the keypoints, read in place from the block in the map segment
+    DescriptorSpan GetDescriptors() const;
+
     // Covisibility graph functions
     void AddConnection(boost::interprocess::offset_ptr<KeyFrame> pKF, const int &weight);
     void EraseConnection(boost::interprocess::offset_ptr<KeyFrame> pKF);
@@ -188,26 +195,24 @@ public:
 
 
     //new code:: Allocators for vectors
-    typedef boost::interprocess::allocator<boost::interprocess::offset_ptr<MapPoint>, boost::interprocess::managed_shared_memory::segment_manager> ShmemAllocator_mappoint;
+    typedef boost::interprocess::allocator<boost::interprocess::offset_ptr<MapPoint>, map_segment_manager> ShmemAllocator_mappoint;
     typedef boost::interprocess::vector<boost::interprocess::offset_ptr<MapPoint>, ShmemAllocator_mappoint> MyVector_mappoint;
 
-    typedef boost::interprocess::allocator<boost::interprocess::offset_ptr<KeyFrame>, boost::interprocess::managed_shared_memory::segment_manager> ShmemAllocator_keyframe;
+    typedef boost::interprocess::allocator<boost::interprocess::offset_ptr<KeyFrame>, map_segment_manager> ShmemAllocator_keyframe;
     typedef boost::interprocess::vector<boost::interprocess::offset_ptr<KeyFrame>, ShmemAllocator_keyframe> MyVector_keyframe;
 
 
-    typedef boost::interprocess::allocator<cv::KeyPoint, boost::interprocess::managed_shared_memory::segment_manager> ShmemAllocator_cv_keypoint;
+    typedef boost::interprocess::allocator<cv::KeyPoint, map_segment_manager> ShmemAllocator_cv_keypoint;
     typedef boost::interprocess::vector<cv::KeyPoint, ShmemAllocator_cv_keypoint> MyVector_CV;
 
-    typedef boost::interprocess::allocator<float,boost::interprocess::managed_shared_memory::segment_manager> ShmemAllocator_float;
+    typedef boost::interprocess::allocator<float,map_segment_manager> ShmemAllocator_float;
     typedef boost::interprocess::vector<float, ShmemAllocator_float> MyVector_float;
 
-    typedef boost::interprocess::allocator<int,boost::interprocess::managed_shared_memory::segment_manager> ShmemAllocator_int;
+    typedef boost::interprocess::allocator<int,map_segment_manager> ShmemAllocator_int;
     typedef boost::interprocess::vector<int, ShmemAllocator_int> MyVector_int;
 
-    //Aditya-Dhakal new matrix fixing function
-    void FixMatrices(boost::interprocess::offset_ptr<KeyFrame> pKF);
-    //new Bow Fixing function
-    void FixBow(boost::interprocess::offset_ptr<KeyFrame> pKF,ORBVocabulary* mpORBVocabulary2);
+    // Computes the BoW of pKF with pORBVocabulary, unless it was computed with a vocabulary of the same fingerprint
+    void FixBow(boost::interprocess::offset_ptr<KeyFrame> pKF,ORBVocabulary* pORBVocabulary);
 
 
     // The following variables are accesed from only 1 thread or never change (no mutex needed).
@@ -254,32 +259,15 @@ public:
 
 
     // Variables used by loop closing
-    cv::Mat mTcwGBA;
-    cv::Mat mTcwBefGBA;
-    cv::Mat mVwbGBA;
-    cv::Mat mVwbBefGBA;
-
-    // Their component void * functions
-    boost::interprocess::offset_ptr<char> mTcwGBA_ptr;
-    boost::interprocess::offset_ptr<char> mTcwBefGBA_ptr;
-    boost::interprocess::offset_ptr<char> mVwbGBA_ptr;
-    boost::interprocess::offset_ptr<char> mVwbBefGBA_ptr;
-     // matrices data pointers
-    boost::interprocess::offset_ptr<char> Tcw_ptr;
-    boost::interprocess::offset_ptr<char> Twc_ptr;
-    boost::interprocess::offset_ptr<char> Ow_ptr;
-    boost::interprocess::offset_ptr<char> Cw_ptr;
-    boost::interprocess::offset_ptr<char> Owb_ptr;
-    boost::interprocess::offset_ptr<char> Vw_ptr;
-
-    boost::interprocess::offset_ptr<char> mTcwMerge_ptr;
-    boost::interprocess::offset_ptr<char> mTcwBefMerge_ptr;
-    boost::interprocess::offset_ptr<char> mTwcBefMerge_ptr;
-    boost::interprocess::offset_ptr<char> mVwbMerge_ptr;
-    boost::interprocess::offset_ptr<char> mVwbBefMerge_ptr;
+    ShmMat<4,4> mTcwGBA;
+    ShmMat<4,4> mTcwBefGBA;
+    ShmMat<3,1> mVwbGBA;
+    ShmMat<3,1> mVwbBefGBA;
+
+    // Data of the variable size matrices, mK and mDescriptors are headers over them
     boost::interprocess::offset_ptr<char> mk_ptr;
 
-    //discriptor
+    //discriptor, one 32 byte aligned ORBDescriptor per keypoint
     boost::interprocess::offset_ptr<char> mDescriptors_ptr;
     
 
@@ -287,11 +275,11 @@ public:
     long unsigned int mnBAGlobalForKF;
 
     // Variables used by merging
-    cv::Mat mTcwMerge;
-    cv::Mat mTcwBefMerge;
-    cv::Mat mTwcBefMerge;
-    cv::Mat mVwbMerge;
-    cv::Mat mVwbBefMerge;
+    ShmMat<4,4> mTcwMerge;
+    ShmMat<4,4> mTcwBefMerge;
+    ShmMat<4,4> mTwcBefMerge;
+    ShmMat<3,1> mVwbMerge;
+    ShmMat<3,1> mVwbBefMerge;
     IMU::Bias mBiasMerge;
     long unsigned int mnMergeCorrectedForKF;
     long unsigned int mnMergeForKF;
@@ -334,13 +322,13 @@ public:
 
     //new templates for working with nested datastructures
     template <typename T>
-    using Alloc = boost::interprocess::allocator<T,  boost::interprocess::managed_shared_memory::segment_manager>;
+    using Alloc = boost::interprocess::allocator<T,  map_segment_manager>;
 
     template <typename T>
     using Vector = boost::container::vector<T, Alloc<T> >;
 
     template <typename T>
-    using Alloc_vec = boost::interprocess::allocator<Vector<T>,  boost::interprocess::managed_shared_memory::segment_manager>;
+    using Alloc_vec = boost::interprocess::allocator<Vector<T>,  map_segment_manager>;
 
     template <typename T>
     using Matrix_1 = Vector<Vector<T> >; 
@@ -354,38 +342,17 @@ public:
 
 
 
-    //BoW --changed for Aditya.
-    //DBoW2::BowVector mBowVec;
-    //DBoW2::FeatureVector mFeatVec;
-    DBoW2::BowVector mBowVec_actual;
-    DBoW2::FeatureVector mFeatVec_actual;
-
-
-
-    //BoW value holders
-    // Rather than changing the BoW library, we will hold the values in the shared memory.
-    // Recreate the BoWVector with these values when reading 
-    //we need different datastructure for maps
-    typedef std::pair<const unsigned int, double> ValueType_bow;
-    typedef boost::interprocess::allocator<ValueType_bow,boost::interprocess::managed_shared_memory::segment_manager> ShmemAllocator_bow;
-    typedef boost::interprocess::map<unsigned int,double,std::less<unsigned int >,ShmemAllocator_bow> bowMap;
-    boost::interprocess::offset_ptr<bowMap> mBowVec;
-
-    typedef boost::interprocess::allocator<unsigned int, boost::interprocess::managed_shared_memory::segment_manager> ShmemAllocator_vec_unsigned_int;
-    typedef boost::interprocess::vector<unsigned int, ShmemAllocator_vec_unsigned_int> MyVector_unsigned_int;
-    typedef std::pair<const unsigned int, Vector<unsigned int> > ValueType_feat;
-    typedef boost::interprocess::allocator<ValueType_feat,boost::interprocess::managed_shared_memory::segment_manager> ShmemAllocator_feat;
-    typedef boost::interprocess::map<unsigned int, Vector<unsigned int> ,std::less<unsigned int >,ShmemAllocator_feat> featMap;
-    boost::interprocess::offset_ptr<featMap> mFeatVec;
-
+    // BoW and feature vectors, in the map segment and tagged with the fingerprint of the vocabulary
+    // they were computed with
+    boost::interprocess::offset_ptr<SharedBowVector> mBowVec;
+    boost::interprocess::offset_ptr<SharedFeatureVector> mFeatVec;
 
-    static double score_KFDatabase_frame(const std::map<double,unsigned int> *v1, const boost::interprocess::offset_ptr<bowMap> v2);
-    static double score_KFDatabase_ptr(const boost::interprocess::offset_ptr<bowMap> v1, const boost::interprocess::offset_ptr<bowMap> v2);
+    static double score_KFDatabase_frame(const DBoW2::BowVector &v1, const SharedBowVector &v2);
+    static double score_KFDatabase_ptr(const SharedBowVector &v1, const SharedBowVector &v2);
 
 
     // Pose relative to parent (this is computed when bad flag is activated)
-    cv::Mat mTcp;
-    boost::interprocess::offset_ptr<char> mTcp_ptr;
+    ShmMat<4,4> mTcp;
 
     // Scale
     const int mnScaleLevels;
@@ -449,10 +416,10 @@ public:
 protected:
 
     // SE3 Pose and camera center
-    cv::Mat Tcw;
-    cv::Mat Twc;
-    cv::Mat Ow;
-    cv::Mat Cw; // Stereo middel point. Only for visualization
+    ShmMat<4,4> Tcw;
+    ShmMat<4,4> Twc;
+    ShmMat<3,1> Ow;
+    ShmMat<4,1> Cw; // Stereo middel point. Only for visualization
 
    
 
@@ -462,10 +429,10 @@ protected:
     cv::Matx31f Ow_;
 
     // IMU position
-    cv::Mat Owb;
+    ShmMat<3,1> Owb;
 
     // Velocity (Only used for inertial SLAM)
-    cv::Mat Vw;
+    ShmMat<3,1> Vw;
 
     // Imu bias
     IMU::Bias mImuBias;
@@ -488,7 +455,7 @@ protected:
     ORBVocabulary* mpORBvocabulary;
 
      //Typedefs of allocators and containers
-    typedef boost::interprocess::managed_shared_memory::segment_manager     segment_manager_t;
+    typedef map_segment_manager     segment_manager_t;
     //typedef boost::interprocess::allocator<void, segment_manager_t>         void_allocator;
     typedef boost::interprocess::allocator<size_t, segment_manager_t>       size_t_allocator;
     typedef boost::interprocess::vector<size_t, size_t_allocator>           size_t_vector;
@@ -512,7 +479,7 @@ protected:
 
     //we need different datastructure for maps
     typedef std::pair<const boost::interprocess::offset_ptr<KeyFrame>, int> ValueType;
-    typedef boost::interprocess::allocator<ValueType,boost::interprocess::managed_shared_memory::segment_manager> ShmemAllocator_map_keyframe;
+    typedef boost::interprocess::allocator<ValueType,map_segment_manager> ShmemAllocator_map_keyframe;
 
     //Maps and Vector.
     typedef boost::interprocess::map<boost::interprocess::offset_ptr<KeyFrame>,int,std::less<boost::interprocess::offset_ptr<KeyFrame> >,ShmemAllocator_map_keyframe> MyMap;
@@ -535,7 +502,7 @@ protected:
 
 
     //new code for Set.
-    typedef boost::interprocess::allocator<boost::interprocess::offset_ptr<KeyFrame>, boost::interprocess::managed_shared_memory::segment_manager> ShmemAllocator_keyframe_set;
+    typedef boost::interprocess::allocator<boost::interprocess::offset_ptr<KeyFrame>, map_segment_manager> ShmemAllocator_keyframe_set;
     typedef boost::interprocess::set<boost::interprocess::offset_ptr<KeyFrame>, std::less<boost::interprocess::offset_ptr<KeyFrame> >,ShmemAllocator_keyframe_set> Myset_keyframe;
 
     // Spanning Tree and Loop Edges
@@ -34,6 +34,7 @@
 #include <boost/serialization/list.hpp>
 
 #include<mutex>
+#include<shared_mutex>
 
 
 namespace ORB_SLAM3
@@ -77,11 +78,29 @@ protected:
   // Associated vocabulary
   const ORBVocabulary* mpVoc;
 
-  // Inverted file
-  std::vector<list<boost::interprocess::offset_ptr<KeyFrame> > > mvInvertedFile;
-
-  // Mutex
-  std::mutex mMutex;
+  // Calls f(pKFi) for every keyframe in the posting lists of vWordIds, holding the lock of each list
+  template<class F>
+  void ForEachKeyFrameSharingWords(const std::vector<unsigned int> &vWordIds, F f);
+
+  // Inverted file. The posting list of each word is contiguous.
+  std::vector<std::vector<boost::interprocess::offset_ptr<KeyFrame> > > mvInvertedFile;
+
+  // The posting lists are guarded by striped locks, the list of word w by the stripe w % NUM_STRIPES.
+  // Queries share them and only an insertion or removal on the same stripe blocks them.
+  static const int NUM_STRIPES = 64;
+  struct alignas(64) Stripe
+  {
+      std::shared_mutex mMutex;
+  };
+  Stripe mStripes[NUM_STRIPES];
+
+  std::shared_mutex& GetStripeMutex(unsigned int wordId){
+      return mStripes[wordId % NUM_STRIPES].mMutex;
+  }
+
+  // Locks every stripe, for the operations that touch the whole inverted file
+  void LockAllStripes();
+  void UnlockAllStripes();
 };
 
 } //namespace ORB_SLAM
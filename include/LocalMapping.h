@@ -106,6 +106,9 @@ public:
     bool mbFarPoints;
     float mThFarPoints;
 
+    // Threads of the local bundle adjustments
+    int mnBAThreads;
+
 #ifdef REGISTER_TIMES
     vector<double> vdKFInsert_ms;
     vector<double> vdMPCulling_ms;
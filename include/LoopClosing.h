@@ -28,6 +28,7 @@
 #include "Config.h"
 
 #include "KeyFrameDatabase.h"
+#include "ThreadPool.h"
 
 #include <boost/algorithm/string.hpp>
 #include <thread>
@@ -54,11 +55,16 @@ public:
 public:
 
     LoopClosing(Atlas* pAtlas, KeyFrameDatabase* pDB, ORBVocabulary* pVoc,const bool bFixScale);
+    ~LoopClosing();
 
     void SetTracker(Tracking* pTracker);
 
     void SetLocalMapper(LocalMapping* pLocalMapper);
 
+    // Threads correcting the keyframes and points of a loop or a merge, the loop closing thread included.
+    // With 1 (the default) they are corrected sequentially. To be set before Run.
+    void SetNumThreads(int nThreads);
+
     // Main function
     void Run();
 
@@ -67,8 +73,25 @@ public:
     void RequestReset();
     void RequestResetActiveMap(boost::interprocess::offset_ptr<Map>  pMap);
 
-    // This function will run in a separate thread
-    void RunGlobalBundleAdjustment(boost::interprocess::offset_ptr<Map>  pActiveMap, unsigned long nLoopKF);
+    // This function will run in a separate thread. In incremental mode only the neighbourhood of vpSeedKFs,
+    // the keyframes of the new constraints, is optimized.
+    void RunGlobalBundleAdjustment(boost::interprocess::offset_ptr<Map>  pActiveMap, unsigned long nLoopKF,
+                                   std::vector<boost::interprocess::offset_ptr<KeyFrame> > vpSeedKFs = std::vector<boost::interprocess::offset_ptr<KeyFrame> >());
+
+    // Progress of the running (or last) visual GBA. The ETA is extrapolated from the time of the chunks done.
+    struct GBAProgress
+    {
+        int nIteration;
+        int nIterations;
+        double chi2;
+        double etaSeconds;
+        int nCommits;
+        bool bRunning;
+    };
+    GBAProgress GetGBAProgress(){
+        std::unique_lock<std::mutex> lock(mMutexGBA);
+        return mGBAProgress;
+    }
 
     bool isRunningGBA(){
         std::unique_lock<std::mutex> lock(mMutexGBA);
@@ -85,6 +108,15 @@ public:
 
     Viewer* mpViewer;
 
+    // Covisibility levels around the new constraints optimized by the visual GBA, 0 for the whole map
+    int mnIncrementalGBALevels;
+
+    // Iterations of the visual GBA between commits of its estimate to the map, 0 commits only at the end
+    int mnGBAChunkIterations;
+
+    // Time budget in ms of the geometric verification of the place recognition candidates of a keyframe, 0 for none
+    int mnVerificationTimeMs;
+
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
 #ifdef REGISTER_TIMES
@@ -94,12 +126,15 @@ public:
     std::vector<double> vTimeSE3_ms;
     std::vector<double> vTimePRTotal_ms;
 
+    std::vector<double> vTimeLoopCorrection_ms;
     std::vector<double> vTimeLoopFusion_ms;
     std::vector<double> vTimeLoopEssent_ms;
     std::vector<double> vTimeLoopTotal_ms;
 
+    std::vector<double> vTimeMergeCorrection_ms;
     std::vector<double> vTimeMergeFusion_ms;
     std::vector<double> vTimeMergeBA_ms;
+    std::vector<double> vTimeMergeMapUpdate_ms;
     std::vector<double> vTimeMergeTotal_ms;
 
     std::vector<double> vTimeFullGBA_ms;
@@ -111,6 +146,10 @@ protected:
 
     bool CheckNewKeyFrames();
 
+    // Runs f(i) for every i in [begin, end) on the pool, or sequentially without it
+    void ParallelFor(int begin, int end, const std::function<void(int)> &f);
+    ThreadPool* mpThreadPool;
+
 
     //Methods to implement the new place recognition algorithm
     bool NewDetectCommonRegions();
@@ -120,6 +159,23 @@ protected:
                                      int &nNumCoincidences, std::vector<boost::interprocess::offset_ptr<MapPoint> > &vpMPs, std::vector<boost::interprocess::offset_ptr<MapPoint> > &vpMatchedMPs);
     bool DetectCommonRegionsFromLastKF(boost::interprocess::offset_ptr<KeyFrame>  pCurrentKF, boost::interprocess::offset_ptr<KeyFrame>  pMatchedKF, g2o::Sim3 &gScw, int &nNumProjMatches,
                                             std::vector<boost::interprocess::offset_ptr<MapPoint> > &vpMPs, std::vector<boost::interprocess::offset_ptr<MapPoint> > &vpMatchedMPs);
+    // Geometric verification of a single BoW candidate. candidate keeps no matches if it is rejected or
+    // isCancelled() becomes true before it is done.
+    struct BoWCandidate
+    {
+        BoWCandidate():nMatchesReproj(0),nNumCoincidences(0){}
+
+        int nMatchesReproj;
+        int nNumCoincidences;
+        boost::interprocess::offset_ptr<KeyFrame>  pMatchedKF;
+        g2o::Sim3 g2oScw;
+        std::vector<boost::interprocess::offset_ptr<MapPoint> > vpMapPoints;
+        std::vector<boost::interprocess::offset_ptr<MapPoint> > vpMatchedMPs;
+
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    };
+    void VerifyBoWCandidate(boost::interprocess::offset_ptr<KeyFrame>  pKFi, const set<boost::interprocess::offset_ptr<KeyFrame> > &spConnectedKeyFrames,
+                            const std::function<bool()> &isCancelled, BoWCandidate &candidate);
     int FindMatchesByProjection(boost::interprocess::offset_ptr<KeyFrame>  pCurrentKF, boost::interprocess::offset_ptr<KeyFrame>  pMatchedKFw, g2o::Sim3 &g2oScw,
                                 set<boost::interprocess::offset_ptr<MapPoint> > &spMatchedMPinOrigin, vector<boost::interprocess::offset_ptr<MapPoint> > &vpMapPoints,
                                 vector<boost::interprocess::offset_ptr<MapPoint> > &vpMatchedMapPoints);
@@ -207,12 +263,29 @@ protected:
     bool mbStopGBA;
     std::mutex mMutexGBA;
     std::thread* mpThreadGBA;
+    GBAProgress mGBAProgress;
+
+    // Seeds of the running GBA, and of those aborted by a new loop or merge, which are added to the next one on
+    // the same map so that it resumes their optimization
+    boost::interprocess::offset_ptr<Map> mpGBAMap;
+    std::vector<boost::interprocess::offset_ptr<KeyFrame> > mvpGBASeedKFs;
+    boost::interprocess::offset_ptr<Map> mpInterruptedGBAMap;
+    std::vector<boost::interprocess::offset_ptr<KeyFrame> > mvpInterruptedGBASeedKFs;
+
+    // Called with mMutexGBA locked when the running GBA is aborted
+    void InterruptGlobalBundleAdjustment();
+
+    // Updates the map with the estimate of the GBA, propagating it through the spanning tree to the keyframes
+    // and points created meanwhile. Intermediate commits leave the propagated keyframes ready for the next one.
+    // Called with mMutexGBA locked.
+    void CommitGlobalBundleAdjustment(boost::interprocess::offset_ptr<Map>  pActiveMap, unsigned long nLoopKF, bool bFinal);
 
     // Fix scale in the stereo/RGB-D case
     bool mbFixScale;
 
 
-    bool mnFullBAIdx;
+    // Changed each time a GBA is aborted, so that it does not commit anything afterwards
+    int mnFullBAIdx;
 
 
 
@@ -34,6 +34,7 @@
 #include <boost/interprocess/containers/set.hpp>
 #include <boost/interprocess/allocators/allocator.hpp>
 #include <boost/interprocess/managed_shared_memory.hpp>
+#include "MapSegment.h"
 #include <boost/serialization/base_object.hpp>
 
 //using namespace boost::interprocess;
@@ -117,7 +118,7 @@ public:
     int sum_of_two();
 
     //create your own vector!
-    typedef boost::interprocess::allocator<boost::interprocess::offset_ptr<KeyFrame>, boost::interprocess::managed_shared_memory::segment_manager> ShmemAllocator; 
+    typedef boost::interprocess::allocator<boost::interprocess::offset_ptr<KeyFrame>, map_segment_manager> ShmemAllocator; 
     //typedef vector
     typedef vector<boost::interprocess::offset_ptr<KeyFrame>, ShmemAllocator> MyVector;
     //changed the vector //old code
@@ -129,7 +130,7 @@ public:
 
     //old code
     //vector<unsigned long int> mvBackupKeyFrameOriginsId;
-    typedef boost::interprocess::allocator<unsigned long int, boost::interprocess::managed_shared_memory::segment_manager> ShmemAllocator_longint; 
+    typedef boost::interprocess::allocator<unsigned long int, map_segment_manager> ShmemAllocator_longint; 
     typedef vector<unsigned long int, ShmemAllocator_longint> MyVector_longint;
     MyVector_longint *mvBackupKeyFrameOriginsId;
     
@@ -155,7 +156,7 @@ public:
 
     //for managed shared memory
     //boost::interprocess::fixed_managed_shared_memory *segment;
-    boost::interprocess::managed_shared_memory *segment;
+    managed_map_segment *segment;
 
     //bool mbBad = false;
 
@@ -169,7 +170,7 @@ boost::interprocess::offset_ptr<std::mutex> mMutexMapPtr;
  int b;
 
  //create your own vector!
-    typedef boost::interprocess::allocator<boost::interprocess::offset_ptr<MapPoint>, boost::interprocess::managed_shared_memory::segment_manager> ShmemAllocator_mappoint; 
+    typedef boost::interprocess::allocator<boost::interprocess::offset_ptr<MapPoint>, map_segment_manager> ShmemAllocator_mappoint; 
     //typedef vector
     typedef vector<boost::interprocess::offset_ptr<MapPoint>, ShmemAllocator_mappoint> MyVector_mappoint;
 
@@ -180,12 +181,12 @@ protected:
     long unsigned int mnId;
 
     //new code for Set -mappoints 
-    typedef boost::interprocess::allocator<boost::interprocess::offset_ptr<MapPoint>, boost::interprocess::managed_shared_memory::segment_manager> ShmemAllocator_mappoint_set;
+    typedef boost::interprocess::allocator<boost::interprocess::offset_ptr<MapPoint>, map_segment_manager> ShmemAllocator_mappoint_set;
     typedef boost::interprocess::set<boost::interprocess::offset_ptr<MapPoint>, std::less<boost::interprocess::offset_ptr<MapPoint> >,ShmemAllocator_mappoint_set> Myset_mappoint;
 
 
     //new code for Set.
-    typedef boost::interprocess::allocator<boost::interprocess::offset_ptr<KeyFrame>, boost::interprocess::managed_shared_memory::segment_manager> ShmemAllocator_keyframe_set;
+    typedef boost::interprocess::allocator<boost::interprocess::offset_ptr<KeyFrame>, map_segment_manager> ShmemAllocator_keyframe_set;
     typedef boost::interprocess::set<boost::interprocess::offset_ptr<KeyFrame>, std::less<boost::interprocess::offset_ptr<KeyFrame> >,ShmemAllocator_keyframe_set> Myset_keyframe;
 
     // Old-code
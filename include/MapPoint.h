@@ -23,6 +23,9 @@
 #include"KeyFrame.h"
 #include"Frame.h"
 #include"Map.h"
+#include"MapSegment.h"
+#include"ShmMat.h"
+#include"ORBDescriptor.h"
 
 
 #include<opencv2/core/core.hpp>
@@ -87,9 +90,10 @@ public:
     void ComputeDistinctiveDescriptors();
 
     cv::Mat GetDescriptor();
+    ORBDescriptor GetDescriptor256();
 
     void UpdateNormalAndDepth();
-    void SetNormalVector(cv::Mat& normal);
+    void SetNormalVector(const cv::Mat& normal);
 
     float GetMinDistanceInvariance();
     float GetMaxDistanceInvariance();
@@ -98,7 +102,6 @@ public:
 
     boost::interprocess::offset_ptr<Map>  GetMap();
     void UpdateMap(boost::interprocess::offset_ptr<Map>  pMap);
-    void FixMatrices();
 
 
 
@@ -130,13 +133,13 @@ public:
     long unsigned int mnLoopPointForKF;
     long unsigned int mnCorrectedByKF;
     long unsigned int mnCorrectedReference;    
-    cv::Mat mPosGBA;
+    ShmMat<3,1> mPosGBA;
     long unsigned int mnBAGlobalForKF;
     long unsigned int mnBALocalForMerge;
 
     // Variable used by merging
-    cv::Mat mPosMerge;
-    cv::Mat mNormalVectorMerge;
+    ShmMat<3,1> mPosMerge;
+    ShmMat<3,1> mNormalVectorMerge;
 
 
 
@@ -151,29 +154,16 @@ public:
     unsigned int mnOriginMapId;
 
 
-    // all the matrix variable addresses.
-    boost::interprocess::offset_ptr<char> mPosGBA_ptr;
-    boost::interprocess::offset_ptr<char> mPosMerge_ptr;
-    boost::interprocess::offset_ptr<char> mNormalVectorMerge_ptr;
-
-    // For the absolute coordinates
-    boost::interprocess::offset_ptr<char> mWorldPos_ptr;
-    boost::interprocess::offset_ptr<char> mWorldPosx_ptr;
-
-    boost::interprocess::offset_ptr<char> mNormalVector_ptr;
-    boost::interprocess::offset_ptr<char> mNormalVectorx_ptr;
-    boost::interprocess::offset_ptr<char> mDescriptor_ptr;
-
     //we need different datastructure for maps
     typedef std::pair<const boost::interprocess::offset_ptr<KeyFrame>, std::tuple<int,int> > ValueType;
-    typedef boost::interprocess::allocator<ValueType,boost::interprocess::managed_shared_memory::segment_manager> ShmemAllocator_observation;
+    typedef boost::interprocess::allocator<ValueType,map_segment_manager> ShmemAllocator_observation;
     //observations map
     typedef boost::interprocess::map<boost::interprocess::offset_ptr<KeyFrame>,std::tuple<int,int>,std::less<boost::interprocess::offset_ptr<KeyFrame> >,ShmemAllocator_observation> Observe_map;
 
 protected:    
 
      // Position in absolute coordinates
-     cv::Mat mWorldPos;
+     ShmMat<3,1> mWorldPos;
      cv::Matx31f mWorldPosx;
 
      // Keyframes observing the point and associated index in keyframe
@@ -183,11 +173,11 @@ protected:
      boost::interprocess::offset_ptr<Observe_map> mObservations;
 
      // Mean viewing direction
-     cv::Mat mNormalVector;
+     ShmMat<3,1> mNormalVector;
      cv::Matx31f mNormalVectorx;
 
      // Best descriptor to fast matching
-     cv::Mat mDescriptor;
+     ShmMat<1,32,uchar> mDescriptor;
 
      // Reference KeyFrame
      boost::interprocess::offset_ptr<KeyFrame>  mpRefKF;
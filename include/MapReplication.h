@@ -0,0 +1,183 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2020 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MAPREPLICATION_H
+#define MAPREPLICATION_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/interprocess/sync/named_mutex.hpp>
+
+#include "MapSegment.h"
+
+namespace ORB_SLAM3
+{
+
+// Replication of a client segment over TCP. Keyframes, map points and the pose graph are stored in the segment of
+// the client with offset pointers and absolute addresses inside it, so a byte copy mapped at the same address is a
+// complete map that the merge server reads like the segment of a local client. The client streams the pages that
+// changed since the last batch, and the server writes them into a replica with the name of the client segment.
+//
+// Every frame is a FrameHeader followed by payloadBytes of payload, in the byte order of the hosts. Both ends must
+// share the architecture anyway, the pages hold the objects as the client laid them out.
+namespace Replication
+{
+
+const uint32_t MAGIC = 0x52424f4d;  // "MORB"
+const uint16_t VERSION = 1;
+const uint32_t PAGE_SIZE = 4096;
+
+// Largest payload of a frame. Runs of changed pages are split to fit.
+const uint32_t MAX_PAYLOAD = 1024*1024;
+
+// Longest wait for a moment without background units on the client, and then for its tracked frame, before a
+// batch is skipped. The tracking is not held back during the first wait.
+const int PAUSE_TIMEOUT_MS = 1000;
+
+enum FrameType
+{
+    // Payload: SegmentInfo. Starts a new replica, the pages of every batch that follows belong to it.
+    HELLO = 1,
+    // Offset: segment offset of the first page. Payload: consecutive pages.
+    PAGES = 2,
+    // Offset: size of the segment. Ends a batch, the server applies its pages at once.
+    COMMIT = 3
+};
+
+struct FrameHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t type;
+    int32_t clientId;
+    uint32_t payloadBytes;
+    // Frames of a connection are numbered from 0
+    uint64_t sequence;
+    uint64_t offset;
+};
+static_assert(sizeof(FrameHeader) == 32, "FrameHeader must not have padding");
+
+struct SegmentInfo
+{
+    uint64_t baseAddress;
+    uint64_t maxSize;
+    uint32_t pageSize;
+    uint32_t reserved;
+};
+static_assert(sizeof(SegmentInfo) == 24, "SegmentInfo must not have padding");
+
+// Named lock of the replica of a segment, taken on construction. The server holds it while it applies a batch and
+// the merge server while it reads the maps of the replica, which therefore never shows half of a batch. Throws
+// boost::interprocess::interprocess_exception if the lock can not be created.
+class ReplicaLock
+{
+public:
+    explicit ReplicaLock(const std::string &segmentName);
+    ~ReplicaLock();
+
+    // Removes the lock of a replica that is not used anymore
+    static void Remove(const std::string &segmentName);
+
+private:
+    boost::interprocess::named_mutex mMutex;
+};
+
+} //namespace Replication
+
+// Client side. Run() sends a batch every period: the pages whose hash changed since they were last sent, followed
+// by a COMMIT. It reconnects if the server goes away, and then sends the whole segment again. The writers of the
+// segment are paused while the batch is copied (MapSegment::PauseWriters), the pages are hashed and sent afterwards.
+// The kernel tracks the pages written since the last batch (soft-dirty bits), so only those are copied while the
+// writers wait. Without that tracking every resident page is hashed in the pause instead.
+class MapReplicator
+{
+public:
+    // strServer is "host:port"
+    MapReplicator(MapSegment* pSegment, const std::string &strServer, int periodMs);
+    ~MapReplicator();
+
+    // Main function
+    void Run();
+
+    // Sends one batch. False if the server could not be reached or the writers could not be paused.
+    bool Replicate();
+
+    void RequestFinish();
+    bool isFinished();
+
+protected:
+
+    bool Connect();
+    void Disconnect();
+    bool SendFrame(uint16_t type, uint64_t offset, const void* pPayload, uint32_t payloadBytes);
+
+    // Residency of the system pages of the segment in mvResident, all resident if it can not be read
+    void ReadResidency(const char* pBase, std::size_t size);
+    // Copies a page into the batch, over its previous copy if it has one
+    void CopyPage(const char* pBase, std::size_t size, std::size_t page);
+    // Copies the resident pages written since the soft-dirty bits were cleared. False if they can not be read.
+    bool CopyDirtyPages(const char* pBase, std::size_t size);
+    // Copies the resident pages whose hash differs from the one last sent
+    void CopyChangedPages(const char* pBase, std::size_t size);
+
+    bool CheckFinish();
+    void SetFinish();
+
+    MapSegment* mpSegment;
+    std::string mStrHost;
+    std::string mStrPort;
+    int mnPeriodMs;
+
+    boost::asio::io_context mIoContext;
+    std::unique_ptr<boost::asio::ip::tcp::socket> mpSocket;
+    uint64_t mnSequence;
+
+    // Hash of every page as it was last sent, 0 if it was not
+    std::vector<uint64_t> mvPageHashes;
+    std::vector<unsigned char> mvResident;
+
+    // /proc/self/pagemap, and whether the kernel sets the soft-dirty bits
+    int mnPagemapFd;
+    bool mbSoftDirty;
+    std::vector<uint64_t> mvPagemap;
+
+    // Copies of the pages of the batch, and the slot of every page in mvBatch (0xFFFFFFFF if it is not in the batch)
+    std::vector<char> mvBatch;
+    std::vector<uint32_t> mvSlots;
+    // The next batch holds every resident page, the server starts a new replica
+    bool mbSendAll;
+
+    unsigned long mnBatches;
+    unsigned long mnBatchesSkipped;
+    unsigned long mnPagesSent;
+    bool mbUnreachableReported;
+
+    bool mbFinishRequested;
+    bool mbFinished;
+    std::mutex mMutexFinish;
+};
+
+} //namespace ORB_SLAM3
+
+#endif // MAPREPLICATION_H
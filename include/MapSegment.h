@@ -0,0 +1,348 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2020 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef MAPSEGMENT_H
+#define MAPSEGMENT_H
+
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <utility>
+#include <new>
+#include <opencv2/core/core.hpp>
+
+#include <boost/interprocess/managed_shared_memory.hpp>
+#include <boost/interprocess/managed_external_buffer.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/offset_ptr.hpp>
+#include <boost/interprocess/mem_algo/rbtree_best_fit.hpp>
+#include <boost/interprocess/sync/mutex_family.hpp>
+#include <boost/interprocess/sync/interprocess_mutex.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+
+namespace ORB_SLAM3
+{
+
+// Best-fit allocation of the map segment. rbtree_best_fit::grow does not take the allocation lock and the
+// lock is private, so the base algorithm runs unlocked and every entry point takes the lock kept here,
+// grow included. The lock lives in the segment, next to the algorithm, and is shared by all the processes.
+class map_segment_algorithm : public boost::interprocess::rbtree_best_fit<boost::interprocess::null_mutex_family>
+{
+    typedef boost::interprocess::rbtree_best_fit<boost::interprocess::null_mutex_family> base_t;
+    typedef boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock_t;
+
+public:
+    // Family of the named object index of the segment manager
+    typedef boost::interprocess::mutex_family mutex_family;
+    typedef base_t::size_type size_type;
+    typedef base_t::multiallocation_chain multiallocation_chain;
+
+    // The lock is placed after the base algorithm, so it is part of the header the base must not allocate
+    map_segment_algorithm(size_type size, size_type extra_hdr_bytes):
+        base_t(size, extra_hdr_bytes + sizeof(map_segment_algorithm) - sizeof(base_t)) {}
+
+    static size_type get_min_size(size_type extra_hdr_bytes)
+    {
+        return base_t::get_min_size(extra_hdr_bytes + sizeof(map_segment_algorithm) - sizeof(base_t));
+    }
+
+    void* allocate(size_type nbytes)
+    {
+        lock_t guard(mMutex);
+        return base_t::allocate(nbytes);
+    }
+
+    void* allocate_aligned(size_type nbytes, size_type alignment)
+    {
+        lock_t guard(mMutex);
+        return base_t::allocate_aligned(nbytes, alignment);
+    }
+
+    void allocate_many(size_type elem_bytes, size_type num_elements, multiallocation_chain &chain)
+    {
+        lock_t guard(mMutex);
+        base_t::allocate_many(elem_bytes, num_elements, chain);
+    }
+
+    void allocate_many(const size_type *elem_sizes, size_type n_elements, size_type sizeof_element,
+                       multiallocation_chain &chain)
+    {
+        lock_t guard(mMutex);
+        base_t::allocate_many(elem_sizes, n_elements, sizeof_element, chain);
+    }
+
+    void deallocate_many(multiallocation_chain &chain)
+    {
+        lock_t guard(mMutex);
+        base_t::deallocate_many(chain);
+    }
+
+    void deallocate(void *addr)
+    {
+        lock_t guard(mMutex);
+        base_t::deallocate(addr);
+    }
+
+    template<class T>
+    T* allocation_command(boost::interprocess::allocation_type command, size_type limit_size,
+                          size_type &prefer_in_recvd_out_size, T *&reuse)
+    {
+        lock_t guard(mMutex);
+        return base_t::allocation_command(command, limit_size, prefer_in_recvd_out_size, reuse);
+    }
+
+    void* raw_allocation_command(boost::interprocess::allocation_type command, size_type limit_object,
+                                 size_type &prefer_in_recvd_out_size, void *&reuse_ptr, size_type sizeof_object = 1)
+    {
+        lock_t guard(mMutex);
+        return base_t::raw_allocation_command(command, limit_object, prefer_in_recvd_out_size, reuse_ptr, sizeof_object);
+    }
+
+    void grow(size_type extra_size)
+    {
+        lock_t guard(mMutex);
+        base_t::grow(extra_size);
+    }
+
+    void shrink_to_fit()
+    {
+        lock_t guard(mMutex);
+        base_t::shrink_to_fit();
+    }
+
+    void zero_free_memory()
+    {
+        lock_t guard(mMutex);
+        base_t::zero_free_memory();
+    }
+
+    bool all_memory_deallocated()
+    {
+        lock_t guard(mMutex);
+        return base_t::all_memory_deallocated();
+    }
+
+    bool check_sanity()
+    {
+        lock_t guard(mMutex);
+        return base_t::check_sanity();
+    }
+
+private:
+    boost::interprocess::interprocess_mutex mMutex;
+};
+
+// Managed memory laid over a shared memory object that we map ourselves, with the index of
+// managed_shared_memory. Containers placed in the segment declare their allocators with map_segment_manager.
+typedef boost::interprocess::basic_managed_external_buffer<char, map_segment_algorithm,
+        boost::interprocess::iset_index> managed_map_segment;
+typedef managed_map_segment::segment_manager map_segment_manager;
+
+class MapSegment
+{
+public:
+    struct Settings
+    {
+        Settings();
+
+        // Name of the shared memory object
+        std::string name;
+        // Name given in the settings file, the client and server names are made from it
+        std::string baseName;
+        // Bytes managed when the segment is created
+        std::size_t size;
+        // Address space reserved for the segment. It can never grow past this size.
+        std::size_t maxSize;
+        // Bytes added on every growth and free bytes that trigger it
+        std::size_t growStep;
+        std::size_t growThreshold;
+        // Bytes every thread takes from the segment at once to place small objects, 0 disables the slabs
+        std::size_t slabSize;
+        // Objects in the segment hold absolute pointers (cv::Mat data), so every process maps it here
+        void* baseAddress;
+
+        // Client that owns the segment, -1 for a single segment shared by all the processes
+        int clientId;
+        // The merge server owns its own segment and opens the client segments read-only
+        bool bMergeServer;
+        int nClients;
+
+        // Name and base address of the segment owned by a client (or the merge server). Every client gets
+        // its own slot of maxSize bytes after the base address, so a process can map several of them at once.
+        Settings ForClient(int id) const;
+        Settings ForServer() const;
+    };
+
+    MapSegment();
+    ~MapSegment();
+
+    // Reads the SharedMemory.* entries of the settings file. Missing entries keep their default value.
+    static Settings ReadSettings(cv::FileStorage &fSettings);
+
+    // Creates the segment (or opens it if another process already created it) and maps it at the base address.
+    bool Open(const Settings &settings);
+    // Maps a segment created by another process without ever writing to it. The mapping is copy-on-write:
+    // the mutexes embedded in keyframes and maps can still be taken and headers fixed, but the changes
+    // stay in this process.
+    bool OpenReadOnly(const Settings &settings);
+    void Close();
+    bool IsOpen() const;
+    bool IsReadOnly() const;
+
+    // Named object lookup. Read-only segments are searched without taking the index lock,
+    // which belongs to the process that owns the segment.
+    template<class T>
+    T* Find(const char* name)
+    {
+        if(mbReadOnly)
+            return mManaged.find_no_lock<T>(name).first;
+        return mManaged.find<T>(name).first;
+    }
+
+    // Adds extraBytes at the end of the segment. The mapping already spans maxSize, so nothing is
+    // remapped and every pointer into the segment stays valid in all the processes that use it.
+    bool Grow(std::size_t extraBytes);
+
+    // Grows the segment by growStep if less than growThreshold bytes are free. Returns true if it grew.
+    // Every allocation made through this class checks it first.
+    bool CheckGrowth();
+
+    // Raw buffer for matrix data. Applies the growth policy before allocating. The default alignment
+    // is the one of the segment allocator, alignment must be a power of two.
+    boost::interprocess::offset_ptr<char> Allocate(std::size_t bytes, std::size_t alignment = 2*sizeof(void*));
+
+    // Anonymous object in the segment, like construct<T>(anonymous_instance). Objects made here are never
+    // destroyed, so small ones are carved out of a slab owned by the calling thread and the allocation lock
+    // of the segment is only taken when the slab runs out. Objects that are freed later are made with
+    // ConstructTemporary.
+    template<class T, class... Args>
+    T* Construct(Args&&... args)
+    {
+        void* ptr = AllocateFromSlab(sizeof(T), alignof(T));
+        if(!ptr)
+        {
+            CheckGrowth();
+            return mManaged.construct<T>(boost::interprocess::anonymous_instance)(std::forward<Args>(args)...);
+        }
+        return new(ptr) T(std::forward<Args>(args)...);
+    }
+
+    // Anonymous object taken from the segment allocator, never from a slab, so that Destroy() can free it
+    template<class T, class... Args>
+    T* ConstructTemporary(Args&&... args)
+    {
+        CheckGrowth();
+        return mManaged.construct<T>(boost::interprocess::anonymous_instance)(std::forward<Args>(args)...);
+    }
+
+    // Destroys an object made with ConstructTemporary and frees its memory
+    template<class T>
+    void Destroy(T* ptr)
+    {
+        mManaged.destroy_ptr(ptr);
+    }
+
+    // Named object, created if it does not exist yet
+    template<class T, class... Args>
+    T* FindOrConstruct(const char* name, Args&&... args)
+    {
+        CheckGrowth();
+        return mManaged.find_or_construct<T>(name)(std::forward<Args>(args)...);
+    }
+
+    // The threads that write the segment run their work in units, each one inside a WriteScope. Scopes of the same
+    // thread nest, the outermost one gives the kind of the unit.
+    enum WriteUnit
+    {
+        // A tracked frame. It is short, and the tracking must not wait for the long units of the other threads.
+        FRAME_UNIT,
+        // A keyframe of the local mapping, a loop closure, the commit of a global bundle adjustment
+        BACKGROUND_UNIT
+    };
+
+    class WriteScope
+    {
+    public:
+        explicit WriteScope(MapSegment &segment, WriteUnit unit = BACKGROUND_UNIT);
+        ~WriteScope();
+
+    private:
+        MapSegment &mSegment;
+        WriteUnit mUnit;
+    };
+
+    // Holds the writers back until ResumeWriters(), so that a copy of the segment taken in between is consistent.
+    // It first waits for a moment when no background unit runs, without holding anything back, and then for the
+    // frame being tracked. False if either wait takes more than timeoutMs, the writers are then running again.
+    bool PauseWriters(int timeoutMs);
+    void ResumeWriters();
+
+    std::size_t GetSize() const;
+    std::size_t GetFreeBytes() const;
+    std::size_t GetUsedBytes() const;
+    std::size_t GetReservedBytes() const;
+
+    void PrintUsage() const;
+
+    const Settings& GetSettings() const;
+    managed_map_segment& GetManaged();
+
+protected:
+
+    bool MapRegion(const Settings &settings, bool bReadOnly);
+    bool GrowLocked(std::size_t extraBytes);
+
+    // Null if the request does not fit in a slab, the caller then uses the segment allocator
+    void* AllocateFromSlab(std::size_t bytes, std::size_t alignment);
+
+    void BeginWrite(WriteUnit unit);
+    void EndWrite(WriteUnit unit);
+
+    Settings mSettings;
+    bool mbReadOnly;
+
+    boost::interprocess::shared_memory_object mShm;
+    boost::interprocess::mapped_region mRegion;
+    managed_map_segment mManaged;
+
+    // Serializes the growth of the segment among the threads of every process that writes to it
+    boost::interprocess::interprocess_mutex* mpMutexGrow;
+
+    // Identifies the current mapping, slabs taken from a previous one are dropped
+    unsigned long mnMapping;
+    std::atomic<unsigned long> mnSlabs;
+    std::atomic<unsigned long> mnSlabObjects;
+
+    // Units of work running and whether new ones are held back, see WriteScope
+    std::mutex mMutexWriters;
+    std::condition_variable mCondWriters;
+    int mnFrameWriters;
+    int mnBackgroundWriters;
+    bool mbWritersPaused;
+};
+
+// Segment that holds the maps of this process
+extern MapSegment map_segment;
+extern managed_map_segment &segment;
+
+} //namespace ORB_SLAM3
+
+#endif // MAPSEGMENT_H
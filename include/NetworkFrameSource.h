@@ -0,0 +1,126 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2020 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NETWORKFRAMESOURCE_H
+#define NETWORKFRAMESOURCE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+
+#include <opencv2/core/core.hpp>
+
+namespace ORB_SLAM3
+{
+
+// Frames sent by a camera over TCP. Each frame is a FrameHeader followed by payloadBytes of payload: the pixels
+// (RAW) or an image file in memory (ENCODED, e.g. a JPEG or a PNG). The payloads are read straight into a ring of
+// buffers allocated once, and Next() gives the frame as a cv::Mat over its buffer (RAW) or decodes it into a
+// matrix of the slot that is reused for the next frames of the same size. Nothing goes through the filesystem.
+//
+// If the frames arrive faster than they are tracked the oldest queued one is dropped, so the tracker always gets
+// the most recent frames.
+class NetworkFrameSource
+{
+public:
+    enum Encoding
+    {
+        RAW = 0,
+        ENCODED = 1
+    };
+
+    struct FrameHeader
+    {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t encoding;
+        int32_t rows;
+        int32_t cols;
+        int32_t type;
+        uint32_t payloadBytes;
+        double timestamp;
+    };
+    static_assert(sizeof(FrameHeader) == 32, "FrameHeader must not have padding");
+
+    static const uint32_t MAGIC = 0x4d415246;  // "FRAM"
+    static const uint16_t VERSION = 1;
+    // Largest rows and cols of a RAW frame
+    static const int32_t MAX_DIMENSION = 16384;
+
+    // Listens on port for one camera. nSlots buffers of maxFrameBytes are allocated, at least 3: one for the frame
+    // being tracked, one for the frame being received and one queued.
+    NetworkFrameSource(unsigned short port, int nSlots = 4, std::size_t maxFrameBytes = 8*1024*1024);
+    ~NetworkFrameSource();
+
+    // Waits for the next frame. The image is valid until the next call. False once the camera has disconnected
+    // and every frame it sent has been returned.
+    bool Next(cv::Mat &im, double &timestamp);
+
+    // Frames dropped because the ring was full
+    unsigned long GetDroppedFrames();
+
+    // Camera side: sends im, as it is or encoded with the extension given (e.g. ".jpg"). False if it failed.
+    static bool Send(boost::asio::ip::tcp::socket &socket, const cv::Mat &im, double timestamp,
+                     const std::string &strEncoding = std::string());
+
+protected:
+    struct Slot
+    {
+        std::vector<unsigned char> buffer;
+        FrameHeader header;
+        cv::Mat decoded;
+    };
+
+    void DoAccept();
+    void DoReadHeader();
+    void DoReadPayload(int slot);
+    void Close();
+
+    // A free slot, or the one of the oldest queued frame
+    int AcquireSlot();
+
+    std::vector<Slot> mvSlots;
+
+    std::mutex mMutex;
+    std::condition_variable mcvFrame;
+    std::vector<int> mvFreeSlots;
+    std::deque<int> mqQueuedSlots;
+    // Slot returned by the last call to Next, -1 if none
+    int mnHeldSlot;
+    bool mbClosed;
+    unsigned long mnDropped;
+
+    FrameHeader mHeader;
+
+    boost::asio::io_context mIoContext;
+    boost::asio::ip::tcp::acceptor mAcceptor;
+    boost::asio::ip::tcp::socket mSocket;
+    std::thread mThread;
+};
+
+} //namespace ORB_SLAM3
+
+#endif // NETWORKFRAMESOURCE_H
@@ -0,0 +1,95 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2020 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ORBDESCRIPTOR_H
+#define ORBDESCRIPTOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+namespace ORB_SLAM3
+{
+
+// 256 bit ORB descriptor, laid out as one row of a CV_8U descriptor matrix
+struct alignas(32) ORBDescriptor
+{
+    static const int bytes = 32;
+
+    uint64_t bits[4];
+};
+
+// Read-only view over consecutive descriptors. Keyframes expose their descriptor block in the map
+// segment through it, so matching reads the descriptors where they are stored.
+class DescriptorSpan
+{
+public:
+    DescriptorSpan(): mpData(nullptr), mnSize(0) {}
+
+    DescriptorSpan(const ORBDescriptor* pData, std::size_t nSize): mpData(pData), mnSize(nSize) {}
+
+    // Rows of a continuous Nx32 CV_8U matrix whose data is aligned for ORBDescriptor. OpenCV only
+    // guarantees 16 bytes (OpenCV 3) or 64 bytes (OpenCV 4), use Aligned() for matrices it allocated.
+    explicit DescriptorSpan(const cv::Mat &descriptors): mpData(nullptr), mnSize(0)
+    {
+        if(descriptors.empty())
+            return;
+
+        CV_Assert(descriptors.type() == CV_8U && descriptors.cols == ORBDescriptor::bytes && descriptors.isContinuous());
+        CV_Assert(IsAligned(descriptors.data));
+        mpData = reinterpret_cast<const ORBDescriptor*>(descriptors.data);
+        mnSize = descriptors.rows;
+    }
+
+    // Rows of descriptors in place if they are aligned, otherwise copied into vStorage
+    static DescriptorSpan Aligned(const cv::Mat &descriptors, std::vector<ORBDescriptor> &vStorage)
+    {
+        if(descriptors.empty() || IsAligned(descriptors.data))
+            return DescriptorSpan(descriptors);
+
+        CV_Assert(descriptors.type() == CV_8U && descriptors.cols == ORBDescriptor::bytes && descriptors.isContinuous());
+        vStorage.resize(descriptors.rows);
+        std::memcpy(vStorage.data(), descriptors.data, vStorage.size()*sizeof(ORBDescriptor));
+        return DescriptorSpan(vStorage.data(), vStorage.size());
+    }
+
+    static bool IsAligned(const void* p)
+    {
+        return reinterpret_cast<std::uintptr_t>(p) % alignof(ORBDescriptor) == 0;
+    }
+
+    const ORBDescriptor& operator[](std::size_t i) const { return mpData[i]; }
+
+    const ORBDescriptor* begin() const { return mpData; }
+    const ORBDescriptor* end() const { return mpData + mnSize; }
+    const ORBDescriptor* data() const { return mpData; }
+
+    std::size_t size() const { return mnSize; }
+    bool empty() const { return mnSize == 0; }
+
+protected:
+    const ORBDescriptor* mpData;
+    std::size_t mnSize;
+};
+
+} //namespace ORB_SLAM3
+
+#endif // ORBDESCRIPTOR_H
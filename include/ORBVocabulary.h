@@ -20,14 +20,61 @@
 #ifndef ORBVOCABULARY_H
 #define ORBVOCABULARY_H
 
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <memory>
+
 #include"Thirdparty/DBoW2/DBoW2/FORB.h"
 #include"Thirdparty/DBoW2/DBoW2/TemplatedVocabulary.h"
 
+#include"ORBDescriptor.h"
+
 namespace ORB_SLAM3
 {
 
-typedef DBoW2::TemplatedVocabulary<DBoW2::FORB::TDescriptor, DBoW2::FORB>
-  ORBVocabulary;
+// DBoW2 vocabulary of ORB descriptors. The BoW transform descends the breadth-first layout of the tree, in which the
+// children of every node, descriptors included, are contiguous and 64-byte aligned, comparing each level with the SIMD
+// Hamming kernel. The layout is the mapped binary file when the vocabulary is loaded from one.
+class ORBVocabulary : public DBoW2::TemplatedVocabulary<DBoW2::FORB::TDescriptor, DBoW2::FORB>
+{
+public:
+    typedef DBoW2::TemplatedVocabulary<DBoW2::FORB::TDescriptor, DBoW2::FORB> Base;
+
+    ORBVocabulary(): mnMaxChildren(0), mnFingerprint(0) {}
+
+    // Same as the DBoW2 loaders, then build the flat tree and compute the fingerprint
+    bool loadFromTextFile(const std::string &filename);
+    bool loadFromBinaryFile(const std::string &filename);
+
+    using Base::transform;
+
+    // Transforms a block of descriptors at once. The output is the same as the one of the DBoW2 transform.
+    void transform(const DescriptorSpan &descriptors, DBoW2::BowVector &v, DBoW2::FeatureVector &fv, int levelsup) const;
+
+    // DBoW2 transform of single descriptors, done on the flat tree
+    virtual void transform(const std::vector<cv::Mat>& features, DBoW2::BowVector &v, DBoW2::FeatureVector &fv, int levelsup) const;
+
+    // Hash of the tree (parameters, nodes, weights and descriptors). Two vocabularies with the same fingerprint
+    // give the same BoW vectors, so vectors computed by another process can be used as they are. 0 if not loaded.
+    uint64_t GetFingerprint() const {return mnFingerprint;}
+
+protected:
+
+    void BuildFlatTree();
+    void ComputeFingerprint();
+
+    // Finds the leaves of n descriptors, and their nodes at level nidLevel
+    void DescendFlatTree(const ORBDescriptor* pDescriptors, int n, int nidLevel, uint32_t* pLeaves, DBoW2::NodeId* pNodeIds,
+                         int* pDist) const;
+
+    // Breadth-first layout of the tree, the root at 0. Null if the vocabulary was not loaded by the methods above or
+    // its descriptors are not ORB ones.
+    std::shared_ptr<const BinaryLayout> mpFlat;
+    int mnMaxChildren;
+
+    uint64_t mnFingerprint;
+};
 
 } //namespace ORB_SLAM
 
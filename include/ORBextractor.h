@@ -21,9 +21,12 @@
 
 #include <vector>
 #include <list>
+#include <functional>
 #include <opencv2/opencv.hpp>
 #include <boost/interprocess/managed_shared_memory.hpp>
 
+#include "ThreadPool.h"
+
 
 namespace ORB_SLAM3
 {
@@ -41,6 +44,36 @@ public:
     bool bNoMore;
 };
 
+// Scale pyramid whose levels, each with a border of fixed width, live in a single block allocated once
+// for a given image size. Computing a new pyramid of the same size does not allocate.
+class ImagePyramid
+{
+public:
+    ImagePyramid():mnBorder(0){}
+    ImagePyramid(const std::vector<float> &vInvScaleFactor, int border);
+
+    // Lays out the levels of images of size sz. Nothing is done if the pyramid already has that size.
+    void Allocate(const cv::Size &sz, int type);
+
+    // Downscales image into the levels, each one from the previous one, and fills their borders.
+    void Compute(const cv::Mat &image);
+
+    int GetLevels() const {return (int)mvLevels.size();}
+    int GetBorder() const {return mnBorder;}
+
+    // Levels without their border. The views are valid until the pyramid is allocated for another size.
+    const cv::Mat& operator[](int level) const {return mvLevels[level];}
+    cv::Mat& operator[](int level) {return mvLevels[level];}
+
+protected:
+    std::vector<float> mvInvScaleFactor;
+    int mnBorder;
+
+    cv::Mat mBlock;
+    std::vector<cv::Mat> mvPaddedLevels;
+    std::vector<cv::Mat> mvLevels;
+};
+
 class ORBextractor
 {
 public:
@@ -59,6 +92,16 @@ public:
                     std::vector<cv::KeyPoint>& _keypoints,
                     cv::OutputArray _descriptors, std::vector<int> &vLappingArea);
 
+    // Pool that runs the FAST cells and the pyramid levels in parallel. The output does not depend on it.
+    // Without a pool (the default) extraction is sequential.
+    void SetThreadPool(ThreadPool* pThreadPool);
+    ThreadPool* GetThreadPool();
+
+    // Vectorized orientation and descriptor kernels, used where the CPU supports them (the default).
+    // The output is the same without them; turning them off is for testing and timing.
+    static void SetVectorKernels(bool bEnable);
+    static bool GetVectorKernels();
+
     int inline GetLevels(){
         return nlevels;}
 
@@ -81,10 +124,18 @@ public:
         return mvInvLevelSigma2;
     }
 
-    std::vector<cv::Mat> mvImagePyramid;
+    // Pyramid of the last image. The stereo matching reads it after the extraction.
+    const ImagePyramid& GetImagePyramid() const {
+        return mImagePyramid;
+    }
 
 protected:
 
+    ImagePyramid mImagePyramid;
+
+    // Blurred levels the descriptors are computed on, allocated along with the pyramid
+    ImagePyramid mBlurredPyramid;
+
     void ComputePyramid(cv::Mat image);
     void ComputeKeyPointsOctTree(std::vector<std::vector<cv::KeyPoint> >& allKeypoints);    
     std::vector<cv::KeyPoint> DistributeOctTree(const std::vector<cv::KeyPoint>& vToDistributeKeys, const int &minX,
@@ -107,6 +158,9 @@ protected:
     std::vector<float> mvInvScaleFactor;    
     std::vector<float> mvLevelSigma2;
     std::vector<float> mvInvLevelSigma2;
+
+    void ParallelFor(int begin, int end, const std::function<void(int)> &f);
+    ThreadPool* mpThreadPool;
 };
 
 } //namespace ORB_SLAM
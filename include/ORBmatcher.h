@@ -27,11 +27,44 @@
 #include"MapPoint.h"
 #include"KeyFrame.h"
 #include"Frame.h"
+#include"ORBDescriptor.h"
+#include"HammingDistance.h"
 
 
 namespace ORB_SLAM3
 {
 
+// Candidate keypoints of a batch of query descriptors. The candidate descriptors are gathered in one
+// block per query, so the distances of the whole batch are computed by the batched Hamming kernel
+// before any match is selected.
+class DescriptorBatch
+{
+public:
+    void Clear();
+
+    // Starts the candidate list of a new query and returns its position in the batch
+    size_t AddQuery(const ORBDescriptor &query);
+
+    // Adds a candidate to the last query
+    void AddCandidate(const size_t idx, const ORBDescriptor &descriptor);
+
+    void ComputeDistances();
+
+    // Candidates of query q are the range [Begin(q), End(q))
+    size_t Begin(const size_t q) const { return mvOffsets[q]; }
+    size_t End(const size_t q) const { return q+1<mvOffsets.size() ? mvOffsets[q+1] : mvIndices.size(); }
+
+    size_t Index(const size_t k) const { return mvIndices[k]; }
+    int Distance(const size_t k) const { return mvDistances[k]; }
+
+protected:
+    std::vector<ORBDescriptor> mvQueries;
+    std::vector<size_t> mvOffsets;
+    std::vector<size_t> mvIndices;
+    std::vector<ORBDescriptor> mvCandidates;
+    std::vector<int> mvDistances;
+};
+
 class ORBmatcher
 {    
 public:
@@ -40,6 +73,10 @@ public:
 
     // Computes the Hamming distance between two ORB descriptors
     static int DescriptorDistance(const cv::Mat &a, const cv::Mat &b);
+    static int DescriptorDistance(const ORBDescriptor &a, const ORBDescriptor &b)
+    {
+        return HammingDistance::Distance(a, b);
+    }
 
     // Search matches between Frame keypoints and projected MapPoints. Returns number of matches
     // Used to track the local map (Tracking)
@@ -25,8 +25,11 @@
 #include "KeyFrame.h"
 #include "LoopClosing.h"
 #include "Frame.h"
+#include "BundleAdjuster.h"
+#include "ThreadPool.h"
 
 #include <math.h>
+#include <functional>
 
 #include "Thirdparty/g2o/g2o/types/types_seven_dof_expmap.h"
 #include "Thirdparty/g2o/g2o/core/sparse_block_matrix.h"
@@ -47,15 +50,33 @@ class Optimizer
 {
 public:
 
+    // Called by the bundle adjustments run in chunks of iterations after each chunk, once its estimate has been
+    // written to the map (or to the GBA variables), with the iterations done so far and the robust chi2.
+    // Returning false stops the optimization.
+    typedef std::function<bool(int,double)> ChunkCallback;
+
+    // Keyframes in spFixedKFs are not optimized, as the first keyframe of the map
+    // With nChunkIterations>0 the optimization runs in chunks of that many iterations, see ChunkCallback
     void static BundleAdjustment(const std::vector<boost::interprocess::offset_ptr<KeyFrame> > &vpKF, const std::vector<boost::interprocess::offset_ptr<MapPoint> > &vpMP,
                                  int nIterations = 5, bool *pbStopFlag=NULL, const unsigned long nLoopKF=0,
-                                 const bool bRobust = true);
+                                 const bool bRobust = true,
+                                 const std::set<boost::interprocess::offset_ptr<KeyFrame> > &spFixedKFs = std::set<boost::interprocess::offset_ptr<KeyFrame> >(),
+                                 int nChunkIterations = 0, const ChunkCallback &chunkCallback = ChunkCallback());
     void static GlobalBundleAdjustemnt(boost::interprocess::offset_ptr<Map>  pMap, int nIterations=5, bool *pbStopFlag=NULL,
-                                       const unsigned long nLoopKF=0, const bool bRobust = true);
+                                       const unsigned long nLoopKF=0, const bool bRobust = true,
+                                       int nChunkIterations = 0, const ChunkCallback &chunkCallback = ChunkCallback());
+    // Global BA restricted to the part of the map affected by new constraints: the keyframes up to nLevels
+    // covisibility hops from vpSeedKFs and the points they see, with the other keyframes observing those points
+    // fixed. The rest of the map keeps its estimate, and is flagged as optimized for the map update of the GBA.
+    void static IncrementalBundleAdjustment(boost::interprocess::offset_ptr<Map>  pMap, const std::vector<boost::interprocess::offset_ptr<KeyFrame> > &vpSeedKFs,
+                                            int nLevels, int nIterations=5, bool *pbStopFlag=NULL, const unsigned long nLoopKF=0,
+                                            const bool bRobust = true,
+                                            int nChunkIterations = 0, const ChunkCallback &chunkCallback = ChunkCallback());
     void static FullInertialBA(boost::interprocess::offset_ptr<Map> pMap, int its, const bool bFixLocal=false, const unsigned long nLoopKF=0, bool *pbStopFlag=NULL, bool bInit=false, float priorG = 1e2, float priorA=1e6, Eigen::VectorXd *vSingVal = NULL, bool *bHess=NULL);
 
     void static LocalBundleAdjustment(boost::interprocess::offset_ptr<KeyFrame>  pKF, bool *pbStopFlag, vector<boost::interprocess::offset_ptr<KeyFrame> > &vpNonEnoughOptKFs);
-    void static LocalBundleAdjustment(boost::interprocess::offset_ptr<KeyFrame>  pKF, bool *pbStopFlag, boost::interprocess::offset_ptr<Map> pMap, int& num_fixedKF, int& num_OptKF, int& num_MPs, int& num_edges);
+    // nThreads linearizes the edges and builds the Schur complement in parallel (g2o built with OpenMP)
+    void static LocalBundleAdjustment(boost::interprocess::offset_ptr<KeyFrame>  pKF, bool *pbStopFlag, boost::interprocess::offset_ptr<Map> pMap, int& num_fixedKF, int& num_OptKF, int& num_MPs, int& num_edges, int nThreads = 1);
 
     void static MergeBundleAdjustmentVisual(boost::interprocess::offset_ptr<KeyFrame>  pCurrentKF, vector<boost::interprocess::offset_ptr<KeyFrame> > vpWeldingKFs, vector<boost::interprocess::offset_ptr<KeyFrame> > vpFixedKFs, bool *pbStopFlag);
 
@@ -65,11 +86,12 @@ public:
     int static PoseInertialOptimizationLastFrame(Frame *pFrame, bool bRecInit = false);
 
     // if bFixScale is true, 6DoF optimization (stereo,rgbd), 7DoF otherwise (mono)
+    // The keyframes and points are corrected with the optimized poses on pThreadPool, if given
     void static OptimizeEssentialGraph(boost::interprocess::offset_ptr<Map>  pMap, boost::interprocess::offset_ptr<KeyFrame>  pLoopKF, boost::interprocess::offset_ptr<KeyFrame>  pCurKF,
                                        const LoopClosing::KeyFrameAndPose &NonCorrectedSim3,
                                        const LoopClosing::KeyFrameAndPose &CorrectedSim3,
                                        const map<boost::interprocess::offset_ptr<KeyFrame> , set<boost::interprocess::offset_ptr<KeyFrame> > > &LoopConnections,
-                                       const bool &bFixScale);
+                                       const bool &bFixScale, ThreadPool* pThreadPool = nullptr);
     void static OptimizeEssentialGraph6DoF(boost::interprocess::offset_ptr<KeyFrame>  pCurKF, vector<boost::interprocess::offset_ptr<KeyFrame> > &vpFixedKFs, vector<boost::interprocess::offset_ptr<KeyFrame> > &vpFixedCorrectedKFs,
                                            vector<boost::interprocess::offset_ptr<KeyFrame> > &vpNonFixedKFs, vector<boost::interprocess::offset_ptr<MapPoint> > &vpNonCorrectedMPs, double scale);
     void static OptimizeEssentialGraph(boost::interprocess::offset_ptr<KeyFrame>  pCurKF, vector<boost::interprocess::offset_ptr<KeyFrame> > &vpFixedKFs, vector<boost::interprocess::offset_ptr<KeyFrame> > &vpFixedCorrectedKFs,
@@ -96,7 +118,7 @@ public:
 
     // For inertial systems
 
-    void static LocalInertialBA(boost::interprocess::offset_ptr<KeyFrame>  pKF, bool *pbStopFlag, boost::interprocess::offset_ptr<Map> pMap, int& num_fixedKF, int& num_OptKF, int& num_MPs, int& num_edges, bool bLarge = false, bool bRecInit = false);
+    void static LocalInertialBA(boost::interprocess::offset_ptr<KeyFrame>  pKF, bool *pbStopFlag, boost::interprocess::offset_ptr<Map> pMap, int& num_fixedKF, int& num_OptKF, int& num_MPs, int& num_edges, bool bLarge = false, bool bRecInit = false, int nThreads = 1);
 
     void static MergeInertialBA(boost::interprocess::offset_ptr<KeyFrame>  pCurrKF, boost::interprocess::offset_ptr<KeyFrame>  pMergeKF, bool *pbStopFlag, boost::interprocess::offset_ptr<Map> pMap, LoopClosing::KeyFrameAndPose &corrPoses);
 
@@ -116,6 +138,22 @@ public:
     void static InertialOptimization(boost::interprocess::offset_ptr<Map> pMap, Eigen::Vector3d &bg, Eigen::Vector3d &ba, float priorG = 1e2, float priorA = 1e6);
     void static InertialOptimization(vector<boost::interprocess::offset_ptr<KeyFrame> > vpKFs, Eigen::Vector3d &bg, Eigen::Vector3d &ba, float priorG = 1e2, float priorA = 1e6);
     void static InertialOptimization(boost::interprocess::offset_ptr<Map> pMap, Eigen::Matrix3d &Rwg, double &scale);
+
+    // Solve the local BA of LocalMapping with the specialized BundleAdjuster instead of g2o. Global BAs
+    // stay on g2o, the adjuster solves the reduced camera system densely, which only pays off for the
+    // few poses of a local BA. If strExportDir is not empty, every problem solved by the adjuster is
+    // saved there before the optimization, to benchmark it offline.
+    void static SetBundleAdjuster(bool bUse, const std::string &strExportDir = "");
+
+protected:
+
+    void static LocalBundleAdjustmentSchur(boost::interprocess::offset_ptr<KeyFrame>  pKF, bool *pbStopFlag, boost::interprocess::offset_ptr<Map> pMap,
+                                           const list<boost::interprocess::offset_ptr<KeyFrame> > &lLocalKeyFrames,
+                                           const list<boost::interprocess::offset_ptr<KeyFrame> > &lFixedCameras,
+                                           const list<boost::interprocess::offset_ptr<MapPoint> > &lLocalMapPoints, int& num_edges);
+
+    static bool sbUseBundleAdjuster;
+    static std::string sstrExportDir;
 };
 
 } //namespace ORB_SLAM3
@@ -1,41 +1,62 @@
 #pragma once
 
 #include <array>
-#include <fstream>
 #include <string>
 #include <memory>
+#include <vector>
 #include <boost/asio.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 
+#include "MapReplication.h"
 
+
+// Receives the segment of a client (see MapReplication.h) and keeps a replica of it in a shared memory object with
+// the name the client uses locally. The merge server then opens it like the segment of a local client.
 class Session
     : public std::enable_shared_from_this<Session>
 {
 public:
     using TcpSocket = boost::asio::ip::tcp::socket;
 
-    Session(TcpSocket t_socket);
+    Session(TcpSocket t_socket, ORB_SLAM3::MapSegment::Settings const& t_segmentSettings);
 
     void start()
     {
-        doRead();
+        doReadHeader();
     }
 
 private:
-    void doRead();
-    void processRead(size_t t_bytesTransferred);
-    void createFile();
-    void readData(std::istream &stream);
-    void doReadFileContent(size_t t_bytesTransferred);
+    void doReadHeader();
+    void processHeader();
+    void doReadPayload();
+    void processFrame();
+    bool startReplica(ORB_SLAM3::Replication::SegmentInfo const& t_info);
+    bool resizeReplica(uint64_t t_size);
+    bool applyBatch(uint64_t t_size);
     void handleError(std::string const& t_functionName, boost::system::error_code const& t_ec);
+    void handleProtocolError(std::string const& t_message);
 
 
     TcpSocket m_socket;
-    enum { MaxLength = 40960 };
-    std::array<char, MaxLength> m_buf;
-    boost::asio::streambuf m_requestBuf_;
-    std::ofstream m_outputFile;
-    size_t m_fileSize;
-    std::string m_fileName;
+    // Settings of the server, ForClient() gives the name and address of a client segment
+    ORB_SLAM3::MapSegment::Settings m_segmentSettings;
+
+    ORB_SLAM3::Replication::FrameHeader m_header;
+    std::vector<char> m_payload;
+    uint64_t m_nextSequence;
+
+    // Pages received since the last COMMIT, applied together
+    std::vector<char> m_batchData;
+    std::vector<std::pair<uint64_t, size_t> > m_batchRuns;
+    // End of the last run of the batch, the next one must start after it
+    uint64_t m_batchEnd;
+
+    int m_clientId;
+    std::string m_replicaName;
+    uint64_t m_replicaSize;
+    boost::interprocess::shared_memory_object m_replicaShm;
+    boost::interprocess::mapped_region m_replicaRegion;
 };
 
 
@@ -47,14 +68,13 @@ public:
     using IoService = boost::asio::io_context;
     /*using IoService = boost::asio::io_service;*/
 
-    Server(IoService& t_ioService, short t_port, std::string const& t_workDirectory);
+    Server(IoService& t_ioService, short t_port, ORB_SLAM3::MapSegment::Settings const& t_segmentSettings);
 
 private:
     void doAccept();
-    void createWorkDirectory();
 
     TcpSocket m_socket;
     TcpAcceptor m_acceptor;
 
-    std::string m_workDirectory;
+    ORB_SLAM3::MapSegment::Settings m_segmentSettings;
 };
@@ -0,0 +1,133 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2020 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SHAREDBOW_H
+#define SHAREDBOW_H
+
+#include <algorithm>
+#include <cstdint>
+
+#include <boost/interprocess/offset_ptr.hpp>
+
+#include "Thirdparty/DBoW2/DBoW2/BowVector.h"
+#include "Thirdparty/DBoW2/DBoW2/FeatureVector.h"
+
+namespace ORB_SLAM3
+{
+
+// BoW vector of a keyframe stored in the map segment: (word id, weight) entries sorted by word id in a single
+// block. It reads like a DBoW2::BowVector (entries have first and second, lower_bound takes a word id), and
+// any process that maps the segment can use it as it is.
+//
+// The vector is tagged with the fingerprint of the vocabulary it was computed with. A process whose vocabulary
+// has the same fingerprint does not need to compute it again.
+class SharedBowVector
+{
+public:
+    struct Entry
+    {
+        DBoW2::WordId first;
+        DBoW2::WordValue second;
+    };
+    typedef const Entry* const_iterator;
+
+    SharedBowVector(): mnSize(0), mnFingerprint(0) {}
+
+    // Copies v into a new block of the map segment. The previous block is not released.
+    void Assign(const DBoW2::BowVector &v, uint64_t fingerprint);
+
+    const_iterator begin() const {return mpEntries.get();}
+    const_iterator end() const {return mpEntries.get()+mnSize;}
+    size_t size() const {return mnSize;}
+    bool empty() const {return mnSize == 0;}
+
+    // First entry whose word id is not less than wordId
+    const_iterator lower_bound(DBoW2::WordId wordId) const
+    {
+        return std::lower_bound(begin(), end(), wordId, [](const Entry &e, DBoW2::WordId id){return e.first < id;});
+    }
+
+    uint64_t GetFingerprint() const {return mnFingerprint;}
+
+    // True if the vector was computed with a vocabulary of this fingerprint
+    bool IsComputedWith(uint64_t fingerprint) const {return fingerprint != 0 && mnFingerprint == fingerprint;}
+
+protected:
+    boost::interprocess::offset_ptr<Entry> mpEntries;
+    uint32_t mnSize;
+    uint64_t mnFingerprint;
+};
+
+// Feature vector of a keyframe stored in the map segment: node ids sorted, each with the indices of its
+// features. The indices of all the nodes are in one block, and every entry points to its range.
+class SharedFeatureVector
+{
+public:
+    // Indices of the features of a node, read like a std::vector<unsigned int>
+    class Indices
+    {
+    public:
+        Indices(): mnSize(0) {}
+        Indices(const unsigned int* pData, uint32_t n): mpData(pData), mnSize(n) {}
+
+        const unsigned int* begin() const {return mpData.get();}
+        const unsigned int* end() const {return mpData.get()+mnSize;}
+        size_t size() const {return mnSize;}
+        bool empty() const {return mnSize == 0;}
+        unsigned int operator[](size_t i) const {return mpData[i];}
+
+    protected:
+        boost::interprocess::offset_ptr<const unsigned int> mpData;
+        uint32_t mnSize;
+    };
+
+    struct Entry
+    {
+        DBoW2::NodeId first;
+        Indices second;
+    };
+    typedef const Entry* const_iterator;
+
+    SharedFeatureVector(): mnSize(0), mnFingerprint(0) {}
+
+    // Copies fv into new blocks of the map segment. The previous blocks are not released.
+    void Assign(const DBoW2::FeatureVector &fv, uint64_t fingerprint);
+
+    const_iterator begin() const {return mpEntries.get();}
+    const_iterator end() const {return mpEntries.get()+mnSize;}
+    size_t size() const {return mnSize;}
+    bool empty() const {return mnSize == 0;}
+
+    // First entry whose node id is not less than nodeId
+    const_iterator lower_bound(DBoW2::NodeId nodeId) const
+    {
+        return std::lower_bound(begin(), end(), nodeId, [](const Entry &e, DBoW2::NodeId id){return e.first < id;});
+    }
+
+    uint64_t GetFingerprint() const {return mnFingerprint;}
+    bool IsComputedWith(uint64_t fingerprint) const {return fingerprint != 0 && mnFingerprint == fingerprint;}
+
+protected:
+    boost::interprocess::offset_ptr<Entry> mpEntries;
+    uint32_t mnSize;
+    uint64_t mnFingerprint;
+};
+
+} //namespace ORB_SLAM3
+
+#endif // SHAREDBOW_H
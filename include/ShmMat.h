@@ -0,0 +1,124 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2020 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef SHMMAT_H
+#define SHMMAT_H
+
+#include <algorithm>
+#include <type_traits>
+#include <opencv2/core/core.hpp>
+
+namespace ORB_SLAM3
+{
+
+// Fixed size matrix that stores its elements inline. A cv::Mat member of an object in the map segment
+// points to its data through an absolute pointer, and to the heap of the owner once it is reassigned.
+// A ShmMat has no pointers, so keyframes and map points can be used as they are by any process that
+// maps the segment.
+//
+// Assigning a cv::Mat copies its elements (it must have R*C of them, a vector can be given as a row or
+// as a column). Reading it as a cv::Mat gives a header over the inline elements, without copying.
+// Like a cv::Mat member, a ShmMat is unset (empty) until a matrix is assigned to it.
+template<int R, int C, typename T = float>
+class ShmMat
+{
+public:
+    static const int cvType = cv::DataType<T>::type;
+
+    ShmMat(): mbEmpty(true)
+    {
+        std::fill(mData, mData+R*C, T(0));
+    }
+
+    ShmMat& operator=(const cv::Mat &m)
+    {
+        if(m.empty())
+        {
+            mbEmpty = true;
+            return *this;
+        }
+
+        CV_Assert(m.total() == static_cast<size_t>(R*C) && m.channels() == 1);
+        cv::Mat dst(m.rows, m.cols, cvType, mData);
+        m.convertTo(dst, cvType);
+        mbEmpty = false;
+        return *this;
+    }
+
+    // Header over the elements. Empty if an empty matrix was assigned.
+    cv::Mat mat() const
+    {
+        if(mbEmpty)
+            return cv::Mat();
+        return cv::Mat(R, C, cvType, const_cast<T*>(mData));
+    }
+
+    operator cv::Mat() const
+    {
+        return mat();
+    }
+
+    bool empty() const { return mbEmpty; }
+    int type() const { return cvType; }
+    cv::Mat clone() const { return mat().clone(); }
+    void copyTo(cv::OutputArray dst) const { mat().copyTo(dst); }
+    cv::MatExpr t() const { return mat().t(); }
+    cv::MatExpr inv() const { return mat().inv(); }
+
+    cv::Mat row(int i) const { return mat().row(i); }
+    cv::Mat col(int j) const { return mat().col(j); }
+    cv::Mat rowRange(int i0, int i1) const { return mat().rowRange(i0, i1); }
+    cv::Mat colRange(int j0, int j1) const { return mat().colRange(j0, j1); }
+
+    template<typename U> U& at(int i, int j)
+    {
+        static_assert(std::is_same<U, T>::value, "ShmMat element type mismatch");
+        return mData[i*C+j];
+    }
+
+    template<typename U> const U& at(int i, int j) const
+    {
+        static_assert(std::is_same<U, T>::value, "ShmMat element type mismatch");
+        return mData[i*C+j];
+    }
+
+    // Element i of a vector (or of the matrix in row-major order)
+    template<typename U> U& at(int i)
+    {
+        static_assert(std::is_same<U, T>::value, "ShmMat element type mismatch");
+        return mData[i];
+    }
+
+    template<typename U> const U& at(int i) const
+    {
+        static_assert(std::is_same<U, T>::value, "ShmMat element type mismatch");
+        return mData[i];
+    }
+
+    T* data() { return mData; }
+    const T* data() const { return mData; }
+
+protected:
+    T mData[R*C];
+    bool mbEmpty;
+};
+
+} //namespace ORB_SLAM3
+
+#endif // SHMMAT_H
@@ -27,6 +27,10 @@
 #include<stdlib.h>
 #include<string>
 #include<thread>
+#include<future>
+#include<atomic>
+#include<map>
+#include<memory>
 #include<opencv2/core/core.hpp>
 
 #include "Tracking.h"
@@ -41,19 +45,20 @@
 #include "ImuTypes.h"
 #include "Config.h"
 #include "MapPoint.h"
+#include "MapSegment.h"
 #include <boost/interprocess/managed_shared_memory.hpp>
 #include <boost/interprocess/allocators/allocator.hpp>
 
+// Map replication server (Server.h)
+class Server;
+namespace boost { namespace asio { class io_context; } }
+
 namespace ORB_SLAM3
 {
    //GLOBAL Variable
 //extern boost::interprocess::fixed_managed_shared_memory segment;//(boost::interprocess::open_or_create, "MySharedMemory",10737418240);
-extern boost::interprocess::managed_shared_memory segment;
+// The map segment (ORB_SLAM3::segment) and its manager (ORB_SLAM3::map_segment) are declared in MapSegment.h
 //extern boost::interprocess::mapped_region region;
-//Create an allocator that allocates ints from the managed segment
-//extern boost::interprocess::allocator<char, boost::interprocess::fixed_managed_shared_memory::segment_manager> allocator_instance;
-extern boost::interprocess::allocator<char, boost::interprocess::managed_shared_memory::segment_manager> allocator_instance;
-//extern boost::interprocess::allocator allocator_instance;
 
 //extern int processnum;
 
@@ -90,6 +95,9 @@ class Atlas;
 class Tracking;
 class LocalMapping;
 class LoopClosing;
+class TrackingFrontEnd;
+class MapReplicator;
+namespace Replication { class ReplicaLock; }
 
 class System
 {
@@ -130,6 +138,19 @@ public:
     // Returns the camera pose (empty if tracking fails).
     cv::Mat TrackMonocular(const cv::Mat &im, const double &timestamp, const vector<IMU::Point>& vImuMeas = vector<IMU::Point>(), string filename="");
 
+    // Asynchronous versions of the calls above. The frame is queued and the future gets its pose once
+    // it has been tracked. The ORB extraction of the next frames runs on another thread while the
+    // previous ones are tracked, at most FrontEnd.queueSize frames ahead. Frames are tracked in the
+    // order they are given, with the same results as the synchronous calls (do not mix both).
+    // The images are copied, so the caller can reuse them as soon as the call returns.
+    std::future<cv::Mat> TrackStereoAsync(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timestamp, const vector<IMU::Point>& vImuMeas = vector<IMU::Point>(), string filename="");
+    std::future<cv::Mat> TrackRGBDAsync(const cv::Mat &im, const cv::Mat &depthmap, const double &timestamp, string filename="");
+    std::future<cv::Mat> TrackMonocularAsync(const cv::Mat &im, const double &timestamp, const vector<IMU::Point>& vImuMeas = vector<IMU::Point>(), string filename="");
+
+
+    // Offline replay (see DatasetReplay). Before tracking a frame, wait for Local Mapping to process the
+    // keyframes already inserted, so none is discarded for arriving while it is busy.
+    void SetReplayMode(bool bReplay);
 
     // This stops local mapping thread (map building) and performs only camera tracking.
     void ActivateLocalizationMode();
@@ -196,10 +217,33 @@ public:
 boost::interprocess::offset_ptr<Tracking> offset_tracker;
 
 //Newly created function to Merge Maps. Load the existing map first.
-void PostLoad();
+//otherNum selects the atlas to merge, by default the one of the previous process.
+void PostLoad(int otherNum = -1);
 //Second map for 2 map merges
 void PostLoad2();
+
+// Atlas of process num. In client/server mode it is looked up in the read-only view of the client segment.
+Atlas* FindAtlas(int num);
+// Merge server: merges the current map of a client into the atlas of the server.
+bool MergeClientMap(int clientId);
 private:
+    friend class TrackingFrontEnd;
+
+    // Read-only view of the segment of a client, opened on first use. Null if the client is not running.
+    MapSegment* OpenClientSegment(int clientId);
+
+    // Takes the lock of the replica that holds the atlas of process num, so that the replication server does not
+    // apply a batch while its maps are read. Null if the atlas is not in a client segment or the lock failed.
+    std::unique_ptr<Replication::ReplicaLock> LockReplica(int num);
+
+    // Applies the mode changes and resets requested since the last frame, before tracking a new one.
+    // In replay mode it first waits for Local Mapping.
+    void CheckModeAndReset();
+    void WaitForLocalMapping();
+    // Keeps the state of the last tracked frame for GetTrackingState() and the others
+    void UpdateTrackingState();
+
+    TrackingFrontEnd* GetFrontEnd();
 
     // Input sensor
     eSensor mSensor;
@@ -237,6 +281,10 @@ private:
     std::thread* mptLoopClosing;
     std::thread* mptViewer;
 
+    // Pipelined front end of the asynchronous calls, started on the first one
+    TrackingFrontEnd* mpFrontEnd;
+    int mnFrontEndQueueSize;
+
     // Reset flag
     std::mutex mMutexReset;
     bool mbReset;
@@ -247,11 +295,24 @@ private:
     bool mbActivateLocalizationMode;
     bool mbDeactivateLocalizationMode;
 
+    std::atomic<bool> mbReplayMode;
+
     // Tracking state
     int mTrackingState;
     std::vector<boost::interprocess::offset_ptr<MapPoint> > mTrackedMapPoints;
     std::vector<cv::KeyPoint> mTrackedKeyPointsUn;
     std::mutex mMutexState;
+
+    // Client segments mapped by the merge server
+    std::map<int, MapSegment*> mmpClientSegments;
+
+    // A client streams its segment to the merge server (Replication.server), which keeps a replica of it
+    // (Replication.port). See MapReplication.h
+    MapReplicator* mpReplicator;
+    std::thread* mptReplicator;
+    boost::asio::io_context* mpReplicationIo;
+    Server* mpReplicationServer;
+    std::thread* mptReplicationServer;
 };
 
 }// namespace ORB_SLAM
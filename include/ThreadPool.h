@@ -0,0 +1,63 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2020 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace ORB_SLAM3
+{
+
+// Fixed set of worker threads that run the iterations of parallel loops, shared by the threads that give it work
+// (the feature extractors of a tracker, the Sim3 propagation and essential graph of Loop Closing).
+class ThreadPool
+{
+public:
+    // nThreads workers, the pool does nothing in parallel with nThreads <= 0
+    ThreadPool(int nThreads);
+    ~ThreadPool();
+
+    int GetNumThreads() const;
+
+    // Runs f(i) for every i in [begin, end) on the workers and on the calling thread, and returns once all
+    // of them have finished. It can be called from several threads, and from inside another ParallelFor.
+    void ParallelFor(int begin, int end, const std::function<void(int)> &f);
+
+protected:
+    void Enqueue(std::function<void()> task);
+    void Run();
+
+    std::vector<std::thread> mvThreads;
+    std::queue<std::function<void()> > mqTasks;
+
+    std::mutex mMutexTasks;
+    std::condition_variable mcvTasks;
+    bool mbStop;
+};
+
+} //namespace ORB_SLAM3
+
+#endif // THREADPOOL_H
@@ -75,6 +75,17 @@ public:
     cv::Mat GrabImageMonocular(const cv::Mat &im, const double &timestamp, string filename);
     // cv::Mat GrabImageImuMonocular(const cv::Mat &im, const double &timestamp);
 
+    // GrabImage* in two steps, so TrackingFrontEnd can build frames ahead on another thread.
+    // CreateFrame* convert the images to grayscale in place and build the frame. They only read the
+    // extractors and the calibration, the frame is linked to the previous one by GrabFrame.
+    Frame CreateFrameStereo(cv::Mat &imGray, cv::Mat &imGrayRight, const double &timestamp);
+    Frame CreateFrameRGBD(cv::Mat &imGray, cv::Mat &imDepth, const double &timestamp);
+    Frame CreateFrameMonocular(cv::Mat &imGray, const double &timestamp, ORBextractor* pExtractor);
+    // Extractor GrabImageMonocular uses for the next frame, it depends on the tracking state
+    ORBextractor* GetMonocularExtractor();
+    // Tracks a frame built by CreateFrame*. imRight is the right image as given (stereo only).
+    cv::Mat GrabFrame(const Frame &frame, const cv::Mat &imGray, const cv::Mat &imRight, string filename);
+
     void GrabImuData(const IMU::Point &imuMeasurement);
 
     void SetLocalMapper(LocalMapping* pLocalMapper);
@@ -174,6 +185,7 @@ public:
     vector<double> vdPosePred_ms;
     vector<double> vdLMTrack_ms;
     vector<double> vdNewKF_ms;
+    vector<double> vdKFCreation_ms;
     vector<double> vdTrackTotal_ms;
 
     vector<double> vdUpdatedLM_ms;
@@ -256,6 +268,7 @@ protected:
     //ORB
     ORBextractor* mpORBextractorLeft, *mpORBextractorRight;
     ORBextractor* mpIniORBextractor;
+    ThreadPool* mpExtractorPool;
 
     //BoW
     ORBVocabulary* mpORBVocabulary;
@@ -0,0 +1,109 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2020 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRACKINGFRONTEND_H
+#define TRACKINGFRONTEND_H
+
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "Frame.h"
+#include "ImuTypes.h"
+
+namespace ORB_SLAM3
+{
+
+class System;
+class Tracking;
+class ORBextractor;
+
+// Pipelined front end behind System::Track*Async. A feature thread builds the frames (ORB extraction
+// and stereo matching) ahead of a tracking thread, which tracks them in order exactly as the
+// synchronous calls do.
+class TrackingFrontEnd
+{
+public:
+    // At most nQueueSize frames are built ahead of the one being tracked
+    TrackingFrontEnd(System* pSys, Tracking* pTracker, int nQueueSize);
+
+    // Tracks the frames still queued and stops both threads
+    ~TrackingFrontEnd();
+
+    // Queues a copy of a frame, it blocks while the queue is full. im2 is the right image (stereo), the
+    // depthmap (RGB-D) or empty (monocular).
+    std::future<cv::Mat> Submit(const cv::Mat &im, const cv::Mat &im2, const double &timestamp,
+                                const std::vector<IMU::Point> &vImuMeas, const std::string &filename);
+
+protected:
+    struct Request
+    {
+        // Copies of the images as given, converted to grayscale (and depth to float) when the frame is built
+        cv::Mat im;
+        cv::Mat im2;
+        cv::Mat imRight;
+        double timestamp;
+        std::vector<IMU::Point> vImuMeas;
+        std::string filename;
+
+        Frame frame;
+        // Extractor a monocular frame was built with
+        ORBextractor* pExtractor;
+
+        std::promise<cv::Mat> promise;
+    };
+
+    void RunFeatures();
+    void RunTracking();
+
+    void BuildFrame(Request* pRequest);
+    void TrackFrame(Request* pRequest);
+
+    System* mpSystem;
+    Tracking* mpTracker;
+    int mSensor;
+    size_t mnQueueSize;
+
+    // Requests waiting for their frame and frames waiting to be tracked
+    std::list<Request*> mlpRequests;
+    std::list<Request*> mlpFrames;
+    std::mutex mMutexQueue;
+    std::condition_variable mcvQueue;
+    bool mbFinish;
+
+    // Held while a frame is built, so the tracking thread can build one again without sharing an extractor
+    std::mutex mMutexExtraction;
+
+    // The monocular extractor depends on the tracking state. Frames are built with the one of the last
+    // tracked frame and built again on the tracking thread in the rare case it changed.
+    std::atomic<ORBextractor*> mpNextExtractor;
+
+    std::thread mtFeatures;
+    std::thread mtTracking;
+};
+
+} //namespace ORB_SLAM3
+
+#endif // TRACKINGFRONTEND_H
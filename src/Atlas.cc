@@ -56,7 +56,7 @@ Atlas::~Atlas()
 
         if(pMi)
         {
-            delete pMi.get();
+            // Maps live in the map segment, where they are never destroyed (see MapSegment::Construct)
             pMi = static_cast<boost::interprocess::offset_ptr<Map> >(NULL);
 
             it = mspMaps.erase(it);
@@ -134,7 +134,7 @@ else{
 
     sprintf(&mapname[3],"%d",processnum);
     std::cout<<"MapName in create map: "<<mapname<<std::endl;
-    mpCurrentMap = ORB_SLAM3::segment.construct<Map>(boost::interprocess::anonymous_instance) (mnLastInitKFidMap);
+    mpCurrentMap = ORB_SLAM3::map_segment.Construct<Map>(mnLastInitKFidMap);
     //cout<<"Created Map object in shared memory! Address is: "<<mpCurrentMap<<endl;
     //cout<<"Reading a variable there "<<mpCurrentMap->GetMaxKFid()<<endl;
 
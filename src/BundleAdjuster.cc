@@ -0,0 +1,780 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2020 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "BundleAdjuster.h"
+
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <map>
+
+#include <Eigen/Dense>
+
+#include "Pinhole.h"
+#include "KannalaBrandt8.h"
+
+namespace ORB_SLAM3
+{
+
+namespace
+{
+
+typedef Eigen::Matrix<double,6,6> Matrix6d;
+typedef Eigen::Matrix<double,6,1> Vector6d;
+typedef Eigen::Matrix<double,6,3> Matrix63d;
+
+// Robust chi2 and weight of the Huber kernel, as g2o::RobustKernelHuber::robustify
+inline void Huber(double chi2, double delta, double &rho0, double &rho1)
+{
+    const double dsqr = delta*delta;
+    if(delta<=0 || chi2<=dsqr)
+    {
+        rho0 = chi2;
+        rho1 = 1.0;
+    }
+    else
+    {
+        const double sqrte = sqrt(chi2);
+        rho0 = 2*sqrte*delta - dsqr;
+        rho1 = delta/sqrte;
+    }
+}
+
+// Adds the weighted normal equations of one observation. Jc is the Jacobian of its error wrt the point
+// in its camera, Rcl the rotation from the keyframe to that camera (NULL if it is the keyframe's).
+template<int D>
+void Linearize(const Eigen::Matrix<double,D,3> &Jc, const Eigen::Matrix<double,D,1> &e, const double w,
+               const Eigen::Matrix3d *pRcl, const Eigen::Matrix3d &Rlw, const Eigen::Vector3d &x3Dl,
+               Matrix6d *pHpp, double *pbp, Eigen::Matrix3d &Hll, Eigen::Vector3d &bl, Matrix63d &Hpl)
+{
+    Eigen::Matrix<double,D,3> A = Jc;
+    if(pRcl)
+        A = Jc*(*pRcl);
+
+    const Eigen::Matrix<double,D,3> Jl = A*Rlw;
+    const Eigen::Matrix<double,3,D> JlTW = w*Jl.transpose();
+    Hll.noalias() += JlTW*Jl;
+    bl.noalias() -= JlTW*e;
+
+    if(!pHpp)
+        return;
+
+    // Left-multiplied exponential update of the pose, as g2o::VertexSE3Expmap
+    Eigen::Matrix3d dXl;
+    dXl << 0.0, x3Dl[2], -x3Dl[1],
+           -x3Dl[2], 0.0, x3Dl[0],
+           x3Dl[1], -x3Dl[0], 0.0;
+
+    Eigen::Matrix<double,D,6> Jp;
+    Jp.template leftCols<3>() = A*dXl;
+    Jp.template rightCols<3>() = A;
+
+    const Eigen::Matrix<double,6,D> JpTW = w*Jp.transpose();
+    pHpp->noalias() += JpTW*Jp;
+    Eigen::Map<Vector6d>(pbp).noalias() -= JpTW*e;
+    Hpl.noalias() = JpTW*Jl;
+}
+
+} // namespace
+
+BundleAdjuster::BundleAdjuster():mInitialLambda(0.0), mnFreePoses(0)
+{
+}
+
+BundleAdjuster::~BundleAdjuster()
+{
+}
+
+void BundleAdjuster::Clear()
+{
+    mvTcw.clear();
+    mvbFixed.clear();
+    mvPoints.clear();
+
+    mvnObsKF.clear();
+    mvnObsMP.clear();
+    mvnObsModel.clear();
+    mvnObsParam.clear();
+    mvObsInvSigma2.clear();
+    mvObsHuber.clear();
+
+    mvMonoObs.clear();
+    mvpMonoCamera.clear();
+    mvMonoK.clear();
+    mvnMonoRig.clear();
+    mvRigs.clear();
+
+    mvStereoObs.clear();
+    mvStereoK.clear();
+
+    mInitialLambda = 0.0;
+
+    mvpPinholes.clear();
+    mvpKannalaBrandts.clear();
+}
+
+int BundleAdjuster::AddKeyFrame(const g2o::SE3Quat &Tcw, bool bFixed)
+{
+    mvTcw.push_back(Tcw);
+    mvbFixed.push_back(bFixed);
+    return (int)mvTcw.size()-1;
+}
+
+int BundleAdjuster::AddMapPoint(const Eigen::Vector3d &x3Dw)
+{
+    mvPoints.push_back(x3Dw);
+    return (int)mvPoints.size()-1;
+}
+
+int BundleAdjuster::AddObservation(int nKF, int nMP, int nModel, int nParam, double invSigma2, double thHuber)
+{
+    mvnObsKF.push_back(nKF);
+    mvnObsMP.push_back(nMP);
+    mvnObsModel.push_back(nModel);
+    mvnObsParam.push_back(nParam);
+    mvObsInvSigma2.push_back(invSigma2);
+    mvObsHuber.push_back(thHuber);
+    return (int)mvnObsKF.size()-1;
+}
+
+int BundleAdjuster::AddRig(const g2o::SE3Quat &Trl)
+{
+    // Observations of a rig come in sequence, share the extrinsics with the last one if they match
+    if(!mvRigs.empty() && mvRigs.back().toVector()==Trl.toVector())
+        return (int)mvRigs.size()-1;
+    mvRigs.push_back(Trl);
+    return (int)mvRigs.size()-1;
+}
+
+int BundleAdjuster::AddMonoObservation(int nKF, int nMP, const Eigen::Vector2d &obs, double invSigma2, double thHuber,
+                                       GeometricCamera* pCamera)
+{
+    // Pinhole projections are evaluated inline, other models through the camera
+    Pinhole* pPinhole = dynamic_cast<Pinhole*>(pCamera);
+    Eigen::Vector4d K = Eigen::Vector4d::Zero();
+    if(pPinhole)
+        K << pPinhole->getParameter(0), pPinhole->getParameter(1), pPinhole->getParameter(2), pPinhole->getParameter(3);
+
+    mvMonoObs.push_back(obs);
+    mvpMonoCamera.push_back(pCamera);
+    mvMonoK.push_back(K);
+    mvnMonoRig.push_back(-1);
+
+    return AddObservation(nKF, nMP, pPinhole ? PINHOLE_MONO : CAMERA_MONO, (int)mvMonoObs.size()-1, invSigma2, thHuber);
+}
+
+int BundleAdjuster::AddRightObservation(int nKF, int nMP, const Eigen::Vector2d &obs, double invSigma2, double thHuber,
+                                        GeometricCamera* pCamera, const g2o::SE3Quat &Trl)
+{
+    const int nObs = AddMonoObservation(nKF, nMP, obs, invSigma2, thHuber, pCamera);
+    mvnMonoRig.back() = AddRig(Trl);
+    return nObs;
+}
+
+int BundleAdjuster::AddStereoObservation(int nKF, int nMP, const Eigen::Vector3d &obs, double invSigma2, double thHuber,
+                                         double fx, double fy, double cx, double cy, double bf)
+{
+    Eigen::Matrix<double,5,1> K;
+    K << fx, fy, cx, cy, bf;
+
+    mvStereoObs.push_back(obs);
+    mvStereoK.push_back(K);
+
+    return AddObservation(nKF, nMP, STEREO, (int)mvStereoObs.size()-1, invSigma2, thHuber);
+}
+
+void BundleAdjuster::SetInitialLambda(double lambda)
+{
+    mInitialLambda = lambda;
+}
+
+BundleAdjuster::Observation BundleAdjuster::GetObservation(int nObs) const
+{
+    Observation obs;
+    obs.nKF = mvnObsKF[nObs];
+    obs.nMP = mvnObsMP[nObs];
+    obs.invSigma2 = mvObsInvSigma2[nObs];
+    obs.thHuber = mvObsHuber[nObs];
+    obs.pCamera = NULL;
+    obs.bRight = false;
+    obs.fx = obs.fy = obs.cx = obs.cy = obs.bf = 0.0;
+
+    const int nParam = mvnObsParam[nObs];
+    if(mvnObsModel[nObs]==STEREO)
+    {
+        const Eigen::Matrix<double,5,1> &K = mvStereoK[nParam];
+        obs.nDim = 3;
+        obs.obs = mvStereoObs[nParam];
+        obs.fx = K[0];
+        obs.fy = K[1];
+        obs.cx = K[2];
+        obs.cy = K[3];
+        obs.bf = K[4];
+    }
+    else
+    {
+        obs.nDim = 2;
+        obs.obs << mvMonoObs[nParam], 0.0;
+        obs.pCamera = mvpMonoCamera[nParam];
+        if(mvnMonoRig[nParam]>=0)
+        {
+            obs.bRight = true;
+            obs.Trl = mvRigs[mvnMonoRig[nParam]];
+        }
+    }
+    return obs;
+}
+
+int BundleAdjuster::ComputeError(int i, Eigen::Vector3d &e, Eigen::Vector3d &x3Dc) const
+{
+    const g2o::SE3Quat &Tcw = mvTcw[mvnObsKF[i]];
+    const Eigen::Vector3d &x3Dw = mvPoints[mvnObsMP[i]];
+    const int nParam = mvnObsParam[i];
+
+    if(mvnObsModel[i]==STEREO)
+    {
+        const Eigen::Matrix<double,5,1> &K = mvStereoK[nParam];
+        const Eigen::Vector3d &obs = mvStereoObs[nParam];
+        x3Dc = Tcw.map(x3Dw);
+
+        // Single precision inverse depth and baseline, as g2o::EdgeStereoSE3ProjectXYZ::cam_project
+        const float invz = 1.0f/x3Dc[2];
+        const float bf = K[4];
+        const double u = x3Dc[0]*invz*K[0] + K[2];
+        e[0] = obs[0] - u;
+        e[1] = obs[1] - (x3Dc[1]*invz*K[1] + K[3]);
+        e[2] = obs[2] - (u - bf*invz);
+        return 3;
+    }
+
+    const int nRig = mvnMonoRig[nParam];
+    x3Dc = nRig<0 ? Tcw.map(x3Dw) : (mvRigs[nRig]*Tcw).map(x3Dw);
+
+    const Eigen::Vector2d &obs = mvMonoObs[nParam];
+    if(mvnObsModel[i]==PINHOLE_MONO)
+    {
+        const Eigen::Vector4d &K = mvMonoK[nParam];
+        e[0] = obs[0] - (K[0]*x3Dc[0]/x3Dc[2] + K[2]);
+        e[1] = obs[1] - (K[1]*x3Dc[1]/x3Dc[2] + K[3]);
+    }
+    else
+        e.head<2>() = obs - mvpMonoCamera[nParam]->project(x3Dc);
+
+    return 2;
+}
+
+double BundleAdjuster::GetChi2(int nObs) const
+{
+    Eigen::Vector3d e, x3Dc;
+    const int nDim = ComputeError(nObs, e, x3Dc);
+    return mvObsInvSigma2[nObs]*e.head(nDim).squaredNorm();
+}
+
+bool BundleAdjuster::IsDepthPositive(int nObs) const
+{
+    Eigen::Vector3d e, x3Dc;
+    ComputeError(nObs, e, x3Dc);
+    return x3Dc[2]>0.0;
+}
+
+double BundleAdjuster::GetRobustChi2() const
+{
+    double chi2 = 0.0;
+    for(int i=0, iend=NumObservations(); i<iend; i++)
+    {
+        double rho0, rho1;
+        Huber(GetChi2(i), mvObsHuber[i], rho0, rho1);
+        chi2 += rho0;
+    }
+    return chi2;
+}
+
+void BundleAdjuster::BuildStructure()
+{
+    const int nKFs = NumKeyFrames();
+    const int nMPs = NumMapPoints();
+    const int nObs = NumObservations();
+
+    mvnPoseCol.assign(nKFs,-1);
+    mnFreePoses = 0;
+    for(int i=0; i<nKFs; i++)
+        if(!mvbFixed[i])
+            mvnPoseCol[i] = mnFreePoses++;
+
+    // Observations grouped by point
+    mvnPointObsBegin.assign(nMPs+1,0);
+    for(int i=0; i<nObs; i++)
+        mvnPointObsBegin[mvnObsMP[i]+1]++;
+    for(int j=0; j<nMPs; j++)
+        mvnPointObsBegin[j+1] += mvnPointObsBegin[j];
+    mvnPointObs.resize(nObs);
+    std::vector<int> vnNext(mvnPointObsBegin.begin(), mvnPointObsBegin.end()-1);
+    for(int i=0; i<nObs; i++)
+        mvnPointObs[vnNext[mvnObsMP[i]]++] = i;
+
+    mvHpp.resize(mnFreePoses);
+    mbp.resize(6*mnFreePoses);
+    mvHll.resize(nMPs);
+    mvbl.resize(nMPs);
+    mvHllInv.resize(nMPs);
+    mvHpl.resize(nObs);
+    mS.resize(6*mnFreePoses,6*mnFreePoses);
+    mbs.resize(6*mnFreePoses);
+    mxp.resize(6*mnFreePoses);
+    mvxl.resize(nMPs);
+}
+
+void BundleAdjuster::BuildSystem()
+{
+    for(int i=0; i<mnFreePoses; i++)
+        mvHpp[i].setZero();
+    mbp.setZero();
+    for(size_t j=0; j<mvHll.size(); j++)
+    {
+        mvHll[j].setZero();
+        mvbl[j].setZero();
+    }
+
+    for(int i=0, iend=NumObservations(); i<iend; i++)
+    {
+        const int nKF = mvnObsKF[i];
+        const int nMP = mvnObsMP[i];
+        const int nCol = mvnPoseCol[nKF];
+        const int nParam = mvnObsParam[i];
+
+        Eigen::Vector3d e, x3Dc;
+        const int nDim = ComputeError(i, e, x3Dc);
+
+        double rho0, rho1;
+        const double invSigma2 = mvObsInvSigma2[i];
+        Huber(invSigma2*e.head(nDim).squaredNorm(), mvObsHuber[i], rho0, rho1);
+        const double w = rho1*invSigma2;
+
+        const g2o::SE3Quat &Tcw = mvTcw[nKF];
+        const Eigen::Matrix3d Rlw = Tcw.rotation().toRotationMatrix();
+        Matrix6d* pHpp = nCol<0 ? NULL : &mvHpp[nCol];
+        double* pbp = nCol<0 ? NULL : mbp.data()+6*nCol;
+
+        if(mvnObsModel[i]==STEREO)
+        {
+            const Eigen::Matrix<double,5,1> &K = mvStereoK[nParam];
+            const double invz = 1.0/x3Dc[2];
+            const double invz2 = invz*invz;
+            Eigen::Matrix3d Jc;
+            Jc << -K[0]*invz, 0.0, K[0]*x3Dc[0]*invz2,
+                  0.0, -K[1]*invz, K[1]*x3Dc[1]*invz2,
+                  -K[0]*invz, 0.0, (K[0]*x3Dc[0]-K[4])*invz2;
+            Linearize<3>(Jc, e, w, NULL, Rlw, x3Dc, pHpp, pbp, mvHll[nMP], mvbl[nMP], mvHpl[i]);
+            continue;
+        }
+
+        Eigen::Matrix<double,2,3> Jc;
+        if(mvnObsModel[i]==PINHOLE_MONO)
+        {
+            const Eigen::Vector4d &K = mvMonoK[nParam];
+            const double invz = 1.0/x3Dc[2];
+            Jc << -K[0]*invz, 0.0, K[0]*x3Dc[0]*invz*invz,
+                  0.0, -K[1]*invz, K[1]*x3Dc[1]*invz*invz;
+        }
+        else
+            Jc = -mvpMonoCamera[nParam]->projectJac(x3Dc);
+
+        const Eigen::Vector2d e2 = e.head<2>();
+        const int nRig = mvnMonoRig[nParam];
+        if(nRig<0)
+            Linearize<2>(Jc, e2, w, NULL, Rlw, x3Dc, pHpp, pbp, mvHll[nMP], mvbl[nMP], mvHpl[i]);
+        else
+        {
+            const Eigen::Matrix3d Rrl = mvRigs[nRig].rotation().toRotationMatrix();
+            Linearize<2>(Jc, e2, w, &Rrl, Rlw, Tcw.map(mvPoints[nMP]), pHpp, pbp, mvHll[nMP], mvbl[nMP], mvHpl[i]);
+        }
+    }
+}
+
+double BundleAdjuster::MaxDiagonal() const
+{
+    double maxDiagonal = 0.0;
+    for(int i=0; i<mnFreePoses; i++)
+        maxDiagonal = std::max(maxDiagonal, mvHpp[i].diagonal().cwiseAbs().maxCoeff());
+    for(size_t j=0; j<mvHll.size(); j++)
+        if(mvnPointObsBegin[j+1]>mvnPointObsBegin[j])
+            maxDiagonal = std::max(maxDiagonal, mvHll[j].diagonal().cwiseAbs().maxCoeff());
+    return maxDiagonal;
+}
+
+bool BundleAdjuster::SolveSystem(double lambda)
+{
+    // Reduced camera system S = Hpp - Hpl*Hll^-1*Hpl^T, upper triangle only
+    mS.setZero();
+    for(int i=0; i<mnFreePoses; i++)
+    {
+        mS.block<6,6>(6*i,6*i) = mvHpp[i];
+        mS.block<6,6>(6*i,6*i).diagonal().array() += lambda;
+    }
+    mbs = mbp;
+
+    for(size_t j=0; j<mvHll.size(); j++)
+    {
+        const int begin = mvnPointObsBegin[j], end = mvnPointObsBegin[j+1];
+        if(begin==end)
+            continue;
+
+        Eigen::Matrix3d D = mvHll[j];
+        D.diagonal().array() += lambda;
+        const Eigen::Matrix3d &Dinv = mvHllInv[j] = D.inverse();
+
+        for(int a=begin; a<end; a++)
+        {
+            const int ia = mvnPointObs[a];
+            const int ca = mvnPoseCol[mvnObsKF[ia]];
+            if(ca<0)
+                continue;
+
+            const Matrix63d BDinv = mvHpl[ia]*Dinv;
+            mbs.segment<6>(6*ca).noalias() -= BDinv*mvbl[j];
+
+            for(int b=begin; b<end; b++)
+            {
+                const int ib = mvnPointObs[b];
+                const int cb = mvnPoseCol[mvnObsKF[ib]];
+                if(cb<ca)
+                    continue;
+                mS.block<6,6>(6*ca,6*cb).noalias() -= BDinv*mvHpl[ib].transpose();
+            }
+        }
+    }
+
+    if(mnFreePoses>0)
+    {
+        Eigen::LLT<Eigen::MatrixXd, Eigen::Upper> llt(mS);
+        if(llt.info()!=Eigen::Success)
+            return false;
+        mxp = llt.solve(mbs);
+    }
+
+    // Back substitution of the points
+    for(size_t j=0; j<mvHll.size(); j++)
+    {
+        const int begin = mvnPointObsBegin[j], end = mvnPointObsBegin[j+1];
+        if(begin==end)
+            continue;
+
+        Eigen::Vector3d r = mvbl[j];
+        for(int a=begin; a<end; a++)
+        {
+            const int ia = mvnPointObs[a];
+            const int ca = mvnPoseCol[mvnObsKF[ia]];
+            if(ca>=0)
+                r.noalias() -= mvHpl[ia].transpose()*mxp.segment<6>(6*ca);
+        }
+        mvxl[j] = mvHllInv[j]*r;
+    }
+
+    return true;
+}
+
+double BundleAdjuster::ComputeScale(double lambda) const
+{
+    double scale = mxp.dot(lambda*mxp + mbp);
+    for(size_t j=0; j<mvxl.size(); j++)
+        if(mvnPointObsBegin[j+1]>mvnPointObsBegin[j])
+            scale += mvxl[j].dot(lambda*mvxl[j] + mvbl[j]);
+    return scale;
+}
+
+void BundleAdjuster::Update()
+{
+    mvTcwBackup = mvTcw;
+    mvPointsBackup = mvPoints;
+
+    for(int i=0, iend=NumKeyFrames(); i<iend; i++)
+        if(mvnPoseCol[i]>=0)
+            mvTcw[i] = g2o::SE3Quat::exp(mxp.segment<6>(6*mvnPoseCol[i]))*mvTcw[i];
+
+    for(size_t j=0; j<mvPoints.size(); j++)
+        if(mvnPointObsBegin[j+1]>mvnPointObsBegin[j])
+            mvPoints[j] += mvxl[j];
+}
+
+void BundleAdjuster::Restore()
+{
+    mvTcw.swap(mvTcwBackup);
+    mvPoints.swap(mvPointsBackup);
+}
+
+int BundleAdjuster::Optimize(int nIterations, bool *pbStopFlag)
+{
+    if(mvnObsKF.empty())
+        return 0;
+
+    BuildStructure();
+
+    const int nMaxTrials = 10;
+    double lambda = 0.0;
+    double ni = 2.0;
+    int nBad = 0;
+
+    int it = 0;
+    while(it<nIterations && !(pbStopFlag && *pbStopFlag))
+    {
+        it++;
+
+        double currentChi = GetRobustChi2();
+        const double iniChi = currentChi;
+
+        BuildSystem();
+
+        if(it==1)
+        {
+            lambda = mInitialLambda>0 ? mInitialLambda : 1e-5*MaxDiagonal();
+            ni = 2.0;
+            nBad = 0;
+        }
+
+        double rho = 0;
+        int nTrials = 0;
+        do
+        {
+            const bool bSolved = SolveSystem(lambda);
+            double tempChi = std::numeric_limits<double>::max();
+            double scale = 0.0;
+            if(bSolved)
+            {
+                Update();
+                tempChi = GetRobustChi2();
+                scale = ComputeScale(lambda);
+            }
+
+            rho = (currentChi-tempChi)/(scale+1e-3);
+
+            if(rho>0 && std::isfinite(tempChi))
+            {
+                const double alpha = std::min(1.0-pow(2*rho-1,3), 2.0/3.0);
+                lambda *= std::max(1.0/3.0, alpha);
+                ni = 2.0;
+                currentChi = tempChi;
+            }
+            else
+            {
+                lambda *= ni;
+                ni *= 2;
+                if(bSolved)
+                    Restore();
+            }
+            nTrials++;
+        }
+        while(rho<0 && nTrials<nMaxTrials && !(pbStopFlag && *pbStopFlag));
+
+        if(nTrials==nMaxTrials || rho==0)
+            break;
+
+        // Stop when the error barely decreases three times in a row
+        if((iniChi-currentChi)*1e3<iniChi)
+            nBad++;
+        else
+            nBad = 0;
+
+        if(nBad>=3)
+            break;
+    }
+
+    return it;
+}
+
+bool BundleAdjuster::Save(const std::string &filename) const
+{
+    std::ofstream f(filename.c_str());
+    if(!f.is_open())
+        return false;
+
+    f << std::setprecision(17);
+    f << "BUNDLE_ADJUSTMENT 1 " << mInitialLambda << std::endl;
+
+    std::map<GeometricCamera*,int> mCameraIds;
+    std::vector<GeometricCamera*> vpCameras;
+    for(size_t i=0; i<mvpMonoCamera.size(); i++)
+    {
+        if(mCameraIds.count(mvpMonoCamera[i]))
+            continue;
+        mCameraIds[mvpMonoCamera[i]] = (int)vpCameras.size();
+        vpCameras.push_back(mvpMonoCamera[i]);
+    }
+
+    f << "CAMERAS " << vpCameras.size() << std::endl;
+    for(size_t i=0; i<vpCameras.size(); i++)
+    {
+        GeometricCamera* pCamera = vpCameras[i];
+        f << (dynamic_cast<Pinhole*>(pCamera) ? 0 : 1) << " " << pCamera->size();
+        for(size_t k=0; k<pCamera->size(); k++)
+            f << " " << pCamera->getParameter(k);
+        f << std::endl;
+    }
+
+    f << "KEYFRAMES " << mvTcw.size() << std::endl;
+    for(size_t i=0; i<mvTcw.size(); i++)
+    {
+        const g2o::Vector7d v = mvTcw[i].toVector();
+        f << (mvbFixed[i] ? 1 : 0);
+        for(int k=0; k<7; k++)
+            f << " " << v[k];
+        f << std::endl;
+    }
+
+    f << "MAPPOINTS " << mvPoints.size() << std::endl;
+    for(size_t j=0; j<mvPoints.size(); j++)
+        f << mvPoints[j][0] << " " << mvPoints[j][1] << " " << mvPoints[j][2] << std::endl;
+
+    f << "OBSERVATIONS " << mvnObsKF.size() << std::endl;
+    for(int i=0, iend=NumObservations(); i<iend; i++)
+    {
+        const Observation obs = GetObservation(i);
+        if(obs.nDim==3)
+        {
+            f << "S " << obs.nKF << " " << obs.nMP << " " << obs.invSigma2 << " " << obs.thHuber << " "
+              << obs.obs[0] << " " << obs.obs[1] << " " << obs.obs[2] << " "
+              << obs.fx << " " << obs.fy << " " << obs.cx << " " << obs.cy << " " << obs.bf;
+        }
+        else
+        {
+            f << (obs.bRight ? "R " : "M ") << obs.nKF << " " << obs.nMP << " " << obs.invSigma2 << " " << obs.thHuber << " "
+              << mCameraIds[obs.pCamera] << " " << obs.obs[0] << " " << obs.obs[1];
+            if(obs.bRight)
+            {
+                const g2o::Vector7d v = obs.Trl.toVector();
+                for(int k=0; k<7; k++)
+                    f << " " << v[k];
+            }
+        }
+        f << std::endl;
+    }
+
+    return f.good();
+}
+
+bool BundleAdjuster::Load(const std::string &filename)
+{
+    std::ifstream f(filename.c_str());
+    if(!f.is_open())
+        return false;
+
+    Clear();
+
+    std::string tag;
+    int version;
+    double lambda;
+    f >> tag >> version >> lambda;
+    if(tag!="BUNDLE_ADJUSTMENT" || version!=1)
+        return false;
+    mInitialLambda = lambda;
+
+    size_t n;
+    f >> tag >> n;
+    if(tag!="CAMERAS")
+        return false;
+    std::vector<GeometricCamera*> vpCameras;
+    for(size_t i=0; i<n && f.good(); i++)
+    {
+        int type;
+        size_t nParams;
+        f >> type >> nParams;
+        std::vector<float> vParams(nParams);
+        for(size_t k=0; k<nParams; k++)
+            f >> vParams[k];
+
+        if(type==0)
+        {
+            mvpPinholes.emplace_back(new Pinhole(vParams));
+            vpCameras.push_back(mvpPinholes.back().get());
+        }
+        else
+        {
+            mvpKannalaBrandts.emplace_back(new KannalaBrandt8(vParams));
+            vpCameras.push_back(mvpKannalaBrandts.back().get());
+        }
+    }
+
+    f >> tag >> n;
+    if(tag!="KEYFRAMES")
+        return false;
+    for(size_t i=0; i<n && f.good(); i++)
+    {
+        int bFixed;
+        g2o::Vector7d v;
+        f >> bFixed;
+        for(int k=0; k<7; k++)
+            f >> v[k];
+        g2o::SE3Quat Tcw;
+        Tcw.fromVector(v);
+        AddKeyFrame(Tcw, bFixed!=0);
+    }
+
+    f >> tag >> n;
+    if(tag!="MAPPOINTS")
+        return false;
+    for(size_t j=0; j<n && f.good(); j++)
+    {
+        Eigen::Vector3d x3Dw;
+        f >> x3Dw[0] >> x3Dw[1] >> x3Dw[2];
+        AddMapPoint(x3Dw);
+    }
+
+    f >> tag >> n;
+    if(tag!="OBSERVATIONS")
+        return false;
+    for(size_t i=0; i<n && f.good(); i++)
+    {
+        std::string model;
+        int nKF, nMP;
+        double invSigma2, thHuber;
+        f >> model >> nKF >> nMP >> invSigma2 >> thHuber;
+        if(nKF<0 || nKF>=NumKeyFrames() || nMP<0 || nMP>=NumMapPoints())
+            return false;
+
+        if(model=="S")
+        {
+            Eigen::Vector3d obs;
+            double fx, fy, cx, cy, bf;
+            f >> obs[0] >> obs[1] >> obs[2] >> fx >> fy >> cx >> cy >> bf;
+            AddStereoObservation(nKF, nMP, obs, invSigma2, thHuber, fx, fy, cx, cy, bf);
+            continue;
+        }
+
+        int nCamera;
+        Eigen::Vector2d obs;
+        f >> nCamera >> obs[0] >> obs[1];
+        if(nCamera<0 || nCamera>=(int)vpCameras.size())
+            return false;
+
+        if(model=="R")
+        {
+            g2o::Vector7d v;
+            for(int k=0; k<7; k++)
+                f >> v[k];
+            g2o::SE3Quat Trl;
+            Trl.fromVector(v);
+            AddRightObservation(nKF, nMP, obs, invSigma2, thHuber, vpCameras[nCamera], Trl);
+        }
+        else
+            AddMonoObservation(nKF, nMP, obs, invSigma2, thHuber, vpCameras[nCamera]);
+    }
+
+    return !f.fail();
+}
+
+} //namespace ORB_SLAM3
@@ -0,0 +1,182 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2020 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "DatasetReplay.h"
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <thread>
+
+#include <opencv2/highgui/highgui.hpp>
+
+namespace ORB_SLAM3
+{
+
+DatasetReplay::DatasetReplay(System* pSystem, const System::eSensor sensor, int nIOThreads, int nPrefetch):
+    mpSystem(pSystem), mSensor(sensor), mnIOThreads(std::max(nIOThreads,1)), mnPrefetch(std::max(nPrefetch,1)),
+    mnNextLoad(0), mnNextTrack(0), mbAbort(false), mnFrames(0), mTime(0)
+{
+}
+
+void DatasetReplay::SetPreprocess(const Preprocess &preprocess)
+{
+    mPreprocess = preprocess;
+}
+
+bool DatasetReplay::Run(const std::vector<std::string> &vstrImages, const std::vector<std::string> &vstrImages2,
+                        const std::vector<double> &vTimestamps, const std::vector<std::vector<IMU::Point> > &vvImuMeas)
+{
+    const int nImages = vstrImages.size();
+
+    mvSlots.assign(mnPrefetch, Slot());
+    for(int i=0; i<mnPrefetch; i++)
+        mvSlots[i].index = -1;
+    mnNextLoad = 0;
+    mnNextTrack = 0;
+    mbAbort = false;
+
+    mpSystem->SetReplayMode(true);
+
+    std::chrono::steady_clock::time_point time_Start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> vLoaders;
+    for(int i=0; i<mnIOThreads; i++)
+        vLoaders.push_back(std::thread(&DatasetReplay::Load, this, std::cref(vstrImages), std::cref(vstrImages2)));
+
+    const std::vector<IMU::Point> vNoImu;
+    std::future<cv::Mat> lastPose;
+    bool bOk = true;
+    int ni = 0;
+    for(; ni<nImages; ni++)
+    {
+        cv::Mat im, im2;
+        {
+            std::unique_lock<std::mutex> lock(mMutexSlots);
+            Slot &slot = mvSlots[ni % mnPrefetch];
+            mcvSlots.wait(lock, [&]{return slot.index == ni;});
+
+            if(slot.bFailed)
+            {
+                bOk = false;
+                mbAbort = true;
+                mcvSlots.notify_all();
+                break;
+            }
+
+            im = slot.im;
+            im2 = slot.im2;
+            slot.im.release();
+            slot.im2.release();
+            slot.index = -1;
+            mnNextTrack = ni+1;
+        }
+        mcvSlots.notify_all();
+
+        const std::vector<IMU::Point> &vImuMeas = ni < (int)vvImuMeas.size() ? vvImuMeas[ni] : vNoImu;
+
+        if(mSensor==System::STEREO || mSensor==System::IMU_STEREO)
+            lastPose = mpSystem->TrackStereoAsync(im,im2,vTimestamps[ni],vImuMeas);
+        else if(mSensor==System::RGBD)
+            lastPose = mpSystem->TrackRGBDAsync(im,im2,vTimestamps[ni]);
+        else
+            lastPose = mpSystem->TrackMonocularAsync(im,vTimestamps[ni],vImuMeas);
+    }
+
+    // Frames are tracked in order, the last one is tracked after all the others
+    if(lastPose.valid())
+        lastPose.wait();
+
+    for(size_t i=0; i<vLoaders.size(); i++)
+        vLoaders[i].join();
+
+    std::chrono::steady_clock::time_point time_End = std::chrono::steady_clock::now();
+    mTime = std::chrono::duration_cast<std::chrono::duration<double> >(time_End - time_Start).count();
+
+    mpSystem->SetReplayMode(false);
+
+    mnFrames = ni;
+    std::cout << "Replayed " << mnFrames << " frames in " << mTime << " s: " << GetFramesPerSecond() << " frames/s" << std::endl;
+
+    return bOk;
+}
+
+void DatasetReplay::Load(const std::vector<std::string> &vstrImages, const std::vector<std::string> &vstrImages2)
+{
+    const int nImages = vstrImages.size();
+    const bool bSecond = mSensor==System::STEREO || mSensor==System::IMU_STEREO || mSensor==System::RGBD;
+
+    while(true)
+    {
+        int ni;
+        {
+            // Take the next frame once its slot is free
+            std::unique_lock<std::mutex> lock(mMutexSlots);
+            if(mbAbort || mnNextLoad >= nImages)
+                break;
+            ni = mnNextLoad++;
+            mcvSlots.wait(lock, [&]{return mbAbort || ni < mnNextTrack + mnPrefetch;});
+            if(mbAbort)
+                break;
+        }
+
+        cv::Mat im = cv::imread(vstrImages[ni],cv::IMREAD_UNCHANGED);
+        cv::Mat im2;
+        if(bSecond && !im.empty())
+            im2 = cv::imread(vstrImages2[ni],cv::IMREAD_UNCHANGED);
+
+        const bool bFailed = im.empty() || (bSecond && im2.empty());
+        if(bFailed)
+        {
+            std::cerr << std::endl << "Failed to load image at: "
+                      << (im.empty() ? vstrImages[ni] : vstrImages2[ni]) << std::endl;
+        }
+        else if(mPreprocess)
+        {
+            mPreprocess(im,im2);
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(mMutexSlots);
+            Slot &slot = mvSlots[ni % mnPrefetch];
+            slot.im = im;
+            slot.im2 = im2;
+            slot.bFailed = bFailed;
+            slot.index = ni;
+        }
+        mcvSlots.notify_all();
+    }
+}
+
+int DatasetReplay::GetNumFrames() const
+{
+    return mnFrames;
+}
+
+double DatasetReplay::GetTime() const
+{
+    return mTime;
+}
+
+double DatasetReplay::GetFramesPerSecond() const
+{
+    return mTime > 0 ? mnFrames/mTime : 0;
+}
+
+} //namespace ORB_SLAM3
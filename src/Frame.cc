@@ -34,6 +34,7 @@ namespace ORB_SLAM3
 {
 
 long unsigned int Frame::nNextId=0;
+thread_local bool Frame::sbDeferId=false;
 bool Frame::mbInitialComputations=true;
 float Frame::cx, Frame::cy, Frame::fx, Frame::fy, Frame::invfx, Frame::invfy;
 float Frame::mnMinX, Frame::mnMinY, Frame::mnMaxX, Frame::mnMaxY;
@@ -101,7 +102,8 @@ Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeSt
      mpCamera(pCamera) ,mpCamera2(nullptr)
 {
     // Frame ID
-    mnId=nNextId++;
+    if(!sbDeferId)
+        AssignId();
 
     // Scale Level Info
     mnScaleLevels = mpORBextractorLeft->GetLevels();
@@ -116,10 +118,7 @@ Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeSt
 #ifdef REGISTER_TIMES
     std::chrono::steady_clock::time_point time_StartExtORB = std::chrono::steady_clock::now();
 #endif
-    thread threadLeft(&Frame::ExtractORB,this,0,imLeft,0,0);
-    thread threadRight(&Frame::ExtractORB,this,1,imRight,0,0);
-    threadLeft.join();
-    threadRight.join();
+    ExtractORBStereo(imLeft,imRight,0,0,0,0);
 #ifdef REGISTER_TIMES
     std::chrono::steady_clock::time_point time_EndExtORB = std::chrono::steady_clock::now();
 
@@ -205,7 +204,8 @@ Frame::Frame(const cv::Mat &imGray, const cv::Mat &imDepth, const double &timeSt
      mpCamera(pCamera),mpCamera2(nullptr)
 {
     // Frame ID
-    mnId=nNextId++;
+    if(!sbDeferId)
+        AssignId();
 
     // Scale Level Info
     mnScaleLevels = mpORBextractorLeft->GetLevels();
@@ -288,7 +288,8 @@ Frame::Frame(const cv::Mat &imGray, const double &timeStamp, ORBextractor* extra
      mpCamera2(nullptr)
 {
     // Frame ID
-    mnId=nNextId++;
+    if(!sbDeferId)
+        AssignId();
 
     // Scale Level Info
     mnScaleLevels = mpORBextractorLeft->GetLevels();
@@ -410,6 +411,11 @@ void Frame::AssignFeaturesToGrid()
     }
 }
 
+void Frame::AssignId()
+{
+    mnId=nNextId++;
+}
+
 void Frame::ExtractORB(int flag, const cv::Mat &im, const int x0, const int x1)
 {
     vector<int> vLapping = {x0,x1};
@@ -419,6 +425,27 @@ void Frame::ExtractORB(int flag, const cv::Mat &im, const int x0, const int x1)
         monoRight = (*mpORBextractorRight)(im,cv::Mat(),mvKeysRight,mDescriptorsRight,vLapping);
 }
 
+void Frame::ExtractORBStereo(const cv::Mat &imLeft, const cv::Mat &imRight, const int x0Left, const int x1Left,
+                             const int x0Right, const int x1Right)
+{
+    ThreadPool* pPool = mpORBextractorLeft->GetThreadPool();
+    if(pPool)
+    {
+        pPool->ParallelFor(0, 2, [&](int flag)
+        {
+            if(flag==0)
+                ExtractORB(0,imLeft,x0Left,x1Left);
+            else
+                ExtractORB(1,imRight,x0Right,x1Right);
+        });
+    }
+    else
+    {
+        ExtractORB(0,imLeft,x0Left,x1Left);
+        ExtractORB(1,imRight,x0Right,x1Right);
+    }
+}
+
 void Frame::SetPose(cv::Mat Tcw)
 {
     mTcw = Tcw.clone();
@@ -725,8 +752,8 @@ void Frame::ComputeBoW()
 {
     if(mBowVec.empty())
     {
-        vector<cv::Mat> vCurrentDesc = Converter::toDescriptorVector(mDescriptors);
-        mpORBvocabulary->transform(vCurrentDesc,mBowVec,mFeatVec,4);
+        std::vector<ORBDescriptor> vAlignedDescriptors;
+        mpORBvocabulary->transform(DescriptorSpan::Aligned(mDescriptors,vAlignedDescriptors),mBowVec,mFeatVec,4);
     }
 }
 
@@ -801,7 +828,11 @@ void Frame::ComputeStereoMatches()
 
     const int thOrbDist = (ORBmatcher::TH_HIGH+ORBmatcher::TH_LOW)/2;
 
-    const int nRows = mpORBextractorLeft->mvImagePyramid[0].rows;
+    // Pyramids left by the extraction, the correlation windows are read from them in place
+    const ImagePyramid &pyramidLeft = mpORBextractorLeft->GetImagePyramid();
+    const ImagePyramid &pyramidRight = mpORBextractorRight->GetImagePyramid();
+
+    const int nRows = pyramidLeft[0].rows;
 
     //Assign keypoints to row table
     vector<vector<size_t> > vRowIndices(nRows,vector<size_t>());
@@ -891,22 +922,21 @@ void Frame::ComputeStereoMatches()
 
             // sliding window search
             const int w = 5;
-            cv::Mat IL = mpORBextractorLeft->mvImagePyramid[kpL.octave].rowRange(scaledvL-w,scaledvL+w+1).colRange(scaleduL-w,scaleduL+w+1);
+            cv::Mat IL = pyramidLeft[kpL.octave].rowRange(scaledvL-w,scaledvL+w+1).colRange(scaleduL-w,scaleduL+w+1);
 
             int bestDist = INT_MAX;
             int bestincR = 0;
             const int L = 5;
-            vector<float> vDists;
-            vDists.resize(2*L+1);
+            float vDists[2*L+1];
 
             const float iniu = scaleduR0+L-w;
             const float endu = scaleduR0+L+w+1;
-            if(iniu<0 || endu >= mpORBextractorRight->mvImagePyramid[kpL.octave].cols)
+            if(iniu<0 || endu >= pyramidRight[kpL.octave].cols)
                 continue;
 
             for(int incR=-L; incR<=+L; incR++)
             {
-                cv::Mat IR = mpORBextractorRight->mvImagePyramid[kpL.octave].rowRange(scaledvL-w,scaledvL+w+1).colRange(scaleduR0+incR-w,scaleduR0+incR+w+1);
+                cv::Mat IR = pyramidRight[kpL.octave].rowRange(scaledvL-w,scaledvL+w+1).colRange(scaleduR0+incR-w,scaleduR0+incR+w+1);
 
                 float dist = cv::norm(IL,IR,cv::NORM_L1);
                 if(dist<bestDist)
@@ -1026,7 +1056,8 @@ Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeSt
     imgRight = imRight.clone();
 
     // Frame ID
-    mnId=nNextId++;
+    if(!sbDeferId)
+        AssignId();
 
     // Scale Level Info
     mnScaleLevels = mpORBextractorLeft->GetLevels();
@@ -1041,10 +1072,8 @@ Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeSt
 #ifdef REGISTER_TIMES
     std::chrono::steady_clock::time_point time_StartExtORB = std::chrono::steady_clock::now();
 #endif
-    thread threadLeft(&Frame::ExtractORB,this,0,imLeft,static_cast<KannalaBrandt8*>(mpCamera)->mvLappingArea[0],static_cast<KannalaBrandt8*>(mpCamera)->mvLappingArea[1]);
-    thread threadRight(&Frame::ExtractORB,this,1,imRight,static_cast<KannalaBrandt8*>(mpCamera2)->mvLappingArea[0],static_cast<KannalaBrandt8*>(mpCamera2)->mvLappingArea[1]);
-    threadLeft.join();
-    threadRight.join();
+    ExtractORBStereo(imLeft,imRight,static_cast<KannalaBrandt8*>(mpCamera)->mvLappingArea[0],static_cast<KannalaBrandt8*>(mpCamera)->mvLappingArea[1],
+                     static_cast<KannalaBrandt8*>(mpCamera2)->mvLappingArea[0],static_cast<KannalaBrandt8*>(mpCamera2)->mvLappingArea[1]);
 #ifdef REGISTER_TIMES
     std::chrono::steady_clock::time_point time_EndExtORB = std::chrono::steady_clock::now();
 
@@ -0,0 +1,305 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2020 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "HammingDistance.h"
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAMMING_X86
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define HAMMING_NEON
+#endif
+
+namespace ORB_SLAM3
+{
+
+namespace
+{
+
+// Bit set count operation from
+// http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetParallel
+inline int PopCount64Scalar(uint64_t v)
+{
+    v = v - ((v >> 1) & 0x5555555555555555ULL);
+    v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+    v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return static_cast<int>((v * 0x0101010101010101ULL) >> 56);
+}
+
+int DistanceScalar(const ORBDescriptor &a, const ORBDescriptor &b)
+{
+    return PopCount64Scalar(a.bits[0] ^ b.bits[0]) + PopCount64Scalar(a.bits[1] ^ b.bits[1]) +
+           PopCount64Scalar(a.bits[2] ^ b.bits[2]) + PopCount64Scalar(a.bits[3] ^ b.bits[3]);
+}
+
+void OneToManyScalar(const ORBDescriptor &q, const ORBDescriptor* pT, std::size_t n, int* pDist)
+{
+    for(std::size_t i=0; i<n; i++)
+        pDist[i] = DistanceScalar(q, pT[i]);
+}
+
+#ifdef HAMMING_X86
+
+// All vector loads are unaligned. Descriptors are often rows of a cv::Mat, which OpenCV 3 only aligns
+// to 16 bytes, and on aligned addresses loadu runs as fast as load.
+
+__attribute__((target("popcnt")))
+int DistancePopcnt(const ORBDescriptor &a, const ORBDescriptor &b)
+{
+    return static_cast<int>(_mm_popcnt_u64(a.bits[0] ^ b.bits[0]) + _mm_popcnt_u64(a.bits[1] ^ b.bits[1]) +
+                            _mm_popcnt_u64(a.bits[2] ^ b.bits[2]) + _mm_popcnt_u64(a.bits[3] ^ b.bits[3]));
+}
+
+__attribute__((target("popcnt")))
+void OneToManyPopcnt(const ORBDescriptor &q, const ORBDescriptor* pT, std::size_t n, int* pDist)
+{
+    const uint64_t q0 = q.bits[0], q1 = q.bits[1], q2 = q.bits[2], q3 = q.bits[3];
+    for(std::size_t i=0; i<n; i++)
+    {
+        pDist[i] = static_cast<int>(_mm_popcnt_u64(q0 ^ pT[i].bits[0]) + _mm_popcnt_u64(q1 ^ pT[i].bits[1]) +
+                                    _mm_popcnt_u64(q2 ^ pT[i].bits[2]) + _mm_popcnt_u64(q3 ^ pT[i].bits[3]));
+    }
+}
+
+// Bytes are counted with a nibble lookup (pshufb) and summed per 64 bit lane with psadbw. This is the
+// per vector step of Harley-Seal; the carry-save tree of Harley-Seal only pays off when a single count
+// is accumulated over many vectors, while here every descriptor needs its own count.
+__attribute__((target("avx2")))
+inline __m256i PopCountLanesAVX2(__m256i v)
+{
+    const __m256i lookup = _mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+                                            0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    const __m256i lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low));
+    const __m256i hi = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low));
+    return _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256());
+}
+
+__attribute__((target("avx2")))
+inline int HorizontalSumAVX2(__m256i v)
+{
+    const __m128i s = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    return static_cast<int>(_mm_cvtsi128_si64(s) + _mm_extract_epi64(s, 1));
+}
+
+__attribute__((target("avx2")))
+int DistanceAVX2(const ORBDescriptor &a, const ORBDescriptor &b)
+{
+    const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a.bits));
+    const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b.bits));
+    return HorizontalSumAVX2(PopCountLanesAVX2(_mm256_xor_si256(va, vb)));
+}
+
+__attribute__((target("avx2")))
+void OneToManyAVX2(const ORBDescriptor &q, const ORBDescriptor* pT, std::size_t n, int* pDist)
+{
+    const __m256i vq = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q.bits));
+
+    std::size_t i=0;
+    for(; i+4<=n; i+=4)
+    {
+        // Lane sums of four descriptors, then one 64 bit lane per descriptor
+        const __m256i c0 = PopCountLanesAVX2(_mm256_xor_si256(vq, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pT[i].bits))));
+        const __m256i c1 = PopCountLanesAVX2(_mm256_xor_si256(vq, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pT[i+1].bits))));
+        const __m256i c2 = PopCountLanesAVX2(_mm256_xor_si256(vq, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pT[i+2].bits))));
+        const __m256i c3 = PopCountLanesAVX2(_mm256_xor_si256(vq, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pT[i+3].bits))));
+
+        // [c0_0+c0_1, c1_0+c1_1, c0_2+c0_3, c1_2+c1_3] and the same for c2, c3
+        const __m256i s01 = _mm256_add_epi64(_mm256_unpacklo_epi64(c0, c1), _mm256_unpackhi_epi64(c0, c1));
+        const __m256i s23 = _mm256_add_epi64(_mm256_unpacklo_epi64(c2, c3), _mm256_unpackhi_epi64(c2, c3));
+        // [d0, d1, d2, d3] as 64 bit lanes
+        const __m256i d = _mm256_add_epi64(_mm256_permute2x128_si256(s01, s23, 0x20),
+                                           _mm256_permute2x128_si256(s01, s23, 0x31));
+        // Distances fit in 32 bits, keep the low half of every lane
+        const __m256i packed = _mm256_permutevar8x32_epi32(d, _mm256_setr_epi32(0,2,4,6,1,3,5,7));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pDist+i), _mm256_castsi256_si128(packed));
+    }
+
+    for(; i<n; i++)
+        pDist[i] = DistanceAVX2(q, pT[i]);
+}
+
+__attribute__((target("avx512f,avx512vl,avx512vpopcntdq")))
+int DistanceAVX512(const ORBDescriptor &a, const ORBDescriptor &b)
+{
+    const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a.bits));
+    const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b.bits));
+    const __m256i c = _mm256_popcnt_epi64(_mm256_xor_si256(va, vb));
+    const __m128i s = _mm_add_epi64(_mm256_castsi256_si128(c), _mm256_extracti128_si256(c, 1));
+    return static_cast<int>(_mm_cvtsi128_si64(s) + _mm_extract_epi64(s, 1));
+}
+
+__attribute__((target("avx512f,avx512vl,avx512vpopcntdq")))
+void OneToManyAVX512(const ORBDescriptor &q, const ORBDescriptor* pT, std::size_t n, int* pDist)
+{
+    // The zero masked forms of broadcast, shuffle and convert are used with full masks throughout: GCC
+    // builds the plain forms on an undefined vector and warns about it with -Wmaybe-uninitialized
+    const __m512i vq = _mm512_maskz_broadcast_i64x4(0xFF, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q.bits)));
+    // Sums every group of four 64 bit lanes: lane j of the result holds descriptor j
+    const __m512i idxLo = _mm512_setr_epi64(0,4,8,12,0,0,0,0);
+
+    std::size_t i=0;
+    for(; i+4<=n; i+=4)
+    {
+        const __m512i c01 = _mm512_popcnt_epi64(_mm512_xor_si512(vq, _mm512_loadu_si512(pT[i].bits)));
+        const __m512i c23 = _mm512_popcnt_epi64(_mm512_xor_si512(vq, _mm512_loadu_si512(pT[i+2].bits)));
+
+        // Pairwise sums, then sums of pairs: lanes 0,4 of a hold d0,d1 and of b hold d2,d3
+        const __m512i s01 = _mm512_add_epi64(c01, _mm512_maskz_shuffle_epi32(0xFFFF, c01, _MM_PERM_BADC));
+        const __m512i s23 = _mm512_add_epi64(c23, _mm512_maskz_shuffle_epi32(0xFFFF, c23, _MM_PERM_BADC));
+        const __m512i t01 = _mm512_add_epi64(s01, _mm512_maskz_shuffle_i64x2(0xFF, s01, s01, _MM_SHUFFLE(2,3,0,1)));
+        const __m512i t23 = _mm512_add_epi64(s23, _mm512_maskz_shuffle_i64x2(0xFF, s23, s23, _MM_SHUFFLE(2,3,0,1)));
+        const __m512i d = _mm512_permutex2var_epi64(t01, idxLo, t23);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pDist+i), _mm256_castsi256_si128(_mm512_maskz_cvtepi64_epi32(0xFF, d)));
+    }
+
+    for(; i<n; i++)
+        pDist[i] = DistanceAVX512(q, pT[i]);
+}
+
+#endif // HAMMING_X86
+
+#ifdef HAMMING_NEON
+
+int DistanceNEON(const ORBDescriptor &a, const ORBDescriptor &b)
+{
+    const uint8_t* pa = reinterpret_cast<const uint8_t*>(a.bits);
+    const uint8_t* pb = reinterpret_cast<const uint8_t*>(b.bits);
+    const uint8x16_t c0 = vcntq_u8(veorq_u8(vld1q_u8(pa), vld1q_u8(pb)));
+    const uint8x16_t c1 = vcntq_u8(veorq_u8(vld1q_u8(pa+16), vld1q_u8(pb+16)));
+    return vaddvq_u16(vpaddlq_u8(vaddq_u8(c0, c1)));
+}
+
+void OneToManyNEON(const ORBDescriptor &q, const ORBDescriptor* pT, std::size_t n, int* pDist)
+{
+    const uint8_t* pq = reinterpret_cast<const uint8_t*>(q.bits);
+    const uint8x16_t q0 = vld1q_u8(pq);
+    const uint8x16_t q1 = vld1q_u8(pq+16);
+    for(std::size_t i=0; i<n; i++)
+    {
+        const uint8_t* pt = reinterpret_cast<const uint8_t*>(pT[i].bits);
+        const uint8x16_t c = vaddq_u8(vcntq_u8(veorq_u8(q0, vld1q_u8(pt))), vcntq_u8(veorq_u8(q1, vld1q_u8(pt+16))));
+        pDist[i] = vaddvq_u16(vpaddlq_u8(c));
+    }
+}
+
+#endif // HAMMING_NEON
+
+} // namespace
+
+bool HammingDistance::IsSupported(Kernel kernel)
+{
+    switch(kernel)
+    {
+    case SCALAR:
+        return true;
+#ifdef HAMMING_X86
+    case POPCNT:
+        return __builtin_cpu_supports("popcnt");
+    case AVX2:
+        return __builtin_cpu_supports("avx2");
+    case AVX512:
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl") &&
+               __builtin_cpu_supports("avx512vpopcntdq");
+#endif
+#ifdef HAMMING_NEON
+    case NEON:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+HammingDistance::Kernels HammingDistance::MakeKernels(Kernel kernel)
+{
+    switch(kernel)
+    {
+#ifdef HAMMING_X86
+    case POPCNT:
+        return {POPCNT, DistancePopcnt, OneToManyPopcnt};
+    case AVX2:
+        // A single pair is four scalar popcnt, cheaper than the vector lookup and the horizontal sum
+        return {AVX2, DistancePopcnt, OneToManyAVX2};
+    case AVX512:
+        return {AVX512, DistanceAVX512, OneToManyAVX512};
+#endif
+#ifdef HAMMING_NEON
+    case NEON:
+        return {NEON, DistanceNEON, OneToManyNEON};
+#endif
+    default:
+        return {SCALAR, DistanceScalar, OneToManyScalar};
+    }
+}
+
+HammingDistance::Kernels& HammingDistance::GetKernels()
+{
+    static Kernels kernels = []()
+    {
+        const Kernel vPreferred[] = {AVX512, AVX2, POPCNT, NEON};
+        for(Kernel kernel : vPreferred)
+        {
+            if(IsSupported(kernel))
+                return MakeKernels(kernel);
+        }
+        return MakeKernels(SCALAR);
+    }();
+    return kernels;
+}
+
+bool HammingDistance::SetKernel(Kernel kernel)
+{
+    if(!IsSupported(kernel))
+        return false;
+
+    GetKernels() = MakeKernels(kernel);
+    return true;
+}
+
+HammingDistance::Kernel HammingDistance::GetKernel()
+{
+    return GetKernels().kernel;
+}
+
+const char* HammingDistance::GetKernelName(Kernel kernel)
+{
+    switch(kernel)
+    {
+    case POPCNT: return "POPCNT";
+    case AVX2: return "AVX2";
+    case AVX512: return "AVX-512 VPOPCNTDQ";
+    case NEON: return "NEON";
+    default: return "scalar";
+    }
+}
+
+void HammingDistance::ManyToMany(const ORBDescriptor* pQueries, std::size_t nQueries,
+                                 const ORBDescriptor* pTargets, std::size_t nTargets, int* pDist)
+{
+    const OneToManyFunc oneToMany = GetKernels().oneToMany;
+    for(std::size_t i=0; i<nQueries; i++)
+        oneToMany(pQueries[i], pTargets, nTargets, pDist + i*nTargets);
+}
+
+} //namespace ORB_SLAM3
@@ -26,6 +26,58 @@
 namespace ORB_SLAM3
 {
 
+namespace
+{
+
+// DBoW2 L1 score of two BoW vectors sorted by word id
+template<class TBowVector1, class TBowVector2>
+double ScoreL1(const TBowVector1 &v1, const TBowVector2 &v2)
+{
+  auto v1_it = v1.begin();
+  auto v2_it = v2.begin();
+  const auto v1_end = v1.end();
+  const auto v2_end = v2.end();
+
+  double score = 0;
+
+  while(v1_it != v1_end && v2_it != v2_end)
+  {
+    const double vi = v1_it->second;
+    const double wi = v2_it->second;
+
+    if(v1_it->first == v2_it->first)
+    {
+      score += fabs(vi - wi) - fabs(vi) - fabs(wi);
+
+      // move v1 and v2 forward
+      ++v1_it;
+      ++v2_it;
+    }
+    else if(v1_it->first < v2_it->first)
+    {
+      // move v1 forward
+      v1_it = v1.lower_bound(v2_it->first);
+      // v1_it = (first element >= v2_it.id)
+    }
+    else
+    {
+      // move v2 forward
+      v2_it = v2.lower_bound(v1_it->first);
+      // v2_it = (first element >= v1_it.id)
+    }
+  }
+
+  // ||v - w||_{L1} = 2 + Sum(|v_i - w_i| - |v_i| - |w_i|)
+  //    for all i | v_i != 0 and w_i != 0
+  // (Nister, 2006)
+  // scaled_||v - w||_{L1} = 1 - 0.5 * ||v - w||_{L1}
+  score = -score/2.0;
+
+  return score; // [0..1]
+}
+
+}
+
 long unsigned int KeyFrame::nNextId=0;
 
 KeyFrame::KeyFrame():
@@ -62,37 +114,37 @@ KeyFrame::KeyFrame():
     //const void_allocator alloc_inst_void (ORB_SLAM3::segment.get_segment_manager());
 
     //keyframes ones
-    mvpLoopCandKFs = ORB_SLAM3::segment.construct<MyVector_keyframe>(boost::interprocess::anonymous_instance)(alloc_inst_key);
-    mvpMergeCandKFs = ORB_SLAM3::segment.construct<MyVector_keyframe>(boost::interprocess::anonymous_instance)(alloc_inst_key);
-    mvpOrderedConnectedKeyFrames = ORB_SLAM3::segment.construct<MyVector_keyframe>(boost::interprocess::anonymous_instance)(alloc_inst_key);
+    mvpLoopCandKFs = ORB_SLAM3::map_segment.Construct<MyVector_keyframe>(alloc_inst_key);
+    mvpMergeCandKFs = ORB_SLAM3::map_segment.Construct<MyVector_keyframe>(alloc_inst_key);
+    mvpOrderedConnectedKeyFrames = ORB_SLAM3::map_segment.Construct<MyVector_keyframe>(alloc_inst_key);
 
     //mappoints ones
-    mvpMapPoints = ORB_SLAM3::segment.construct<MyVector_mappoint>(boost::interprocess::anonymous_instance)(alloc_inst);
+    mvpMapPoints = ORB_SLAM3::map_segment.Construct<MyVector_mappoint>(alloc_inst);
     //mvpMapPoints = mvpMapPoints_original;
 
     //map-keyframe
-    mConnectedKeyFrameWeights = ORB_SLAM3::segment.construct<MyMap>(boost::interprocess::anonymous_instance)(std::less<boost::interprocess::offset_ptr<KeyFrame> >(),alloc_map_key);
+    mConnectedKeyFrameWeights = ORB_SLAM3::map_segment.Construct<MyMap>(std::less<boost::interprocess::offset_ptr<KeyFrame> >(),alloc_map_key);
 
     //set-keyframe
-    mspMergeEdges = ORB_SLAM3::segment.construct<Myset_keyframe>(boost::interprocess::anonymous_instance)(alloc_set_key);
-    mspChildrens = ORB_SLAM3::segment.construct<Myset_keyframe>(boost::interprocess::anonymous_instance)(alloc_set_key);
-    mspLoopEdges = ORB_SLAM3::segment.construct<Myset_keyframe>(boost::interprocess::anonymous_instance)(alloc_set_key);
+    mspMergeEdges = ORB_SLAM3::map_segment.Construct<Myset_keyframe>(alloc_set_key);
+    mspChildrens = ORB_SLAM3::map_segment.Construct<Myset_keyframe>(alloc_set_key);
+    mspLoopEdges = ORB_SLAM3::map_segment.Construct<Myset_keyframe>(alloc_set_key);
 
 
     //mvkeys and mvkeysun
-    mvKeys = ORB_SLAM3::segment.construct<MyVector_CV>(boost::interprocess::anonymous_instance)(alloc_set_cv);
-    mvKeysUn = ORB_SLAM3::segment.construct<MyVector_CV>(boost::interprocess::anonymous_instance)(alloc_set_cv);
+    mvKeys = ORB_SLAM3::map_segment.Construct<MyVector_CV>(alloc_set_cv);
+    mvKeysUn = ORB_SLAM3::map_segment.Construct<MyVector_CV>(alloc_set_cv);
 
     //constructor arguments
     (*mvKeys).clear();// = (static_cast<vector<cv::KeyPoint> >(NULL));
     (*mvKeysUn).clear();
 
     //float vectors
-    mvuRight = ORB_SLAM3::segment.construct<MyVector_float>(boost::interprocess::anonymous_instance)(alloc_set_float);
-    mvDepth = ORB_SLAM3::segment.construct<MyVector_float>(boost::interprocess::anonymous_instance)(alloc_set_float);
-    mvScaleFactors = ORB_SLAM3::segment.construct<MyVector_float>(boost::interprocess::anonymous_instance)(alloc_set_float);
-    mvLevelSigma2 = ORB_SLAM3::segment.construct<MyVector_float>(boost::interprocess::anonymous_instance)(alloc_set_float);
-    mvInvLevelSigma2 = ORB_SLAM3::segment.construct<MyVector_float>(boost::interprocess::anonymous_instance)(alloc_set_float);
+    mvuRight = ORB_SLAM3::map_segment.Construct<MyVector_float>(alloc_set_float);
+    mvDepth = ORB_SLAM3::map_segment.Construct<MyVector_float>(alloc_set_float);
+    mvScaleFactors = ORB_SLAM3::map_segment.Construct<MyVector_float>(alloc_set_float);
+    mvLevelSigma2 = ORB_SLAM3::map_segment.Construct<MyVector_float>(alloc_set_float);
+    mvInvLevelSigma2 = ORB_SLAM3::map_segment.Construct<MyVector_float>(alloc_set_float);
     mvuRight->clear();
     mvDepth->clear();
     mvScaleFactors->clear();
@@ -101,13 +153,13 @@ KeyFrame::KeyFrame():
 
     /* the triple vector */
     //mGridRight = ORB_SLAM3::segment.construct<size_t_vector_vector_vector>(boost::interprocess::anonymous_instance)(alloc_inst_void);
-    mGridRight = ORB_SLAM3::segment.construct<Matrix_3<size_t> >(boost::interprocess::anonymous_instance)(ORB_SLAM3::segment.get_segment_manager());
-    mGrid = ORB_SLAM3::segment.construct<Matrix_3<size_t> >(boost::interprocess::anonymous_instance)(ORB_SLAM3::segment.get_segment_manager());
+    mGridRight = ORB_SLAM3::map_segment.Construct<Matrix_3<size_t> >(ORB_SLAM3::segment.get_segment_manager());
+    mGrid = ORB_SLAM3::map_segment.Construct<Matrix_3<size_t> >(ORB_SLAM3::segment.get_segment_manager());
 
     //record pid
     ownerProcess = getpid();
 
-    mvOrderedWeights = ORB_SLAM3::segment.construct<MyVector_int>(boost::interprocess::anonymous_instance)(alloc_set_int);
+    mvOrderedWeights = ORB_SLAM3::map_segment.Construct<MyVector_int>(alloc_set_int);
 
 
 }
@@ -150,15 +202,15 @@ KeyFrame::KeyFrame(Frame &F, boost::interprocess::offset_ptr<Map> pMap, KeyFrame
     std::cout<<"Keyframe constructor: mnID "<<mnId<<std::endl;
 
     
-    mGrid = ORB_SLAM3::segment.construct<Matrix_3<size_t> >(boost::interprocess::anonymous_instance)(ORB_SLAM3::segment.get_segment_manager());
+    mGrid = ORB_SLAM3::map_segment.Construct<Matrix_3<size_t> >(ORB_SLAM3::segment.get_segment_manager());
     mGrid->clear();
     mGrid->shrink_to_fit();
 
-    auto& nested = *(ORB_SLAM3::segment).find_or_construct<Matrix_1<size_t> >(boost::interprocess::anonymous_instance)(segment.get_segment_manager());
+    auto& nested = *ORB_SLAM3::map_segment.Construct<Matrix_1<size_t> >(segment.get_segment_manager());
     nested.assign(mnGridRows,Vector<size_t>(FRAME_GRID_ROWS,ORB_SLAM3::segment.get_segment_manager()));
     mGrid->assign(mnGridCols,nested);
     
-    mGridRight = ORB_SLAM3::segment.construct<Matrix_3<size_t> >(boost::interprocess::anonymous_instance)(ORB_SLAM3::segment.get_segment_manager());
+    mGridRight = ORB_SLAM3::map_segment.Construct<Matrix_3<size_t> >(ORB_SLAM3::segment.get_segment_manager());
     mGridRight->clear();
     mGridRight->shrink_to_fit();
     mGridRight->assign(mnGridCols,nested);
@@ -188,36 +240,33 @@ KeyFrame::KeyFrame(Frame &F, boost::interprocess::offset_ptr<Map> pMap, KeyFrame
     const ShmemAllocator_cv_keypoint alloc_set_cv(ORB_SLAM3::segment.get_segment_manager());
     const ShmemAllocator_float alloc_set_float(ORB_SLAM3::segment.get_segment_manager());
     const ShmemAllocator_int alloc_set_int(ORB_SLAM3::segment.get_segment_manager());
-    const ShmemAllocator_bow alloc_map_bow(ORB_SLAM3::segment.get_segment_manager());
-    const ShmemAllocator_vec_unsigned_int alloc_vector_uint(ORB_SLAM3::segment.get_segment_manager());
-    const ShmemAllocator_feat alloc_feat_bow(ORB_SLAM3::segment.get_segment_manager());
 
 
 
     //keyframes ones
-    mvpLoopCandKFs = ORB_SLAM3::segment.construct<MyVector_keyframe>(boost::interprocess::anonymous_instance)(alloc_inst_key);
-    mvpMergeCandKFs = ORB_SLAM3::segment.construct<MyVector_keyframe>(boost::interprocess::anonymous_instance)(alloc_inst_key);
-    mvpOrderedConnectedKeyFrames = ORB_SLAM3::segment.construct<MyVector_keyframe>(boost::interprocess::anonymous_instance)(alloc_inst_key);
+    mvpLoopCandKFs = ORB_SLAM3::map_segment.Construct<MyVector_keyframe>(alloc_inst_key);
+    mvpMergeCandKFs = ORB_SLAM3::map_segment.Construct<MyVector_keyframe>(alloc_inst_key);
+    mvpOrderedConnectedKeyFrames = ORB_SLAM3::map_segment.Construct<MyVector_keyframe>(alloc_inst_key);
 
     //mappoints ones
-    mvpMapPoints = ORB_SLAM3::segment.construct<MyVector_mappoint>(boost::interprocess::anonymous_instance)(alloc_inst);
+    mvpMapPoints = ORB_SLAM3::map_segment.Construct<MyVector_mappoint>(alloc_inst);
 
      //map-keyframe
-    mConnectedKeyFrameWeights = ORB_SLAM3::segment.construct<MyMap>(boost::interprocess::anonymous_instance)(std::less<boost::interprocess::offset_ptr<KeyFrame> >(),alloc_map_key);
+    mConnectedKeyFrameWeights = ORB_SLAM3::map_segment.Construct<MyMap>(std::less<boost::interprocess::offset_ptr<KeyFrame> >(),alloc_map_key);
 
 
     //set-keyframe
-    mspMergeEdges = ORB_SLAM3::segment.construct<Myset_keyframe>(boost::interprocess::anonymous_instance)(alloc_set_key);
-    mspChildrens = ORB_SLAM3::segment.construct<Myset_keyframe>(boost::interprocess::anonymous_instance)(alloc_set_key);
-    mspLoopEdges = ORB_SLAM3::segment.construct<Myset_keyframe>(boost::interprocess::anonymous_instance)(alloc_set_key);
+    mspMergeEdges = ORB_SLAM3::map_segment.Construct<Myset_keyframe>(alloc_set_key);
+    mspChildrens = ORB_SLAM3::map_segment.Construct<Myset_keyframe>(alloc_set_key);
+    mspLoopEdges = ORB_SLAM3::map_segment.Construct<Myset_keyframe>(alloc_set_key);
 
     //mvpMapPoints = mvpMapPoints_original;
     (*mvpMapPoints).assign(F.mvpMapPoints.begin(), F.mvpMapPoints.end());
 
     //mvkeys and mvkeysun cv vectors
-    mvKeys = ORB_SLAM3::segment.construct<MyVector_CV>(boost::interprocess::anonymous_instance)(alloc_set_cv);
-    mvKeysUn = ORB_SLAM3::segment.construct<MyVector_CV>(boost::interprocess::anonymous_instance)(alloc_set_cv);
-    mvKeysRight = ORB_SLAM3::segment.construct<MyVector_CV>(boost::interprocess::anonymous_instance)(alloc_set_cv);
+    mvKeys = ORB_SLAM3::map_segment.Construct<MyVector_CV>(alloc_set_cv);
+    mvKeysUn = ORB_SLAM3::map_segment.Construct<MyVector_CV>(alloc_set_cv);
+    mvKeysRight = ORB_SLAM3::map_segment.Construct<MyVector_CV>(alloc_set_cv);
 
 
     (mvKeys)->assign(F.mvKeys.begin(), F.mvKeys.end());
@@ -225,11 +274,11 @@ KeyFrame::KeyFrame(Frame &F, boost::interprocess::offset_ptr<Map> pMap, KeyFrame
     mvKeysRight->assign(F.mvKeysRight.begin(),F.mvKeysRight.end());
 
     //float vectors
-    mvuRight = ORB_SLAM3::segment.construct<MyVector_float>(boost::interprocess::anonymous_instance)(alloc_set_float);
-    mvDepth = ORB_SLAM3::segment.construct<MyVector_float>(boost::interprocess::anonymous_instance)(alloc_set_float);
-    mvScaleFactors = ORB_SLAM3::segment.construct<MyVector_float>(boost::interprocess::anonymous_instance)(alloc_set_float);
-    mvLevelSigma2 = ORB_SLAM3::segment.construct<MyVector_float>(boost::interprocess::anonymous_instance)(alloc_set_float);
-    mvInvLevelSigma2 = ORB_SLAM3::segment.construct<MyVector_float>(boost::interprocess::anonymous_instance)(alloc_set_float);
+    mvuRight = ORB_SLAM3::map_segment.Construct<MyVector_float>(alloc_set_float);
+    mvDepth = ORB_SLAM3::map_segment.Construct<MyVector_float>(alloc_set_float);
+    mvScaleFactors = ORB_SLAM3::map_segment.Construct<MyVector_float>(alloc_set_float);
+    mvLevelSigma2 = ORB_SLAM3::map_segment.Construct<MyVector_float>(alloc_set_float);
+    mvInvLevelSigma2 = ORB_SLAM3::map_segment.Construct<MyVector_float>(alloc_set_float);
     mvuRight->assign(F.mvuRight.begin(),F.mvuRight.end());
     mvDepth->assign(F.mvDepth.begin(), F.mvDepth.end());
     mvScaleFactors->assign(F.mvScaleFactors.begin(),F.mvScaleFactors.end());
@@ -237,80 +286,27 @@ KeyFrame::KeyFrame(Frame &F, boost::interprocess::offset_ptr<Map> pMap, KeyFrame
     mvInvLevelSigma2->assign(F.mvInvLevelSigma2.begin(),F.mvInvLevelSigma2.end());
 
     //int vectors
-    mvLeftToRightMatch = ORB_SLAM3::segment.construct<MyVector_int>(boost::interprocess::anonymous_instance)(alloc_set_int);
-    mvRightToLeftMatch = ORB_SLAM3::segment.construct<MyVector_int>(boost::interprocess::anonymous_instance)(alloc_set_int);
+    mvLeftToRightMatch = ORB_SLAM3::map_segment.Construct<MyVector_int>(alloc_set_int);
+    mvRightToLeftMatch = ORB_SLAM3::map_segment.Construct<MyVector_int>(alloc_set_int);
     mvLeftToRightMatch->assign(F.mvLeftToRightMatch.begin(),F.mvLeftToRightMatch.end());
     mvRightToLeftMatch->assign(F.mvRightToLeftMatch.begin(),F.mvRightToLeftMatch.end());
-    mvOrderedWeights = ORB_SLAM3::segment.construct<MyVector_int>(boost::interprocess::anonymous_instance)(alloc_set_int);
+    mvOrderedWeights = ORB_SLAM3::map_segment.Construct<MyVector_int>(alloc_set_int);
 
 
-    //the map for bow vec
-    mBowVec = ORB_SLAM3::segment.construct<bowMap>(boost::interprocess::anonymous_instance)(std::less<unsigned int >(),alloc_map_bow);
-    mFeatVec = ORB_SLAM3::segment.construct<featMap>(boost::interprocess::anonymous_instance)(std::less<unsigned int >(),alloc_feat_bow);
+    // BoW vectors of the frame, computed with the same vocabulary
+    const uint64_t vocabularyFingerprint = mpORBvocabulary ? mpORBvocabulary->GetFingerprint() : 0;
+    mBowVec = ORB_SLAM3::map_segment.Construct<SharedBowVector>();
+    mFeatVec = ORB_SLAM3::map_segment.Construct<SharedFeatureVector>();
+    mBowVec->Assign(F.mBowVec, vocabularyFingerprint);
+    mFeatVec->Assign(F.mFeatVec, vocabularyFingerprint);
 
-    //now fill up the mBowVec and mFeatVec
-    for(auto it = F.mBowVec.begin(); it != F.mBowVec.end(); ++it) {
-        mBowVec->insert(std::pair<unsigned int, double>(it->first, it->second));
-    }
-
-    for(auto it = F.mFeatVec.begin(); it != F.mFeatVec.end(); ++it) {
-        //here since the second element is a vector, we need to create a vector dynamically in the shared memory and insert it
-        //create a vector first. 
-        boost::interprocess::offset_ptr<Vector<unsigned int> > insertable_vector = ORB_SLAM3::segment.construct<Vector<unsigned int> >(boost::interprocess::anonymous_instance)(alloc_vector_uint);
-        insertable_vector->assign(it->second.begin(),it->second.end());
-        std::pair<unsigned int, Vector<unsigned int>  > p(it->first,*insertable_vector);
-        mFeatVec->insert(p);
-    }
-
-    //creating all the matrix in the keyframe
+    //The fixed size matrices (poses, velocities, GBA and merge variables) are stored inline as ShmMat
     std::cout<<"Keyframe constructor.--++ this one is used"<<std::endl;
-    mTcwGBA_ptr = ORB_SLAM3::allocator_instance.allocate(4*4*4);
-    mTcwBefGBA_ptr = ORB_SLAM3::allocator_instance.allocate(4*4*4);
-    mVwbGBA_ptr = ORB_SLAM3::allocator_instance.allocate(3*4*4);
-    mVwbBefGBA_ptr = ORB_SLAM3::allocator_instance.allocate(10*4*4);
-
-    mTcwGBA = cv::Mat(4,4,CV_32F,mTcwGBA_ptr.get());
-    mTcwBefGBA = cv::Mat(4,4,CV_32F,mTcwBefGBA_ptr.get());
-    mVwbGBA = cv::Mat(3,1,CV_32F,mVwbGBA_ptr.get());
-    mVwbBefGBA = cv::Mat(3,1,CV_32F,mVwbBefGBA_ptr.get());
-
-    //for basic matrices.
-    Tcw_ptr = ORB_SLAM3::allocator_instance.allocate(4*4*4);
-    Twc_ptr = ORB_SLAM3::allocator_instance.allocate(4*4*4);
-    Ow_ptr = ORB_SLAM3::allocator_instance.allocate(3*1*4);
-    Cw_ptr = ORB_SLAM3::allocator_instance.allocate(4*4);
-    Owb_ptr = ORB_SLAM3::allocator_instance.allocate(4*4);
-    Vw_ptr = ORB_SLAM3::allocator_instance.allocate(3*4);
-
-    //Other matrices. No idea how big the size it should be.
-    //Good big size. so it works
-    mTcwMerge_ptr = ORB_SLAM3::allocator_instance.allocate(4*4*4);
-    mTcwBefMerge_ptr = ORB_SLAM3::allocator_instance.allocate(4*4*4);
-    mTwcBefMerge_ptr = ORB_SLAM3::allocator_instance.allocate(4*4*4);
-    mVwbMerge_ptr = ORB_SLAM3::allocator_instance.allocate(3*1*4);
-    mVwbBefMerge_ptr = ORB_SLAM3::allocator_instance.allocate(10*4*4);
-    mTcp_ptr = ORB_SLAM3::allocator_instance.allocate(4*4*4);
-
-    Tcw = cv::Mat(4,4,CV_32F,Tcw_ptr.get());
-    Twc = cv::Mat(4,4,CV_32F,Twc_ptr.get());
-    Ow = cv::Mat(3,1,CV_32F,Ow_ptr.get());
-    Cw = cv::Mat(4,1,CV_32F,Cw_ptr.get());
-    Owb = cv::Mat(3,1,CV_32F,Owb_ptr.get());
-    mTcp = cv::Mat(4,4,CV_32F,mTcp_ptr.get());
-
-    mTcwMerge = cv::Mat(4,4,CV_32F,mTcwMerge_ptr.get());
-    mTcwBefMerge = cv::Mat(4,4,CV_32F,mTcwBefMerge_ptr.get());
-    mTwcBefMerge = cv::Mat(4,4,CV_32F,mTwcBefMerge_ptr.get());
-    mVwbMerge = cv::Mat(3,1,CV_32F,mVwbMerge_ptr.get());
-
-    Vw = cv::Mat(3,1,CV_32F,Vw_ptr.get());
-
-    cv::Mat temp = cv::Mat::zeros(3,1,CV_32F);
 
     if(F.mVw.empty())
-        temp.copyTo(Vw);
+        Vw = cv::Mat::zeros(3,1,CV_32F);
     else
-        F.mVw.copyTo(Vw);
+        Vw = F.mVw;
     //Old-code for Vw
    /*
     if(F.mVw.empty())
@@ -324,12 +320,12 @@ KeyFrame::KeyFrame(Frame &F, boost::interprocess::offset_ptr<Map> pMap, KeyFrame
     mDescriptors_rows = mDescriptors_size.height;
     mDescriptors_cols = mDescriptors_size.width;
 
-    mDescriptors_ptr = ORB_SLAM3::allocator_instance.allocate(F.mDescriptors.total()*F.mDescriptors.elemSize());
+    mDescriptors_ptr = ORB_SLAM3::map_segment.Allocate(F.mDescriptors.total()*F.mDescriptors.elemSize(), alignof(ORBDescriptor));
     mDescriptors = cv::Mat(mDescriptors_size,F.mDescriptors.type(),mDescriptors_ptr.get());
     F.mDescriptors.copyTo(mDescriptors);
     mDescriptors_type = F.mDescriptors.type();
 
-    mk_ptr = ORB_SLAM3::allocator_instance.allocate(F.mK.total()*F.mK.elemSize());
+    mk_ptr = ORB_SLAM3::map_segment.Allocate(F.mK.total()*F.mK.elemSize());
     mK = cv::Mat(F.mK.size(),F.mK.type(),mk_ptr.get());
     F.mK.copyTo(mK);
     mk_rows = F.mK.size().height;
@@ -349,144 +345,6 @@ KeyFrame::KeyFrame(Frame &F, boost::interprocess::offset_ptr<Map> pMap, KeyFrame
     //record pid
     ownerProcess = getpid();
 
-}
-
-/* helper functions to fix matrix */
-void KeyFrame::FixMatrices(boost::interprocess::offset_ptr<KeyFrame> pKF)
-{
-    // if same pid is calling, don't update
-    if(ownerProcess == getpid())
-    {
-        //std::cout<<"===== Same PID. Returning ----\n";
-        return;
-    }
-
-    //std::cout<<"Fix the loop closer matrices\n";
-    //std::cout<<"Size of cv::mat: "<<sizeof(cv::Mat)<<std::endl;
-    //std::cout<<"Create a fake matrix "<<std::endl;
-    cv::Mat *fake1 = new cv::Mat(4,4,CV_32F,mTcwGBA_ptr.get());
-    memcpy(&(pKF->mTcwGBA),fake1,sizeof(cv::Mat));
-    
-    //std::cout<<"Works with memcpy? "<<std::endl;
-    //pKF->mTcwGBA.addref();
-    //std::cout<<"Release?"<<std::endl;
-    //cv::Mat * fake111 = new cv::Mat(4,4,CV_32F,mTcwGBA_ptr.get());
-    //pKF->mTcwGBA = *fake111;
-    //pKF->mTcwGBA = cv::Mat(4,4,CV_32F,mTcwGBA_ptr.get());
-    /*
-    mTcwGBA = cv::Mat(4,4,CV_32F,mTcwGBA_ptr.get());
-    mTcwBefGBA = cv::Mat(4,4,CV_32F,mTcwBefGBA_ptr.get());
-    mVwbGBA = cv::Mat(3,1,CV_32F,mVwbGBA_ptr.get());
-    mVwbBefGBA = cv::Mat(3,1,CV_32F,mVwbBefGBA_ptr.get());
-    
-    for(int i =0; i < 16; i++)
-    {
-        std::cout<<((float*)(Tcw_ptr.get()))[i]<<std::endl;
-    }
-    */
-    //std::cout<<"Memcpy success?"<<std::endl;
-    //fake.addref();
-    //pKF->mTcwGBA = cv::Mat(4,4,CV_32F,mTcwGBA_ptr.get());
-    //std::cout<<"Here works?"<<std::endl;
-    //std::cout<<"Finished release and reinitailizztion\n";
-    
-    //Second merge
-    cv::Mat *fake2 = new cv::Mat(4,4,CV_32F,mTcwBefGBA_ptr.get());
-    memcpy(&(pKF->mTcwBefGBA),fake2,sizeof(cv::Mat));
-    //pKF->mTcwBefGBA = cv::Mat(4,4,CV_32F,mTcwBefGBA_ptr.get());
-
-    //Third merge
-    cv::Mat *fake3 = new cv::Mat(3,1,CV_32F,mVwbGBA_ptr.get());
-    memcpy(&(pKF->mVwbGBA),fake3,sizeof(cv::Mat));
-    //pKF->mVwbGBA = cv::Mat(3,1,CV_32F,mVwbGBA_ptr.get());
-    //Third merge
-    cv::Mat *fake4 = new cv::Mat(3,1,CV_32F,mVwbBefGBA_ptr.get());
-    memcpy(&(pKF->mVwbBefGBA),fake4,sizeof(cv::Mat));
-    //pKF->mVwbBefGBA = cv::Mat(3,1,CV_32F,mVwbBefGBA_ptr.get());
-
-    //Previous ones
-    //mTcwBefGBA = *(new cv::Mat(4,4,CV_32F));
-    //mVwbGBA = *(new cv::Mat(3,1,CV_32F));
-    //mVwbBefGBA = *(new cv::Mat(3,1,CV_32F));
-
-    //std::cout<<"Fix the main matrices\n";
-    cv::Mat *fake5 = new cv::Mat(4,4,CV_32F,pKF->Tcw_ptr.get());
-    memcpy(&(pKF->Tcw), fake5, sizeof(cv::Mat));
-    //pKF->Tcw = cv::Mat(4,4,CV_32F,pKF->Tcw_ptr.get());
-
-    cv::Mat *fake6 = new cv::Mat(4,4,CV_32F,pKF->Twc_ptr.get());
-    memcpy(&(pKF->Twc), fake6, sizeof(cv::Mat));
-    //pKF->Twc = cv::Mat(4,4,CV_32F,pKF->Twc_ptr.get());
-
-    cv::Mat *fake7 = new cv::Mat(3,1,CV_32F,pKF->Ow_ptr.get());
-    memcpy(&(pKF->Ow), fake7, sizeof(cv::Mat));
-    //pKF->Ow = cv::Mat(3,1,CV_32F,pKF->Ow_ptr.get());
-
-    cv::Mat *fake8 = new cv::Mat(4,1,CV_32F,pKF->Cw_ptr.get());
-    memcpy(&(pKF->Cw), fake8, sizeof(cv::Mat));
-    //pKF->Cw = cv::Mat(4,1,CV_32F,pKF->Cw_ptr.get());
-
-    cv::Mat *fake9 = new cv::Mat(3,1,CV_32F,pKF->Owb_ptr.get());
-    memcpy(&(pKF->Owb), fake9, sizeof(cv::Mat));
-    //pKF->Owb = cv::Mat(3,1,CV_32F,pKF->Owb_ptr.get());
-
-    /*
-    pKF->Tcw = cv::Mat(4,4,CV_32F,pKF->Tcw_ptr.get());
-    pKF->Twc = cv::Mat(4,4,CV_32F,pKF->Twc_ptr.get());
-    pKF->Ow = cv::Mat(3,1,CV_32F,pKF->Ow_ptr.get());
-    pKF->Cw = cv::Mat(4,1,CV_32F,pKF->Cw_ptr.get());
-    pKF->Owb = cv::Mat(3,1,CV_32F,pKF->Owb_ptr.get());
-    */
-
-    //std::cout<<"Fix the merge matrices\n";
-
-    cv::Mat *fake10 = new cv::Mat(4,4,CV_32F,pKF->mTcwMerge_ptr.get());
-    cv::Mat *fake11 = new cv::Mat(4,4,CV_32F,pKF->mTcwBefMerge_ptr.get());
-    cv::Mat *fake12 = new cv::Mat(4,4,CV_32F,pKF->mTwcBefMerge_ptr.get());
-    cv::Mat *fake13 = new cv::Mat(3,1,CV_32F,pKF->mVwbMerge_ptr.get());
-
-    cv::Mat *fake16 = new cv::Mat(4,4,CV_32F, pKF->mTcp_ptr.get());
-
-    memcpy(&(pKF->mTcwMerge), fake10, sizeof(cv::Mat));
-    memcpy(&(pKF->mTcwBefMerge), fake11, sizeof(cv::Mat));
-    memcpy(&(pKF->mTwcBefMerge), fake12, sizeof(cv::Mat));
-    memcpy(&(pKF->mVwbMerge), fake13, sizeof(cv::Mat));
-    memcpy(&(pKF->mTcp), fake16, sizeof(cv::Mat));
-
-    //pKF->mTcwMerge = cv::Mat(4,4,CV_32F,pKF->mTcwMerge_ptr.get());
-   // pKF->mTcwBefMerge = cv::Mat(4,4,CV_32F,pKF->mTcwBefMerge_ptr.get());
-    //pKF->mTwcBefMerge = cv::Mat(4,4,CV_32F,pKF->mTwcBefMerge_ptr.get());
-    //pKF->mVwbMerge = cv::Mat(3,1,CV_32F,pKF->mVwbMerge_ptr.get());
-    /*
-
-    pKF->mTcwMerge = cv::Mat(4,4,CV_32F,pKF->mTcwMerge_ptr.get());
-    pKF->mTcwBefMerge = cv::Mat(4,4,CV_32F,pKF->mTcwBefMerge_ptr.get());
-    pKF->mTwcBefMerge = cv::Mat(4,4,CV_32F,pKF->mTwcBefMerge_ptr.get());
-    pKF->mVwbMerge = cv::Mat(3,1,CV_32F,pKF->mVwbMerge_ptr.get());
-    */
-    //cv::Mat *fake14 = new cv::Mat(mDescriptors_rows,mDescriptors_cols,mDescriptors_type,pKF->mDescriptors_ptr.get());
-    cv::Mat *fake14 = new cv::Mat(mDescriptors_rows,mDescriptors_cols,mDescriptors_type,pKF->mDescriptors_ptr.get());
-    memcpy(&(pKF->mDescriptors), fake14, sizeof(cv::Mat));
-
-    cv::Mat *fake15 = new cv::Mat(mk_rows,mk_cols,mk_type,pKF->mk_ptr.get());
-    memcpy (&(pKF->mK), fake15, sizeof(cv::Mat));
-
-
-    //SetKeyFrameDatabase(pKF->;
-
-    //mBowVec = new DBoW2::BowVector();
-    //mFeatVec = new DBoW2::FeatureVector();
-    std::cout<<"Completed the matrices of the keyFrame: "<<pKF->mnId<<std::endl;
-
-    //update the PID
-    ownerProcess = getpid();
-
-    //SetPose(Tcw);
-
-    //UpdateBestCovisibles();
-    //std::cout<<"Updated the Best Covisibles--"<<std::endl;
-
-   
 }
 
  void KeyFrame::ResetCamera(std::vector<GeometricCamera* >newCameras){
@@ -499,172 +357,59 @@ void KeyFrame::FixMatrices(boost::interprocess::offset_ptr<KeyFrame> pKF)
 
  }
 
- double KeyFrame::score_KFDatabase_ptr(const boost::interprocess::offset_ptr<bowMap> v1, const boost::interprocess::offset_ptr<bowMap> v2)
-{
-  //BowVector::const_iterator v1_it, v2_it;
-  //const BowVector::const_iterator v1_end = v1.end();
-  //const BowVector::const_iterator v2_end = v2.end();
-  
-  auto v1_it = v1->begin();
-  auto v2_it = v2->begin();
-  auto v1_end = v1->end();
-  auto v2_end = v2->end();
-  
-  double score = 0;
-  
-  while(v1_it != v1_end && v2_it != v2_end)
-  {
-    const double& vi = v1_it->second;
-    const double& wi = v2_it->second;
-    
-    if(v1_it->first == v2_it->first)
-    {
-      score += fabs(vi - wi) - fabs(vi) - fabs(wi);
-      
-      // move v1 and v2 forward
-      ++v1_it;
-      ++v2_it;
-    }
-    else if(v1_it->first < v2_it->first)
-    {
-      // move v1 forward
-      v1_it = v1->lower_bound(v2_it->first);
-      // v1_it = (first element >= v2_it.id)
-    }
-    else
-    {
-      // move v2 forward
-      v2_it = v2->lower_bound(v1_it->first);
-      // v2_it = (first element >= v1_it.id)
-    }
-  }
-  
-  // ||v - w||_{L1} = 2 + Sum(|v_i - w_i| - |v_i| - |w_i|) 
-  //    for all i | v_i != 0 and w_i != 0 
-  // (Nister, 2006)
-  // scaled_||v - w||_{L1} = 1 - 0.5 * ||v - w||_{L1}
-  score = -score/2.0;
-
-  return score; // [0..1]
+double KeyFrame::score_KFDatabase_ptr(const SharedBowVector &v1, const SharedBowVector &v2)
+{
+  return ScoreL1(v1, v2);
 }
 
-double KeyFrame::score_KFDatabase_frame(const std::map<double,unsigned int> *v1, const boost::interprocess::offset_ptr<bowMap> v2)
+double KeyFrame::score_KFDatabase_frame(const DBoW2::BowVector &v1, const SharedBowVector &v2)
 {
-  //BowVector::const_iterator v1_it, v2_it;
-  //const BowVector::const_iterator v1_end = v1.end();
-  //const BowVector::const_iterator v2_end = v2.end();
-  
-  auto v1_it = v1->begin();
-  auto v2_it = v2->begin();
-  auto v1_end = v1->end();
-  auto v2_end = v2->end();
-  
-  double score = 0;
-  
-  while(v1_it != v1_end && v2_it != v2_end)
-  {
-    const double& vi = v1_it->second;
-    const double& wi = v2_it->second;
-    
-    if(v1_it->first == v2_it->first)
-    {
-      score += fabs(vi - wi) - fabs(vi) - fabs(wi);
-      
-      // move v1 and v2 forward
-      ++v1_it;
-      ++v2_it;
-    }
-    else if(v1_it->first < v2_it->first)
-    {
-      // move v1 forward
-      v1_it = v1->lower_bound(v2_it->first);
-      // v1_it = (first element >= v2_it.id)
-    }
-    else
-    {
-      // move v2 forward
-      v2_it = v2->lower_bound(v1_it->first);
-      // v2_it = (first element >= v1_it.id)
-    }
-  }
-  
-  // ||v - w||_{L1} = 2 + Sum(|v_i - w_i| - |v_i| - |w_i|) 
-  //    for all i | v_i != 0 and w_i != 0 
-  // (Nister, 2006)
-  // scaled_||v - w||_{L1} = 1 - 0.5 * ||v - w||_{L1}
-  score = -score/2.0;
-
-  return score; // [0..1]
+  return ScoreL1(v1, v2);
 }
 
 
- void KeyFrame::FixBow(boost::interprocess::offset_ptr<KeyFrame> pKF,ORBVocabulary* mpORBVocabulary_2){
-    std::cout<<"We probably never need to run this\n";
-    //if(pKF->mBowVec.empty() || pKF->mFeatVec.empty())
-    //{
-        //memcpy(&(pKF->mBowVec), &mBowVec, sizeof(DBoW2::BowVector));
-        //memcpy(&(pKF->mFeatVec), &mFeatVec, sizeof(DBoW2::FeatureVector));
-
-        DBoW2::BowVector *newBow = new DBoW2::BowVector();// = mBowVec;
-        DBoW2::FeatureVector *newFeat = new DBoW2::FeatureVector();
-        memcpy(&(pKF->mBowVec_actual), newBow, sizeof(DBoW2::BowVector));
-        //std::cout<<"first memcpy passed\n";
-        memcpy(&(pKF->mFeatVec_actual), newFeat, sizeof(DBoW2::FeatureVector));
-        //pKF->mBowVec = mBowVec;
-        //pKF->mFeatVec = mFeatVec;
-        //std::cout<<"Fails here? descriptor size: "<<pKF->mDescriptors.size()<<std::endl;
-        vector<cv::Mat> vCurrentDesc = Converter::toDescriptorVector(pKF->mDescriptors);
-        // Feature vector associate features with nodes in the 4th level (from leaves up)
-        // We assume the vocabulary tree has 6 levels, change the 4 otherwise
-        //std::cout<<"Or fails here. vCurrentDesc size: "<<vCurrentDesc.size()<<std::endl;
-        
-        //mpORBvocabulary->transform(vCurrentDesc,*newBow,*newFeat,4);
-        
-        
-        
-        //std::cout<<"Transform passed\n";
-        //pKF->mBowVec = *newBow;
-        //pKF->mFeatVec = *newFeat;
-
-        mpORBvocabulary->transform(vCurrentDesc,pKF->mBowVec_actual,pKF->mFeatVec_actual,4);
-        
-        
-        //pKF->mBowVec = newBow;
-        //pKF->mFeatVec = newFeat;
-    //}
-        std::cout<<"Fixed BOW\n";
+void KeyFrame::FixBow(boost::interprocess::offset_ptr<KeyFrame> pKF,ORBVocabulary* pORBVocabulary)
+{
+    // Vectors computed with the same vocabulary, maybe by another process, are used as they are
+    const uint64_t fingerprint = pORBVocabulary->GetFingerprint();
+    if(pKF->mBowVec->IsComputedWith(fingerprint) && pKF->mFeatVec->IsComputedWith(fingerprint))
+        return;
 
+    DBoW2::BowVector bowVec;
+    DBoW2::FeatureVector featVec;
+    pORBVocabulary->transform(pKF->GetDescriptors(),bowVec,featVec,4);
+    pKF->mBowVec->Assign(bowVec, fingerprint);
+    pKF->mFeatVec->Assign(featVec, fingerprint);
 }
 
 
 void KeyFrame::ComputeBoW()
 {
-    if(mBowVec_actual.empty() || mFeatVec_actual.empty())
-    {
-        vector<cv::Mat> vCurrentDesc = Converter::toDescriptorVector(mDescriptors);
-        // Feature vector associate features with nodes in the 4th level (from leaves up)
-        // We assume the vocabulary tree has 6 levels, change the 4 otherwise
-        mpORBvocabulary->transform(vCurrentDesc,mBowVec_actual,mFeatVec_actual,4);
-    }
-    //Iterate throught he computed BOW and then fill it in the maps.
-     //now fill up the mBowVec and mFeatVec
-    for(auto it = mBowVec_actual.begin(); it != mBowVec_actual.end(); ++it) {
-        mBowVec->insert(std::pair<unsigned int, double>(it->first,it->second));
-    }
-    for(auto it2 = mFeatVec_actual.begin(); it2 != mFeatVec_actual.end(); ++it2) {
-        //mFeatVec->insert(std::pair<unsigned int, double>(it2->first,it2->second));
-        const ShmemAllocator_vec_unsigned_int alloc_vector_uint(ORB_SLAM3::segment.get_segment_manager());
-        MyVector_unsigned_int * vec_ptr = ORB_SLAM3::segment.construct<MyVector_unsigned_int>(boost::interprocess::anonymous_instance)(alloc_vector_uint);
-        vec_ptr->assign(it2->second.begin(),it2->second.end());
-        mFeatVec->insert(std::pair<unsigned int, Vector<unsigned int> >(it2->first,*vec_ptr));
-    }
+    const uint64_t fingerprint = mpORBvocabulary->GetFingerprint();
+    if(!mBowVec->empty() && !mFeatVec->empty() && mBowVec->IsComputedWith(fingerprint) && mFeatVec->IsComputedWith(fingerprint))
+        return;
+
+    // Feature vector associate features with nodes in the 4th level (from leaves up)
+    // We assume the vocabulary tree has 6 levels, change the 4 otherwise
+    DBoW2::BowVector bowVec;
+    DBoW2::FeatureVector featVec;
+    mpORBvocabulary->transform(GetDescriptors(),bowVec,featVec,4);
+    mBowVec->Assign(bowVec, fingerprint);
+    mFeatVec->Assign(featVec, fingerprint);
+}
 
+DescriptorSpan KeyFrame::GetDescriptors() const
+{
+    // The block never changes after construction, no lock is needed
+    if(mDescriptors_rows <= 0)
+        return DescriptorSpan();
+    return DescriptorSpan(reinterpret_cast<const ORBDescriptor*>(mDescriptors_ptr.get()), mDescriptors_rows);
 }
 
 void KeyFrame::SetPose(const cv::Mat &Tcw_)
 {
     std::unique_lock<mutex> lock(mMutexPose);
-    Tcw_.copyTo(Tcw);
+    Tcw = Tcw_;
     cv::Mat Rcw = Tcw.rowRange(0,3).colRange(0,3);
     cv::Mat tcw = Tcw.rowRange(0,3).col(3);
     cv::Mat Rwc = Rcw.t();
@@ -674,8 +419,7 @@ void KeyFrame::SetPose(const cv::Mat &Tcw_)
 
 
     //Twc = cv::Mat::eye(4,4,Tcw.type());
-    cv::Mat temp = cv::Mat::eye(4,4,Tcw.type());
-    temp.copyTo(Twc);
+    Twc = cv::Mat::eye(4,4,Tcw.type());
     Rwc.copyTo(Twc.rowRange(0,3).colRange(0,3));
     Ow.copyTo(Twc.rowRange(0,3).col(3));
     cv::Mat center = (cv::Mat_<float>(4,1) << mHalfBaseline, 0 , 0, 1);
@@ -698,7 +442,7 @@ void KeyFrame::SetPose(const cv::Mat &Tcw_)
 void KeyFrame::SetVelocity(const cv::Mat &Vw_)
 {
     std::unique_lock<mutex> lock(mMutexPose);
-    Vw_.copyTo(Vw);
+    Vw = Vw_;
 }
 
 
@@ -707,27 +451,21 @@ cv::Mat KeyFrame::GetPose()
     //std::cout<<"Before making a clone1\n";
    
     //std::unique_lock<mutex> lock(mMutexPose);
-    cv::Mat returnable = cv::Mat(4,4,CV_32F,Tcw_ptr.get());
     //std::cout<<"Before making a clone2\n";
-    //return Tcw.clone();
-    return returnable.clone();
+    return Tcw.clone();
 }
 
 cv::Mat KeyFrame::GetPoseInverse()
 {
     //std::unique_lock<mutex> lock(mMutexPose);
     //new code to see why the problem is coming from some matrix.
-    cv::Mat returnable = cv::Mat(4,4,CV_32F,Twc_ptr.get());
-    //return Twc.clone();
-    return returnable.clone();
+    return Twc.clone();
 }
 
 cv::Mat KeyFrame::GetCameraCenter()
 {
     std::unique_lock<mutex> lock(mMutexPose);
-    cv::Mat returnable = cv::Mat(3,1,CV_32F,Ow_ptr.get());
-    //return Ow.clone();
-    return returnable.clone();
+    return Ow.clone();
 }
 
 cv::Mat KeyFrame::GetStereoCenter()
@@ -1457,7 +1195,7 @@ void KeyFrame::SetBadFlag()
             cv::Mat temp_map = Tcw*mpParent->GetPoseInverse(); 
             std::cout<<"Size of temp_map is: "<<temp_map.size()<<" element size: "<<temp_map.elemSize()<<std::endl;
             //mTcp = Tcw*mpParent->GetPoseInverse();
-            temp_map.copyTo(mTcp);
+            mTcp = temp_map;
         }
         mbBad = true;
     }
@@ -24,628 +24,337 @@
 
 #include<mutex>
 #include<cfloat>
+#include<algorithm>
+#include<unordered_map>
 
 using namespace std;
 
 namespace ORB_SLAM3
 {
 
-KeyFrameDatabase::KeyFrameDatabase (const ORBVocabulary &voc):
-    mpVoc(&voc)
+namespace
 {
-    mvInvertedFile.resize(voc.size());
-}
-
 
-void KeyFrameDatabase::add(boost::interprocess::offset_ptr<KeyFrame> pKF)
+// Keyframes sharing words with a query, stored contiguously along with the number of shared words and the
+// score of each one. It belongs to the query, so concurrent queries do not write to the keyframes.
+struct KeyFrameScores
 {
-    /*
-    std::cout<<"KeyFrameDatabase::add1: Pk-id "<<pKF->mnId<<std::endl;
-    DBoW2::BowVector newBow = DBoW2::BowVector();// = mBowVec;
-    DBoW2::FeatureVector newFeat = DBoW2::FeatureVector();
-    cv::Mat descriptor_mat;
-    pKF->mDescriptors.copyTo(descriptor_mat);
-    std::vector<cv::Mat> vCurrentDesc;
-
-    vCurrentDesc.reserve(descriptor_mat.rows);
-    for (int j=0;j<descriptor_mat.rows;j++)
-        vCurrentDesc.push_back(descriptor_mat.row(j));
-    
-             
-        //pKF->mBowVec = mBowVec;
-        //pKF->mFeatVec = mFeatVec;
-        std::cout<<"Fails here? descriptor size: "<<descriptor_mat<<std::endl;
-        //vCurrentDesc = Converter::toDescriptorVector(descriptor_mat);
-        // Feature vector associate features with nodes in the 4th level (from leaves up)
-        // We assume the vocabulary tree has 6 levels, change the 4 otherwise
-        //std::cout<<"Or fails here. vCurrentDesc size: "<<vCurrentDesc.size()<<std::endl;
-        mpVoc->transform(vCurrentDesc,newBow,newFeat,4);
-
-    
-    std::cout<<"KeyFrameDatabase::add entry"<<newBow.size()<<std::endl;
-    //std::unique_lock<mutex> lock(mMutex);
-    //std::cout<<"KeyFrameDatabase::after lock. mBowVec Size: "<<pKF->mBowVec.size()<<" mvInvertedFile size: "<<mvInvertedFile.size()<<std::endl;
-    */
-    int counter = 0;
-    // forgive me compiler I hope auto iterator will work.
-    //for(DBoW2::BowVector::const_iterator vit= pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit!=vend; vit++){
-    
-    for(auto vit= pKF->mBowVec->begin(); vit!=pKF->mBowVec->end(); vit++){
-
-    //for(DBoW2::BowVector::const_iterator vit= newBow.begin(), vend=newBow.end(); vit!=vend; vit++){
-        //std::cout<<"Crash?"<<std::endl;
-        //std::cout<<"BowVec output: "<<vit->first<<std::endl;
-        counter++;
-        mvInvertedFile[vit->first].push_back(pKF);
-        //if(counter>=pKF->mBowVec.size())
-        if(counter>=pKF->mBowVec->size())
-            break;
-    }
-    //std::cout<<"KeyFrameDatabase::add2\n";
-    //std::cout<<"Finished pushing the keyframe into Inverted File\n";
-}
+    vector<boost::interprocess::offset_ptr<KeyFrame> > vpKFs;
+    vector<int> vnWords;
+    vector<float> vScores;
+    unordered_map<const KeyFrame*,int> mIndices;
 
-void KeyFrameDatabase::erase(boost::interprocess::offset_ptr<KeyFrame>  pKF)
-{
-    
-    //temp-temp-temp-- don't erase anything
-    //return;
-
-    //remove
-    //std::unique_lock<mutex> lock(mMutex);
-    std::cout<<"KeyFrameDatabase erase 1\n";
-
-    int counter = 0;
-
-    //pKF->FixBow(pKF,nullptr);
-    // Erase elements in the Inverse File for the entry
-    //for(DBoW2::BowVector::const_iterator vit=pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit!=vend; vit++)
-    for(auto vit= pKF->mBowVec->begin(); vit!=pKF->mBowVec->end(); vit++)
+    void AddWord(boost::interprocess::offset_ptr<KeyFrame> pKF)
     {
-        std::cout<<"KeyFrameDatabase erase 1.1\n";
-        std::cout<<"KeyFrameDatabase erase 1.2 keyframe: "<<pKF->mnId<<std::endl;
-        std::cout<<"vit->first: "<<vit->first<<std::endl;
-        std::cout<<"mvInvertedFile size: "<<mvInvertedFile.size()<<std::endl;
-        // List of keyframes that share the word
-        list<boost::interprocess::offset_ptr<KeyFrame> > &lKFs =   mvInvertedFile[vit->first];
-        std::cout<<"KeyFrameDatabase erase 2\n";
-        counter++;
-
-        for(list<boost::interprocess::offset_ptr<KeyFrame> >::iterator lit=lKFs.begin(), lend= lKFs.end(); lit!=lend; lit++)
+        pair<unordered_map<const KeyFrame*,int>::iterator,bool> it = mIndices.emplace(pKF.get(), (int)vpKFs.size());
+        if(it.second)
         {
-            std::cout<<"KeyFrameDatabase erase 3\n";
-            if(*lit){
-                if(pKF==*lit)
-                    {
-                    lKFs.erase(lit);
-                    break;
-                    }   
-            }
+            vpKFs.push_back(pKF);
+            vnWords.push_back(0);
+            vScores.push_back(0.f);
         }
-        //if(counter>=pKF->mBowVec.size())
-        if(counter>=pKF->mBowVec->size())
-            break;
+        vnWords[it.first->second]++;
     }
-}
 
-void KeyFrameDatabase::clear()
-{
-    mvInvertedFile.clear();
-    mvInvertedFile.resize(mpVoc->size());
-}
+    // Index of pKF, -1 if it does not share words with the query
+    int Find(boost::interprocess::offset_ptr<KeyFrame> pKF) const
+    {
+        unordered_map<const KeyFrame*,int>::const_iterator it = mIndices.find(pKF.get());
+        return it == mIndices.end() ? -1 : it->second;
+    }
 
+    int MaxWords() const
+    {
+        int maxWords = 0;
+        for(int nWords : vnWords)
+            maxWords = max(maxWords, nWords);
+        return maxWords;
+    }
 
+    bool empty() const {return vpKFs.empty();}
+};
 
-void KeyFrameDatabase::clearMap(boost::interprocess::offset_ptr<Map>  pMap)
+template<class TBowVector>
+vector<unsigned int> GetWordIds(const TBowVector &bowVec)
 {
-    std::unique_lock<mutex> lock(mMutex);
-
-    // Erase elements in the Inverse File for the entry
-    for(std::vector<list<boost::interprocess::offset_ptr<KeyFrame> > >::iterator vit=mvInvertedFile.begin(), vend=mvInvertedFile.end(); vit!=vend; vit++)
-    {
-        // List of keyframes that share the word
-        list<boost::interprocess::offset_ptr<KeyFrame> > &lKFs =  *vit;
-
-        for(list<boost::interprocess::offset_ptr<KeyFrame> >::iterator lit=lKFs.begin(), lend= lKFs.end(); lit!=lend;)
-        {
-            boost::interprocess::offset_ptr<KeyFrame>  pKFi = *lit;
-            if(pMap == pKFi->GetMap())
-            {
-                lit = lKFs.erase(lit);
-                // Dont delete the KF because the class Map clean all the KF when it is destroyed
-            }
-            else
-            {
-                ++lit;
-            }
-        }
-    }
+    vector<unsigned int> vWordIds;
+    vWordIds.reserve(bowVec.size());
+    for(auto vit=bowVec.begin(), vend=bowVec.end(); vit!=vend; vit++)
+        vWordIds.push_back(vit->first);
+    return vWordIds;
 }
 
-vector<boost::interprocess::offset_ptr<KeyFrame> > KeyFrameDatabase::DetectLoopCandidates(boost::interprocess::offset_ptr<KeyFrame>  pKF, float minScore)
+// Adds to every scored keyframe the scores of its best covisibles among the scored ones (those with more
+// than minCommonWords shared words), and returns the accumulated score with the best keyframe of the group
+vector<pair<float,boost::interprocess::offset_ptr<KeyFrame> > > AccumulateCovisibleScores(const KeyFrameScores &scores,
+                                                                                         const vector<pair<float,boost::interprocess::offset_ptr<KeyFrame> > > &vScoreAndMatch,
+                                                                                         int minCommonWords, float &bestAccScore)
 {
-    set<boost::interprocess::offset_ptr<KeyFrame> > spConnectedKeyFrames = pKF->GetConnectedKeyFrames();
-    list<boost::interprocess::offset_ptr<KeyFrame> > lKFsSharingWords;
+    vector<pair<float,boost::interprocess::offset_ptr<KeyFrame> > > vAccScoreAndMatch;
+    vAccScoreAndMatch.reserve(vScoreAndMatch.size());
 
-    // Search all keyframes that share a word with current keyframes
-    // Discard keyframes connected to the query keyframe
+    for(vector<pair<float,boost::interprocess::offset_ptr<KeyFrame> > >::const_iterator it=vScoreAndMatch.begin(), itend=vScoreAndMatch.end(); it!=itend; it++)
     {
-        std::unique_lock<mutex> lock(mMutex);
+        boost::interprocess::offset_ptr<KeyFrame>  pKFi = it->second;
+        vector<boost::interprocess::offset_ptr<KeyFrame> > vpNeighs = pKFi->GetBestCovisibilityKeyFrames(10);
 
-        //for(DBoW2::BowVector::const_iterator vit=pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit != vend; vit++)
-        for(auto vit= pKF->mBowVec->begin(); vit!=pKF->mBowVec->end(); vit++)
+        float bestScore = it->first;
+        float accScore = it->first;
+        boost::interprocess::offset_ptr<KeyFrame>  pBestKF = pKFi;
+        for(vector<boost::interprocess::offset_ptr<KeyFrame> >::iterator vit=vpNeighs.begin(), vend=vpNeighs.end(); vit!=vend; vit++)
         {
-            list<boost::interprocess::offset_ptr<KeyFrame> > &lKFs =   mvInvertedFile[vit->first];
+            boost::interprocess::offset_ptr<KeyFrame>  pKF2 = *vit;
+            const int idx = scores.Find(pKF2);
+            if(idx < 0 || scores.vnWords[idx] <= minCommonWords)
+                continue;
 
-            for(list<boost::interprocess::offset_ptr<KeyFrame> >::iterator lit=lKFs.begin(), lend= lKFs.end(); lit!=lend; lit++)
+            accScore+=scores.vScores[idx];
+            if(scores.vScores[idx]>bestScore)
             {
-                boost::interprocess::offset_ptr<KeyFrame>  pKFi=*lit;
-                if(pKFi->GetMap()==pKF->GetMap()) // For consider a loop candidate it a candidate it must be in the same map
-                {
-                    if(pKFi->mnLoopQuery!=pKF->mnId)
-                    {
-                        pKFi->mnLoopWords=0;
-                        if(!spConnectedKeyFrames.count(pKFi))
-                        {
-                            pKFi->mnLoopQuery=pKF->mnId;
-                            lKFsSharingWords.push_back(pKFi);
-                        }
-                    }
-                    pKFi->mnLoopWords++;
-                }
-
-
+                pBestKF=pKF2;
+                bestScore = scores.vScores[idx];
             }
         }
-    }
 
-    if(lKFsSharingWords.empty())
-        return vector<boost::interprocess::offset_ptr<KeyFrame> >();
+        vAccScoreAndMatch.push_back(make_pair(accScore,pBestKF));
+        if(accScore>bestAccScore)
+            bestAccScore=accScore;
+    }
 
-    list<pair<float,boost::interprocess::offset_ptr<KeyFrame> > > lScoreAndMatch;
+    return vAccScoreAndMatch;
+}
 
+// Loop (or merge) candidates of the keyframes in scores: those whose accumulated score by covisibility is over
+// 0.75 of the best one. Only the keyframes with a score over minScore are considered.
+void SelectCandidates(KeyFrameScores &scores, boost::interprocess::offset_ptr<KeyFrame> pKF, float minScore,
+                      vector<boost::interprocess::offset_ptr<KeyFrame> > &vpCandidates)
+{
     // Only compare against those keyframes that share enough words
-    int maxCommonWords=0;
-    for(list<boost::interprocess::offset_ptr<KeyFrame> >::iterator lit=lKFsSharingWords.begin(), lend= lKFsSharingWords.end(); lit!=lend; lit++)
-    {
-        if((*lit)->mnLoopWords>maxCommonWords)
-            maxCommonWords=(*lit)->mnLoopWords;
-    }
+    int minCommonWords = scores.MaxWords()*0.8f;
 
-    int minCommonWords = maxCommonWords*0.8f;
-
-    int nscores=0;
+    vector<pair<float,boost::interprocess::offset_ptr<KeyFrame> > > vScoreAndMatch;
 
     // Compute similarity score. Retain the matches whose score is higher than minScore
-    for(list<boost::interprocess::offset_ptr<KeyFrame> >::iterator lit=lKFsSharingWords.begin(), lend= lKFsSharingWords.end(); lit!=lend; lit++)
+    for(size_t i=0; i<scores.vpKFs.size(); i++)
     {
-        boost::interprocess::offset_ptr<KeyFrame>  pKFi = *lit;
-
-        if(pKFi->mnLoopWords>minCommonWords)
+        if(scores.vnWords[i]>minCommonWords)
         {
-            nscores++;
+            float si = KeyFrame::score_KFDatabase_ptr(*pKF->mBowVec,*scores.vpKFs[i]->mBowVec);
 
-            //float si = mpVoc->score_new(pKF->mBowVec,pKFi->mBowVec);
-            float si = KeyFrame::score_KFDatabase_ptr(pKF->mBowVec,pKFi->mBowVec);
-
-            pKFi->mLoopScore = si;
+            scores.vScores[i] = si;
             if(si>=minScore)
-                lScoreAndMatch.push_back(make_pair(si,pKFi));
+                vScoreAndMatch.push_back(make_pair(si,scores.vpKFs[i]));
         }
     }
 
-    if(lScoreAndMatch.empty())
-        return vector<boost::interprocess::offset_ptr<KeyFrame> >();
-
-    list<pair<float,boost::interprocess::offset_ptr<KeyFrame> > > lAccScoreAndMatch;
-    float bestAccScore = minScore;
+    if(vScoreAndMatch.empty())
+        return;
 
     // Lets now accumulate score by covisibility
-    for(list<pair<float,boost::interprocess::offset_ptr<KeyFrame> > >::iterator it=lScoreAndMatch.begin(), itend=lScoreAndMatch.end(); it!=itend; it++)
-    {
-        boost::interprocess::offset_ptr<KeyFrame>  pKFi = it->second;
-        vector<boost::interprocess::offset_ptr<KeyFrame> > vpNeighs = pKFi->GetBestCovisibilityKeyFrames(10);
-
-        float bestScore = it->first;
-        float accScore = it->first;
-        boost::interprocess::offset_ptr<KeyFrame>  pBestKF = pKFi;
-        for(vector<boost::interprocess::offset_ptr<KeyFrame> >::iterator vit=vpNeighs.begin(), vend=vpNeighs.end(); vit!=vend; vit++)
-        {
-            boost::interprocess::offset_ptr<KeyFrame>  pKF2 = *vit;
-            if(pKF2->mnLoopQuery==pKF->mnId && pKF2->mnLoopWords>minCommonWords)
-            {
-                accScore+=pKF2->mLoopScore;
-                if(pKF2->mLoopScore>bestScore)
-                {
-                    pBestKF=pKF2;
-                    bestScore = pKF2->mLoopScore;
-                }
-            }
-        }
-
-        lAccScoreAndMatch.push_back(make_pair(accScore,pBestKF));
-        if(accScore>bestAccScore)
-            bestAccScore=accScore;
-    }
+    float bestAccScore = minScore;
+    vector<pair<float,boost::interprocess::offset_ptr<KeyFrame> > > vAccScoreAndMatch = AccumulateCovisibleScores(scores, vScoreAndMatch, minCommonWords, bestAccScore);
 
     // Return all those keyframes with a score higher than 0.75*bestScore
     float minScoreToRetain = 0.75f*bestAccScore;
 
     set<boost::interprocess::offset_ptr<KeyFrame> > spAlreadyAddedKF;
-    vector<boost::interprocess::offset_ptr<KeyFrame> > vpLoopCandidates;
-    vpLoopCandidates.reserve(lAccScoreAndMatch.size());
+    vpCandidates.reserve(vAccScoreAndMatch.size());
 
-    for(list<pair<float,boost::interprocess::offset_ptr<KeyFrame> > >::iterator it=lAccScoreAndMatch.begin(), itend=lAccScoreAndMatch.end(); it!=itend; it++)
+    for(vector<pair<float,boost::interprocess::offset_ptr<KeyFrame> > >::iterator it=vAccScoreAndMatch.begin(), itend=vAccScoreAndMatch.end(); it!=itend; it++)
     {
         if(it->first>minScoreToRetain)
         {
             boost::interprocess::offset_ptr<KeyFrame>  pKFi = it->second;
             if(!spAlreadyAddedKF.count(pKFi))
             {
-                vpLoopCandidates.push_back(pKFi);
+                vpCandidates.push_back(pKFi);
                 spAlreadyAddedKF.insert(pKFi);
             }
         }
     }
+}
 
-
-    return vpLoopCandidates;
 }
 
-void KeyFrameDatabase::DetectCandidates(boost::interprocess::offset_ptr<KeyFrame>  pKF, float minScore,vector<boost::interprocess::offset_ptr<KeyFrame> >& vpLoopCand, vector<boost::interprocess::offset_ptr<KeyFrame> >& vpMergeCand)
+KeyFrameDatabase::KeyFrameDatabase (const ORBVocabulary &voc):
+    mpVoc(&voc)
 {
-    set<boost::interprocess::offset_ptr<KeyFrame> > spConnectedKeyFrames = pKF->GetConnectedKeyFrames();
-    list<boost::interprocess::offset_ptr<KeyFrame> > lKFsSharingWordsLoop,lKFsSharingWordsMerge;
+    mvInvertedFile.resize(voc.size());
+}
 
-    // Search all keyframes that share a word with current keyframes
-    // Discard keyframes connected to the query keyframe
+template<class F>
+void KeyFrameDatabase::ForEachKeyFrameSharingWords(const vector<unsigned int> &vWordIds, F f)
+{
+    for(unsigned int wordId : vWordIds)
     {
-        std::unique_lock<mutex> lock(mMutex);
+        shared_lock<shared_mutex> lock(GetStripeMutex(wordId));
 
-        //for(DBoW2::BowVector::const_iterator vit=pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit != vend; vit++)
-        for(auto vit= pKF->mBowVec->begin(); vit!=pKF->mBowVec->end(); vit++)
-        {
-            list<boost::interprocess::offset_ptr<KeyFrame> > &lKFs = mvInvertedFile[vit->first];
-
-            for(list<boost::interprocess::offset_ptr<KeyFrame> >::iterator lit=lKFs.begin(), lend= lKFs.end(); lit!=lend; lit++)
-            {
-                boost::interprocess::offset_ptr<KeyFrame>  pKFi=*lit;
-                if(pKFi->GetMap()==pKF->GetMap()) // For consider a loop candidate it a candidate it must be in the same map
-                {
-                    if(pKFi->mnLoopQuery!=pKF->mnId)
-                    {
-                        pKFi->mnLoopWords=0;
-                        if(!spConnectedKeyFrames.count(pKFi))
-                        {
-                            pKFi->mnLoopQuery=pKF->mnId;
-                            lKFsSharingWordsLoop.push_back(pKFi);
-                        }
-                    }
-                    pKFi->mnLoopWords++;
-                }
-                else if(!pKFi->GetMap()->IsBad())
-                {
-                    if(pKFi->mnMergeQuery!=pKF->mnId)
-                    {
-                        pKFi->mnMergeWords=0;
-                        if(!spConnectedKeyFrames.count(pKFi))
-                        {
-                            pKFi->mnMergeQuery=pKF->mnId;
-                            lKFsSharingWordsMerge.push_back(pKFi);
-                        }
-                    }
-                    pKFi->mnMergeWords++;
-                }
-            }
-        }
+        const vector<boost::interprocess::offset_ptr<KeyFrame> > &vpKFs = mvInvertedFile[wordId];
+        for(vector<boost::interprocess::offset_ptr<KeyFrame> >::const_iterator vit=vpKFs.begin(), vend=vpKFs.end(); vit!=vend; vit++)
+            f(*vit);
     }
+}
 
-    if(lKFsSharingWordsLoop.empty() && lKFsSharingWordsMerge.empty())
-        return;
-
-    if(!lKFsSharingWordsLoop.empty())
-    {
-        list<pair<float,boost::interprocess::offset_ptr<KeyFrame> > > lScoreAndMatch;
-
-        // Only compare against those keyframes that share enough words
-        int maxCommonWords=0;
-        for(list<boost::interprocess::offset_ptr<KeyFrame> >::iterator lit=lKFsSharingWordsLoop.begin(), lend= lKFsSharingWordsLoop.end(); lit!=lend; lit++)
-        {
-            if((*lit)->mnLoopWords>maxCommonWords)
-                maxCommonWords=(*lit)->mnLoopWords;
-        }
-
-        int minCommonWords = maxCommonWords*0.8f;
-
-        int nscores=0;
-
-        // Compute similarity score. Retain the matches whose score is higher than minScore
-        for(list<boost::interprocess::offset_ptr<KeyFrame> >::iterator lit=lKFsSharingWordsLoop.begin(), lend= lKFsSharingWordsLoop.end(); lit!=lend; lit++)
-        {
-            boost::interprocess::offset_ptr<KeyFrame>  pKFi = *lit;
-
-            if(pKFi->mnLoopWords>minCommonWords)
-            {
-                nscores++;
-
-                //float si = mpVoc->KeyFrameDatabase::score_KFDatabase_ptr(pKF->mBowVec,pKFi->mBowVec);
-                float si = KeyFrame::score_KFDatabase_ptr(pKF->mBowVec,pKFi->mBowVec);
-
-                pKFi->mLoopScore = si;
-                if(si>=minScore)
-                    lScoreAndMatch.push_back(make_pair(si,pKFi));
-            }
-        }
-
-        if(!lScoreAndMatch.empty())
-        {
-            list<pair<float,boost::interprocess::offset_ptr<KeyFrame> > > lAccScoreAndMatch;
-            float bestAccScore = minScore;
-
-            // Lets now accumulate score by covisibility
-            for(list<pair<float,boost::interprocess::offset_ptr<KeyFrame> > >::iterator it=lScoreAndMatch.begin(), itend=lScoreAndMatch.end(); it!=itend; it++)
-            {
-                boost::interprocess::offset_ptr<KeyFrame>  pKFi = it->second;
-                vector<boost::interprocess::offset_ptr<KeyFrame> > vpNeighs = pKFi->GetBestCovisibilityKeyFrames(10);
-
-                float bestScore = it->first;
-                float accScore = it->first;
-                boost::interprocess::offset_ptr<KeyFrame>  pBestKF = pKFi;
-                for(vector<boost::interprocess::offset_ptr<KeyFrame> >::iterator vit=vpNeighs.begin(), vend=vpNeighs.end(); vit!=vend; vit++)
-                {
-                    boost::interprocess::offset_ptr<KeyFrame>  pKF2 = *vit;
-                    if(pKF2->mnLoopQuery==pKF->mnId && pKF2->mnLoopWords>minCommonWords)
-                    {
-                        accScore+=pKF2->mLoopScore;
-                        if(pKF2->mLoopScore>bestScore)
-                        {
-                            pBestKF=pKF2;
-                            bestScore = pKF2->mLoopScore;
-                        }
-                    }
-                }
-
-                lAccScoreAndMatch.push_back(make_pair(accScore,pBestKF));
-                if(accScore>bestAccScore)
-                    bestAccScore=accScore;
-            }
-
-            // Return all those keyframes with a score higher than 0.75*bestScore
-            float minScoreToRetain = 0.75f*bestAccScore;
-
-            set<boost::interprocess::offset_ptr<KeyFrame> > spAlreadyAddedKF;
-            vpLoopCand.reserve(lAccScoreAndMatch.size());
+void KeyFrameDatabase::LockAllStripes()
+{
+    for(int i=0; i<NUM_STRIPES; i++)
+        mStripes[i].mMutex.lock();
+}
 
-            for(list<pair<float,boost::interprocess::offset_ptr<KeyFrame> > >::iterator it=lAccScoreAndMatch.begin(), itend=lAccScoreAndMatch.end(); it!=itend; it++)
-            {
-                if(it->first>minScoreToRetain)
-                {
-                    boost::interprocess::offset_ptr<KeyFrame>  pKFi = it->second;
-                    if(!spAlreadyAddedKF.count(pKFi))
-                    {
-                        vpLoopCand.push_back(pKFi);
-                        spAlreadyAddedKF.insert(pKFi);
-                    }
-                }
-            }
-        }
+void KeyFrameDatabase::UnlockAllStripes()
+{
+    for(int i=NUM_STRIPES-1; i>=0; i--)
+        mStripes[i].mMutex.unlock();
+}
 
+void KeyFrameDatabase::add(boost::interprocess::offset_ptr<KeyFrame> pKF)
+{
+    for(auto vit= pKF->mBowVec->begin(); vit!=pKF->mBowVec->end(); vit++)
+    {
+        unique_lock<shared_mutex> lock(GetStripeMutex(vit->first));
+        mvInvertedFile[vit->first].push_back(pKF);
     }
+}
 
-    if(!lKFsSharingWordsMerge.empty())
+void KeyFrameDatabase::erase(boost::interprocess::offset_ptr<KeyFrame>  pKF)
+{
+    // Erase elements in the Inverse File for the entry
+    for(auto vit= pKF->mBowVec->begin(); vit!=pKF->mBowVec->end(); vit++)
     {
-        list<pair<float,boost::interprocess::offset_ptr<KeyFrame> > > lScoreAndMatch;
+        unique_lock<shared_mutex> lock(GetStripeMutex(vit->first));
 
-        // Only compare against those keyframes that share enough words
-        int maxCommonWords=0;
-        for(list<boost::interprocess::offset_ptr<KeyFrame> >::iterator lit=lKFsSharingWordsMerge.begin(), lend=lKFsSharingWordsMerge.end(); lit!=lend; lit++)
-        {
-            if((*lit)->mnMergeWords>maxCommonWords)
-                maxCommonWords=(*lit)->mnMergeWords;
-        }
+        // Keyframes that share the word
+        vector<boost::interprocess::offset_ptr<KeyFrame> > &vpKFs = mvInvertedFile[vit->first];
 
-        int minCommonWords = maxCommonWords*0.8f;
+        vector<boost::interprocess::offset_ptr<KeyFrame> >::iterator vitKF = find(vpKFs.begin(), vpKFs.end(), pKF);
+        if(vitKF != vpKFs.end())
+            vpKFs.erase(vitKF);
+    }
+}
 
-        int nscores=0;
+void KeyFrameDatabase::clear()
+{
+    LockAllStripes();
+    mvInvertedFile.clear();
+    mvInvertedFile.resize(mpVoc->size());
+    UnlockAllStripes();
+}
 
-        // Compute similarity score. Retain the matches whose score is higher than minScore
-        for(list<boost::interprocess::offset_ptr<KeyFrame> >::iterator lit=lKFsSharingWordsMerge.begin(), lend=lKFsSharingWordsMerge.end(); lit!=lend; lit++)
-        {
-            boost::interprocess::offset_ptr<KeyFrame>  pKFi = *lit;
 
-            if(pKFi->mnMergeWords>minCommonWords)
-            {
-                nscores++;
 
-                //float si = mpVoc->KeyFrameDatabase::score_KFDatabase_ptr(pKF->mBowVec,pKFi->mBowVec);
-                float si = KeyFrame::score_KFDatabase_ptr(pKF->mBowVec,pKFi->mBowVec);
+void KeyFrameDatabase::clearMap(boost::interprocess::offset_ptr<Map>  pMap)
+{
+    // Erase elements in the Inverse File for the entry
+    for(size_t wordId=0; wordId<mvInvertedFile.size(); wordId++)
+    {
+        unique_lock<shared_mutex> lock(GetStripeMutex(wordId));
 
-                pKFi->mMergeScore = si;
-                if(si>=minScore)
-                    lScoreAndMatch.push_back(make_pair(si,pKFi));
-            }
-        }
+        // Keyframes that share the word
+        vector<boost::interprocess::offset_ptr<KeyFrame> > &vpKFs = mvInvertedFile[wordId];
 
-        if(!lScoreAndMatch.empty())
+        // Dont delete the KF because the class Map clean all the KF when it is destroyed
+        vpKFs.erase(remove_if(vpKFs.begin(), vpKFs.end(), [&](boost::interprocess::offset_ptr<KeyFrame> pKFi)
         {
-            list<pair<float,boost::interprocess::offset_ptr<KeyFrame> > > lAccScoreAndMatch;
-            float bestAccScore = minScore;
-
-            // Lets now accumulate score by covisibility
-            for(list<pair<float,boost::interprocess::offset_ptr<KeyFrame> > >::iterator it=lScoreAndMatch.begin(), itend=lScoreAndMatch.end(); it!=itend; it++)
-            {
-                boost::interprocess::offset_ptr<KeyFrame>  pKFi = it->second;
-                vector<boost::interprocess::offset_ptr<KeyFrame> > vpNeighs = pKFi->GetBestCovisibilityKeyFrames(10);
-
-                float bestScore = it->first;
-                float accScore = it->first;
-                boost::interprocess::offset_ptr<KeyFrame>  pBestKF = pKFi;
-                for(vector<boost::interprocess::offset_ptr<KeyFrame> >::iterator vit=vpNeighs.begin(), vend=vpNeighs.end(); vit!=vend; vit++)
-                {
-                    boost::interprocess::offset_ptr<KeyFrame>  pKF2 = *vit;
-                    if(pKF2->mnMergeQuery==pKF->mnId && pKF2->mnMergeWords>minCommonWords)
-                    {
-                        accScore+=pKF2->mMergeScore;
-                        if(pKF2->mMergeScore>bestScore)
-                        {
-                            pBestKF=pKF2;
-                            bestScore = pKF2->mMergeScore;
-                        }
-                    }
-                }
+            return pMap == pKFi->GetMap();
+        }), vpKFs.end());
+    }
+}
 
-                lAccScoreAndMatch.push_back(make_pair(accScore,pBestKF));
-                if(accScore>bestAccScore)
-                    bestAccScore=accScore;
-            }
+vector<boost::interprocess::offset_ptr<KeyFrame> > KeyFrameDatabase::DetectLoopCandidates(boost::interprocess::offset_ptr<KeyFrame>  pKF, float minScore)
+{
+    set<boost::interprocess::offset_ptr<KeyFrame> > spConnectedKeyFrames = pKF->GetConnectedKeyFrames();
+    KeyFrameScores scores;
 
-            // Return all those keyframes with a score higher than 0.75*bestScore
-            float minScoreToRetain = 0.75f*bestAccScore;
+    // Search all keyframes that share a word with current keyframes
+    // Discard keyframes connected to the query keyframe
+    ForEachKeyFrameSharingWords(GetWordIds(*pKF->mBowVec), [&](boost::interprocess::offset_ptr<KeyFrame> pKFi)
+    {
+        // For consider a loop candidate it a candidate it must be in the same map
+        if(pKFi->GetMap()==pKF->GetMap() && !spConnectedKeyFrames.count(pKFi))
+            scores.AddWord(pKFi);
+    });
 
-            set<boost::interprocess::offset_ptr<KeyFrame> > spAlreadyAddedKF;
-            vpMergeCand.reserve(lAccScoreAndMatch.size());
+    vector<boost::interprocess::offset_ptr<KeyFrame> > vpLoopCandidates;
+    if(!scores.empty())
+        SelectCandidates(scores, pKF, minScore, vpLoopCandidates);
 
-            for(list<pair<float,boost::interprocess::offset_ptr<KeyFrame> > >::iterator it=lAccScoreAndMatch.begin(), itend=lAccScoreAndMatch.end(); it!=itend; it++)
-            {
-                if(it->first>minScoreToRetain)
-                {
-                    boost::interprocess::offset_ptr<KeyFrame>  pKFi = it->second;
-                    if(!spAlreadyAddedKF.count(pKFi))
-                    {
-                        vpMergeCand.push_back(pKFi);
-                        spAlreadyAddedKF.insert(pKFi);
-                    }
-                }
-            }
-        }
+    return vpLoopCandidates;
+}
 
-    }
+void KeyFrameDatabase::DetectCandidates(boost::interprocess::offset_ptr<KeyFrame>  pKF, float minScore,vector<boost::interprocess::offset_ptr<KeyFrame> >& vpLoopCand, vector<boost::interprocess::offset_ptr<KeyFrame> >& vpMergeCand)
+{
+    set<boost::interprocess::offset_ptr<KeyFrame> > spConnectedKeyFrames = pKF->GetConnectedKeyFrames();
+    KeyFrameScores loopScores, mergeScores;
 
-    //for(DBoW2::BowVector::const_iterator vit=pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit != vend; vit++)
-    for(auto vit= pKF->mBowVec->begin(); vit!=pKF->mBowVec->end(); vit++)
+    // Search all keyframes that share a word with current keyframes
+    // Discard keyframes connected to the query keyframe
+    ForEachKeyFrameSharingWords(GetWordIds(*pKF->mBowVec), [&](boost::interprocess::offset_ptr<KeyFrame> pKFi)
     {
-        list<boost::interprocess::offset_ptr<KeyFrame> > &lKFs = mvInvertedFile[vit->first];
+        if(spConnectedKeyFrames.count(pKFi))
+            return;
 
-        for(list<boost::interprocess::offset_ptr<KeyFrame> >::iterator lit=lKFs.begin(), lend= lKFs.end(); lit!=lend; lit++)
-        {
-            boost::interprocess::offset_ptr<KeyFrame>  pKFi=*lit;
-            pKFi->mnLoopQuery=-1;
-            pKFi->mnMergeQuery=-1;
-        }
-    }
+        if(pKFi->GetMap()==pKF->GetMap()) // For consider a loop candidate it a candidate it must be in the same map
+            loopScores.AddWord(pKFi);
+        else if(!pKFi->GetMap()->IsBad())
+            mergeScores.AddWord(pKFi);
+    });
 
+    if(!loopScores.empty())
+        SelectCandidates(loopScores, pKF, minScore, vpLoopCand);
+
+    if(!mergeScores.empty())
+        SelectCandidates(mergeScores, pKF, minScore, vpMergeCand);
 }
 
 void KeyFrameDatabase::DetectBestCandidates(boost::interprocess::offset_ptr<KeyFrame> pKF, vector<boost::interprocess::offset_ptr<KeyFrame> > &vpLoopCand, vector<boost::interprocess::offset_ptr<KeyFrame> > &vpMergeCand, int nMinWords)
 {
-    list<boost::interprocess::offset_ptr<KeyFrame> > lKFsSharingWords;
-    set<boost::interprocess::offset_ptr<KeyFrame> > spConnectedKF;
+    set<boost::interprocess::offset_ptr<KeyFrame> > spConnectedKF = pKF->GetConnectedKeyFrames();
+    KeyFrameScores scores;
 
     // Search all keyframes that share a word with current frame
+    ForEachKeyFrameSharingWords(GetWordIds(*pKF->mBowVec), [&](boost::interprocess::offset_ptr<KeyFrame> pKFi)
     {
-        std::unique_lock<mutex> lock(mMutex);
-
-        spConnectedKF = pKF->GetConnectedKeyFrames();
+        if(!spConnectedKF.count(pKFi))
+            scores.AddWord(pKFi);
+    });
 
-        //for(DBoW2::BowVector::const_iterator vit=pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit != vend; vit++)
-        for(auto vit= pKF->mBowVec->begin(); vit!=pKF->mBowVec->end(); vit++)
-        {
-            list<boost::interprocess::offset_ptr<KeyFrame> > &lKFs =   mvInvertedFile[vit->first];
-
-            for(list<boost::interprocess::offset_ptr<KeyFrame> >::iterator lit=lKFs.begin(), lend= lKFs.end(); lit!=lend; lit++)
-            {
-                boost::interprocess::offset_ptr<KeyFrame>  pKFi=*lit;
-                if(spConnectedKF.find(pKFi) != spConnectedKF.end())
-                {
-                    continue;
-                }
-                if(pKFi->mnPlaceRecognitionQuery!=pKF->mnId)
-                {
-                    pKFi->mnPlaceRecognitionWords=0;
-                    pKFi->mnPlaceRecognitionQuery=pKF->mnId;
-                    lKFsSharingWords.push_back(pKFi);
-                }
-               pKFi->mnPlaceRecognitionWords++;
-
-            }
-        }
-    }
-    if(lKFsSharingWords.empty())
+    if(scores.empty())
         return;
 
     // Only compare against those keyframes that share enough words
-    int maxCommonWords=0;
-    for(list<boost::interprocess::offset_ptr<KeyFrame> >::iterator lit=lKFsSharingWords.begin(), lend= lKFsSharingWords.end(); lit!=lend; lit++)
-    {
-        if((*lit)->mnPlaceRecognitionWords>maxCommonWords)
-            maxCommonWords=(*lit)->mnPlaceRecognitionWords;
-    }
-
-    int minCommonWords = maxCommonWords*0.8f;
+    int minCommonWords = scores.MaxWords()*0.8f;
 
     if(minCommonWords < nMinWords)
     {
         minCommonWords = nMinWords;
     }
 
-    list<pair<float,boost::interprocess::offset_ptr<KeyFrame> > > lScoreAndMatch;
-
-    int nscores=0;
+    vector<pair<float,boost::interprocess::offset_ptr<KeyFrame> > > vScoreAndMatch;
 
     // Compute similarity score.
-    for(list<boost::interprocess::offset_ptr<KeyFrame> >::iterator lit=lKFsSharingWords.begin(), lend= lKFsSharingWords.end(); lit!=lend; lit++)
+    for(size_t i=0; i<scores.vpKFs.size(); i++)
     {
-        boost::interprocess::offset_ptr<KeyFrame>  pKFi = *lit;
-
-        if(pKFi->mnPlaceRecognitionWords>minCommonWords)
+        if(scores.vnWords[i]>minCommonWords)
         {
-            nscores++;
-            float si = KeyFrame::score_KFDatabase_ptr(pKF->mBowVec,pKFi->mBowVec);
-            pKFi->mPlaceRecognitionScore=si;
-            lScoreAndMatch.push_back(make_pair(si,pKFi));
+            float si = KeyFrame::score_KFDatabase_ptr(*pKF->mBowVec,*scores.vpKFs[i]->mBowVec);
+            scores.vScores[i] = si;
+            vScoreAndMatch.push_back(make_pair(si,scores.vpKFs[i]));
         }
     }
 
-    if(lScoreAndMatch.empty())
+    if(vScoreAndMatch.empty())
         return;
 
-    list<pair<float,boost::interprocess::offset_ptr<KeyFrame> > > lAccScoreAndMatch;
-    float bestAccScore = 0;
-
     // Lets now accumulate score by covisibility
-    for(list<pair<float,boost::interprocess::offset_ptr<KeyFrame> > >::iterator it=lScoreAndMatch.begin(), itend=lScoreAndMatch.end(); it!=itend; it++)
-    {
-        boost::interprocess::offset_ptr<KeyFrame>  pKFi = it->second;
-        vector<boost::interprocess::offset_ptr<KeyFrame> > vpNeighs = pKFi->GetBestCovisibilityKeyFrames(10);
-
-        float bestScore = it->first;
-        float accScore = bestScore;
-        boost::interprocess::offset_ptr<KeyFrame>  pBestKF = pKFi;
-        for(vector<boost::interprocess::offset_ptr<KeyFrame> >::iterator vit=vpNeighs.begin(), vend=vpNeighs.end(); vit!=vend; vit++)
-        {
-            boost::interprocess::offset_ptr<KeyFrame>  pKF2 = *vit;
-            if(pKF2->mnPlaceRecognitionQuery!=pKF->mnId)
-                continue;
-
-            accScore+=pKF2->mPlaceRecognitionScore;
-            if(pKF2->mPlaceRecognitionScore>bestScore)
-            {
-                pBestKF=pKF2;
-                bestScore = pKF2->mPlaceRecognitionScore;
-            }
-
-        }
-        lAccScoreAndMatch.push_back(make_pair(accScore,pBestKF));
-        if(accScore>bestAccScore)
-            bestAccScore=accScore;
-    }
+    float bestAccScore = 0;
+    vector<pair<float,boost::interprocess::offset_ptr<KeyFrame> > > vAccScoreAndMatch = AccumulateCovisibleScores(scores, vScoreAndMatch, minCommonWords, bestAccScore);
 
     // Return all those keyframes with a score higher than 0.75*bestScore
     float minScoreToRetain = 0.75f*bestAccScore;
     set<boost::interprocess::offset_ptr<KeyFrame> > spAlreadyAddedKF;
-    vpLoopCand.reserve(lAccScoreAndMatch.size());
-    vpMergeCand.reserve(lAccScoreAndMatch.size());
-    for(list<pair<float,boost::interprocess::offset_ptr<KeyFrame> > >::iterator it=lAccScoreAndMatch.begin(), itend=lAccScoreAndMatch.end(); it!=itend; it++)
+    vpLoopCand.reserve(vAccScoreAndMatch.size());
+    vpMergeCand.reserve(vAccScoreAndMatch.size());
+    for(vector<pair<float,boost::interprocess::offset_ptr<KeyFrame> > >::iterator it=vAccScoreAndMatch.begin(), itend=vAccScoreAndMatch.end(); it!=itend; it++)
     {
         const float &si = it->first;
         if(si>minScoreToRetain)
@@ -675,118 +384,50 @@ bool compFirst(const pair<float, boost::interprocess::offset_ptr<KeyFrame> > & a
 
 void KeyFrameDatabase::DetectNBestCandidates(boost::interprocess::offset_ptr<KeyFrame> pKF, vector<boost::interprocess::offset_ptr<KeyFrame> > &vpLoopCand, vector<boost::interprocess::offset_ptr<KeyFrame> > &vpMergeCand, int nNumCandidates)
 {
-    list<boost::interprocess::offset_ptr<KeyFrame> > lKFsSharingWords;
-    set<boost::interprocess::offset_ptr<KeyFrame> > spConnectedKF;
+    set<boost::interprocess::offset_ptr<KeyFrame> > spConnectedKF = pKF->GetConnectedKeyFrames();
+    KeyFrameScores scores;
 
     // Search all keyframes that share a word with current frame
+    ForEachKeyFrameSharingWords(GetWordIds(*pKF->mBowVec), [&](boost::interprocess::offset_ptr<KeyFrame> pKFi)
     {
-        std::unique_lock<mutex> lock(mMutex);
-
-        spConnectedKF = pKF->GetConnectedKeyFrames();
-        int counter = 0;
-
-        //for(DBoW2::BowVector::const_iterator vit=pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit != vend; vit++)
-        for(auto vit= pKF->mBowVec->begin(); vit!=pKF->mBowVec->end(); vit++)
-        {
-            //std::cout<<"Counter: DetectNBestCandidates: "<<counter++<<std::endl;
-            list<boost::interprocess::offset_ptr<KeyFrame> > &lKFs =   mvInvertedFile[vit->first];
-
-            for(list<boost::interprocess::offset_ptr<KeyFrame> >::iterator lit=lKFs.begin(), lend= lKFs.end(); lit!=lend; lit++)
-            {
-                boost::interprocess::offset_ptr<KeyFrame>  pKFi=*lit;
-                if(pKFi->mnPlaceRecognitionQuery!=pKF->mnId)
-                {
-                    pKFi->mnPlaceRecognitionWords=0;
-                    if(!spConnectedKF.count(pKFi))
-                    {
+        if(!spConnectedKF.count(pKFi))
+            scores.AddWord(pKFi);
+    });
 
-                        pKFi->mnPlaceRecognitionQuery=pKF->mnId;
-                        lKFsSharingWords.push_back(pKFi);
-                    }
-                }
-                pKFi->mnPlaceRecognitionWords++;
-
-            }
-            if(counter++>=pKF->mBowVec->size())
-                break;
-        }
-    }
-    std::cout<<"DetectNBestCandidates: after loop\n";
-    if(lKFsSharingWords.empty())
+    if(scores.empty())
         return;
 
     // Only compare against those keyframes that share enough words
-    int maxCommonWords=0;
-    for(list<boost::interprocess::offset_ptr<KeyFrame> >::iterator lit=lKFsSharingWords.begin(), lend= lKFsSharingWords.end(); lit!=lend; lit++)
-    {
-        if((*lit)->mnPlaceRecognitionWords>maxCommonWords)
-            maxCommonWords=(*lit)->mnPlaceRecognitionWords;
-    }
-
-    int minCommonWords = maxCommonWords*0.8f;
+    int minCommonWords = scores.MaxWords()*0.8f;
 
-    list<pair<float,boost::interprocess::offset_ptr<KeyFrame> > > lScoreAndMatch;
-
-    int nscores=0;
+    vector<pair<float,boost::interprocess::offset_ptr<KeyFrame> > > vScoreAndMatch;
 
     // Compute similarity score.
-    for(list<boost::interprocess::offset_ptr<KeyFrame> >::iterator lit=lKFsSharingWords.begin(), lend= lKFsSharingWords.end(); lit!=lend; lit++)
+    for(size_t i=0; i<scores.vpKFs.size(); i++)
     {
-        boost::interprocess::offset_ptr<KeyFrame>  pKFi = *lit;
-
-        if(pKFi->mnPlaceRecognitionWords>minCommonWords)
+        if(scores.vnWords[i]>minCommonWords)
         {
-            nscores++;
-            float si = KeyFrame::score_KFDatabase_ptr(pKF->mBowVec,pKFi->mBowVec);
-            pKFi->mPlaceRecognitionScore=si;
-            lScoreAndMatch.push_back(make_pair(si,pKFi));
+            float si = KeyFrame::score_KFDatabase_ptr(*pKF->mBowVec,*scores.vpKFs[i]->mBowVec);
+            scores.vScores[i] = si;
+            vScoreAndMatch.push_back(make_pair(si,scores.vpKFs[i]));
         }
     }
 
-    if(lScoreAndMatch.empty())
+    if(vScoreAndMatch.empty())
         return;
 
-    list<pair<float,boost::interprocess::offset_ptr<KeyFrame> > > lAccScoreAndMatch;
-    float bestAccScore = 0;
-
     // Lets now accumulate score by covisibility
-    for(list<pair<float,boost::interprocess::offset_ptr<KeyFrame> > >::iterator it=lScoreAndMatch.begin(), itend=lScoreAndMatch.end(); it!=itend; it++)
-    {
-        boost::interprocess::offset_ptr<KeyFrame>  pKFi = it->second;
-        vector<boost::interprocess::offset_ptr<KeyFrame> > vpNeighs = pKFi->GetBestCovisibilityKeyFrames(10);
-
-        float bestScore = it->first;
-        float accScore = bestScore;
-        boost::interprocess::offset_ptr<KeyFrame>  pBestKF = pKFi;
-        for(vector<boost::interprocess::offset_ptr<KeyFrame> >::iterator vit=vpNeighs.begin(), vend=vpNeighs.end(); vit!=vend; vit++)
-        {
-            boost::interprocess::offset_ptr<KeyFrame>  pKF2 = *vit;
-            if(pKF2->mnPlaceRecognitionQuery!=pKF->mnId)
-                continue;
-
-            accScore+=pKF2->mPlaceRecognitionScore;
-            if(pKF2->mPlaceRecognitionScore>bestScore)
-            {
-                pBestKF=pKF2;
-                bestScore = pKF2->mPlaceRecognitionScore;
-            }
-
-        }
-        lAccScoreAndMatch.push_back(make_pair(accScore,pBestKF));
-        if(accScore>bestAccScore)
-            bestAccScore=accScore;
-    }
+    float bestAccScore = 0;
+    vector<pair<float,boost::interprocess::offset_ptr<KeyFrame> > > vAccScoreAndMatch = AccumulateCovisibleScores(scores, vScoreAndMatch, minCommonWords, bestAccScore);
 
-    lAccScoreAndMatch.sort(compFirst);
+    stable_sort(vAccScoreAndMatch.begin(), vAccScoreAndMatch.end(), compFirst);
 
     vpLoopCand.reserve(nNumCandidates);
     vpMergeCand.reserve(nNumCandidates);
     set<boost::interprocess::offset_ptr<KeyFrame> > spAlreadyAddedKF;
-    int i = 0;
-    list<pair<float,boost::interprocess::offset_ptr<KeyFrame> > >::iterator it=lAccScoreAndMatch.begin();
-    while(i < lAccScoreAndMatch.size() && (vpLoopCand.size() < nNumCandidates || vpMergeCand.size() < nNumCandidates))
+    for(size_t i=0; i<vAccScoreAndMatch.size() && (vpLoopCand.size() < nNumCandidates || vpMergeCand.size() < nNumCandidates); i++)
     {
-        boost::interprocess::offset_ptr<KeyFrame>  pKFi = it->second;
+        boost::interprocess::offset_ptr<KeyFrame>  pKFi = vAccScoreAndMatch[i].second;
         if(pKFi->isBad())
             continue;
 
@@ -802,117 +443,53 @@ void KeyFrameDatabase::DetectNBestCandidates(boost::interprocess::offset_ptr<Key
             }
             spAlreadyAddedKF.insert(pKFi);
         }
-        i++;
-        it++;
     }
 }
 
 
 vector<boost::interprocess::offset_ptr<KeyFrame> > KeyFrameDatabase::DetectRelocalizationCandidates(Frame *F, boost::interprocess::offset_ptr<Map>  pMap)
 {
-    list<boost::interprocess::offset_ptr<KeyFrame> > lKFsSharingWords;
+    KeyFrameScores scores;
 
     // Search all keyframes that share a word with current frame
+    ForEachKeyFrameSharingWords(GetWordIds(F->mBowVec), [&](boost::interprocess::offset_ptr<KeyFrame> pKFi)
     {
-        std::unique_lock<mutex> lock(mMutex);
+        scores.AddWord(pKFi);
+    });
 
-        for(DBoW2::BowVector::const_iterator vit=F->mBowVec.begin(), vend=F->mBowVec.end(); vit != vend; vit++){
-        //for(auto vit= F->mBowVec->begin(); vit!=pKF->mBowVec->end(); vit++){
-            list<boost::interprocess::offset_ptr<KeyFrame> > &lKFs =   mvInvertedFile[vit->first];
-
-            for(list<boost::interprocess::offset_ptr<KeyFrame> >::iterator lit=lKFs.begin(), lend= lKFs.end(); lit!=lend; lit++)
-            {
-                boost::interprocess::offset_ptr<KeyFrame>  pKFi=*lit;
-                if(pKFi->mnRelocQuery!=F->mnId)
-                {
-                    pKFi->mnRelocWords=0;
-                    pKFi->mnRelocQuery=F->mnId;
-                    lKFsSharingWords.push_back(pKFi);
-                }
-                pKFi->mnRelocWords++;
-            }
-        }
-    }
-    if(lKFsSharingWords.empty())
+    if(scores.empty())
         return vector<boost::interprocess::offset_ptr<KeyFrame> >();
 
     // Only compare against those keyframes that share enough words
-    int maxCommonWords=0;
-    for(list<boost::interprocess::offset_ptr<KeyFrame> >::iterator lit=lKFsSharingWords.begin(), lend= lKFsSharingWords.end(); lit!=lend; lit++)
-    {
-        if((*lit)->mnRelocWords>maxCommonWords)
-            maxCommonWords=(*lit)->mnRelocWords;
-    }
-
-    int minCommonWords = maxCommonWords*0.8f;
+    int minCommonWords = scores.MaxWords()*0.8f;
 
-    list<pair<float,boost::interprocess::offset_ptr<KeyFrame> > > lScoreAndMatch;
-
-    int nscores=0;
+    vector<pair<float,boost::interprocess::offset_ptr<KeyFrame> > > vScoreAndMatch;
 
     // Compute similarity score.
-    for(list<boost::interprocess::offset_ptr<KeyFrame> >::iterator lit=lKFsSharingWords.begin(), lend= lKFsSharingWords.end(); lit!=lend; lit++)
+    for(size_t i=0; i<scores.vpKFs.size(); i++)
     {
-        boost::interprocess::offset_ptr<KeyFrame>  pKFi = *lit;
-        std::map<double,unsigned int> temp_featmap;
-        //insert the map from the frame.
-        
-         for(auto it = F->mBowVec.begin(); it != F->mBowVec.end(); ++it) {
-            temp_featmap.insert(std::pair<double,unsigned int>(it->first,it->second));
-         }
-         
-
-
-        if(pKFi->mnRelocWords>minCommonWords)
+        if(scores.vnWords[i]>minCommonWords)
         {
-            nscores++;
-            //float si = mpVoc->score_new(F->mBowVec,pKFi->mBowVec);
-            float si = pKFi->score_KFDatabase_frame(&temp_featmap,pKFi->mBowVec);
-            pKFi->mRelocScore=si;
-            lScoreAndMatch.push_back(make_pair(si,pKFi));
+            boost::interprocess::offset_ptr<KeyFrame>  pKFi = scores.vpKFs[i];
+            float si = KeyFrame::score_KFDatabase_frame(F->mBowVec,*pKFi->mBowVec);
+            scores.vScores[i] = si;
+            vScoreAndMatch.push_back(make_pair(si,pKFi));
         }
     }
 
-    if(lScoreAndMatch.empty())
+    if(vScoreAndMatch.empty())
         return vector<boost::interprocess::offset_ptr<KeyFrame> >();
 
-    list<pair<float,boost::interprocess::offset_ptr<KeyFrame> > > lAccScoreAndMatch;
-    float bestAccScore = 0;
-
     // Lets now accumulate score by covisibility
-    for(list<pair<float,boost::interprocess::offset_ptr<KeyFrame> > >::iterator it=lScoreAndMatch.begin(), itend=lScoreAndMatch.end(); it!=itend; it++)
-    {
-        boost::interprocess::offset_ptr<KeyFrame>  pKFi = it->second;
-        vector<boost::interprocess::offset_ptr<KeyFrame> > vpNeighs = pKFi->GetBestCovisibilityKeyFrames(10);
-
-        float bestScore = it->first;
-        float accScore = bestScore;
-        boost::interprocess::offset_ptr<KeyFrame>  pBestKF = pKFi;
-        for(vector<boost::interprocess::offset_ptr<KeyFrame> >::iterator vit=vpNeighs.begin(), vend=vpNeighs.end(); vit!=vend; vit++)
-        {
-            boost::interprocess::offset_ptr<KeyFrame>  pKF2 = *vit;
-            if(pKF2->mnRelocQuery!=F->mnId)
-                continue;
-
-            accScore+=pKF2->mRelocScore;
-            if(pKF2->mRelocScore>bestScore)
-            {
-                pBestKF=pKF2;
-                bestScore = pKF2->mRelocScore;
-            }
-
-        }
-        lAccScoreAndMatch.push_back(make_pair(accScore,pBestKF));
-        if(accScore>bestAccScore)
-            bestAccScore=accScore;
-    }
+    float bestAccScore = 0;
+    vector<pair<float,boost::interprocess::offset_ptr<KeyFrame> > > vAccScoreAndMatch = AccumulateCovisibleScores(scores, vScoreAndMatch, minCommonWords, bestAccScore);
 
     // Return all those keyframes with a score higher than 0.75*bestScore
     float minScoreToRetain = 0.75f*bestAccScore;
     set<boost::interprocess::offset_ptr<KeyFrame> > spAlreadyAddedKF;
     vector<boost::interprocess::offset_ptr<KeyFrame> > vpRelocCandidates;
-    vpRelocCandidates.reserve(lAccScoreAndMatch.size());
-    for(list<pair<float,boost::interprocess::offset_ptr<KeyFrame> > >::iterator it=lAccScoreAndMatch.begin(), itend=lAccScoreAndMatch.end(); it!=itend; it++)
+    vpRelocCandidates.reserve(vAccScoreAndMatch.size());
+    for(vector<pair<float,boost::interprocess::offset_ptr<KeyFrame> > >::iterator it=vAccScoreAndMatch.begin(), itend=vAccScoreAndMatch.end(); it!=itend; it++)
     {
         const float &si = it->first;
         if(si>minScoreToRetain)
@@ -933,12 +510,16 @@ vector<boost::interprocess::offset_ptr<KeyFrame> > KeyFrameDatabase::DetectReloc
 
 void KeyFrameDatabase::SetORBVocabulary(ORBVocabulary* pORBVoc)
 {
+    LockAllStripes();
+
     ORBVocabulary** ptr;
     ptr = (ORBVocabulary**)( &mpVoc );
     *ptr = pORBVoc;
 
     mvInvertedFile.clear();
     mvInvertedFile.resize(mpVoc->size());
+
+    UnlockAllStripes();
 }
 
 } //namespace ORB_SLAM
@@ -34,7 +34,7 @@ namespace ORB_SLAM3
 LocalMapping::LocalMapping(System* pSys, Atlas *pAtlas, const float bMonocular, bool bInertial, const string &_strSeqName):
     mpSystem(pSys), mbMonocular(bMonocular), mbInertial(bInertial), mbResetRequested(false), mbResetRequestedActiveMap(false), mbFinishRequested(false), mbFinished(true), mpAtlas(pAtlas), bInitializing(false),
     mbAbortBA(false), mbStopped(false), mbStopRequested(false), mbNotStop(false), mbAcceptKeyFrames(true),
-    mbNewInit(false), mIdxInit(0), mScale(1.0), mInitSect(0), mbNotBA1(true), mbNotBA2(true), infoInertial(Eigen::MatrixXd::Zero(9,9))
+    mbNewInit(false), mIdxInit(0), mScale(1.0), mInitSect(0), mbNotBA1(true), mbNotBA2(true), mnBAThreads(1), infoInertial(Eigen::MatrixXd::Zero(9,9))
 {
     mnMatchesInliers = 0;
 
@@ -75,6 +75,8 @@ void LocalMapping::Run()
         // Check if there are keyframes in the queue
         if(CheckNewKeyFrames() && !mbBadImu)
         {
+            // The map replicator copies the segment between keyframes, see MapSegment::WriteScope
+            MapSegment::WriteScope writeScope(map_segment);
 
 #ifdef REGISTER_TIMES
             double timeLBA_ms = 0;
@@ -148,12 +150,12 @@ void LocalMapping::Run()
                         }
 
                         bool bLarge = ((mpTracker->GetMatchesInliers()>75)&&mbMonocular)||((mpTracker->GetMatchesInliers()>100)&&!mbMonocular);
-                        Optimizer::LocalInertialBA(mpCurrentKeyFrame, &mbAbortBA, mpCurrentKeyFrame->GetMap(),num_FixedKF_BA,num_OptKF_BA,num_MPs_BA,num_edges_BA, bLarge, !mpCurrentKeyFrame->GetMap()->GetIniertialBA2());
+                        Optimizer::LocalInertialBA(mpCurrentKeyFrame, &mbAbortBA, mpCurrentKeyFrame->GetMap(),num_FixedKF_BA,num_OptKF_BA,num_MPs_BA,num_edges_BA, bLarge, !mpCurrentKeyFrame->GetMap()->GetIniertialBA2(), mnBAThreads);
                         b_doneLBA = true;
                     }
                     else
                     {
-                        Optimizer::LocalBundleAdjustment(mpCurrentKeyFrame,&mbAbortBA, mpCurrentKeyFrame->GetMap(),num_FixedKF_BA,num_OptKF_BA,num_MPs_BA,num_edges_BA);
+                        Optimizer::LocalBundleAdjustment(mpCurrentKeyFrame,&mbAbortBA, mpCurrentKeyFrame->GetMap(),num_FixedKF_BA,num_OptKF_BA,num_MPs_BA,num_edges_BA,mnBAThreads);
                         b_doneLBA = true;
                     }
 
@@ -745,7 +747,7 @@ void LocalMapping::CreateNewMapPoints()
             // Triangulation is succesfull
             cv::Mat x3D_(x3D);
             //boost::interprocess::offset_ptr<MapPoint>  pMP = new MapPoint(x3D_,mpCurrentKeyFrame,mpAtlas->GetCurrentMap());
-            boost::interprocess::offset_ptr<MapPoint>  pMP = ORB_SLAM3::segment.find_or_construct<MapPoint>(boost::interprocess::anonymous_instance)(x3D_,mpCurrentKeyFrame,mpAtlas->GetCurrentMap());
+            boost::interprocess::offset_ptr<MapPoint>  pMP = ORB_SLAM3::map_segment.Construct<MapPoint>(x3D_,mpCurrentKeyFrame,mpAtlas->GetCurrentMap());
 
             pMP->AddObservation(mpCurrentKeyFrame,idx1);            
             pMP->AddObservation(pKF2,idx2);
@@ -951,8 +953,7 @@ void LocalMapping::Release()
         return;
     mbStopped = false;
     mbStopRequested = false;
-    for(list<boost::interprocess::offset_ptr<KeyFrame> >::iterator lit = mlNewKeyFrames.begin(), lend=mlNewKeyFrames.end(); lit!=lend; lit++)
-        delete (*lit).get();
+    // The keyframes are left in the map segment, where nothing made with MapSegment::Construct is destroyed
     mlNewKeyFrames.clear();
 
     cout << "Local Mapping RELEASE" << endl;
@@ -1456,11 +1457,9 @@ void LocalMapping::InitializeIMU(float priorG, float priorA, bool bFIBA)
     mnKFs=vpKF.size();
     mIdxInit++;
 
+    // The keyframes are left in the map segment, where nothing made with MapSegment::Construct is destroyed
     for(list<boost::interprocess::offset_ptr<KeyFrame> >::iterator lit = mlNewKeyFrames.begin(), lend=mlNewKeyFrames.end(); lit!=lend; lit++)
-    {
         (*lit)->SetBadFlag();
-        delete (*lit).get();
-    }
     mlNewKeyFrames.clear();
 
     mpTracker->mState=Tracking::OK;
@@ -1523,11 +1522,9 @@ void LocalMapping::ScaleRefinement()
     }
     std::chrono::steady_clock::time_point t3 = std::chrono::steady_clock::now();
 
+    // The keyframes are left in the map segment, where nothing made with MapSegment::Construct is destroyed
     for(list<boost::interprocess::offset_ptr<KeyFrame> >::iterator lit = mlNewKeyFrames.begin(), lend=mlNewKeyFrames.end(); lit!=lend; lit++)
-    {
         (*lit)->SetBadFlag();
-        delete (*lit).get();
-    }
     mlNewKeyFrames.clear();
 
     double t_inertial_only = std::chrono::duration_cast<std::chrono::duration<double> >(t1 - t0).count();
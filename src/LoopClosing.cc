@@ -27,6 +27,8 @@
 
 #include<mutex>
 #include<thread>
+#include<atomic>
+#include<chrono>
 
 
 namespace ORB_SLAM3
@@ -36,8 +38,10 @@ LoopClosing::LoopClosing(Atlas *pAtlas, KeyFrameDatabase *pDB, ORBVocabulary *pV
     mbResetRequested(false), mbResetActiveMapRequested(false), mbFinishRequested(false), mbFinished(true), mpAtlas(pAtlas),
     mpKeyFrameDB(pDB), mpORBVocabulary(pVoc), mpMatchedKF(NULL), mLastLoopKFid(0), mbRunningGBA(false), mbFinishedGBA(true),
     mbStopGBA(false), mpThreadGBA(NULL), mbFixScale(bFixScale), mnFullBAIdx(0), mnLoopNumCoincidences(0), mnMergeNumCoincidences(0),
-    mbLoopDetected(false), mbMergeDetected(false), mnLoopNumNotFound(0), mnMergeNumNotFound(0)
+    mbLoopDetected(false), mbMergeDetected(false), mnLoopNumNotFound(0), mnMergeNumNotFound(0), mnIncrementalGBALevels(0),
+    mnGBAChunkIterations(0), mnVerificationTimeMs(0), mpThreadPool(nullptr)
 {
+    mGBAProgress = GBAProgress();
     mnCovisibilityConsistencyTh = 3;
     mpLastCurrentKF = static_cast<boost::interprocess::offset_ptr<KeyFrame> >(NULL);
 }
@@ -52,6 +56,34 @@ void LoopClosing::SetLocalMapper(LocalMapping *pLocalMapper)
     mpLocalMapper=pLocalMapper;
 }
 
+LoopClosing::~LoopClosing()
+{
+    delete mpThreadPool;
+}
+
+void LoopClosing::SetNumThreads(int nThreads)
+{
+    delete mpThreadPool;
+    mpThreadPool = nullptr;
+
+    // The loop closing thread takes part in the corrections, so it counts as one of the threads
+    if(nThreads > 1)
+        mpThreadPool = new ThreadPool(nThreads-1);
+}
+
+void LoopClosing::ParallelFor(int begin, int end, const std::function<void(int)> &f)
+{
+    if(mpThreadPool)
+    {
+        mpThreadPool->ParallelFor(begin, end, f);
+    }
+    else
+    {
+        for(int i=begin; i<end; i++)
+            f(i);
+    }
+}
+
 
 void LoopClosing::Run()
 {
@@ -63,6 +95,9 @@ void LoopClosing::Run()
         //----------------------------
         if(CheckNewKeyFrames())
         {
+            // The map replicator copies the segment between keyframes, see MapSegment::WriteScope
+            MapSegment::WriteScope writeScope(map_segment);
+
             std::chrono::steady_clock::time_point time_StartCheckNewFrames = std::chrono::steady_clock::now();
             std::cout<<"New KeyFrames\n";
             if(mpLastCurrentKF)
@@ -539,274 +574,249 @@ bool LoopClosing::DetectAndReffineSim3FromLastKF(boost::interprocess::offset_ptr
     return false;
 }
 
-bool LoopClosing::DetectCommonRegionsFromBoW(std::vector<boost::interprocess::offset_ptr<KeyFrame> > &vpBowCand, boost::interprocess::offset_ptr<KeyFrame>  &pMatchedKF2, boost::interprocess::offset_ptr<KeyFrame>  &pLastCurrentKF, g2o::Sim3 &g2oScw,
-                                             int &nNumCoincidences, std::vector<boost::interprocess::offset_ptr<MapPoint> > &vpMPs, std::vector<boost::interprocess::offset_ptr<MapPoint> > &vpMatchedMPs)
+void LoopClosing::VerifyBoWCandidate(boost::interprocess::offset_ptr<KeyFrame>  pKFi, const set<boost::interprocess::offset_ptr<KeyFrame> > &spConnectedKeyFrames,
+                                     const std::function<bool()> &isCancelled, BoWCandidate &candidate)
 {
-    //std::cout<<"DetectCommonRegionsFromBoW 1\n";
     int nBoWMatches = 20;
     int nBoWInliers = 15;
     int nSim3Inliers = 20;
     int nProjMatches = 50;
     int nProjOptMatches = 80;
 
-    set<boost::interprocess::offset_ptr<KeyFrame> > spConnectedKeyFrames = mpCurrentKF->GetConnectedKeyFrames();
-
-    //std::cout<<"DetectCommonRegionsFromBoW 2\n";
-
     int nNumCovisibles = 5;
 
+    // Candidates can be verified concurrently, the matchers are not shared
     ORBmatcher matcherBoW(0.9, true);
     ORBmatcher matcher(0.75, true);
-    int nNumGuidedMatching = 0;
 
-    boost::interprocess::offset_ptr<KeyFrame>  pBestMatchedKF;
-    int nBestMatchesReproj = 0;
-    int nBestNumCoindicendes = 0;
-    g2o::Sim3 g2oBestScw;
-    std::vector<boost::interprocess::offset_ptr<MapPoint> > vpBestMapPoints;
-    std::vector<boost::interprocess::offset_ptr<MapPoint> > vpBestMatchedMapPoints;
+    // Current KF against KF with covisibles version
+    std::vector<boost::interprocess::offset_ptr<KeyFrame> > vpCovKFi = pKFi->GetBestCovisibilityKeyFrames(nNumCovisibles);
+    vpCovKFi.push_back(vpCovKFi[0]);
+    vpCovKFi[0] = pKFi;
 
-    int numCandidates = vpBowCand.size();
-    vector<int> vnStage(numCandidates, 0);
-    vector<int> vnMatchesStage(numCandidates, 0);
+    std::vector<std::vector<boost::interprocess::offset_ptr<MapPoint> > > vvpMatchedMPs;
+    vvpMatchedMPs.resize(vpCovKFi.size());
+    std::set<boost::interprocess::offset_ptr<MapPoint> > spMatchedMPi;
+    int numBoWMatches = 0;
 
-    //std::cout<<"DetectCommonRegionsFromBoW 3\n";
+    boost::interprocess::offset_ptr<KeyFrame>  pMostBoWMatchesKF = pKFi;
+    int nMostBoWNumMatches = 0;
 
-    int index = 0;
-    for(boost::interprocess::offset_ptr<KeyFrame>  pKFi : vpBowCand)
+    std::vector<boost::interprocess::offset_ptr<MapPoint> > vpMatchedPoints = std::vector<boost::interprocess::offset_ptr<MapPoint> >(mpCurrentKF->GetMapPointMatches().size(), static_cast<boost::interprocess::offset_ptr<MapPoint> >(NULL));
+    std::vector<boost::interprocess::offset_ptr<KeyFrame> > vpKeyFrameMatchedMP = std::vector<boost::interprocess::offset_ptr<KeyFrame> >(mpCurrentKF->GetMapPointMatches().size(), static_cast<boost::interprocess::offset_ptr<KeyFrame> >(NULL));
+
+    int nIndexMostBoWMatchesKF=0;
+    for(int j=0; j<vpCovKFi.size(); ++j)
     {
-        if(!pKFi || pKFi->isBad())
+        if(!vpCovKFi[j] || vpCovKFi[j]->isBad())
             continue;
+        int num = matcherBoW.SearchByBoW(mpCurrentKF, vpCovKFi[j], vvpMatchedMPs[j]);
+        if (num > nMostBoWNumMatches)
+        {
+            nMostBoWNumMatches = num;
+            nIndexMostBoWMatchesKF = j;
+        }
+    }
 
+    for(int j=0; j<vpCovKFi.size(); ++j)
+    {
+        if(spConnectedKeyFrames.find(vpCovKFi[j]) != spConnectedKeyFrames.end())
+            return;
 
-        // Current KF against KF with covisibles version
-        std::vector<boost::interprocess::offset_ptr<KeyFrame> > vpCovKFi = pKFi->GetBestCovisibilityKeyFrames(nNumCovisibles);
-        vpCovKFi.push_back(vpCovKFi[0]);
-        vpCovKFi[0] = pKFi;
-
-        std::vector<std::vector<boost::interprocess::offset_ptr<MapPoint> > > vvpMatchedMPs;
-        vvpMatchedMPs.resize(vpCovKFi.size());
-        std::set<boost::interprocess::offset_ptr<MapPoint> > spMatchedMPi;
-        int numBoWMatches = 0;
-
-        boost::interprocess::offset_ptr<KeyFrame>  pMostBoWMatchesKF = pKFi;
-        int nMostBoWNumMatches = 0;
-
-        std::vector<boost::interprocess::offset_ptr<MapPoint> > vpMatchedPoints = std::vector<boost::interprocess::offset_ptr<MapPoint> >(mpCurrentKF->GetMapPointMatches().size(), static_cast<boost::interprocess::offset_ptr<MapPoint> >(NULL));
-        std::vector<boost::interprocess::offset_ptr<KeyFrame> > vpKeyFrameMatchedMP = std::vector<boost::interprocess::offset_ptr<KeyFrame> >(mpCurrentKF->GetMapPointMatches().size(), static_cast<boost::interprocess::offset_ptr<KeyFrame> >(NULL));
-
-        int nIndexMostBoWMatchesKF=0;
-        //std::cout<<"DetectCommonRegionsFromBoW 4\n";
-        for(int j=0; j<vpCovKFi.size(); ++j)
+        for(int k=0; k < vvpMatchedMPs[j].size(); ++k)
         {
-            if(!vpCovKFi[j] || vpCovKFi[j]->isBad())
+            boost::interprocess::offset_ptr<MapPoint>  pMPi_j = vvpMatchedMPs[j][k];
+            if(!pMPi_j || pMPi_j->isBad())
                 continue;
-            //std::cout<<"DetectCommonRegionsFromBoW 4.1\n";
-            int num = matcherBoW.SearchByBoW(mpCurrentKF, vpCovKFi[j], vvpMatchedMPs[j]);
-            //std::cout<<"DetectCommonRegionsFromBoW 4.2\n";
-            if (num > nMostBoWNumMatches)
+
+            if(spMatchedMPi.find(pMPi_j) == spMatchedMPi.end())
             {
-                nMostBoWNumMatches = num;
-                nIndexMostBoWMatchesKF = j;
+                spMatchedMPi.insert(pMPi_j);
+                numBoWMatches++;
+
+                vpMatchedPoints[k]= pMPi_j;
+                vpKeyFrameMatchedMP[k] = vpCovKFi[j];
             }
-            //std::cout<<"DetectCommonRegionsFromBoW 4.3\n";
         }
-        //std::cout<<"DetectCommonRegionsFromBoW 5\n";
-        bool bAbortByNearKF = false;
-        for(int j=0; j<vpCovKFi.size(); ++j)
-        {
-            if(spConnectedKeyFrames.find(vpCovKFi[j]) != spConnectedKeyFrames.end())
-            {
-                bAbortByNearKF = true;
-                break;
-            }
+    }
 
-            for(int k=0; k < vvpMatchedMPs[j].size(); ++k)
-            {
-                boost::interprocess::offset_ptr<MapPoint>  pMPi_j = vvpMatchedMPs[j][k];
-                if(!pMPi_j || pMPi_j->isBad())
-                    continue;
+    if(numBoWMatches < nBoWMatches || isCancelled()) // TODO pick a good threshold
+        return;
 
-                if(spMatchedMPi.find(pMPi_j) == spMatchedMPi.end())
-                {
-                    spMatchedMPi.insert(pMPi_j);
-                    numBoWMatches++;
+    // Geometric validation
+    bool bFixedScale = mbFixScale;
+    if(mpTracker->mSensor==System::IMU_MONOCULAR && !mpCurrentKF->GetMap()->GetIniertialBA2())
+        bFixedScale=false;
 
-                    vpMatchedPoints[k]= pMPi_j;
-                    vpKeyFrameMatchedMP[k] = vpCovKFi[j];
-                }
-            }
-        }
-        //std::cout<<"DetectCommonRegionsFromBoW 6\n";
+    Sim3Solver solver = Sim3Solver(mpCurrentKF, pMostBoWMatchesKF, vpMatchedPoints, bFixedScale, vpKeyFrameMatchedMP);
+    solver.SetRansacParameters(0.99, nBoWInliers, 300); // at least 15 inliers
 
-        if(!bAbortByNearKF && numBoWMatches >= nBoWMatches) // TODO pick a good threshold
-        {
-            // Geometric validation
+    bool bNoMore = false;
+    vector<bool> vbInliers;
+    int nInliers;
+    bool bConverge = false;
+    cv::Mat mTcm;
+    while(!bConverge && !bNoMore)
+    {
+        mTcm = solver.iterate(20,bNoMore, vbInliers, nInliers, bConverge);
+        if(!bConverge && isCancelled())
+            return;
+    }
 
-            bool bFixedScale = mbFixScale;
-            if(mpTracker->mSensor==System::IMU_MONOCULAR && !mpCurrentKF->GetMap()->GetIniertialBA2())
-                bFixedScale=false;
+    if(!bConverge || isCancelled())
+        return;
 
-            Sim3Solver solver = Sim3Solver(mpCurrentKF, pMostBoWMatchesKF, vpMatchedPoints, bFixedScale, vpKeyFrameMatchedMP);
-            solver.SetRansacParameters(0.99, nBoWInliers, 300); // at least 15 inliers
+    vpCovKFi.clear();
+    vpCovKFi = pMostBoWMatchesKF->GetBestCovisibilityKeyFrames(nNumCovisibles);
+    vpCovKFi.push_back(pMostBoWMatchesKF);
 
-            //std::cout<<"DetectCommonRegionsFromBoW 6.1\n";
+    set<boost::interprocess::offset_ptr<MapPoint> > spMapPoints;
+    vector<boost::interprocess::offset_ptr<MapPoint> > vpMapPoints;
+    vector<boost::interprocess::offset_ptr<KeyFrame> > vpKeyFrames;
+    for(boost::interprocess::offset_ptr<KeyFrame>  pCovKFi : vpCovKFi)
+    {
+        for(boost::interprocess::offset_ptr<MapPoint>  pCovMPij : pCovKFi->GetMapPointMatches())
+        {
+            if(!pCovMPij || pCovMPij->isBad())
+                continue;
 
-            bool bNoMore = false;
-            vector<bool> vbInliers;
-            int nInliers;
-            bool bConverge = false;
-            cv::Mat mTcm;
-            while(!bConverge && !bNoMore)
+            if(spMapPoints.find(pCovMPij) == spMapPoints.end())
             {
-                mTcm = solver.iterate(20,bNoMore, vbInliers, nInliers, bConverge);
+                spMapPoints.insert(pCovMPij);
+                vpMapPoints.push_back(pCovMPij);
+                vpKeyFrames.push_back(pCovKFi);
             }
-            //std::cout<<"DetectCommonRegionsFromBoW 6.2\nmTcm size"<<mTcm.size()<<" bconverge "<<bConverge<<std::endl;
-            if(bConverge)
-            {
-                vpCovKFi.clear();
-                //std::cout<<"DetectCommonRegionsFromBoW 6.3\n";
-                vpCovKFi = pMostBoWMatchesKF->GetBestCovisibilityKeyFrames(nNumCovisibles);
-                int nInitialCov = vpCovKFi.size();
-                vpCovKFi.push_back(pMostBoWMatchesKF);
-                //std::cout<<"DetectCommonRegionsFromBoW 6.4\n";
-
-                set<boost::interprocess::offset_ptr<KeyFrame> > spCheckKFs(vpCovKFi.begin(), vpCovKFi.end());
-
-                set<boost::interprocess::offset_ptr<MapPoint> > spMapPoints;
-                vector<boost::interprocess::offset_ptr<MapPoint> > vpMapPoints;
-                vector<boost::interprocess::offset_ptr<KeyFrame> > vpKeyFrames;
-                for(boost::interprocess::offset_ptr<KeyFrame>  pCovKFi : vpCovKFi)
-                {
-                    for(boost::interprocess::offset_ptr<MapPoint>  pCovMPij : pCovKFi->GetMapPointMatches())
-                    {
-                        if(!pCovMPij || pCovMPij->isBad())
-                            continue;
+        }
+    }
 
-                        if(spMapPoints.find(pCovMPij) == spMapPoints.end())
-                        {
-                            spMapPoints.insert(pCovMPij);
-                            vpMapPoints.push_back(pCovMPij);
-                            vpKeyFrames.push_back(pCovKFi);
-                        }
-                    }
-                }
-                //std::cout<<"DetectCommonRegionsFromBoW 6.5\n";
-                g2o::Sim3 gScm(Converter::toMatrix3d(solver.GetEstimatedRotation()),Converter::toVector3d(solver.GetEstimatedTranslation()),solver.GetEstimatedScale());
-                g2o::Sim3 gSmw(Converter::toMatrix3d(pMostBoWMatchesKF->GetRotation()),Converter::toVector3d(pMostBoWMatchesKF->GetTranslation()),1.0);
-                g2o::Sim3 gScw = gScm*gSmw; // Similarity matrix of current from the world position
-                cv::Mat mScw = Converter::toCvMat(gScw);
-                //std::cout<<"DetectCommonRegionsFromBoW 7\n";
-
-                vector<boost::interprocess::offset_ptr<MapPoint> > vpMatchedMP;
-                vpMatchedMP.resize(mpCurrentKF->GetMapPointMatches().size(), static_cast<boost::interprocess::offset_ptr<MapPoint> >(NULL));
-                vector<boost::interprocess::offset_ptr<KeyFrame> > vpMatchedKF;
-                vpMatchedKF.resize(mpCurrentKF->GetMapPointMatches().size(), static_cast<boost::interprocess::offset_ptr<KeyFrame> >(NULL));
-                int numProjMatches = matcher.SearchByProjection(mpCurrentKF, mScw, vpMapPoints, vpKeyFrames, vpMatchedMP, vpMatchedKF, 8, 1.5);
-                //std::cout<<"DetectCommonRegionsFromBoW 8\n";
-                if(numProjMatches >= nProjMatches)
-                {
-                    // Optimize Sim3 transformation with every matches
-                    Eigen::Matrix<double, 7, 7> mHessian7x7;
+    g2o::Sim3 gScm(Converter::toMatrix3d(solver.GetEstimatedRotation()),Converter::toVector3d(solver.GetEstimatedTranslation()),solver.GetEstimatedScale());
+    g2o::Sim3 gSmw(Converter::toMatrix3d(pMostBoWMatchesKF->GetRotation()),Converter::toVector3d(pMostBoWMatchesKF->GetTranslation()),1.0);
+    g2o::Sim3 gScw = gScm*gSmw; // Similarity matrix of current from the world position
+    cv::Mat mScw = Converter::toCvMat(gScw);
 
-                    bool bFixedScale = mbFixScale;
-                    if(mpTracker->mSensor==System::IMU_MONOCULAR && !mpCurrentKF->GetMap()->GetIniertialBA2())
-                        bFixedScale=false;
+    vector<boost::interprocess::offset_ptr<MapPoint> > vpMatchedMP;
+    vpMatchedMP.resize(mpCurrentKF->GetMapPointMatches().size(), static_cast<boost::interprocess::offset_ptr<MapPoint> >(NULL));
+    vector<boost::interprocess::offset_ptr<KeyFrame> > vpMatchedKF;
+    vpMatchedKF.resize(mpCurrentKF->GetMapPointMatches().size(), static_cast<boost::interprocess::offset_ptr<KeyFrame> >(NULL));
+    int numProjMatches = matcher.SearchByProjection(mpCurrentKF, mScw, vpMapPoints, vpKeyFrames, vpMatchedMP, vpMatchedKF, 8, 1.5);
 
-                    int numOptMatches = Optimizer::OptimizeSim3(mpCurrentKF, pKFi, vpMatchedMP, gScm, 10, mbFixScale, mHessian7x7, true);
+    if(numProjMatches < nProjMatches || isCancelled())
+        return;
 
-                    if(numOptMatches >= nSim3Inliers)
-                    {
-                        g2o::Sim3 gSmw(Converter::toMatrix3d(pMostBoWMatchesKF->GetRotation()),Converter::toVector3d(pMostBoWMatchesKF->GetTranslation()),1.0);
-                        g2o::Sim3 gScw = gScm*gSmw; // Similarity matrix of current from the world position
-                        cv::Mat mScw = Converter::toCvMat(gScw);
+    // Optimize Sim3 transformation with every matches
+    Eigen::Matrix<double, 7, 7> mHessian7x7;
 
-                        vector<boost::interprocess::offset_ptr<MapPoint> > vpMatchedMP;
-                        vpMatchedMP.resize(mpCurrentKF->GetMapPointMatches().size(), static_cast<boost::interprocess::offset_ptr<MapPoint> >(NULL));
-                        int numProjOptMatches = matcher.SearchByProjection(mpCurrentKF, mScw, vpMapPoints, vpMatchedMP, 5, 1.0);
+    int numOptMatches = Optimizer::OptimizeSim3(mpCurrentKF, pKFi, vpMatchedMP, gScm, 10, mbFixScale, mHessian7x7, true);
 
-                        if(numProjOptMatches >= nProjOptMatches)
-                        {
-                            int nNumKFs = 0;
-                            // Check the Sim3 transformation with the current KeyFrame covisibles
-                            vector<boost::interprocess::offset_ptr<KeyFrame> > vpCurrentCovKFs = mpCurrentKF->GetBestCovisibilityKeyFrames(nNumCovisibles);
-                            int j = 0;
-                            while(nNumKFs < 3 && j<vpCurrentCovKFs.size())
-                            {
-                                boost::interprocess::offset_ptr<KeyFrame>  pKFj = vpCurrentCovKFs[j];
-                                cv::Mat mTjc = pKFj->GetPose() * mpCurrentKF->GetPoseInverse();
-                                g2o::Sim3 gSjc(Converter::toMatrix3d(mTjc.rowRange(0, 3).colRange(0, 3)),Converter::toVector3d(mTjc.rowRange(0, 3).col(3)),1.0);
-                                g2o::Sim3 gSjw = gSjc * gScw;
-                                int numProjMatches_j = 0;
-                                vector<boost::interprocess::offset_ptr<MapPoint> > vpMatchedMPs_j;
-                                bool bValid = DetectCommonRegionsFromLastKF(pKFj,pMostBoWMatchesKF, gSjw,numProjMatches_j, vpMapPoints, vpMatchedMPs_j);
-
-                                if(bValid)
-                                {
-                                    nNumKFs++;
-                                }
+    if(numOptMatches < nSim3Inliers || isCancelled())
+        return;
 
-                                j++;
-                            }
+    gScw = gScm*gSmw; // Similarity matrix of current from the world position
+    mScw = Converter::toCvMat(gScw);
 
-                            if(nNumKFs < 3)
-                            {
-                                vnStage[index] = 8;
-                                vnMatchesStage[index] = nNumKFs;
-                            }
+    vpMatchedMP.assign(mpCurrentKF->GetMapPointMatches().size(), static_cast<boost::interprocess::offset_ptr<MapPoint> >(NULL));
+    int numProjOptMatches = matcher.SearchByProjection(mpCurrentKF, mScw, vpMapPoints, vpMatchedMP, 5, 1.0);
 
-                            if(nBestMatchesReproj < numProjOptMatches)
-                            {
-                                nBestMatchesReproj = numProjOptMatches;
-                                nBestNumCoindicendes = nNumKFs;
-                                pBestMatchedKF = pMostBoWMatchesKF;
-                                g2oBestScw = gScw;
-                                vpBestMapPoints = vpMapPoints;
-                                vpBestMatchedMapPoints = vpMatchedMP;
-                            }
+    if(numProjOptMatches < nProjOptMatches)
+        return;
 
+    int nNumKFs = 0;
+    // Check the Sim3 transformation with the current KeyFrame covisibles
+    vector<boost::interprocess::offset_ptr<KeyFrame> > vpCurrentCovKFs = mpCurrentKF->GetBestCovisibilityKeyFrames(nNumCovisibles);
+    int j = 0;
+    while(nNumKFs < 3 && j<vpCurrentCovKFs.size())
+    {
+        boost::interprocess::offset_ptr<KeyFrame>  pKFj = vpCurrentCovKFs[j];
+        cv::Mat mTjc = pKFj->GetPose() * mpCurrentKF->GetPoseInverse();
+        g2o::Sim3 gSjc(Converter::toMatrix3d(mTjc.rowRange(0, 3).colRange(0, 3)),Converter::toVector3d(mTjc.rowRange(0, 3).col(3)),1.0);
+        g2o::Sim3 gSjw = gSjc * gScw;
+        int numProjMatches_j = 0;
+        vector<boost::interprocess::offset_ptr<MapPoint> > vpMatchedMPs_j;
+        bool bValid = DetectCommonRegionsFromLastKF(pKFj,pMostBoWMatchesKF, gSjw,numProjMatches_j, vpMapPoints, vpMatchedMPs_j);
+
+        if(bValid)
+        {
+            nNumKFs++;
+        }
 
-                        }
+        j++;
+    }
 
-                    }
+    candidate.nMatchesReproj = numProjOptMatches;
+    candidate.nNumCoincidences = nNumKFs;
+    candidate.pMatchedKF = pMostBoWMatchesKF;
+    candidate.g2oScw = gScw;
+    candidate.vpMapPoints = vpMapPoints;
+    candidate.vpMatchedMPs = vpMatchedMP;
+}
 
-                }
-            }
-            //std::cout<<"DetectCommonRegionsFromBoW 9\n";
-            //delete solver;
+bool LoopClosing::DetectCommonRegionsFromBoW(std::vector<boost::interprocess::offset_ptr<KeyFrame> > &vpBowCand, boost::interprocess::offset_ptr<KeyFrame>  &pMatchedKF2, boost::interprocess::offset_ptr<KeyFrame>  &pLastCurrentKF, g2o::Sim3 &g2oScw,
+                                             int &nNumCoincidences, std::vector<boost::interprocess::offset_ptr<MapPoint> > &vpMPs, std::vector<boost::interprocess::offset_ptr<MapPoint> > &vpMatchedMPs)
+{
+    set<boost::interprocess::offset_ptr<KeyFrame> > spConnectedKeyFrames = mpCurrentKF->GetConnectedKeyFrames();
+
+    // The candidates are verified concurrently. Once one of them is confirmed by 3 covisibles of the current
+    // keyframe, or the time budget runs out, the others stop at their next stage and are discarded.
+    std::atomic<bool> bConfirmed(false);
+    const bool bTimeBudget = mnVerificationTimeMs > 0;
+    const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(mnVerificationTimeMs);
+    auto isCancelled = [&]()
+    {
+        return bConfirmed.load() || (bTimeBudget && std::chrono::steady_clock::now() > deadline);
+    };
+
+    int numCandidates = vpBowCand.size();
+    vector<BoWCandidate> vCandidates(numCandidates);
+    ParallelFor(0, numCandidates, [&](int i)
+    {
+        boost::interprocess::offset_ptr<KeyFrame>  pKFi = vpBowCand[i];
+        if(!pKFi || pKFi->isBad() || isCancelled())
+            return;
+
+        VerifyBoWCandidate(pKFi, spConnectedKeyFrames, isCancelled, vCandidates[i]);
+        if(vCandidates[i].nNumCoincidences >= 3)
+            bConfirmed = true;
+    });
+
+    // Confirmed candidates are preferred, and among them (or among all if none is) the one with most matches
+    int nBest = -1;
+    for(int i=0; i<numCandidates; ++i)
+    {
+        const BoWCandidate &candidate = vCandidates[i];
+        if(candidate.nMatchesReproj == 0)
+            continue;
+
+        if(nBest < 0)
+        {
+            nBest = i;
+            continue;
         }
-        index++;
-        //std::cout<<"DetectCommonRegionsFromBoW 9.1\n";
-    }
 
-    //std::cout<<"DetectCommonRegionsFromBoW 10\n";
+        const bool bConfirmedi = candidate.nNumCoincidences >= 3;
+        const bool bConfirmedBest = vCandidates[nBest].nNumCoincidences >= 3;
+        if(bConfirmedi != bConfirmedBest)
+        {
+            if(bConfirmedi)
+                nBest = i;
+        }
+        else if(vCandidates[nBest].nMatchesReproj < candidate.nMatchesReproj)
+            nBest = i;
+    }
 
-    if(nBestMatchesReproj > 0)
+    if(nBest >= 0)
     {
+        BoWCandidate &best = vCandidates[nBest];
         pLastCurrentKF = mpCurrentKF;
-        nNumCoincidences = nBestNumCoindicendes;
-        pMatchedKF2 = pBestMatchedKF;
+        nNumCoincidences = best.nNumCoincidences;
+        pMatchedKF2 = best.pMatchedKF;
         pMatchedKF2->SetNotErase();
-        g2oScw = g2oBestScw;
-        vpMPs = vpBestMapPoints;
-        vpMatchedMPs = vpBestMatchedMapPoints;
+        g2oScw = best.g2oScw;
+        vpMPs.swap(best.vpMapPoints);
+        vpMatchedMPs.swap(best.vpMatchedMPs);
 
         return nNumCoincidences >= 3;
     }
-    else
-    {
-        int maxStage = -1;
-        int maxMatched;
-        for(int i=0; i<vnStage.size(); ++i)
-        {
-            if(vnStage[i] > maxStage)
-            {
-                maxStage = vnStage[i];
-                maxMatched = vnMatchesStage[i];
-            }
-        }
 
-    }
     return false;
 }
 
@@ -885,20 +895,16 @@ void LoopClosing::CorrectLoop()
     cout << "Loop detected! Starting the Time measurement." << endl;
     std::chrono::steady_clock::time_point time_startCorrectLoop = std::chrono::steady_clock::now();
 
-    // Send a stop signal to Local Mapping
-    // Avoid new keyframes are inserted while correcting the loop
-    mpLocalMapper->RequestStop();
-    mpLocalMapper->EmptyQueue(); // Proccess keyframes in the queue
-
-
     // If a Global Bundle Adjustment is running, abort it
+    // It is done before stopping Local Mapping, which a commit of the GBA in progress would release
     cout << "Request GBA abort" << endl;
     if(isRunningGBA())
     {
         std::unique_lock<mutex> lock(mMutexGBA);
         mbStopGBA = true;
 
-        mnFullBAIdx = !mnFullBAIdx;
+        mnFullBAIdx++;
+        InterruptGlobalBundleAdjustment();
 
 
         if(mpThreadGBA)
@@ -909,6 +915,11 @@ void LoopClosing::CorrectLoop()
         }
     }
 
+    // Send a stop signal to Local Mapping
+    // Avoid new keyframes are inserted while correcting the loop
+    mpLocalMapper->RequestStop();
+    mpLocalMapper->EmptyQueue(); // Proccess keyframes in the queue
+
     // Wait until Local Mapping has effectively stopped
     while(!mpLocalMapper->isStopped())
     {
@@ -923,6 +934,11 @@ void LoopClosing::CorrectLoop()
     mvpCurrentConnectedKFs = mpCurrentKF->GetVectorCovisibleKeyFrames();
     mvpCurrentConnectedKFs.push_back(mpCurrentKF);
 
+#ifdef REGISTER_TIMES
+    std::chrono::steady_clock::time_point time_StartCorrection = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point time_EndCorrection;
+#endif
+
     KeyFrameAndPose CorrectedSim3, NonCorrectedSim3;
     CorrectedSim3[mpCurrentKF]=mg2oLoopScw;
     cv::Mat Twc = mpCurrentKF->GetPoseInverse();
@@ -960,13 +976,14 @@ void LoopClosing::CorrectLoop()
         }
 
         // Correct all MapPoints obsrved by current keyframe and neighbors, so that they align with the other side of the loop
+        // Each point is assigned to the first keyframe that sees it, so that the keyframes can be corrected in parallel
+        vector<KeyFrameAndPose::iterator> vitCorrectedKFs;
+        vector<vector<boost::interprocess::offset_ptr<MapPoint> > > vvpCorrectedMPs;
         for(KeyFrameAndPose::iterator mit=CorrectedSim3.begin(), mend=CorrectedSim3.end(); mit!=mend; mit++)
         {
             boost::interprocess::offset_ptr<KeyFrame>  pKFi = mit->first;
-            g2o::Sim3 g2oCorrectedSiw = mit->second;
-            g2o::Sim3 g2oCorrectedSwi = g2oCorrectedSiw.inverse();
-
-            g2o::Sim3 g2oSiw =NonCorrectedSim3[pKFi];
+            vitCorrectedKFs.push_back(mit);
+            vvpCorrectedMPs.push_back(vector<boost::interprocess::offset_ptr<MapPoint> >());
 
             vector<boost::interprocess::offset_ptr<MapPoint> > vpMPsi = pKFi->GetMapPointMatches();
             for(size_t iMP=0, endMPi = vpMPsi.size(); iMP<endMPi; iMP++)
@@ -979,6 +996,25 @@ void LoopClosing::CorrectLoop()
                 if(pMPi->mnCorrectedByKF==mpCurrentKF->mnId)
                     continue;
 
+                pMPi->mnCorrectedByKF = mpCurrentKF->mnId;
+                pMPi->mnCorrectedReference = pKFi->mnId;
+                vvpCorrectedMPs.back().push_back(pMPi);
+            }
+        }
+
+        ParallelFor(0, vitCorrectedKFs.size(), [&](int i)
+        {
+            boost::interprocess::offset_ptr<KeyFrame>  pKFi = vitCorrectedKFs[i]->first;
+            g2o::Sim3 g2oCorrectedSiw = vitCorrectedKFs[i]->second;
+            g2o::Sim3 g2oCorrectedSwi = g2oCorrectedSiw.inverse();
+
+            g2o::Sim3 g2oSiw = NonCorrectedSim3.find(pKFi)->second;
+
+            const vector<boost::interprocess::offset_ptr<MapPoint> > &vpMPsi = vvpCorrectedMPs[i];
+            for(size_t iMP=0, endMPi = vpMPsi.size(); iMP<endMPi; iMP++)
+            {
+                boost::interprocess::offset_ptr<MapPoint>  pMPi = vpMPsi[iMP];
+
                 // Project with non-corrected pose and project back with corrected pose
                 cv::Mat P3Dw = pMPi->GetWorldPos();
                 Eigen::Matrix<double,3,1> eigP3Dw = Converter::toVector3d(P3Dw);
@@ -986,9 +1022,6 @@ void LoopClosing::CorrectLoop()
 
                 cv::Mat cvCorrectedP3Dw = Converter::toCvMat(eigCorrectedP3Dw);
                 pMPi->SetWorldPos(cvCorrectedP3Dw);
-                pMPi->mnCorrectedByKF = mpCurrentKF->mnId;
-                pMPi->mnCorrectedReference = pKFi->mnId;
-                pMPi->UpdateNormalAndDepth();
             }
 
             // Update keyframe pose with corrected Sim3. First transform Sim3 to SE3 (scale translation)
@@ -1008,13 +1041,27 @@ void LoopClosing::CorrectLoop()
                 Eigen::Matrix3d Rcor = eigR.transpose()*g2oSiw.rotation().toRotationMatrix();
                 pKFi->SetVelocity(Converter::toCvMat(Rcor)*pKFi->GetVelocity());
             }
+        });
+
+        // Normals and depths once all the keyframes are corrected
+        ParallelFor(0, vvpCorrectedMPs.size(), [&](int i)
+        {
+            for(size_t iMP=0, endMPi = vvpCorrectedMPs[i].size(); iMP<endMPi; iMP++)
+                vvpCorrectedMPs[i][iMP]->UpdateNormalAndDepth();
+        });
+
+        // Make sure connections are updated
+        for(size_t i=0; i<vitCorrectedKFs.size(); i++)
+            vitCorrectedKFs[i]->first->UpdateConnections();
 
-            // Make sure connections are updated
-            pKFi->UpdateConnections();
-        }
         // TODO Check this index increasement
         pLoopMap->IncreaseChangeIndex();
 
+#ifdef REGISTER_TIMES
+        time_EndCorrection = std::chrono::steady_clock::now();
+        vTimeLoopCorrection_ms.push_back(std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(time_EndCorrection - time_StartCorrection).count());
+#endif
+
 
         // Start Loop Fusion
         // Update matched map points and replace if duplicated
@@ -1062,6 +1109,11 @@ void LoopClosing::CorrectLoop()
         }
     }
 
+#ifdef REGISTER_TIMES
+    std::chrono::steady_clock::time_point time_EndFusion = std::chrono::steady_clock::now();
+    vTimeLoopFusion_ms.push_back(std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(time_EndFusion - time_EndCorrection).count());
+#endif
+
     // Optimize graph
     bool bFixedScale = mbFixScale;
     if(mpTracker->mSensor==System::IMU_MONOCULAR && !mpCurrentKF->GetMap()->GetIniertialBA2())
@@ -1074,9 +1126,14 @@ void LoopClosing::CorrectLoop()
     }
     else
     {
-        Optimizer::OptimizeEssentialGraph(pLoopMap, mpLoopMatchedKF, mpCurrentKF, NonCorrectedSim3, CorrectedSim3, LoopConnections, bFixedScale);
+        Optimizer::OptimizeEssentialGraph(pLoopMap, mpLoopMatchedKF, mpCurrentKF, NonCorrectedSim3, CorrectedSim3, LoopConnections, bFixedScale, mpThreadPool);
     }
 
+#ifdef REGISTER_TIMES
+    std::chrono::steady_clock::time_point time_EndEssent = std::chrono::steady_clock::now();
+    vTimeLoopEssent_ms.push_back(std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(time_EndEssent - time_EndFusion).count());
+#endif
+
     mpAtlas->InformNewBigChange();
 
     // Add loop edge
@@ -1090,7 +1147,10 @@ void LoopClosing::CorrectLoop()
         mbFinishedGBA = false;
         mbStopGBA = false;
 
-        mpThreadGBA = new thread(&LoopClosing::RunGlobalBundleAdjustment, this, pLoopMap, mpCurrentKF->mnId);
+        vector<boost::interprocess::offset_ptr<KeyFrame> > vpSeedKFs = mvpCurrentConnectedKFs;
+        vpSeedKFs.push_back(mpLoopMatchedKF);
+
+        mpThreadGBA = new thread(&LoopClosing::RunGlobalBundleAdjustment, this, pLoopMap, mpCurrentKF->mnId, vpSeedKFs);
     }
 
     // Loop closed. Release Local Mapping.
@@ -1129,7 +1189,8 @@ void LoopClosing::MergeLocal()
         std::unique_lock<mutex> lock(mMutexGBA);
         mbStopGBA = true;
 
-        mnFullBAIdx = !mnFullBAIdx;
+        mnFullBAIdx++;
+        InterruptGlobalBundleAdjustment();
 
 
         if(mpThreadGBA)
@@ -1285,6 +1346,10 @@ void LoopClosing::MergeLocal()
 
     std::cout<<"Merge local 4\n";
 
+#ifdef REGISTER_TIMES
+    std::chrono::steady_clock::time_point time_StartCorrection = std::chrono::steady_clock::now();
+#endif
+
     cv::Mat Twc = mpCurrentKF->GetPoseInverse();
 
     cv::Mat Rwc = Twc.rowRange(0,3).colRange(0,3);
@@ -1297,6 +1362,9 @@ void LoopClosing::MergeLocal()
     vCorrectedSim3[mpCurrentKF]=g2oCorrectedScw;
     vNonCorrectedSim3[mpCurrentKF]=g2oNonCorrectedScw;
 
+    // The corrections are computed first, the keyframes and points are then corrected in parallel without
+    // modifying the maps of poses
+    vector<boost::interprocess::offset_ptr<KeyFrame> > vpWindowKFs;
     for(boost::interprocess::offset_ptr<KeyFrame>  pKFi : spLocalWindowKFs)
     {
         if(!pKFi || pKFi->isBad())
@@ -1304,8 +1372,6 @@ void LoopClosing::MergeLocal()
             continue;
         }
 
-        g2o::Sim3 g2oCorrectedSiw;
-
         if(pKFi!=mpCurrentKF)
         {
             cv::Mat Tiw = pKFi->GetPose();
@@ -1319,15 +1385,18 @@ void LoopClosing::MergeLocal()
             cv::Mat Ric = Tic.rowRange(0,3).colRange(0,3);
             cv::Mat tic = Tic.rowRange(0,3).col(3);
             g2o::Sim3 g2oSic(Converter::toMatrix3d(Ric),Converter::toVector3d(tic),1.0);
-            g2oCorrectedSiw = g2oSic*mg2oMergeScw;
-            vCorrectedSim3[pKFi]=g2oCorrectedSiw;
-        }
-        else
-        {
-            g2oCorrectedSiw = g2oCorrectedScw;
+            vCorrectedSim3[pKFi]=g2oSic*mg2oMergeScw;
         }
+        vpWindowKFs.push_back(pKFi);
+    }
+
+    ParallelFor(0, vpWindowKFs.size(), [&](int i)
+    {
+        boost::interprocess::offset_ptr<KeyFrame>  pKFi = vpWindowKFs[i];
+        const g2o::Sim3 &g2oCorrectedSiw = vCorrectedSim3.find(pKFi)->second;
+
         //pKFi->mTcwMerge  = pKFi->GetPose();
-        pKFi->GetPose().copyTo(pKFi->mTcwMerge);
+        pKFi->mTcwMerge = pKFi->GetPose();
         // Update keyframe pose with corrected Sim3. First transform Sim3 to SE3 (scale translation)
         Eigen::Matrix3d eigR = g2oCorrectedSiw.rotation().toRotationMatrix();
         Eigen::Vector3d eigt = g2oCorrectedSiw.translation();
@@ -1339,27 +1408,37 @@ void LoopClosing::MergeLocal()
         cv::Mat correctedTiw = Converter::toCvSE3(eigR,eigt);
 
         //pKFi->mTcwMerge = correctedTiw;
-        correctedTiw.copyTo(pKFi->mTcwMerge);
+        pKFi->mTcwMerge = correctedTiw;
 
         if(pCurrentMap->isImuInitialized())
         {
-            Eigen::Matrix3d Rcor = eigR.transpose()*vNonCorrectedSim3[pKFi].rotation().toRotationMatrix();
+            Eigen::Matrix3d Rcor = eigR.transpose()*vNonCorrectedSim3.find(pKFi)->second.rotation().toRotationMatrix();
             cv::Mat temp1 = Converter::toCvMat(Rcor)*pKFi->GetVelocity();
-            temp1.copyTo(pKFi->mVwbMerge);
+            pKFi->mVwbMerge = temp1;
             //pKFi->mVwbMerge = Converter::toCvMat(Rcor)*pKFi->GetVelocity();
         }
 
-    }
+    });
 
      std::cout<<"Merge local 5\n";
+    vector<boost::interprocess::offset_ptr<MapPoint> > vpWindowMPs;
+    vector<const g2o::Sim3*> vpCorrectedSiw, vpNonCorrectedSiw;
     for(boost::interprocess::offset_ptr<MapPoint>  pMPi : spLocalWindowMPs)
     {
         if(!pMPi || pMPi->isBad())
             continue;
 
         boost::interprocess::offset_ptr<KeyFrame>  pKFref = pMPi->GetReferenceKeyFrame();
-        g2o::Sim3 g2oCorrectedSwi = vCorrectedSim3[pKFref].inverse();
-        g2o::Sim3 g2oNonCorrectedSiw = vNonCorrectedSim3[pKFref];
+        vpWindowMPs.push_back(pMPi);
+        vpCorrectedSiw.push_back(&vCorrectedSim3[pKFref]);
+        vpNonCorrectedSiw.push_back(&vNonCorrectedSim3[pKFref]);
+    }
+
+    ParallelFor(0, vpWindowMPs.size(), [&](int i)
+    {
+        boost::interprocess::offset_ptr<MapPoint>  pMPi = vpWindowMPs[i];
+        g2o::Sim3 g2oCorrectedSwi = vpCorrectedSiw[i]->inverse();
+        g2o::Sim3 g2oNonCorrectedSiw = *vpNonCorrectedSiw[i];
 
         // Project with non-corrected pose and project back with corrected pose
         cv::Mat P3Dw = pMPi->GetWorldPos();
@@ -1373,14 +1452,14 @@ void LoopClosing::MergeLocal()
         //std::cout<<"Size of cvCorrectedP3Dw: (mPosMerge) "<<cvCorrectedP3Dw.size()<<" element size: "<<cvCorrectedP3Dw.elemSize()<<std::endl;
 
         //pMPi->mPosMerge = cvCorrectedP3Dw;
-        cvCorrectedP3Dw.copyTo(pMPi->mPosMerge);
+        pMPi->mPosMerge = cvCorrectedP3Dw;
         
 
         //pMPi->mNormalVectorMerge = Converter::toCvMat(Rcor) * pMPi->GetNormal();
         cv::Mat temp_mat = Converter::toCvMat(Rcor) * pMPi->GetNormal();
         //std::cout<<"Size of temp_map: (mNormalVectorMerge) "<<temp_mat.size()<<" element size: "<<temp_mat.elemSize()<<std::endl;
-        temp_mat.copyTo(pMPi->mNormalVectorMerge);
-    }
+        pMPi->mNormalVectorMerge = temp_mat;
+    });
 
      std::cout<<"Merge local 6\n";
     {
@@ -1396,8 +1475,8 @@ void LoopClosing::MergeLocal()
 
             //pKFi->mTcwBefMerge = pKFi->GetPose();
             //pKFi->mTwcBefMerge = pKFi->GetPoseInverse();
-            pKFi->GetPose().copyTo(pKFi->mTcwBefMerge);
-            pKFi->GetPoseInverse().copyTo(pKFi->mTwcBefMerge);
+            pKFi->mTcwBefMerge = pKFi->GetPose();
+            pKFi->mTwcBefMerge = pKFi->GetPoseInverse();
             pKFi->SetPose(pKFi->mTcwMerge);
 
             // Make sure connections are updated
@@ -1429,6 +1508,11 @@ void LoopClosing::MergeLocal()
         pMergeMap->IncreaseChangeIndex();
     }
 
+#ifdef REGISTER_TIMES
+    std::chrono::steady_clock::time_point time_EndCorrection = std::chrono::steady_clock::now();
+    vTimeMergeCorrection_ms.push_back(std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(time_EndCorrection - time_StartCorrection).count());
+#endif
+
      std::cout<<"Merge local 7\n";
 
     //Rebuild the essential graph in the local window
@@ -1477,6 +1561,11 @@ void LoopClosing::MergeLocal()
         pKFi->UpdateConnections();
     }
 
+#ifdef REGISTER_TIMES
+    std::chrono::steady_clock::time_point time_EndFusion = std::chrono::steady_clock::now();
+    vTimeMergeFusion_ms.push_back(std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(time_EndFusion - time_EndCorrection).count());
+#endif
+
      std::cout<<"Merge local 8\n";
 
     bool bStop = false;
@@ -1494,6 +1583,11 @@ void LoopClosing::MergeLocal()
         Optimizer::LocalBundleAdjustment(mpCurrentKF, vpLocalCurrentWindowKFs, vpMergeConnectedKFs,&bStop);
     }
 
+#ifdef REGISTER_TIMES
+    std::chrono::steady_clock::time_point time_EndBA = std::chrono::steady_clock::now();
+    vTimeMergeBA_ms.push_back(std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(time_EndBA - time_EndFusion).count());
+#endif
+
     // Loop closed. Release Local Mapping.
     mpLocalMapper->Release();
 
@@ -1519,6 +1613,9 @@ void LoopClosing::MergeLocal()
             {
                 std::unique_lock<mutex> currentLock(pCurrentMap->mMutexMapUpdate); // We update the current map with the Merge information
 
+                // The entries of the keyframes are created first, and filled in parallel
+                vector<boost::interprocess::offset_ptr<KeyFrame> > vpCorrectKFs;
+                vector<g2o::Sim3*> vpKFCorrectedSiw, vpKFNonCorrectedSiw;
                 for(boost::interprocess::offset_ptr<KeyFrame>  pKFi : vpCurrentMapKFs)
                 {
                     if(!pKFi || pKFi->isBad() || pKFi->GetMap() != pCurrentMap)
@@ -1526,6 +1623,15 @@ void LoopClosing::MergeLocal()
                         continue;
                     }
 
+                    vpCorrectKFs.push_back(pKFi);
+                    vpKFCorrectedSiw.push_back(&vCorrectedSim3[pKFi]);
+                    vpKFNonCorrectedSiw.push_back(&vNonCorrectedSim3[pKFi]);
+                }
+
+                ParallelFor(0, vpCorrectKFs.size(), [&](int i)
+                {
+                    boost::interprocess::offset_ptr<KeyFrame>  pKFi = vpCorrectKFs[i];
+
                     g2o::Sim3 g2oCorrectedSiw;
 
                     cv::Mat Tiw = pKFi->GetPose();
@@ -1533,14 +1639,14 @@ void LoopClosing::MergeLocal()
                     cv::Mat tiw = Tiw.rowRange(0,3).col(3);
                     g2o::Sim3 g2oSiw(Converter::toMatrix3d(Riw),Converter::toVector3d(tiw),1.0);
                     //Pose without correction
-                    vNonCorrectedSim3[pKFi]=g2oSiw;
+                    *vpKFNonCorrectedSiw[i]=g2oSiw;
 
                     cv::Mat Tic = Tiw*Twc;
                     cv::Mat Ric = Tic.rowRange(0,3).colRange(0,3);
                     cv::Mat tic = Tic.rowRange(0,3).col(3);
                     g2o::Sim3 g2oSim(Converter::toMatrix3d(Ric),Converter::toVector3d(tic),1.0);
                     g2oCorrectedSiw = g2oSim*mg2oMergeScw;
-                    vCorrectedSim3[pKFi]=g2oCorrectedSiw;
+                    *vpKFCorrectedSiw[i]=g2oCorrectedSiw;
 
                     // Update keyframe pose with corrected Sim3. First transform Sim3 to SE3 (scale translation)
                     Eigen::Matrix3d eigR = g2oCorrectedSiw.rotation().toRotationMatrix();
@@ -1555,26 +1661,37 @@ void LoopClosing::MergeLocal()
                     //pKFi->mTcwBefMerge = pKFi->GetPose();
                     //pKFi->mTwcBefMerge = pKFi->GetPoseInverse();
 
-                    pKFi->GetPose().copyTo(pKFi->mTcwBefMerge);
-                    pKFi->GetPoseInverse().copyTo(pKFi->mTwcBefMerge);
+                    pKFi->mTcwBefMerge = pKFi->GetPose();
+                    pKFi->mTwcBefMerge = pKFi->GetPoseInverse();
 
                     pKFi->SetPose(correctedTiw);
 
                     if(pCurrentMap->isImuInitialized())
                     {
-                        Eigen::Matrix3d Rcor = eigR.transpose()*vNonCorrectedSim3[pKFi].rotation().toRotationMatrix();
+                        Eigen::Matrix3d Rcor = eigR.transpose()*g2oSiw.rotation().toRotationMatrix();
                         pKFi->SetVelocity(Converter::toCvMat(Rcor)*pKFi->GetVelocity()); // TODO: should add here scale s
                     }
 
-                }
+                });
+
+                vector<boost::interprocess::offset_ptr<MapPoint> > vpCorrectMPs;
+                vector<const g2o::Sim3*> vpMPCorrectedSiw, vpMPNonCorrectedSiw;
                 for(boost::interprocess::offset_ptr<MapPoint>  pMPi : vpCurrentMapMPs)
                 {
                     if(!pMPi || pMPi->isBad()|| pMPi->GetMap() != pCurrentMap)
                         continue;
 
                     boost::interprocess::offset_ptr<KeyFrame>  pKFref = pMPi->GetReferenceKeyFrame();
-                    g2o::Sim3 g2oCorrectedSwi = vCorrectedSim3[pKFref].inverse();
-                    g2o::Sim3 g2oNonCorrectedSiw = vNonCorrectedSim3[pKFref];
+                    vpCorrectMPs.push_back(pMPi);
+                    vpMPCorrectedSiw.push_back(&vCorrectedSim3[pKFref]);
+                    vpMPNonCorrectedSiw.push_back(&vNonCorrectedSim3[pKFref]);
+                }
+
+                ParallelFor(0, vpCorrectMPs.size(), [&](int i)
+                {
+                    boost::interprocess::offset_ptr<MapPoint>  pMPi = vpCorrectMPs[i];
+                    g2o::Sim3 g2oCorrectedSwi = vpMPCorrectedSiw[i]->inverse();
+                    g2o::Sim3 g2oNonCorrectedSiw = *vpMPNonCorrectedSiw[i];
 
                     // Project with non-corrected pose and project back with corrected pose
                     cv::Mat P3Dw = pMPi->GetWorldPos();
@@ -1585,7 +1702,7 @@ void LoopClosing::MergeLocal()
                     pMPi->SetWorldPos(cvCorrectedP3Dw);
 
                     pMPi->UpdateNormalAndDepth();
-                }
+                });
             }
         }
         std::cout<<"Merge local 10\n";
@@ -1637,6 +1754,11 @@ void LoopClosing::MergeLocal()
     mpLocalMapper->Release();
     std::cout<<"Merge local 11\n";
 
+#ifdef REGISTER_TIMES
+    std::chrono::steady_clock::time_point time_EndMapUpdate = std::chrono::steady_clock::now();
+    vTimeMergeMapUpdate_ms.push_back(std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(time_EndMapUpdate - time_EndBA).count());
+#endif
+
     Verbose::PrintMess("MERGE:Completed!!!!!", Verbose::VERBOSITY_DEBUG);
 
     if(bRelaunchBA && (!pCurrentMap->isImuInitialized() || (pCurrentMap->KeyFramesInMap()<200 && mpAtlas->CountMaps()==1)))
@@ -1646,7 +1768,11 @@ void LoopClosing::MergeLocal()
         mbRunningGBA = true;
         mbFinishedGBA = false;
         mbStopGBA = false;
-        mpThreadGBA = new thread(&LoopClosing::RunGlobalBundleAdjustment,this, pMergeMap, mpCurrentKF->mnId);
+
+        vector<boost::interprocess::offset_ptr<KeyFrame> > vpSeedKFs(spLocalWindowKFs.begin(), spLocalWindowKFs.end());
+        vpSeedKFs.insert(vpSeedKFs.end(), spMergeConnectedKFs.begin(), spMergeConnectedKFs.end());
+
+        mpThreadGBA = new thread(&LoopClosing::RunGlobalBundleAdjustment,this, pMergeMap, mpCurrentKF->mnId, vpSeedKFs);
     }
 
     mpMergeMatchedKF->AddMergeEdge(mpCurrentKF);
@@ -1685,7 +1811,8 @@ void LoopClosing::MergeLocal2()
         std::unique_lock<mutex> lock(mMutexGBA);
         mbStopGBA = true;
 
-        mnFullBAIdx = !mnFullBAIdx;
+        mnFullBAIdx++;
+        InterruptGlobalBundleAdjustment();
 
 
         if(mpThreadGBA)
@@ -2010,20 +2137,76 @@ void LoopClosing::ResetIfRequested()
     }
 }
 
-void LoopClosing::RunGlobalBundleAdjustment(boost::interprocess::offset_ptr<Map>  pActiveMap, unsigned long nLoopKF)
+void LoopClosing::InterruptGlobalBundleAdjustment()
+{
+    if(mpInterruptedGBAMap!=mpGBAMap)
+        mvpInterruptedGBASeedKFs.clear();
+    mpInterruptedGBAMap = mpGBAMap;
+    mvpInterruptedGBASeedKFs.insert(mvpInterruptedGBASeedKFs.end(), mvpGBASeedKFs.begin(), mvpGBASeedKFs.end());
+    mGBAProgress.bRunning = false;
+}
+
+void LoopClosing::RunGlobalBundleAdjustment(boost::interprocess::offset_ptr<Map>  pActiveMap, unsigned long nLoopKF,
+                                            vector<boost::interprocess::offset_ptr<KeyFrame> > vpSeedKFs)
 {
     Verbose::PrintMess("Starting Global Bundle Adjustment", Verbose::VERBOSITY_NORMAL);
 
     const bool bImuInit = pActiveMap->isImuInitialized();
+    const int nIterations = bImuInit ? 7 : 10;
+
+    int idx;
+    {
+        std::unique_lock<mutex> lock(mMutexGBA);
+        idx = mnFullBAIdx;
+
+        // Resume the GBAs aborted on this map
+        if(!vpSeedKFs.empty() && mpInterruptedGBAMap==pActiveMap)
+            vpSeedKFs.insert(vpSeedKFs.end(), mvpInterruptedGBASeedKFs.begin(), mvpInterruptedGBASeedKFs.end());
+        mpInterruptedGBAMap = static_cast<boost::interprocess::offset_ptr<Map> >(NULL);
+        mvpInterruptedGBASeedKFs.clear();
+
+        mpGBAMap = pActiveMap;
+        mvpGBASeedKFs = vpSeedKFs;
+
+        mGBAProgress = GBAProgress();
+        mGBAProgress.nIterations = nIterations;
+        mGBAProgress.bRunning = true;
+    }
 
-#ifdef REGISTER_TIMES
     std::chrono::steady_clock::time_point time_StartFGBA = std::chrono::steady_clock::now();
-#endif
 
-    if(!bImuInit)
-        Optimizer::GlobalBundleAdjustemnt(pActiveMap,10,&mbStopGBA,nLoopKF,false);
+    // Commit of the estimate after each chunk of iterations, so that tracking works on the partially optimized map.
+    // The GBA is stopped if it has been aborted meanwhile.
+    Optimizer::ChunkCallback commitChunk = [&](int nIteration, double chi2)
+    {
+        std::unique_lock<mutex> lock(mMutexGBA);
+        if(idx!=mnFullBAIdx || mbStopGBA)
+            return false;
+
+        if(!bImuInit && pActiveMap->isImuInitialized())
+            return false;
+
+        const double elapsed = std::chrono::duration_cast<std::chrono::duration<double> >(std::chrono::steady_clock::now() - time_StartFGBA).count();
+        mGBAProgress.nIteration = nIteration;
+        mGBAProgress.chi2 = chi2;
+        mGBAProgress.etaSeconds = elapsed/nIteration*(nIterations-nIteration);
+
+        Verbose::PrintMess("Global Bundle Adjustment: iteration " + to_string(nIteration) + "/" + to_string(nIterations) + ", chi2 " + to_string(chi2)
+                           + ", ETA " + to_string(mGBAProgress.etaSeconds) + " s", Verbose::VERBOSITY_NORMAL);
+
+        CommitGlobalBundleAdjustment(pActiveMap, nLoopKF, false);
+        mGBAProgress.nCommits++;
+        return true;
+    };
+
+    const int nChunkIterations = mnGBAChunkIterations;
+    if(!bImuInit && mnIncrementalGBALevels>0 && !vpSeedKFs.empty())
+        Optimizer::IncrementalBundleAdjustment(pActiveMap,vpSeedKFs,mnIncrementalGBALevels,nIterations,&mbStopGBA,nLoopKF,false,
+                                               nChunkIterations,commitChunk);
+    else if(!bImuInit)
+        Optimizer::GlobalBundleAdjustemnt(pActiveMap,nIterations,&mbStopGBA,nLoopKF,false,nChunkIterations,commitChunk);
     else
-        Optimizer::FullInertialBA(pActiveMap,7,false,nLoopKF,&mbStopGBA);
+        Optimizer::FullInertialBA(pActiveMap,nIterations,false,nLoopKF,&mbStopGBA);
 
 #ifdef REGISTER_TIMES
     std::chrono::steady_clock::time_point time_StartMapUpdate = std::chrono::steady_clock::now();
@@ -2032,9 +2215,6 @@ void LoopClosing::RunGlobalBundleAdjustment(boost::interprocess::offset_ptr<Map>
     vTimeFullGBA_ms.push_back(timeFullGBA);
 #endif
 
-
-    int idx =  mnFullBAIdx;
-
     // Update all MapPoints and KeyFrames
     // Local Mapping was active during BA, that means that there might be new keyframes
     // not included in the Global BA and they are not consistent with the updated map.
@@ -2050,142 +2230,167 @@ void LoopClosing::RunGlobalBundleAdjustment(boost::interprocess::offset_ptr<Map>
         if(!mbStopGBA)
         {
             Verbose::PrintMess("Global Bundle Adjustment finished", Verbose::VERBOSITY_NORMAL);
-            Verbose::PrintMess("Updating map ...", Verbose::VERBOSITY_NORMAL);
 
-            mpLocalMapper->RequestStop();
-            // Wait until Local Mapping has effectively stopped
+            CommitGlobalBundleAdjustment(pActiveMap, nLoopKF, true);
+            mGBAProgress.nIteration = nIterations;
+            mGBAProgress.etaSeconds = 0;
+            mGBAProgress.nCommits++;
+        }
 
-            while(!mpLocalMapper->isStopped() && !mpLocalMapper->isFinished())
-            {
-                usleep(1000);
-            }
+        mGBAProgress.bRunning = false;
+        mbFinishedGBA = true;
+        mbRunningGBA = false;
+    }
 
-            // Get Map Mutex
-            std::unique_lock<mutex> lock(pActiveMap->mMutexMapUpdate);
+#ifdef REGISTER_TIMES
+    std::chrono::steady_clock::time_point time_EndMapUpdate = std::chrono::steady_clock::now();
 
-            // Correct keyframes starting at map first keyframe
-            //old
-            //list<boost::interprocess::offset_ptr<KeyFrame> > lpKFtoCheck(pActiveMap->mvpKeyFrameOrigins.begin(),pActiveMap->mvpKeyFrameOrigins.end());
-            //new
-            list<boost::interprocess::offset_ptr<KeyFrame> > lpKFtoCheck(pActiveMap->mvpKeyFrameOrigins->begin(),pActiveMap->mvpKeyFrameOrigins->end());
+    double timeMapUpdate = std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(time_EndMapUpdate - time_StartMapUpdate).count();
+    vTimeMapUpdate_ms.push_back(timeMapUpdate);
 
-            while(!lpKFtoCheck.empty())
-            {
-                boost::interprocess::offset_ptr<KeyFrame>  pKF = lpKFtoCheck.front();
-                const set<boost::interprocess::offset_ptr<KeyFrame> > sChilds = pKF->GetChilds();
-                cv::Mat Twc = pKF->GetPoseInverse();
-                for(set<boost::interprocess::offset_ptr<KeyFrame> >::const_iterator sit=sChilds.begin();sit!=sChilds.end();sit++)
-                {
-                    boost::interprocess::offset_ptr<KeyFrame>  pChild = *sit;
-                    if(!pChild || pChild->isBad())
-                        continue;
+    double timeGBA = std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(time_EndMapUpdate - time_StartFGBA).count();
+    vTimeGBATotal_ms.push_back(timeGBA);
+#endif
+}
 
-                    if(pChild->mnBAGlobalForKF!=nLoopKF)
-                    {
-                        cv::Mat Tchildc = pChild->GetPose()*Twc;
-                        //pChild->mTcwGBA = Tchildc*pKF->mTcwGBA;
-                        cv::Mat temp_mat1 = Tchildc*pKF->mTcwGBA;
-                        (temp_mat1).copyTo(pChild->mTcwGBA);
-
-                        cv::Mat Rcor = pChild->mTcwGBA.rowRange(0,3).colRange(0,3).t()*pChild->GetRotation();
-                        if(!pChild->GetVelocity().empty()){
-                            //pChild->mVwbGBA = Rcor*pChild->GetVelocity();
-                            cv::Mat temp_mat2 = Rcor*pChild->GetVelocity();
-                            (temp_mat2).copyTo(pChild->mVwbGBA);
-                        }
-                        else
-                            Verbose::PrintMess("Child velocity empty!! ", Verbose::VERBOSITY_NORMAL);
+void LoopClosing::CommitGlobalBundleAdjustment(boost::interprocess::offset_ptr<Map>  pActiveMap, unsigned long nLoopKF, bool bFinal)
+{
+    Verbose::PrintMess("Updating map ...", Verbose::VERBOSITY_NORMAL);
 
+    mpLocalMapper->RequestStop();
+    // Wait until Local Mapping has effectively stopped
 
-                        pChild->mBiasGBA = pChild->GetImuBias();
+    while(!mpLocalMapper->isStopped() && !mpLocalMapper->isFinished())
+    {
+        usleep(1000);
+    }
 
+    // The map replicator does not copy the segment while the map is corrected
+    MapSegment::WriteScope writeScope(map_segment);
 
-                        pChild->mnBAGlobalForKF=nLoopKF;
+    // Get Map Mutex
+    std::unique_lock<mutex> lock(pActiveMap->mMutexMapUpdate);
 
-                    }
-                    lpKFtoCheck.push_back(pChild);
-                }
+    // Keyframes corrected through the spanning tree, with their previous flag. After an intermediate commit it is
+    // restored, for them to take the correction of the next one.
+    vector<pair<boost::interprocess::offset_ptr<KeyFrame>, long unsigned int> > vPropagatedKFs;
 
-                //pKF->mTcwBefGBA = pKF->GetPose();
-                pKF->GetPose().copyTo(pKF->mTcwBefGBA);
-                pKF->SetPose(pKF->mTcwGBA);
+    // Correct keyframes starting at map first keyframe
+    //old
+    //list<boost::interprocess::offset_ptr<KeyFrame> > lpKFtoCheck(pActiveMap->mvpKeyFrameOrigins.begin(),pActiveMap->mvpKeyFrameOrigins.end());
+    //new
+    list<boost::interprocess::offset_ptr<KeyFrame> > lpKFtoCheck(pActiveMap->mvpKeyFrameOrigins->begin(),pActiveMap->mvpKeyFrameOrigins->end());
 
-                if(pKF->bImu)
-                {
-                    //pKF->mVwbBefGBA = pKF->GetVelocity();
-                    pKF->GetVelocity().copyTo(pKF->mVwbBefGBA);
-                    if (pKF->mVwbGBA.empty())
-                        Verbose::PrintMess("pKF->mVwbGBA is empty", Verbose::VERBOSITY_NORMAL);
-
-                    assert(!pKF->mVwbGBA.empty());
-                    pKF->SetVelocity(pKF->mVwbGBA);
-                    pKF->SetNewBias(pKF->mBiasGBA);                    
+    while(!lpKFtoCheck.empty())
+    {
+        boost::interprocess::offset_ptr<KeyFrame>  pKF = lpKFtoCheck.front();
+        const set<boost::interprocess::offset_ptr<KeyFrame> > sChilds = pKF->GetChilds();
+        cv::Mat Twc = pKF->GetPoseInverse();
+        for(set<boost::interprocess::offset_ptr<KeyFrame> >::const_iterator sit=sChilds.begin();sit!=sChilds.end();sit++)
+        {
+            boost::interprocess::offset_ptr<KeyFrame>  pChild = *sit;
+            if(!pChild || pChild->isBad())
+                continue;
+
+            if(pChild->mnBAGlobalForKF!=nLoopKF)
+            {
+                vPropagatedKFs.push_back(make_pair(pChild, pChild->mnBAGlobalForKF));
+
+                cv::Mat Tchildc = pChild->GetPose()*Twc;
+                //pChild->mTcwGBA = Tchildc*pKF->mTcwGBA;
+                cv::Mat temp_mat1 = Tchildc*pKF->mTcwGBA;
+                pChild->mTcwGBA = temp_mat1;
+
+                cv::Mat Rcor = pChild->mTcwGBA.rowRange(0,3).colRange(0,3).t()*pChild->GetRotation();
+                if(!pChild->GetVelocity().empty()){
+                    //pChild->mVwbGBA = Rcor*pChild->GetVelocity();
+                    cv::Mat temp_mat2 = Rcor*pChild->GetVelocity();
+                    pChild->mVwbGBA = temp_mat2;
                 }
+                else
+                    Verbose::PrintMess("Child velocity empty!! ", Verbose::VERBOSITY_NORMAL);
+
+
+                pChild->mBiasGBA = pChild->GetImuBias();
+
+
+                pChild->mnBAGlobalForKF=nLoopKF;
 
-                lpKFtoCheck.pop_front();
             }
+            lpKFtoCheck.push_back(pChild);
+        }
 
-            // Correct MapPoints
-            const vector<boost::interprocess::offset_ptr<MapPoint> > vpMPs = pActiveMap->GetAllMapPoints();
+        //pKF->mTcwBefGBA = pKF->GetPose();
+        pKF->mTcwBefGBA = pKF->GetPose();
+        pKF->SetPose(pKF->mTcwGBA);
 
-            for(size_t i=0; i<vpMPs.size(); i++)
-            {
-                boost::interprocess::offset_ptr<MapPoint>  pMP = vpMPs[i];
+        if(pKF->bImu)
+        {
+            //pKF->mVwbBefGBA = pKF->GetVelocity();
+            pKF->mVwbBefGBA = pKF->GetVelocity();
+            if (pKF->mVwbGBA.empty())
+                Verbose::PrintMess("pKF->mVwbGBA is empty", Verbose::VERBOSITY_NORMAL);
+
+            assert(!pKF->mVwbGBA.empty());
+            pKF->SetVelocity(pKF->mVwbGBA);
+            pKF->SetNewBias(pKF->mBiasGBA);                    
+        }
 
-                if(pMP->isBad())
-                    continue;
+        lpKFtoCheck.pop_front();
+    }
 
-                if(pMP->mnBAGlobalForKF==nLoopKF)
-                {
-                    // If optimized by Global BA, just update
-                    pMP->SetWorldPos(pMP->mPosGBA);
-                }
-                else
-                {
-                    // Update according to the correction of its reference keyframe
-                    boost::interprocess::offset_ptr<KeyFrame>  pRefKF = pMP->GetReferenceKeyFrame();
+    // Correct MapPoints
+    const vector<boost::interprocess::offset_ptr<MapPoint> > vpMPs = pActiveMap->GetAllMapPoints();
 
-                    if(pRefKF->mnBAGlobalForKF!=nLoopKF)
-                        continue;
+    for(size_t i=0; i<vpMPs.size(); i++)
+    {
+        boost::interprocess::offset_ptr<MapPoint>  pMP = vpMPs[i];
 
-                    if(pRefKF->mTcwBefGBA.empty())
-                        continue;
+        if(pMP->isBad())
+            continue;
 
-                    // Map to non-corrected camera
-                    cv::Mat Rcw = pRefKF->mTcwBefGBA.rowRange(0,3).colRange(0,3);
-                    cv::Mat tcw = pRefKF->mTcwBefGBA.rowRange(0,3).col(3);
-                    cv::Mat Xc = Rcw*pMP->GetWorldPos()+tcw;
+        if(pMP->mnBAGlobalForKF==nLoopKF)
+        {
+            // If optimized by Global BA, just update
+            pMP->SetWorldPos(pMP->mPosGBA);
+        }
+        else
+        {
+            // Update according to the correction of its reference keyframe
+            boost::interprocess::offset_ptr<KeyFrame>  pRefKF = pMP->GetReferenceKeyFrame();
 
-                    // Backproject using corrected camera
-                    cv::Mat Twc = pRefKF->GetPoseInverse();
-                    cv::Mat Rwc = Twc.rowRange(0,3).colRange(0,3);
-                    cv::Mat twc = Twc.rowRange(0,3).col(3);
+            if(pRefKF->mnBAGlobalForKF!=nLoopKF)
+                continue;
 
-                    pMP->SetWorldPos(Rwc*Xc+twc);
-                }
-            }
+            if(pRefKF->mTcwBefGBA.empty())
+                continue;
 
-            pActiveMap->InformNewBigChange();
-            pActiveMap->IncreaseChangeIndex();
+            // Map to non-corrected camera
+            cv::Mat Rcw = pRefKF->mTcwBefGBA.rowRange(0,3).colRange(0,3);
+            cv::Mat tcw = pRefKF->mTcwBefGBA.rowRange(0,3).col(3);
+            cv::Mat Xc = Rcw*pMP->GetWorldPos()+tcw;
 
-            mpLocalMapper->Release();
+            // Backproject using corrected camera
+            cv::Mat Twc = pRefKF->GetPoseInverse();
+            cv::Mat Rwc = Twc.rowRange(0,3).colRange(0,3);
+            cv::Mat twc = Twc.rowRange(0,3).col(3);
 
-            Verbose::PrintMess("Map updated!", Verbose::VERBOSITY_NORMAL);
+            pMP->SetWorldPos(Rwc*Xc+twc);
         }
+    }
 
-        mbFinishedGBA = true;
-        mbRunningGBA = false;
+    if(!bFinal)
+    {
+        for(size_t i=0; i<vPropagatedKFs.size(); i++)
+            vPropagatedKFs[i].first->mnBAGlobalForKF = vPropagatedKFs[i].second;
     }
 
-#ifdef REGISTER_TIMES
-    std::chrono::steady_clock::time_point time_EndMapUpdate = std::chrono::steady_clock::now();
+    pActiveMap->InformNewBigChange();
+    pActiveMap->IncreaseChangeIndex();
 
-    double timeMapUpdate = std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(time_EndMapUpdate - time_StartMapUpdate).count();
-    vTimeMapUpdate_ms.push_back(timeMapUpdate);
+    mpLocalMapper->Release();
 
-    double timeGBA = std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(time_EndMapUpdate - time_StartFGBA).count();
-    vTimeGBATotal_ms.push_back(timeGBA);
-#endif
+    Verbose::PrintMess("Map updated!", Verbose::VERBOSITY_NORMAL);
 }
 
 void LoopClosing::RequestFinish()
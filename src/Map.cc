@@ -43,20 +43,20 @@ mbFail(false), mIsInUse(false), mHasTumbnail(false), mbBad(false), mnMapChangeNo
     shm = &shm_temp;
     */
     const ShmemAllocator alloc_inst(ORB_SLAM3::segment.get_segment_manager());
-    mvpKeyFrameOrigins = ORB_SLAM3::segment.construct<MyVector>(boost::interprocess::anonymous_instance)(alloc_inst);
+    mvpKeyFrameOrigins = ORB_SLAM3::map_segment.Construct<MyVector>(alloc_inst);
     keyframeorigins_offsetptr = mvpKeyFrameOrigins;
 
     const ShmemAllocator_longint alloc_inst2(ORB_SLAM3::segment.get_segment_manager());
-    mvBackupKeyFrameOriginsId = ORB_SLAM3::segment.construct<MyVector_longint>(boost::interprocess::anonymous_instance)(alloc_inst2);
+    mvBackupKeyFrameOriginsId = ORB_SLAM3::map_segment.Construct<MyVector_longint>(alloc_inst2);
 
     const ShmemAllocator_keyframe_set alloc_set_key(ORB_SLAM3::segment.get_segment_manager());
-    mspKeyFrames = ORB_SLAM3::segment.construct<Myset_keyframe>(boost::interprocess::anonymous_instance)(alloc_set_key);
+    mspKeyFrames = ORB_SLAM3::map_segment.Construct<Myset_keyframe>(alloc_set_key);
 
     const ShmemAllocator_mappoint_set alloc_set_mappoint(ORB_SLAM3::segment.get_segment_manager());
-    mspMapPoints = ORB_SLAM3::segment.construct<Myset_mappoint>(boost::interprocess::anonymous_instance)(alloc_set_mappoint);
+    mspMapPoints = ORB_SLAM3::map_segment.Construct<Myset_mappoint>(alloc_set_mappoint);
 
     const ShmemAllocator_mappoint alloc_inst_mappoint(ORB_SLAM3::segment.get_segment_manager());
-    mvpReferenceMapPoints = ORB_SLAM3::segment.construct<MyVector_mappoint>(boost::interprocess::anonymous_instance)(alloc_inst_mappoint);
+    mvpReferenceMapPoints = ORB_SLAM3::map_segment.Construct<MyVector_mappoint>(alloc_inst_mappoint);
 
     mnId=nNextId++;
     mThumbnail = static_cast<GLubyte*>(NULL);
@@ -78,12 +78,12 @@ Map::Map(int initKFid):mnInitKFid(initKFid), mnMaxKFid(initKFid),mnLastLoopKFid(
     //b = 25;
 
     const ShmemAllocator alloc_inst(ORB_SLAM3::segment.get_segment_manager());
-    mvpKeyFrameOrigins = ORB_SLAM3::segment.construct<MyVector>(boost::interprocess::anonymous_instance)(alloc_inst);
+    mvpKeyFrameOrigins = ORB_SLAM3::map_segment.Construct<MyVector>(alloc_inst);
     keyframeorigins_offsetptr = mvpKeyFrameOrigins;
 
 
     const ShmemAllocator_longint alloc_inst2(ORB_SLAM3::segment.get_segment_manager());
-    mvBackupKeyFrameOriginsId = ORB_SLAM3::segment.construct<MyVector_longint>(boost::interprocess::anonymous_instance)(alloc_inst2);
+    mvBackupKeyFrameOriginsId = ORB_SLAM3::map_segment.Construct<MyVector_longint>(alloc_inst2);
 
     //also initialize the mutex.
     mMutexMapPtr = &mMutexMap;
@@ -93,14 +93,14 @@ Map::Map(int initKFid):mnInitKFid(initKFid), mnMaxKFid(initKFid),mnLastLoopKFid(
 
     //for the sets
     const ShmemAllocator_keyframe_set alloc_set_key(ORB_SLAM3::segment.get_segment_manager());
-    mspKeyFrames = ORB_SLAM3::segment.construct<Myset_keyframe>(boost::interprocess::anonymous_instance)(alloc_set_key);
+    mspKeyFrames = ORB_SLAM3::map_segment.Construct<Myset_keyframe>(alloc_set_key);
 
     //for mappoint reference
      const ShmemAllocator_mappoint alloc_inst_mappoint(ORB_SLAM3::segment.get_segment_manager());
-    mvpReferenceMapPoints = ORB_SLAM3::segment.construct<MyVector_mappoint>(boost::interprocess::anonymous_instance)(alloc_inst_mappoint);
+    mvpReferenceMapPoints = ORB_SLAM3::map_segment.Construct<MyVector_mappoint>(alloc_inst_mappoint);
 
     const ShmemAllocator_mappoint_set alloc_set_mappoint(ORB_SLAM3::segment.get_segment_manager());
-    mspMapPoints = ORB_SLAM3::segment.construct<Myset_mappoint>(boost::interprocess::anonymous_instance)(alloc_set_mappoint);
+    mspMapPoints = ORB_SLAM3::map_segment.Construct<Myset_mappoint>(alloc_set_mappoint);
 
 
 }
@@ -327,7 +327,6 @@ void MapDrawer::DrawKeyFrames(const bool bDrawKF, const bool bDrawGraph, const b
             for(size_t i=0; i<vpKFs.size(); i++)
             {
                 boost::interprocess::offset_ptr<KeyFrame> pKF = vpKFs[i];
-                pKF->FixMatrices(pKF);
                 //std::cout<<"--- checking the keyframe: "<<i<<std::endl;
                 //std::cout<<"Printing the matrix itself "<<pKF->GetPoseInverse()<<std::endl;
                 cv::Mat Twc = pKF->GetPoseInverse().t();
@@ -18,9 +18,11 @@
 
 #include "MapPoint.h"
 #include "ORBmatcher.h"
+#include "HammingDistance.h"
 #include "System.h"
 
 #include<mutex>
+#include<cstring>
 
 namespace ORB_SLAM3
 {
@@ -44,37 +46,11 @@ MapPoint::MapPoint(const cv::Mat &Pos, boost::interprocess::offset_ptr<KeyFrame>
     mpReplaced(static_cast<boost::interprocess::offset_ptr<MapPoint> >(NULL)), mfMinDistance(0), mfMaxDistance(0), mpMap(pMap),
     mnOriginMapId(pMap->GetId())
 {
-    //initialize data for cv matrix mNormalVector
-    mWorldPos_ptr = ORB_SLAM3::allocator_instance.allocate(3*1*4);
-    mWorldPos = cv::Mat(3,1,CV_32F,mWorldPos_ptr.get());
-    //std::cout<<"Shared memory data for worldpos "<<mWorldPos_ptr<<std::endl;
-
-    Pos.copyTo(mWorldPos);
+    //mWorldPos, mNormalVector and the GBA/merge variables are stored inline, mNormalVector starts at zero
+    mWorldPos = Pos;
     mWorldPosx = cv::Matx31f(Pos.at<float>(0), Pos.at<float>(1), Pos.at<float>(2));
-    
-    //initialize data for cv matrix mNormalVector
-    mNormalVector_ptr = ORB_SLAM3::allocator_instance.allocate(3*1*4);
-    memset(mNormalVector_ptr.get(), 0, 3*4);//zeroing the mNormalVector
-    mNormalVector = cv::Mat(3,1,CV_32F,mNormalVector_ptr.get());
-
-    mNormalVectorMerge_ptr = ORB_SLAM3::allocator_instance.allocate(1*3*4);
-    mNormalVectorMerge = cv::Mat(1,3,CV_32F,mNormalVectorMerge_ptr.get());
-
-
-
-    //initialize data for cv matrix mDescriptor
-    mDescriptor_ptr = ORB_SLAM3::allocator_instance.allocate(32*1*4);
-    mDescriptor = cv::Mat(32,1,CV_32F,mDescriptor_ptr.get());
 
-    mPosMerge_ptr = ORB_SLAM3::allocator_instance.allocate(3*1*4);
-    mPosMerge = cv::Mat(1,3,CV_32F,mPosMerge_ptr.get());
-
-    //mposgba
-    mPosGBA_ptr = ORB_SLAM3::allocator_instance.allocate(3*1*4);
-    mPosGBA = cv::Mat(3,1,CV_32F,mPosGBA_ptr.get());
-
-    //mNormalVector_ptr = mNormalVector_data;
-    //mNormalVector = cv::Mat::zeros(3,1,CV_32F);
+    mNormalVector = cv::Mat::zeros(3,1,CV_32F);
     mNormalVectorx = cv::Matx31f::zeros();
 
     mbTrackInViewR = false;
@@ -86,7 +62,7 @@ MapPoint::MapPoint(const cv::Mat &Pos, boost::interprocess::offset_ptr<KeyFrame>
 
     //the observations
     const ShmemAllocator_observation alloc_map_observe(ORB_SLAM3::segment.get_segment_manager());
-    mObservations = ORB_SLAM3::segment.construct<Observe_map>(boost::interprocess::anonymous_instance)(alloc_map_observe);
+    mObservations = ORB_SLAM3::map_segment.Construct<Observe_map>(alloc_map_observe);
 }
 
 MapPoint::MapPoint(const double invDepth, cv::Point2f uv_init, boost::interprocess::offset_ptr<KeyFrame>  pRefKF, boost::interprocess::offset_ptr<KeyFrame>  pHostKF, boost::interprocess::offset_ptr<Map>  pMap):
@@ -101,30 +77,7 @@ MapPoint::MapPoint(const double invDepth, cv::Point2f uv_init, boost::interproce
     mInitV=(double)uv_init.y;
     mpHostKF = pHostKF;
 
-    std::cout<<"2nd *** Shared memory data for worldpos "<<mWorldPos_ptr<<std::endl;
-
-    //initialize data for cv matrix mNormalVector
-    mNormalVector_ptr = ORB_SLAM3::allocator_instance.allocate(3*1*4);
-    memset(mNormalVector_ptr.get(), 0, 3*4);//zeroing the mNormalVector
-    mNormalVector = cv::Mat(3,1,CV_32F,mNormalVector_ptr.get());
-
-    mNormalVectorMerge_ptr = ORB_SLAM3::allocator_instance.allocate(1*3*4);
-    mNormalVectorMerge = cv::Mat(1,3,CV_32F,mNormalVectorMerge_ptr.get());
-
-
-    //initialize data for cv matrix mDescriptor
-    mDescriptor_ptr = ORB_SLAM3::allocator_instance.allocate(32*1*4);
-    mDescriptor = cv::Mat(32,1,CV_32F,mDescriptor_ptr.get());
-
-     //mposgba
-    mPosGBA_ptr = ORB_SLAM3::allocator_instance.allocate(3*1*4);
-    mPosGBA = cv::Mat(3,1,CV_32F,mPosGBA_ptr.get());
-
-    mPosMerge_ptr = ORB_SLAM3::allocator_instance.allocate(3*1*4);
-    mPosMerge = cv::Mat(1,3,CV_32F,mPosMerge_ptr.get());
-
-    //mNormalVector_ptr = mNormalVector_data;
-    //mNormalVector = cv::Mat::zeros(3,1,CV_32F);
+    mNormalVector = cv::Mat::zeros(3,1,CV_32F);
     mNormalVectorx = cv::Matx31f::zeros();
 
     // Worldpos is not set
@@ -134,7 +87,7 @@ MapPoint::MapPoint(const double invDepth, cv::Point2f uv_init, boost::interproce
 
     //the observations
     const ShmemAllocator_observation alloc_map_observe(ORB_SLAM3::segment.get_segment_manager());
-    mObservations = ORB_SLAM3::segment.construct<Observe_map>(boost::interprocess::anonymous_instance)(alloc_map_observe);
+    mObservations = ORB_SLAM3::map_segment.Construct<Observe_map>(alloc_map_observe);
 }
 
 MapPoint::MapPoint(const cv::Mat &Pos, boost::interprocess::offset_ptr<Map>  pMap, Frame* pFrame, const int &idxF):
@@ -144,37 +97,7 @@ MapPoint::MapPoint(const cv::Mat &Pos, boost::interprocess::offset_ptr<Map>  pMa
     mnFound(1), mbBad(false), mpReplaced(NULL), mpMap(pMap), mnOriginMapId(pMap->GetId())
 {
 
-    //initialize data for cv matrix mNormalVector
-    mNormalVector_ptr = ORB_SLAM3::allocator_instance.allocate(3*1*4);
-    memset(mNormalVector_ptr.get(), 0, 3*4);//zeroing the mNormalVector
-    mNormalVector = cv::Mat(3,1,CV_32F,mNormalVector_ptr.get());
-
-    //initialize all the cv matrix here:
-    // get size from above.
-    //void *mworldPos_data = ORB_SLAM3::allocator_instance.allocate(3*1*4);
-    // create mworldpos data
-
-    //initialize data for cv matrix mDescriptor
-    mDescriptor_ptr = ORB_SLAM3::allocator_instance.allocate(32*1*4);
-    mDescriptor = cv::Mat(32,1,CV_32F,mDescriptor_ptr.get());
-    
-    //initialize data for cv matrix mNormalVector
-    mWorldPos_ptr = ORB_SLAM3::allocator_instance.allocate(3*1*4);
-    mWorldPos = cv::Mat(3,1,CV_32F,mWorldPos_ptr.get());
-
-    //mposgba
-    mPosGBA_ptr = ORB_SLAM3::allocator_instance.allocate(3*1*4);
-    mPosGBA = cv::Mat(3,1,CV_32F,mPosGBA_ptr.get());
-
-    mPosMerge_ptr = ORB_SLAM3::allocator_instance.allocate(3*1*4);
-    mPosMerge = cv::Mat(1,3,CV_32F,mPosMerge_ptr.get());
-
-     mNormalVectorMerge_ptr = ORB_SLAM3::allocator_instance.allocate(1*3*4);
-    mNormalVectorMerge = cv::Mat(1,3,CV_32F,mNormalVectorMerge_ptr.get());
-
-    //std::cout<<"Shared memory data for worldpos "<<mWorldPos_ptr<<std::endl;
-
-    Pos.copyTo(mWorldPos);
+    mWorldPos = Pos;
     mWorldPosx = cv::Matx31f(Pos.at<float>(0), Pos.at<float>(1), Pos.at<float>(2));
 
     cv::Mat Ow;
@@ -192,7 +115,7 @@ MapPoint::MapPoint(const cv::Mat &Pos, boost::interprocess::offset_ptr<Map>  pMa
     normaltemp = normaltemp/cv::norm(normaltemp);
     //mNormalVector = mWorldPos - Ow;
     //mNormalVector = mNormalVector/cv::norm(mNormalVector);
-    normaltemp.copyTo(mNormalVector);
+    mNormalVector = normaltemp;
     mNormalVectorx = cv::Matx31f(mNormalVector.at<float>(0), mNormalVector.at<float>(1), mNormalVector.at<float>(2));
 
 
@@ -207,7 +130,7 @@ MapPoint::MapPoint(const cv::Mat &Pos, boost::interprocess::offset_ptr<Map>  pMa
     mfMaxDistance = dist*levelScaleFactor;
     mfMinDistance = mfMaxDistance/pFrame->mvScaleFactors[nLevels-1];
 
-    pFrame->mDescriptors.row(idxF).copyTo(mDescriptor);
+    mDescriptor = pFrame->mDescriptors.row(idxF);
 
     // MapPoints can be created from Tracking and Local Mapping. This mutex avoid conflicts with id.
     std::unique_lock<mutex> lock(mpMap->mMutexPointCreation);
@@ -215,55 +138,27 @@ MapPoint::MapPoint(const cv::Mat &Pos, boost::interprocess::offset_ptr<Map>  pMa
 
     //the observations
     const ShmemAllocator_observation alloc_map_observe(ORB_SLAM3::segment.get_segment_manager());
-    mObservations = ORB_SLAM3::segment.construct<Observe_map>(boost::interprocess::anonymous_instance)(alloc_map_observe);
+    mObservations = ORB_SLAM3::map_segment.Construct<Observe_map>(alloc_map_observe);
 }
 
 void MapPoint::SetWorldPos(const cv::Mat &Pos)
 {
     std::scoped_lock lock2(mGlobalMutex, mMutexPos);
     //std::unique_lock<mutex> lock(mMutexPos);
-    Pos.copyTo(mWorldPos);
+    mWorldPos = Pos;
     mWorldPosx = cv::Matx31f(Pos.at<float>(0), Pos.at<float>(1), Pos.at<float>(2));
 }
 
-void MapPoint::FixMatrices(){
-    cv::Mat *fake = new cv::Mat(3,1,CV_32F,mWorldPos_ptr.get());
-    memcpy(&mWorldPos, fake, sizeof(cv::Mat));
-
-    cv::Mat *fake1 = new cv::Mat(32,1,CV_32F,mDescriptor_ptr.get());
-    memcpy(&mDescriptor, fake1, sizeof(cv::Mat));
-
-    cv::Mat *fake2 = new cv::Mat(3,1,CV_32F,mNormalVector_ptr.get());
-    memcpy(&mNormalVector,fake2, sizeof(cv::Mat));
-
-    cv::Mat *fake3 = new cv::Mat(3,1,CV_32F,mPosGBA_ptr.get());
-    memcpy(&mPosGBA, fake3, sizeof(cv::Mat));
-
-    cv::Mat *fake4 = new cv::Mat(1,3,CV_32F,mPosMerge_ptr.get());
-    memcpy(&mPosMerge, fake4, sizeof(cv::Mat));
-
-    cv::Mat *fake5 = new cv::Mat(1,3,CV_32F,mNormalVectorMerge_ptr.get());
-    memcpy(&mNormalVectorMerge, fake5, sizeof(cv::Mat));
-
-
-
-    //now correct mWorldpos with original data
-}
-
 cv::Mat MapPoint::GetWorldPos()
 {
     std::unique_lock<mutex> lock(mMutexPos);
-    cv::Mat returnable = cv::Mat(3,1,CV_32F,mWorldPos_ptr.get());
-    return returnable.clone();
-    //return mWorldPos.clone();
+    return mWorldPos.clone();
 }
 
 cv::Mat MapPoint::GetNormal()
 {
     std::unique_lock<mutex> lock(mMutexPos);
-    cv::Mat temp = cv::Mat(3,1,CV_32F,mNormalVector_ptr.get());
-    return temp.clone();
-    //return mNormalVector.clone();
+    return mNormalVector.clone();
 }
 
 cv::Matx31f MapPoint::GetWorldPos2()
@@ -501,7 +396,7 @@ float MapPoint::GetFoundRatio()
 void MapPoint::ComputeDistinctiveDescriptors()
 {
     // Retrieve all observed descriptors
-    vector<cv::Mat> vDescriptors;
+    vector<ORBDescriptor> vDescriptors;
 
     map<boost::interprocess::offset_ptr<KeyFrame> ,tuple<int,int>> observations;
 
@@ -525,12 +420,13 @@ void MapPoint::ComputeDistinctiveDescriptors()
         if(!pKF->isBad()){
             tuple<int,int> indexes = mit -> second;
             int leftIndex = get<0>(indexes), rightIndex = get<1>(indexes);
+            const DescriptorSpan vDescKF = pKF->GetDescriptors();
 
             if(leftIndex != -1){
-                vDescriptors.push_back(pKF->mDescriptors.row(leftIndex));
+                vDescriptors.push_back(vDescKF[leftIndex]);
             }
             if(rightIndex != -1){
-                vDescriptors.push_back(pKF->mDescriptors.row(rightIndex));
+                vDescriptors.push_back(vDescKF[rightIndex]);
             }
         }
     }
@@ -541,24 +437,15 @@ void MapPoint::ComputeDistinctiveDescriptors()
     // Compute distances between them
     const size_t N = vDescriptors.size();
 
-    float Distances[N][N];
-    for(size_t i=0;i<N;i++)
-    {
-        Distances[i][i]=0;
-        for(size_t j=i+1;j<N;j++)
-        {
-            int distij = ORBmatcher::DescriptorDistance(vDescriptors[i],vDescriptors[j]);
-            Distances[i][j]=distij;
-            Distances[j][i]=distij;
-        }
-    }
+    vector<int> Distances(N*N);
+    HammingDistance::ManyToMany(vDescriptors.data(),N,vDescriptors.data(),N,Distances.data());
 
     // Take the descriptor with least median distance to the rest
     int BestMedian = INT_MAX;
     int BestIdx = 0;
     for(size_t i=0;i<N;i++)
     {
-        vector<int> vDists(Distances[i],Distances[i]+N);
+        vector<int> vDists(Distances.begin()+i*N,Distances.begin()+(i+1)*N);
         sort(vDists.begin(),vDists.end());
         int median = vDists[0.5*(N-1)];
 
@@ -573,7 +460,7 @@ void MapPoint::ComputeDistinctiveDescriptors()
         std::unique_lock<mutex> lock(mMutexFeatures);
         //mDescriptor = vDescriptors[BestIdx].clone();
         //std::cout<<"vDescriptors[BestIdx] size: "<<vDescriptors[BestIdx].size()<<" and size of mDescriptor "<<mDescriptor.size()<<std::endl;
-        vDescriptors[BestIdx].copyTo(mDescriptor);
+        mDescriptor = cv::Mat(1,ORBDescriptor::bytes,CV_8U,vDescriptors[BestIdx].bits);
     }
 }
 
@@ -583,6 +470,14 @@ cv::Mat MapPoint::GetDescriptor()
     return mDescriptor.clone();
 }
 
+ORBDescriptor MapPoint::GetDescriptor256()
+{
+    ORBDescriptor d;
+    std::unique_lock<mutex> lock(mMutexFeatures);
+    memcpy(d.bits, mDescriptor.data(), ORBDescriptor::bytes);
+    return d;
+}
+
 tuple<int,int> MapPoint::GetIndexInKeyFrame(boost::interprocess::offset_ptr<KeyFrame> pKF)
 {
     std::unique_lock<mutex> lock(mMutexFeatures);
@@ -669,14 +564,13 @@ void MapPoint::UpdateNormalAndDepth()
         mfMaxDistance = dist*levelScaleFactor;
         mfMinDistance = mfMaxDistance/pRefKF->mvScaleFactors->at(nLevels-1);//mfMinDistance = mfMaxDistance/pRefKF->mvScaleFactors[nLevels-1];
         //mNormalVector = normal/n;
-        cv::Mat temp = normal/n;
-        temp.copyTo(mNormalVector);
+        mNormalVector = normal/n;
         mNormalVectorx = cv::Matx31f(mNormalVector.at<float>(0), mNormalVector.at<float>(1), mNormalVector.at<float>(2));
     }
     //std::cout<<"UpdateNormalAndDepth6\n";
 }
 
-void MapPoint::SetNormalVector(cv::Mat& normal)
+void MapPoint::SetNormalVector(const cv::Mat& normal)
 {
     std::unique_lock<mutex> lock3(mMutexPos);
     mNormalVector = normal;
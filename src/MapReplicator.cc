@@ -0,0 +1,477 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2020 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MapReplication.h"
+
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include <boost/asio/connect.hpp>
+#include <boost/asio/write.hpp>
+
+namespace ORB_SLAM3
+{
+
+namespace
+{
+
+inline uint64_t RotateLeft(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64-r));
+}
+
+// Hash of a page, four lanes to keep the multiplications independent. Never 0, which marks the pages not sent yet.
+uint64_t HashPage(const char* p, std::size_t bytes)
+{
+    const uint64_t prime = 0x9e3779b97f4a7c15ULL;
+    uint64_t h[4] = {1, 2, 3, 4};
+
+    std::size_t i = 0;
+    for(; i+32 <= bytes; i += 32)
+    {
+        uint64_t w[4];
+        memcpy(w, p+i, 32);
+        for(int k=0; k<4; k++)
+            h[k] = RotateLeft((h[k] ^ w[k]) * prime, 29);
+    }
+    for(; i < bytes; i += 8)
+    {
+        uint64_t w = 0;
+        memcpy(&w, p+i, std::min<std::size_t>(8, bytes-i));
+        h[0] = RotateLeft((h[0] ^ w) * prime, 29);
+    }
+
+    uint64_t hash = bytes;
+    for(int k=0; k<4; k++)
+        hash = RotateLeft((hash ^ h[k]) * prime, 31);
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash != 0 ? hash : 1;
+}
+
+// Slot of a page that is not in the batch
+const uint32_t NO_SLOT = 0xFFFFFFFF;
+
+// Soft-dirty bits of the kernel: writing 4 to clear_refs clears them for the whole process, and bit 55 of the
+// pagemap entry of a page is set again once the page is written.
+const uint64_t PAGEMAP_SOFT_DIRTY = 1ULL << 55;
+
+bool ClearSoftDirty()
+{
+    const int fd = open("/proc/self/clear_refs", O_WRONLY);
+    if(fd < 0)
+        return false;
+    const bool bCleared = write(fd, "4", 1) == 1;
+    close(fd);
+    return bCleared;
+}
+
+// Pagemap entries of nPages system pages from address p
+bool ReadPagemap(int fd, const void* p, std::size_t nPages, uint64_t* pEntries)
+{
+    const std::size_t systemPageSize = sysconf(_SC_PAGESIZE);
+    const off_t offset = reinterpret_cast<std::uintptr_t>(p)/systemPageSize*sizeof(uint64_t);
+    const std::size_t bytes = nPages*sizeof(uint64_t);
+    std::size_t done = 0;
+    while(done < bytes)
+    {
+        const ssize_t n = pread(fd, reinterpret_cast<char*>(pEntries)+done, bytes-done, offset+done);
+        if(n <= 0)
+            return false;
+        done += n;
+    }
+    return true;
+}
+
+// Kernels built without CONFIG_MEM_SOFT_DIRTY accept the clear but never set the bit
+bool SoftDirtyWorks(int fd)
+{
+    const std::size_t systemPageSize = sysconf(_SC_PAGESIZE);
+    void* p = mmap(nullptr, systemPageSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(p == MAP_FAILED)
+        return false;
+
+    uint64_t clean = 0, dirty = 0;
+    *static_cast<volatile char*>(p) = 1;
+    bool bWorks = ClearSoftDirty() && ReadPagemap(fd, p, 1, &clean);
+    *static_cast<volatile char*>(p) = 2;
+    bWorks = bWorks && ReadPagemap(fd, p, 1, &dirty) && !(clean & PAGEMAP_SOFT_DIRTY) && (dirty & PAGEMAP_SOFT_DIRTY);
+
+    munmap(p, systemPageSize);
+    return bWorks;
+}
+
+}
+
+namespace Replication
+{
+
+static std::string LockName(const std::string &segmentName)
+{
+    return segmentName + "_replica_lock";
+}
+
+ReplicaLock::ReplicaLock(const std::string &segmentName):
+    mMutex(boost::interprocess::open_or_create, LockName(segmentName).c_str())
+{
+    mMutex.lock();
+}
+
+ReplicaLock::~ReplicaLock()
+{
+    mMutex.unlock();
+}
+
+void ReplicaLock::Remove(const std::string &segmentName)
+{
+    boost::interprocess::named_mutex::remove(LockName(segmentName).c_str());
+}
+
+} //namespace Replication
+
+MapReplicator::MapReplicator(MapSegment* pSegment, const std::string &strServer, int periodMs):
+    mpSegment(pSegment), mnPeriodMs(std::max(periodMs, 1)), mnSequence(0), mbSendAll(true), mnBatches(0),
+    mnBatchesSkipped(0), mnPagesSent(0), mbUnreachableReported(false), mbFinishRequested(false), mbFinished(true)
+{
+    mnPagemapFd = open("/proc/self/pagemap", O_RDONLY);
+    mbSoftDirty = mnPagemapFd >= 0 && SoftDirtyWorks(mnPagemapFd);
+    if(!mbSoftDirty)
+        std::cout << "Map replication: the kernel does not track soft-dirty pages, the writers wait while every batch "
+                     "hashes the resident pages" << std::endl;
+
+    const std::size_t pos = strServer.find_last_of(':');
+    if(pos == std::string::npos)
+    {
+        mStrHost = strServer;
+        mStrPort = "6767";
+    }
+    else
+    {
+        mStrHost = strServer.substr(0, pos);
+        mStrPort = strServer.substr(pos+1);
+    }
+}
+
+MapReplicator::~MapReplicator()
+{
+    Disconnect();
+    if(mnPagemapFd >= 0)
+        close(mnPagemapFd);
+}
+
+void MapReplicator::Run()
+{
+    mbFinished = false;
+
+    while(1)
+    {
+        Replicate();
+
+        // The batch sent after the request holds the final state of the maps
+        if(CheckFinish())
+            break;
+
+        usleep(mnPeriodMs*1000);
+    }
+
+    Disconnect();
+    std::cout << "Map replication: " << mnBatches << " batches, " << mnPagesSent << " pages sent, " << mnBatchesSkipped
+              << " batches skipped while the map was busy" << std::endl;
+
+    SetFinish();
+}
+
+bool MapReplicator::Replicate()
+{
+    using namespace Replication;
+
+    if(!mpSocket && !Connect())
+        return false;
+
+    const char* pBase = static_cast<const char*>(mpSegment->GetManaged().get_address());
+    mvBatch.clear();
+    mvSlots.clear();
+
+    // The first batch of a connection holds every resident page. They are copied while the writers run, after
+    // the soft-dirty bits are cleared, and the pages written meanwhile are copied again while they wait.
+    if(mbSendAll && mbSoftDirty)
+    {
+        mbSoftDirty = ClearSoftDirty();
+        const std::size_t size = mpSegment->GetSize();
+        if(mbSoftDirty)
+        {
+            ReadResidency(pBase, size);
+            const std::size_t systemPageSize = sysconf(_SC_PAGESIZE);
+            mvSlots.resize((size + PAGE_SIZE-1)/PAGE_SIZE, NO_SLOT);
+            for(std::size_t i=0; i<mvSlots.size(); i++)
+                if(mvResident[static_cast<uint64_t>(i)*PAGE_SIZE/systemPageSize] & 1)
+                    CopyPage(pBase, size, i);
+        }
+    }
+
+    // The pages are read between two units of work of the writers, so the batch holds a consistent map
+    if(!mpSegment->PauseWriters(PAUSE_TIMEOUT_MS))
+    {
+        mnBatchesSkipped++;
+        return false;
+    }
+
+    const std::size_t size = mpSegment->GetSize();
+    const std::size_t nPages = (size + PAGE_SIZE-1)/PAGE_SIZE;
+    mvSlots.resize(nPages, NO_SLOT);
+    if(mvPageHashes.size() < nPages)
+        mvPageHashes.resize(nPages, 0);
+
+    // Pages that were never written are not resident. Reading them would allocate them, and the replica
+    // reads them as zeros anyway.
+    ReadResidency(pBase, size);
+    if(mbSoftDirty && !CopyDirtyPages(pBase, size))
+    {
+        std::cerr << "Map replication: could not read the soft-dirty pages, hashing the resident pages instead" << std::endl;
+        mbSoftDirty = false;
+    }
+    if(mbSoftDirty)
+        mbSoftDirty = ClearSoftDirty();
+    else
+        CopyChangedPages(pBase, size);
+
+    mpSegment->ResumeWriters();
+    mbSendAll = false;
+
+    // Written pages that hold what was last sent are not sent again. A failed send disconnects, which clears the
+    // hashes: the next connection sends every page again.
+    uint64_t runOffset = 0;
+    const char* pRun = nullptr;
+    uint32_t runBytes = 0;
+    for(std::size_t i=0; i<nPages; i++)
+    {
+        if(mvSlots[i] == NO_SLOT)
+            continue;
+
+        const uint64_t offset = static_cast<uint64_t>(i)*PAGE_SIZE;
+        const std::size_t bytes = std::min<std::size_t>(PAGE_SIZE, size-offset);
+        const char* pPage = mvBatch.data() + static_cast<std::size_t>(mvSlots[i])*PAGE_SIZE;
+        const uint64_t hash = HashPage(pPage, bytes);
+        if(hash == mvPageHashes[i])
+            continue;
+
+        // Consecutive pages are sent in one frame when their copies are consecutive too
+        if(runBytes > 0 && (runOffset+runBytes != offset || pRun+runBytes != pPage || runBytes+bytes > MAX_PAYLOAD))
+        {
+            if(!SendFrame(PAGES, runOffset, pRun, runBytes))
+                return false;
+            runBytes = 0;
+        }
+        if(runBytes == 0)
+        {
+            runOffset = offset;
+            pRun = pPage;
+        }
+        runBytes += bytes;
+
+        mvPageHashes[i] = hash;
+        mnPagesSent++;
+    }
+    if(runBytes > 0 && !SendFrame(PAGES, runOffset, pRun, runBytes))
+        return false;
+
+    // The first batch of a connection holds the whole segment, its copy is not kept
+    if(mvBatch.capacity() > 64*MAX_PAYLOAD)
+        std::vector<char>().swap(mvBatch);
+
+    if(!SendFrame(COMMIT, size, nullptr, 0))
+        return false;
+
+    mnBatches++;
+    return true;
+}
+
+void MapReplicator::ReadResidency(const char* pBase, std::size_t size)
+{
+    const std::size_t systemPageSize = sysconf(_SC_PAGESIZE);
+    mvResident.resize((size + systemPageSize-1)/systemPageSize);
+    if(mincore(const_cast<char*>(pBase), size, mvResident.data()) != 0)
+        std::fill(mvResident.begin(), mvResident.end(), 1);
+}
+
+void MapReplicator::CopyPage(const char* pBase, std::size_t size, std::size_t page)
+{
+    using namespace Replication;
+
+    uint32_t &slot = mvSlots[page];
+    if(slot == NO_SLOT)
+    {
+        slot = mvBatch.size()/PAGE_SIZE;
+        mvBatch.resize(mvBatch.size() + PAGE_SIZE);
+    }
+
+    const uint64_t offset = static_cast<uint64_t>(page)*PAGE_SIZE;
+    memcpy(mvBatch.data() + static_cast<std::size_t>(slot)*PAGE_SIZE, pBase+offset, std::min<std::size_t>(PAGE_SIZE, size-offset));
+}
+
+bool MapReplicator::CopyDirtyPages(const char* pBase, std::size_t size)
+{
+    using namespace Replication;
+
+    // A page written and then swapped out loses its bit. The segment is mapped again when it grows, and the
+    // kernel then reports every page of the new mapping, which the residency reduces to the resident ones.
+    const std::size_t systemPageSize = sysconf(_SC_PAGESIZE);
+    const std::size_t nSystemPages = (size + systemPageSize-1)/systemPageSize;
+    const std::size_t pagesPerRead = 64*1024;
+    mvPagemap.resize(std::min(pagesPerRead, nSystemPages));
+    for(std::size_t first=0; first<nSystemPages; first+=pagesPerRead)
+    {
+        const std::size_t n = std::min(pagesPerRead, nSystemPages-first);
+        if(!ReadPagemap(mnPagemapFd, pBase + first*systemPageSize, n, mvPagemap.data()))
+            return false;
+
+        for(std::size_t j=0; j<n; j++)
+        {
+            const std::size_t systemPage = first+j;
+            if(!(mvPagemap[j] & PAGEMAP_SOFT_DIRTY) || !(mvResident[systemPage] & 1))
+                continue;
+
+            const std::size_t end = std::min((systemPage+1)*systemPageSize, size);
+            for(std::size_t page=systemPage*systemPageSize/PAGE_SIZE; page*PAGE_SIZE < end; page++)
+                CopyPage(pBase, size, page);
+        }
+    }
+    return true;
+}
+
+void MapReplicator::CopyChangedPages(const char* pBase, std::size_t size)
+{
+    using namespace Replication;
+
+    const std::size_t systemPageSize = sysconf(_SC_PAGESIZE);
+    for(std::size_t i=0; i<mvSlots.size(); i++)
+    {
+        const uint64_t offset = static_cast<uint64_t>(i)*PAGE_SIZE;
+        if(!(mvResident[offset/systemPageSize] & 1))
+            continue;
+        if(HashPage(pBase+offset, std::min<std::size_t>(PAGE_SIZE, size-offset)) != mvPageHashes[i])
+            CopyPage(pBase, size, i);
+    }
+}
+
+bool MapReplicator::Connect()
+{
+    using boost::asio::ip::tcp;
+
+    try
+    {
+        tcp::resolver resolver(mIoContext);
+        tcp::resolver::results_type endpoints = resolver.resolve(mStrHost, mStrPort);
+        std::unique_ptr<tcp::socket> pSocket(new tcp::socket(mIoContext));
+        boost::asio::connect(*pSocket, endpoints);
+        pSocket->set_option(tcp::no_delay(true));
+        mpSocket.swap(pSocket);
+    }
+    catch(boost::system::system_error &e)
+    {
+        // Reported once until the server is reached again
+        if(!mbUnreachableReported)
+            std::cerr << "Map replication: could not connect to " << mStrHost << ":" << mStrPort << ": " << e.what() << std::endl;
+        mbUnreachableReported = true;
+        return false;
+    }
+
+    mbUnreachableReported = false;
+    std::cout << "Map replication: connected to " << mStrHost << ":" << mStrPort << std::endl;
+
+    // The server starts a new replica, every page is sent again
+    mnSequence = 0;
+    mbSendAll = true;
+    std::fill(mvPageHashes.begin(), mvPageHashes.end(), 0);
+
+    const MapSegment::Settings &settings = mpSegment->GetSettings();
+    Replication::SegmentInfo info;
+    info.baseAddress = reinterpret_cast<uint64_t>(settings.baseAddress);
+    info.maxSize = settings.maxSize;
+    info.pageSize = Replication::PAGE_SIZE;
+    info.reserved = 0;
+    return SendFrame(Replication::HELLO, 0, &info, sizeof(info));
+}
+
+void MapReplicator::Disconnect()
+{
+    if(mpSocket)
+    {
+        boost::system::error_code ec;
+        mpSocket->shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+        mpSocket->close(ec);
+        mpSocket.reset();
+    }
+    std::fill(mvPageHashes.begin(), mvPageHashes.end(), 0);
+}
+
+bool MapReplicator::SendFrame(uint16_t type, uint64_t offset, const void* pPayload, uint32_t payloadBytes)
+{
+    Replication::FrameHeader header;
+    header.magic = Replication::MAGIC;
+    header.version = Replication::VERSION;
+    header.type = type;
+    header.clientId = mpSegment->GetSettings().clientId;
+    header.payloadBytes = payloadBytes;
+    header.sequence = mnSequence++;
+    header.offset = offset;
+
+    std::array<boost::asio::const_buffer, 2> buffers = {{boost::asio::buffer(&header, sizeof(header)),
+                                                         boost::asio::buffer(pPayload, payloadBytes)}};
+    boost::system::error_code ec;
+    boost::asio::write(*mpSocket, buffers, ec);
+    if(ec)
+    {
+        std::cerr << "Map replication: connection to " << mStrHost << ":" << mStrPort << " lost: " << ec.message() << std::endl;
+        Disconnect();
+        return false;
+    }
+    return true;
+}
+
+void MapReplicator::RequestFinish()
+{
+    std::unique_lock<std::mutex> lock(mMutexFinish);
+    mbFinishRequested = true;
+}
+
+bool MapReplicator::CheckFinish()
+{
+    std::unique_lock<std::mutex> lock(mMutexFinish);
+    return mbFinishRequested;
+}
+
+void MapReplicator::SetFinish()
+{
+    std::unique_lock<std::mutex> lock(mMutexFinish);
+    mbFinished = true;
+}
+
+bool MapReplicator::isFinished()
+{
+    std::unique_lock<std::mutex> lock(mMutexFinish);
+    return mbFinished;
+}
+
+} //namespace ORB_SLAM3
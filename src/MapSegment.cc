@@ -0,0 +1,468 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2020 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MapSegment.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <chrono>
+
+#include <boost/interprocess/sync/interprocess_mutex.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+
+namespace ORB_SLAM3
+{
+
+static const std::size_t MB = 1024*1024;
+
+// Name of the object in the segment that records the address space reserved by its creator
+static const char* RESERVED_SIZE_NAME = "segment-reserved-size";
+// Name of the mutex in the segment that serializes its growth
+static const char* GROW_MUTEX_NAME = "segment-grow-mutex";
+
+// Slab of the calling thread. Only the map segment of the process is written, so one slab per thread is enough.
+struct Slab
+{
+    const MapSegment* pSegment;
+    unsigned long nMapping;
+    char* pBegin;
+    char* pEnd;
+};
+static thread_local Slab tlSlab = {nullptr, 0, nullptr, nullptr};
+
+// Write scopes the calling thread is in. As with the slabs, only the map segment of the process is written.
+static thread_local int tlWriteDepth = 0;
+
+static std::atomic<unsigned long> nMappings(0);
+
+MapSegment map_segment;
+managed_map_segment &segment = map_segment.GetManaged();
+
+MapSegment::Settings::Settings():
+    name("MySharedMemory"), size(512*MB), maxSize(10240*MB), growStep(256*MB), growThreshold(64*MB),
+    slabSize(256*1024), baseAddress((void*)0x30000000), clientId(-1), bMergeServer(false), nClients(0)
+{
+}
+
+MapSegment::Settings MapSegment::Settings::ForClient(int id) const
+{
+    // Slot 0 belongs to the merge server, client i uses slot i+1
+    Settings settings = *this;
+    settings.baseName = baseName.empty() ? name : baseName;
+    settings.name = settings.baseName + "_client" + std::to_string(id);
+    settings.baseAddress = static_cast<char*>(baseAddress) + static_cast<std::size_t>(id+1)*maxSize;
+    settings.clientId = id;
+    settings.bMergeServer = false;
+    return settings;
+}
+
+MapSegment::Settings MapSegment::Settings::ForServer() const
+{
+    Settings settings = *this;
+    settings.baseName = baseName.empty() ? name : baseName;
+    settings.name = settings.baseName + "_server";
+    settings.clientId = -1;
+    settings.bMergeServer = true;
+    return settings;
+}
+
+MapSegment::MapSegment(): mbReadOnly(false), mpMutexGrow(nullptr), mnMapping(0), mnSlabs(0), mnSlabObjects(0),
+    mnFrameWriters(0), mnBackgroundWriters(0), mbWritersPaused(false)
+{
+}
+
+MapSegment::~MapSegment()
+{
+    Close();
+}
+
+MapSegment::Settings MapSegment::ReadSettings(cv::FileStorage &fSettings)
+{
+    Settings settings;
+
+    cv::FileNode node = fSettings["SharedMemory.name"];
+    if(!node.empty() && node.isString())
+        settings.name = node.string();
+
+    // Sizes are given in MB, cv::FileStorage only reads 32 bit integers
+    node = fSettings["SharedMemory.sizeMB"];
+    if(!node.empty() && node.isInt())
+        settings.size = static_cast<std::size_t>(node.operator int())*MB;
+
+    node = fSettings["SharedMemory.maxSizeMB"];
+    if(!node.empty() && node.isInt())
+        settings.maxSize = static_cast<std::size_t>(node.operator int())*MB;
+
+    node = fSettings["SharedMemory.growStepMB"];
+    if(!node.empty() && node.isInt())
+        settings.growStep = static_cast<std::size_t>(node.operator int())*MB;
+
+    node = fSettings["SharedMemory.growThresholdMB"];
+    if(!node.empty() && node.isInt())
+        settings.growThreshold = static_cast<std::size_t>(node.operator int())*MB;
+
+    node = fSettings["SharedMemory.slabKB"];
+    if(!node.empty() && node.isInt())
+        settings.slabSize = static_cast<std::size_t>(std::max(node.operator int(), 0))*1024;
+
+    // Hexadecimal string, i.e. "0x30000000"
+    node = fSettings["SharedMemory.baseAddress"];
+    if(!node.empty() && node.isString())
+        settings.baseAddress = reinterpret_cast<void*>(std::stoull(node.string(), nullptr, 16));
+
+    node = fSettings["SharedMemory.clientId"];
+    if(!node.empty() && node.isInt())
+        settings.clientId = node.operator int();
+
+    node = fSettings["SharedMemory.mergeServer"];
+    if(!node.empty() && node.isInt())
+        settings.bMergeServer = node.operator int() != 0;
+
+    node = fSettings["SharedMemory.nClients"];
+    if(!node.empty() && node.isInt())
+        settings.nClients = node.operator int();
+
+    if(settings.maxSize < settings.size)
+    {
+        std::cerr << "*SharedMemory.maxSizeMB is smaller than SharedMemory.sizeMB, the segment will not grow*" << std::endl;
+        settings.maxSize = settings.size;
+    }
+
+    return settings;
+}
+
+bool MapSegment::Open(const Settings &settings)
+{
+    return MapRegion(settings, false);
+}
+
+bool MapSegment::OpenReadOnly(const Settings &settings)
+{
+    return MapRegion(settings, true);
+}
+
+bool MapSegment::MapRegion(const Settings &settings, bool bReadOnly)
+{
+    using namespace boost::interprocess;
+
+    Close();
+    mSettings = settings;
+    mbReadOnly = bReadOnly;
+    mnMapping = ++nMappings;
+
+    try
+    {
+        bool bCreated = false;
+        if(mbReadOnly)
+        {
+            shared_memory_object shm(open_only, mSettings.name.c_str(), read_only);
+            mShm.swap(shm);
+        }
+        else
+        {
+            try
+            {
+                shared_memory_object shm(create_only, mSettings.name.c_str(), read_write);
+                shm.truncate(mSettings.size);
+                mShm.swap(shm);
+                bCreated = true;
+            }
+            catch(interprocess_exception &ex)
+            {
+                if(ex.get_error_code() != already_exists_error)
+                    throw;
+                shared_memory_object shm(open_only, mSettings.name.c_str(), read_write);
+                mShm.swap(shm);
+            }
+        }
+
+        // Copy-on-write keeps the pages of the owner untouched, see OpenReadOnly
+        const boost::interprocess::mode_t mode = mbReadOnly ? copy_on_write : read_write;
+
+        offset_t currentSize = 0;
+        mShm.get_size(currentSize);
+
+        std::size_t reservedSize = std::max(mSettings.maxSize, static_cast<std::size_t>(currentSize));
+        mapped_region region(mShm, mode, 0, reservedSize, mSettings.baseAddress);
+        mRegion.swap(region);
+
+        if(bCreated)
+        {
+            mManaged = managed_map_segment(create_only, mRegion.get_address(), mSettings.size);
+            mManaged.construct<std::size_t>(RESERVED_SIZE_NAME)(reservedSize);
+        }
+        else
+        {
+            mManaged = managed_map_segment(open_only, mRegion.get_address(), currentSize);
+
+            // The creator may have reserved more address space than we did. Map the same span so
+            // that we keep seeing the segment after it grows.
+            std::size_t* pCreatorReserved = Find<std::size_t>(RESERVED_SIZE_NAME);
+            if(pCreatorReserved && *pCreatorReserved > reservedSize)
+            {
+                reservedSize = *pCreatorReserved;
+                mManaged = managed_map_segment();
+                mapped_region().swap(mRegion);
+                mapped_region bigger(mShm, mode, 0, reservedSize, mSettings.baseAddress);
+                mRegion.swap(bigger);
+                mManaged = managed_map_segment(open_only, mRegion.get_address(), currentSize);
+            }
+        }
+    }
+    catch(interprocess_exception &ex)
+    {
+        std::cerr << "Failed to map shared memory segment \"" << mSettings.name << "\" at " << mSettings.baseAddress
+                  << ": " << ex.what() << std::endl;
+        Close();
+        return false;
+    }
+
+    // The sanity check walks the free blocks under the allocation lock of the owner
+    if(!mbReadOnly && !mManaged.check_sanity())
+    {
+        std::cerr << "Shared memory check failed" << std::endl;
+        Close();
+        return false;
+    }
+
+    if(!mbReadOnly)
+        mpMutexGrow = mManaged.find_or_construct<boost::interprocess::interprocess_mutex>(GROW_MUTEX_NAME)();
+
+    std::cout << "Shared memory segment \"" << mSettings.name << "\" mapped " << (mbReadOnly ? "read-only " : "")
+              << "at " << mRegion.get_address() << std::endl;
+    PrintUsage();
+
+    return true;
+}
+
+void MapSegment::Close()
+{
+    mpMutexGrow = nullptr;
+    mManaged = managed_map_segment();
+    boost::interprocess::mapped_region().swap(mRegion);
+    boost::interprocess::shared_memory_object().swap(mShm);
+}
+
+bool MapSegment::IsOpen() const
+{
+    return mRegion.get_address() != 0;
+}
+
+bool MapSegment::IsReadOnly() const
+{
+    return mbReadOnly;
+}
+
+bool MapSegment::Grow(std::size_t extraBytes)
+{
+    if(mbReadOnly || !mpMutexGrow)
+    {
+        std::cerr << "Shared memory segment \"" << mSettings.name << "\" is read-only, it can only grow in its owner" << std::endl;
+        return false;
+    }
+
+    boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock(*mpMutexGrow);
+    return GrowLocked(extraBytes);
+}
+
+bool MapSegment::CheckGrowth()
+{
+    if(!IsOpen() || mbReadOnly || !mpMutexGrow || GetFreeBytes() >= mSettings.growThreshold)
+        return false;
+
+    boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock(*mpMutexGrow);
+    // Another thread, maybe of another process, may have grown the segment while we waited
+    if(GetFreeBytes() >= mSettings.growThreshold)
+        return false;
+
+    return GrowLocked(std::min(mSettings.growStep, GetReservedBytes()-GetSize()));
+}
+
+bool MapSegment::GrowLocked(std::size_t extraBytes)
+{
+
+    const std::size_t newSize = GetSize() + extraBytes;
+    if(extraBytes == 0 || newSize > GetReservedBytes())
+    {
+        std::cerr << "Shared memory segment \"" << mSettings.name << "\" can not grow past its reserved "
+                  << GetReservedBytes()/MB << " MB" << std::endl;
+        return false;
+    }
+
+    try
+    {
+        // New pages become visible to every process that maps the reserved span. The size is read under
+        // the grow mutex, so no other process can truncate the object in between.
+        mShm.truncate(newSize);
+    }
+    catch(boost::interprocess::interprocess_exception &ex)
+    {
+        std::cerr << "Failed to grow shared memory segment \"" << mSettings.name << "\": " << ex.what() << std::endl;
+        return false;
+    }
+
+    // Takes the allocation lock, see map_segment_algorithm
+    mManaged.grow(extraBytes);
+
+    std::cout << "Shared memory segment \"" << mSettings.name << "\" grown by " << extraBytes/MB << " MB" << std::endl;
+    PrintUsage();
+
+    return true;
+}
+
+boost::interprocess::offset_ptr<char> MapSegment::Allocate(std::size_t bytes, std::size_t alignment)
+{
+    void* ptr = AllocateFromSlab(bytes, alignment);
+    if(ptr)
+        return static_cast<char*>(ptr);
+
+    CheckGrowth();
+    if(alignment > 2*sizeof(void*))
+        return static_cast<char*>(mManaged.allocate_aligned(bytes, alignment));
+    return static_cast<char*>(mManaged.allocate(bytes));
+}
+
+void* MapSegment::AllocateFromSlab(std::size_t bytes, std::size_t alignment)
+{
+    // Large objects would waste most of a slab
+    if(mbReadOnly || bytes > mSettings.slabSize/16)
+        return nullptr;
+
+    Slab &slab = tlSlab;
+    if(slab.pSegment != this || slab.nMapping != mnMapping)
+    {
+        slab.pSegment = this;
+        slab.nMapping = mnMapping;
+        slab.pBegin = slab.pEnd = nullptr;
+    }
+
+    std::uintptr_t begin = (reinterpret_cast<std::uintptr_t>(slab.pBegin) + alignment-1) & ~(alignment-1);
+    if(!slab.pBegin || begin + bytes > reinterpret_cast<std::uintptr_t>(slab.pEnd))
+    {
+        // What is left of the old slab is never used, at most slabSize/16 bytes
+        CheckGrowth();
+        slab.pBegin = static_cast<char*>(mManaged.allocate(mSettings.slabSize));
+        slab.pEnd = slab.pBegin + mSettings.slabSize;
+        mnSlabs++;
+        begin = (reinterpret_cast<std::uintptr_t>(slab.pBegin) + alignment-1) & ~(alignment-1);
+    }
+
+    slab.pBegin = reinterpret_cast<char*>(begin + bytes);
+    mnSlabObjects++;
+    return reinterpret_cast<void*>(begin);
+}
+
+MapSegment::WriteScope::WriteScope(MapSegment &segment, WriteUnit unit): mSegment(segment), mUnit(unit)
+{
+    if(tlWriteDepth++ == 0)
+        mSegment.BeginWrite(mUnit);
+}
+
+MapSegment::WriteScope::~WriteScope()
+{
+    if(--tlWriteDepth == 0)
+        mSegment.EndWrite(mUnit);
+}
+
+void MapSegment::BeginWrite(WriteUnit unit)
+{
+    std::unique_lock<std::mutex> lock(mMutexWriters);
+    mCondWriters.wait(lock, [this]{ return !mbWritersPaused; });
+    if(unit == FRAME_UNIT)
+        mnFrameWriters++;
+    else
+        mnBackgroundWriters++;
+}
+
+void MapSegment::EndWrite(WriteUnit unit)
+{
+    std::unique_lock<std::mutex> lock(mMutexWriters);
+    if(unit == FRAME_UNIT)
+        mnFrameWriters--;
+    else
+        mnBackgroundWriters--;
+    mCondWriters.notify_all();
+}
+
+bool MapSegment::PauseWriters(int timeoutMs)
+{
+    std::unique_lock<std::mutex> lock(mMutexWriters);
+
+    // Holding the writers back while a background unit finishes would stop the tracking for as long as a local
+    // bundle adjustment runs, and Loop Closing waits for Local Mapping to stop. The pause starts between them.
+    if(!mCondWriters.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]{ return mnBackgroundWriters == 0; }))
+        return false;
+    mbWritersPaused = true;
+
+    if(!mCondWriters.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]{ return mnFrameWriters == 0; }))
+    {
+        mbWritersPaused = false;
+        mCondWriters.notify_all();
+        return false;
+    }
+    return true;
+}
+
+void MapSegment::ResumeWriters()
+{
+    std::unique_lock<std::mutex> lock(mMutexWriters);
+    mbWritersPaused = false;
+    mCondWriters.notify_all();
+}
+
+std::size_t MapSegment::GetSize() const
+{
+    return IsOpen() ? mManaged.get_size() : 0;
+}
+
+std::size_t MapSegment::GetFreeBytes() const
+{
+    return IsOpen() ? mManaged.get_free_memory() : 0;
+}
+
+std::size_t MapSegment::GetUsedBytes() const
+{
+    return GetSize() - GetFreeBytes();
+}
+
+std::size_t MapSegment::GetReservedBytes() const
+{
+    return mRegion.get_size();
+}
+
+void MapSegment::PrintUsage() const
+{
+    std::cout << "Shared memory \"" << mSettings.name << "\": used " << GetUsedBytes()/MB << " MB, free "
+              << GetFreeBytes()/MB << " MB, size " << GetSize()/MB << " MB, reserved " << GetReservedBytes()/MB << " MB" << std::endl;
+    if(mnSlabs > 0)
+        std::cout << "Shared memory \"" << mSettings.name << "\": " << mnSlabObjects << " small objects placed in "
+                  << mnSlabs << " slabs of " << mSettings.slabSize/1024 << " KB" << std::endl;
+}
+
+const MapSegment::Settings& MapSegment::GetSettings() const
+{
+    return mSettings;
+}
+
+managed_map_segment& MapSegment::GetManaged()
+{
+    return mManaged;
+}
+
+} //namespace ORB_SLAM3
@@ -0,0 +1,253 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2020 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "NetworkFrameSource.h"
+
+#include <iostream>
+#include <array>
+#include <algorithm>
+
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+
+#include <opencv2/imgcodecs.hpp>
+
+namespace ORB_SLAM3
+{
+
+NetworkFrameSource::NetworkFrameSource(unsigned short port, int nSlots, std::size_t maxFrameBytes):
+    mnHeldSlot(-1), mbClosed(false), mnDropped(0),
+    mAcceptor(mIoContext, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port)), mSocket(mIoContext)
+{
+    mvSlots.resize(std::max(nSlots, 3));
+    for(size_t i=0; i<mvSlots.size(); i++)
+    {
+        mvSlots[i].buffer.resize(maxFrameBytes);
+        mvFreeSlots.push_back(i);
+    }
+
+    std::cout << "Waiting for frames on port " << port << std::endl;
+
+    DoAccept();
+    mThread = std::thread([this]{ mIoContext.run(); });
+}
+
+NetworkFrameSource::~NetworkFrameSource()
+{
+    mIoContext.stop();
+    if(mThread.joinable())
+        mThread.join();
+}
+
+bool NetworkFrameSource::Next(cv::Mat &im, double &timestamp)
+{
+    int slot;
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if(mnHeldSlot >= 0)
+        {
+            mvFreeSlots.push_back(mnHeldSlot);
+            mnHeldSlot = -1;
+        }
+
+        mcvFrame.wait(lock, [this]{ return !mqQueuedSlots.empty() || mbClosed; });
+        if(mqQueuedSlots.empty())
+            return false;
+
+        slot = mqQueuedSlots.front();
+        mqQueuedSlots.pop_front();
+        mnHeldSlot = slot;
+    }
+
+    // The slot is held, the receiver does not write it until the next call
+    Slot &s = mvSlots[slot];
+    const FrameHeader &header = s.header;
+    timestamp = header.timestamp;
+
+    if(header.encoding == RAW)
+    {
+        im = cv::Mat(header.rows, header.cols, header.type, s.buffer.data());
+        return true;
+    }
+
+    cv::imdecode(cv::Mat(1, header.payloadBytes, CV_8U, s.buffer.data()), cv::IMREAD_UNCHANGED, &s.decoded);
+    im = s.decoded;
+    if(im.empty())
+        std::cerr << "Failed to decode the frame at " << header.timestamp << std::endl;
+    return true;
+}
+
+unsigned long NetworkFrameSource::GetDroppedFrames()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    return mnDropped;
+}
+
+bool NetworkFrameSource::Send(boost::asio::ip::tcp::socket &socket, const cv::Mat &im, double timestamp,
+                              const std::string &strEncoding)
+{
+    FrameHeader header;
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.rows = im.rows;
+    header.cols = im.cols;
+    header.type = im.type();
+    header.timestamp = timestamp;
+
+    std::vector<unsigned char> vEncoded;
+    cv::Mat continuous = im.isContinuous() ? im : im.clone();
+    const unsigned char* pPayload = continuous.data;
+    if(strEncoding.empty())
+    {
+        header.encoding = RAW;
+        header.payloadBytes = continuous.total()*continuous.elemSize();
+    }
+    else
+    {
+        if(!cv::imencode(strEncoding, im, vEncoded))
+            return false;
+        header.encoding = ENCODED;
+        header.payloadBytes = vEncoded.size();
+        pPayload = vEncoded.data();
+    }
+
+    std::array<boost::asio::const_buffer, 2> buffers = {{boost::asio::buffer(&header, sizeof(header)),
+                                                         boost::asio::buffer(pPayload, header.payloadBytes)}};
+    boost::system::error_code ec;
+    boost::asio::write(socket, buffers, ec);
+    return !ec;
+}
+
+void NetworkFrameSource::DoAccept()
+{
+    mAcceptor.async_accept(mSocket, [this](boost::system::error_code ec)
+    {
+        if(ec)
+        {
+            std::cerr << "Failed to accept a camera: " << ec.message() << std::endl;
+            Close();
+            return;
+        }
+
+        // One camera per source
+        mAcceptor.close(ec);
+        mSocket.set_option(boost::asio::ip::tcp::no_delay(true), ec);
+        DoReadHeader();
+    });
+}
+
+void NetworkFrameSource::DoReadHeader()
+{
+    boost::asio::async_read(mSocket, boost::asio::buffer(&mHeader, sizeof(mHeader)),
+        [this](boost::system::error_code ec, std::size_t)
+    {
+        if(ec)
+        {
+            if(ec != boost::asio::error::eof)
+                std::cerr << "Camera connection lost: " << ec.message() << std::endl;
+            Close();
+            return;
+        }
+
+        const FrameHeader &header = mHeader;
+        const std::size_t capacity = mvSlots[0].buffer.size();
+        bool bValid = header.magic == MAGIC && header.version == VERSION && header.payloadBytes <= capacity;
+        if(bValid && header.encoding == RAW)
+        {
+            // Only the plain types, of 1 to 4 channels, and dimensions that can not overflow the size
+            const int depth = CV_MAT_DEPTH(header.type);
+            const int channels = CV_MAT_CN(header.type);
+            const bool bType = header.type == CV_MAKETYPE(depth, channels) && channels <= 4 &&
+                    (depth == CV_8U || depth == CV_8S || depth == CV_16U || depth == CV_16S || depth == CV_32S ||
+                     depth == CV_32F || depth == CV_64F);
+            const bool bSize = header.rows > 0 && header.rows <= MAX_DIMENSION && header.cols > 0 &&
+                    header.cols <= MAX_DIMENSION;
+            bValid = bType && bSize &&
+                    static_cast<std::size_t>(header.rows)*header.cols*CV_ELEM_SIZE(header.type) == header.payloadBytes;
+        }
+        else if(bValid)
+            bValid = header.encoding == ENCODED;
+
+        if(!bValid)
+        {
+            std::cerr << "Invalid frame from the camera (" << header.payloadBytes << " bytes, at most "
+                      << capacity << ")" << std::endl;
+            Close();
+            return;
+        }
+
+        DoReadPayload(AcquireSlot());
+    });
+}
+
+void NetworkFrameSource::DoReadPayload(int slot)
+{
+    mvSlots[slot].header = mHeader;
+    boost::asio::async_read(mSocket, boost::asio::buffer(mvSlots[slot].buffer.data(), mHeader.payloadBytes),
+        [this, slot](boost::system::error_code ec, std::size_t)
+    {
+        if(ec)
+        {
+            std::cerr << "Camera connection lost: " << ec.message() << std::endl;
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                mvFreeSlots.push_back(slot);
+            }
+            Close();
+            return;
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mqQueuedSlots.push_back(slot);
+        }
+        mcvFrame.notify_one();
+
+        DoReadHeader();
+    });
+}
+
+int NetworkFrameSource::AcquireSlot()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    if(!mvFreeSlots.empty())
+    {
+        const int slot = mvFreeSlots.back();
+        mvFreeSlots.pop_back();
+        return slot;
+    }
+
+    // With at least 3 slots and at most one held, at least two frames are queued
+    const int slot = mqQueuedSlots.front();
+    mqQueuedSlots.pop_front();
+    mnDropped++;
+    return slot;
+}
+
+void NetworkFrameSource::Close()
+{
+    boost::system::error_code ec;
+    mSocket.close(ec);
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mbClosed = true;
+    }
+    mcvFrame.notify_all();
+}
+
+} //namespace ORB_SLAM3
@@ -0,0 +1,284 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2020 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ORBVocabulary.h"
+#include "HammingDistance.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace ORB_SLAM3
+{
+
+namespace
+{
+
+// Descriptors descended together. The children of their nodes are prefetched for all of them before any is
+// compared, so the misses on the large tree overlap.
+const int TRANSFORM_BATCH = 8;
+
+inline void PrefetchDescriptors(const ORBDescriptor* pDescriptors, uint32_t n)
+{
+    const char* p = reinterpret_cast<const char*>(pDescriptors);
+    const char* pEnd = reinterpret_cast<const char*>(pDescriptors + n);
+    for(; p < pEnd; p += 64)
+        __builtin_prefetch(p);
+}
+
+// FNV-1a over 64-bit words, the tail zero-padded
+inline uint64_t HashBytes(uint64_t hash, const void* data, size_t bytes)
+{
+    const uint64_t prime = 0x100000001b3ULL;
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for(; bytes >= 8; p += 8, bytes -= 8)
+    {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        hash = (hash ^ word) * prime;
+    }
+    if(bytes > 0)
+    {
+        uint64_t word = 0;
+        memcpy(&word, p, bytes);
+        hash = (hash ^ word) * prime;
+    }
+    return hash;
+}
+
+template<class T>
+inline uint64_t HashValue(uint64_t hash, const T &value)
+{
+    return HashBytes(hash, &value, sizeof(value));
+}
+
+}
+
+bool ORBVocabulary::loadFromTextFile(const std::string &filename)
+{
+    if(!Base::loadFromTextFile(filename))
+        return false;
+
+    BuildFlatTree();
+    ComputeFingerprint();
+    return true;
+}
+
+bool ORBVocabulary::loadFromBinaryFile(const std::string &filename)
+{
+    if(!Base::loadFromBinaryFile(filename))
+        return false;
+
+    BuildFlatTree();
+    ComputeFingerprint();
+    return true;
+}
+
+void ORBVocabulary::BuildFlatTree()
+{
+    mpFlat.reset();
+    mnMaxChildren = 0;
+
+    if(m_nodes.empty() || m_nodes[0].children.empty())
+        return;
+
+    // The mapped file is the layout itself, so it is shared with the other processes that map it
+    std::shared_ptr<const BinaryLayout> pFlat = m_binary ? m_binary : makeBinaryLayout();
+
+    // Only ORB descriptors can be compared with the Hamming kernels, otherwise the DBoW2 tree is used
+    if(!pFlat || pFlat->descriptorBytes != ORBDescriptor::bytes)
+        return;
+
+    int nMaxChildren = 0;
+    for(uint32_t i=0; i<pFlat->nEntries; i++)
+        nMaxChildren = std::max(nMaxChildren, (int)pFlat->nodes[i].nChildren);
+
+    mpFlat = pFlat;
+    mnMaxChildren = nMaxChildren;
+}
+
+void ORBVocabulary::ComputeFingerprint()
+{
+    mnFingerprint = 0;
+    if(m_nodes.empty())
+        return;
+
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    hash = HashValue(hash, (int32_t)m_k);
+    hash = HashValue(hash, (int32_t)m_L);
+    hash = HashValue(hash, (int32_t)m_weighting);
+    hash = HashValue(hash, (int32_t)m_scoring);
+    hash = HashValue(hash, (uint64_t)m_nodes.size());
+
+    for(const Node &node : m_nodes)
+    {
+        hash = HashValue(hash, node.parent);
+        hash = HashValue(hash, node.weight);
+        hash = HashValue(hash, node.isLeaf() ? node.word_id : DBoW2::WordId(-1));
+        if(!node.descriptor.empty())
+        {
+            cv::Mat descriptor = node.descriptor.isContinuous() ? node.descriptor : node.descriptor.clone();
+            hash = HashBytes(hash, descriptor.data, descriptor.total()*descriptor.elemSize());
+        }
+    }
+
+    // 0 stands for no vocabulary
+    mnFingerprint = hash != 0 ? hash : 1;
+}
+
+void ORBVocabulary::DescendFlatTree(const ORBDescriptor* pDescriptors, int n, int nidLevel, uint32_t* pLeaves,
+                                    DBoW2::NodeId* pNodeIds, int* pDist) const
+{
+    // Every block of children starts on a 64-byte boundary
+    const ORBDescriptor* pFlatDescriptors = reinterpret_cast<const ORBDescriptor*>(mpFlat->descriptors);
+
+    uint32_t vCurrent[TRANSFORM_BATCH];
+    bool vbActive[TRANSFORM_BATCH];
+    for(int i=0; i<n; i++)
+    {
+        vCurrent[i] = 0;
+        vbActive[i] = true;
+        pNodeIds[i] = 0; // root
+    }
+
+    int nActive = n;
+    int level = 0;
+    while(nActive > 0)
+    {
+        ++level;
+
+        for(int i=0; i<n; i++)
+        {
+            if(vbActive[i])
+            {
+                const BinaryNode &node = mpFlat->nodes[vCurrent[i]];
+                PrefetchDescriptors(pFlatDescriptors + node.childrenBegin, node.nChildren);
+            }
+        }
+
+        for(int i=0; i<n; i++)
+        {
+            if(!vbActive[i])
+                continue;
+
+            const BinaryNode &node = mpFlat->nodes[vCurrent[i]];
+            HammingDistance::OneToMany(pDescriptors[i], pFlatDescriptors + node.childrenBegin, node.nChildren, pDist);
+
+            // The first closest child, as DBoW2 does
+            uint32_t best = 0;
+            for(uint32_t j=1; j<node.nChildren; j++)
+            {
+                if(pDist[j] < pDist[best])
+                    best = j;
+            }
+            vCurrent[i] = node.childrenBegin + best;
+
+            const BinaryNode &child = mpFlat->nodes[vCurrent[i]];
+            if(level == nidLevel)
+                pNodeIds[i] = child.nodeId;
+
+            if(child.nChildren == 0)
+            {
+                // A leaf above nidLevel is its own node, DBoW2 leaves it undefined
+                if(level < nidLevel)
+                    pNodeIds[i] = child.nodeId;
+                pLeaves[i] = vCurrent[i];
+                vbActive[i] = false;
+                nActive--;
+            }
+        }
+    }
+}
+
+void ORBVocabulary::transform(const DescriptorSpan &descriptors, DBoW2::BowVector &v, DBoW2::FeatureVector &fv, int levelsup) const
+{
+    v.clear();
+    fv.clear();
+
+    if(empty())
+        return;
+
+    if(!mpFlat)
+    {
+        std::vector<cv::Mat> vDesc;
+        vDesc.reserve(descriptors.size());
+        for(const ORBDescriptor &descriptor : descriptors)
+            vDesc.push_back(cv::Mat(1, ORBDescriptor::bytes, CV_8U, const_cast<ORBDescriptor*>(&descriptor)));
+        Base::transform(vDesc, v, fv, levelsup);
+        return;
+    }
+
+    // normalize
+    DBoW2::LNorm norm;
+    bool must = m_scoring_object->mustNormalize(norm);
+
+    const bool bAddWeights = m_weighting == DBoW2::TF || m_weighting == DBoW2::TF_IDF;
+    const int nidLevel = m_L - levelsup;
+
+    std::vector<int> vDist(mnMaxChildren);
+    uint32_t vLeaves[TRANSFORM_BATCH];
+    DBoW2::NodeId vNodeIds[TRANSFORM_BATCH];
+
+    const unsigned int nFeatures = descriptors.size();
+    for(unsigned int i_batch=0; i_batch<nFeatures; i_batch+=TRANSFORM_BATCH)
+    {
+        const int n = std::min<unsigned int>(TRANSFORM_BATCH, nFeatures-i_batch);
+        DescendFlatTree(descriptors.data()+i_batch, n, nidLevel, vLeaves, vNodeIds, vDist.data());
+
+        for(int i=0; i<n; i++)
+        {
+            // w is the idf value if TF_IDF, 1 if TF, idf if IDF, or 1 if BINARY
+            const DBoW2::WordValue w = mpFlat->weights[vLeaves[i]];
+            if(w > 0) // not stopped
+            {
+                const DBoW2::WordId id = mpFlat->nodes[vLeaves[i]].wordId;
+                if(bAddWeights)
+                    v.addWeight(id, w);
+                else
+                    v.addIfNotExist(id, w);
+                fv.addFeature(vNodeIds[i], i_batch+i);
+            }
+        }
+    }
+
+    if(bAddWeights && !v.empty() && !must)
+    {
+        // unnecessary when normalizing
+        const double nd = v.size();
+        for(DBoW2::BowVector::iterator vit = v.begin(); vit != v.end(); vit++)
+            vit->second /= nd;
+    }
+
+    if(must) v.normalize(norm);
+}
+
+void ORBVocabulary::transform(const std::vector<cv::Mat>& features, DBoW2::BowVector &v, DBoW2::FeatureVector &fv, int levelsup) const
+{
+    if(!mpFlat)
+    {
+        Base::transform(features, v, fv, levelsup);
+        return;
+    }
+
+    std::vector<ORBDescriptor> vDescriptors(features.size());
+    for(size_t i=0; i<features.size(); i++)
+        memcpy(&vDescriptors[i], features[i].ptr(), ORBDescriptor::bytes);
+
+    transform(DescriptorSpan(vDescriptors.data(), vDescriptors.size()), v, fv, levelsup);
+}
+
+} //namespace ORB_SLAM
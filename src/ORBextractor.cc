@@ -60,6 +60,11 @@
 
 #include "ORBextractor.h"
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ORB_KERNELS_X86
+#endif
+
 
 using namespace cv;
 using namespace std;
@@ -101,14 +106,96 @@ namespace ORB_SLAM3
         return fastAtan2((float)m_01, (float)m_10);
     }
 
+#ifdef __SSE2__
+    // Weights of the intensity centroid over rows of 32 pixels, u = -15..16. For row v, the first 32
+    // values weight the moment m_10 (u inside the circular patch, 0 outside) and the next 32 the moment
+    // m_01 (v inside the patch, 0 outside).
+    struct ICAngleWeights
+    {
+        ICAngleWeights(const vector<int> & u_max)
+        {
+            for (int v = 0; v <= HALF_PATCH_SIZE; ++v)
+            {
+                for (int i = 0; i < 32; ++i)
+                {
+                    const int u = i - HALF_PATCH_SIZE;
+                    const bool bInside = abs(u) <= u_max[v];
+                    w[v][i] = bInside ? u : 0;
+                    w[v][32+i] = bInside ? v : 0;
+                }
+            }
+        }
+
+        short w[HALF_PATCH_SIZE+1][64];
+    };
+
+    // Same moments as IC_Angle, 8 pixels at a time. The sums are integers, so the angle is the same.
+    // Reads one pixel past the patch on every row, inside the border of the pyramid levels.
+    static float IC_AngleSSE2(const Mat& image, Point2f pt, const ICAngleWeights& weights)
+    {
+        const uchar* center = &image.at<uchar> (cvRound(pt.y), cvRound(pt.x));
+        const int step = (int)image.step1();
+        const __m128i zero = _mm_setzero_si128();
+
+        __m128i m_10 = zero, m_01 = zero;
+
+        // Center line, v=0
+        {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(center - HALF_PATCH_SIZE));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(center - HALF_PATCH_SIZE + 16));
+            const __m128i* w = reinterpret_cast<const __m128i*>(weights.w[0]);
+            m_10 = _mm_add_epi32(m_10, _mm_madd_epi16(_mm_unpacklo_epi8(a, zero), _mm_loadu_si128(w)));
+            m_10 = _mm_add_epi32(m_10, _mm_madd_epi16(_mm_unpackhi_epi8(a, zero), _mm_loadu_si128(w+1)));
+            m_10 = _mm_add_epi32(m_10, _mm_madd_epi16(_mm_unpacklo_epi8(b, zero), _mm_loadu_si128(w+2)));
+            m_10 = _mm_add_epi32(m_10, _mm_madd_epi16(_mm_unpackhi_epi8(b, zero), _mm_loadu_si128(w+3)));
+        }
+
+        for (int v = 1; v <= HALF_PATCH_SIZE; ++v)
+        {
+            const uchar* plus = center + v*step - HALF_PATCH_SIZE;
+            const uchar* minus = center - v*step - HALF_PATCH_SIZE;
+            const __m128i* w = reinterpret_cast<const __m128i*>(weights.w[v]);
+
+            for (int half = 0; half < 2; ++half)
+            {
+                const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(plus + 16*half));
+                const __m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i*>(minus + 16*half));
+
+                const __m128i pLo = _mm_unpacklo_epi8(p, zero), pHi = _mm_unpackhi_epi8(p, zero);
+                const __m128i mLo = _mm_unpacklo_epi8(m, zero), mHi = _mm_unpackhi_epi8(m, zero);
+
+                m_10 = _mm_add_epi32(m_10, _mm_madd_epi16(_mm_add_epi16(pLo, mLo), _mm_loadu_si128(w + 2*half)));
+                m_10 = _mm_add_epi32(m_10, _mm_madd_epi16(_mm_add_epi16(pHi, mHi), _mm_loadu_si128(w + 2*half + 1)));
+                m_01 = _mm_add_epi32(m_01, _mm_madd_epi16(_mm_sub_epi16(pLo, mLo), _mm_loadu_si128(w + 4 + 2*half)));
+                m_01 = _mm_add_epi32(m_01, _mm_madd_epi16(_mm_sub_epi16(pHi, mHi), _mm_loadu_si128(w + 4 + 2*half + 1)));
+            }
+        }
+
+        // Horizontal sums
+        m_10 = _mm_add_epi32(m_10, _mm_shuffle_epi32(m_10, _MM_SHUFFLE(1,0,3,2)));
+        m_10 = _mm_add_epi32(m_10, _mm_shuffle_epi32(m_10, _MM_SHUFFLE(2,3,0,1)));
+        m_01 = _mm_add_epi32(m_01, _mm_shuffle_epi32(m_01, _MM_SHUFFLE(1,0,3,2)));
+        m_01 = _mm_add_epi32(m_01, _mm_shuffle_epi32(m_01, _MM_SHUFFLE(2,3,0,1)));
+
+        return fastAtan2((float)_mm_cvtsi128_si32(m_01), (float)_mm_cvtsi128_si32(m_10));
+    }
+#endif
+
 
     const float factorPI = (float)(CV_PI/180.f);
+    static inline void computeRotation(const KeyPoint& kpt, float &a, float &b)
+    {
+        float angle = (float)kpt.angle*factorPI;
+        a = (float)cos(angle);
+        b = (float)sin(angle);
+    }
+
     static void computeOrbDescriptor(const KeyPoint& kpt,
                                      const Mat& img, const Point* pattern,
                                      uchar* desc)
     {
-        float angle = (float)kpt.angle*factorPI;
-        float a = (float)cos(angle), b = (float)sin(angle);
+        float a, b;
+        computeRotation(kpt, a, b);
 
         const uchar* center = &img.at<uchar>(cvRound(kpt.pt.y), cvRound(kpt.pt.x));
         const int step = (int)img.step;
@@ -144,6 +231,61 @@ namespace ORB_SLAM3
 #undef GET_VALUE
     }
 
+#ifdef ORB_KERNELS_X86
+    // Pixel of 8 keypoints at the rotated position of a pattern point. The gather reads 4 bytes, the 3
+    // after the pixel are still within the image.
+    __attribute__((target("avx2")))
+    static inline __m256i getRotatedValues(const int* data, const __m256i center, const __m256i step,
+                                           const __m256 a, const __m256 b, const Point& p)
+    {
+        const __m256 x = _mm256_set1_ps((float)p.x), y = _mm256_set1_ps((float)p.y);
+        const __m256i row = _mm256_cvtps_epi32(_mm256_add_ps(_mm256_mul_ps(x, b), _mm256_mul_ps(y, a)));
+        const __m256i col = _mm256_cvtps_epi32(_mm256_sub_ps(_mm256_mul_ps(x, a), _mm256_mul_ps(y, b)));
+        const __m256i offset = _mm256_add_epi32(center, _mm256_add_epi32(_mm256_mullo_epi32(row, step), col));
+        return _mm256_and_si256(_mm256_i32gather_epi32(data, offset, 1), _mm256_set1_epi32(0xFF));
+    }
+
+    // computeOrbDescriptor on 8 keypoints at a time, one keypoint per lane. Rotated sample positions are
+    // rounded as cvRound does (current rounding mode) and no multiply-add is fused, so the descriptors
+    // are the same as the scalar ones. desc holds 8 consecutive 32 byte descriptors.
+    __attribute__((target("avx2")))
+    static void computeOrbDescriptorsAVX2(const KeyPoint* kpts,
+                                          const Mat& img, const Point* pattern,
+                                          uchar* desc)
+    {
+        const int step = (int)img.step;
+
+        alignas(32) float va[8], vb[8];
+        alignas(32) int vcenter[8];
+        for (int k = 0; k < 8; ++k)
+        {
+            computeRotation(kpts[k], va[k], vb[k]);
+            vcenter[k] = cvRound(kpts[k].pt.y)*step + cvRound(kpts[k].pt.x);
+        }
+
+        const __m256 a = _mm256_load_ps(va), b = _mm256_load_ps(vb);
+        const __m256i center = _mm256_load_si256(reinterpret_cast<const __m256i*>(vcenter));
+        const __m256i vstep = _mm256_set1_epi32(step);
+        const int* data = reinterpret_cast<const int*>(img.data);
+
+        alignas(32) int vbyte[8];
+        for (int i = 0; i < 32; ++i, pattern += 16)
+        {
+            __m256i val = _mm256_setzero_si256();
+            for (int bit = 0; bit < 8; ++bit)
+            {
+                const __m256i t0 = getRotatedValues(data, center, vstep, a, b, pattern[2*bit]);
+                const __m256i t1 = getRotatedValues(data, center, vstep, a, b, pattern[2*bit+1]);
+                val = _mm256_or_si256(val, _mm256_and_si256(_mm256_cmpgt_epi32(t1, t0), _mm256_set1_epi32(1 << bit)));
+            }
+
+            _mm256_store_si256(reinterpret_cast<__m256i*>(vbyte), val);
+            for (int k = 0; k < 8; ++k)
+                desc[32*k + i] = (uchar)vbyte[k];
+        }
+    }
+#endif
+
 
     static int bit_pattern_31_[256*4] =
             {
@@ -408,7 +550,7 @@ namespace ORB_SLAM3
     ORBextractor::ORBextractor(int _nfeatures, float _scaleFactor, int _nlevels,
                                int _iniThFAST, int _minThFAST):
             nfeatures(_nfeatures), scaleFactor(_scaleFactor), nlevels(_nlevels),
-            iniThFAST(_iniThFAST), minThFAST(_minThFAST)
+            iniThFAST(_iniThFAST), minThFAST(_minThFAST), mpThreadPool(nullptr)
     {
         mvScaleFactor.resize(nlevels);
         mvLevelSigma2.resize(nlevels);
@@ -428,7 +570,8 @@ namespace ORB_SLAM3
             mvInvLevelSigma2[i]=1.0f/mvLevelSigma2[i];
         }
 
-        mvImagePyramid.resize(nlevels);
+        mImagePyramid = ImagePyramid(mvInvScaleFactor, EDGE_THRESHOLD);
+        mBlurredPyramid = ImagePyramid(mvInvScaleFactor, EDGE_THRESHOLD);
 
         mnFeaturesPerLevel.resize(nlevels);
         float factor = 1.0f / scaleFactor;
@@ -467,8 +610,24 @@ namespace ORB_SLAM3
         }
     }
 
+    // Set with ORBextractor::SetVectorKernels
+    static bool bVectorKernels = true;
+
     static void computeOrientation(const Mat& image, vector<KeyPoint>& keypoints, const vector<int>& umax)
     {
+#ifdef __SSE2__
+        if (bVectorKernels)
+        {
+            // umax is the same for every extractor
+            static const ICAngleWeights weights(umax);
+            for (vector<KeyPoint>::iterator keypoint = keypoints.begin(),
+                         keypointEnd = keypoints.end(); keypoint != keypointEnd; ++keypoint)
+            {
+                keypoint->angle = IC_AngleSSE2(image, keypoint->pt, weights);
+            }
+            return;
+        }
+#endif
         for (vector<KeyPoint>::iterator keypoint = keypoints.begin(),
                      keypointEnd = keypoints.end(); keypoint != keypointEnd; ++keypoint)
         {
@@ -766,98 +925,97 @@ namespace ORB_SLAM3
 
         const float W = 35;
 
+        // Cell grid of every level. FAST runs on the cells of all the levels as independent tasks, the
+        // keypoints of each cell are then appended in the same order as a sequential scan.
+        struct LevelGrid
+        {
+            int minBorderX, minBorderY, maxBorderX, maxBorderY;
+            int nCols, nRows, wCell, hCell;
+            int firstCell;
+        };
+
+        vector<LevelGrid> vGrids(nlevels);
+        int nCells = 0;
         for (int level = 0; level < nlevels; ++level)
         {
-            const int minBorderX = EDGE_THRESHOLD-3;
-            const int minBorderY = minBorderX;
-            const int maxBorderX = mvImagePyramid[level].cols-EDGE_THRESHOLD+3;
-            const int maxBorderY = mvImagePyramid[level].rows-EDGE_THRESHOLD+3;
+            LevelGrid &grid = vGrids[level];
+            grid.minBorderX = EDGE_THRESHOLD-3;
+            grid.minBorderY = grid.minBorderX;
+            grid.maxBorderX = mImagePyramid[level].cols-EDGE_THRESHOLD+3;
+            grid.maxBorderY = mImagePyramid[level].rows-EDGE_THRESHOLD+3;
+
+            const float width = (grid.maxBorderX-grid.minBorderX);
+            const float height = (grid.maxBorderY-grid.minBorderY);
+
+            grid.nCols = width/W;
+            grid.nRows = height/W;
+            grid.wCell = ceil(width/grid.nCols);
+            grid.hCell = ceil(height/grid.nRows);
+            grid.firstCell = nCells;
+            nCells += grid.nRows*grid.nCols;
+        }
 
-            vector<cv::KeyPoint> vToDistributeKeys;
-            vToDistributeKeys.reserve(nfeatures*10);
+        vector<vector<cv::KeyPoint> > vCellKeys(nCells);
 
-            const float width = (maxBorderX-minBorderX);
-            const float height = (maxBorderY-minBorderY);
+        ParallelFor(0, nCells, [&](int cell)
+        {
+            int level = nlevels-1;
+            while(vGrids[level].firstCell > cell)
+                level--;
 
-            const int nCols = width/W;
-            const int nRows = height/W;
-            const int wCell = ceil(width/nCols);
-            const int hCell = ceil(height/nRows);
+            const LevelGrid &grid = vGrids[level];
+            const int i = (cell-grid.firstCell)/grid.nCols;
+            const int j = (cell-grid.firstCell)%grid.nCols;
 
-            for(int i=0; i<nRows; i++)
-            {
-                const float iniY =minBorderY+i*hCell;
-                float maxY = iniY+hCell+6;
+            const float iniY =grid.minBorderY+i*grid.hCell;
+            float maxY = iniY+grid.hCell+6;
 
-                if(iniY>=maxBorderY-3)
-                    continue;
-                if(maxY>maxBorderY)
-                    maxY = maxBorderY;
+            if(iniY>=grid.maxBorderY-3)
+                return;
+            if(maxY>grid.maxBorderY)
+                maxY = grid.maxBorderY;
 
-                for(int j=0; j<nCols; j++)
-                {
-                    const float iniX =minBorderX+j*wCell;
-                    float maxX = iniX+wCell+6;
-                    if(iniX>=maxBorderX-6)
-                        continue;
-                    if(maxX>maxBorderX)
-                        maxX = maxBorderX;
+            const float iniX =grid.minBorderX+j*grid.wCell;
+            float maxX = iniX+grid.wCell+6;
+            if(iniX>=grid.maxBorderX-6)
+                return;
+            if(maxX>grid.maxBorderX)
+                maxX = grid.maxBorderX;
 
-                    vector<cv::KeyPoint> vKeysCell;
+            vector<cv::KeyPoint> &vKeysCell = vCellKeys[cell];
 
-                    FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                         vKeysCell,iniThFAST,true);
+            FAST(mImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
+                 vKeysCell,iniThFAST,true);
 
-                    /*if(bRight && j <= 13){
-                        FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                             vKeysCell,10,true);
-                    }
-                    else if(!bRight && j >= 16){
-                        FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                             vKeysCell,10,true);
-                    }
-                    else{
-                        FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                             vKeysCell,iniThFAST,true);
-                    }*/
+            if(vKeysCell.empty())
+            {
+                FAST(mImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
+                     vKeysCell,minThFAST,true);
+            }
 
+            for(vector<cv::KeyPoint>::iterator vit=vKeysCell.begin(); vit!=vKeysCell.end();vit++)
+            {
+                (*vit).pt.x+=j*grid.wCell;
+                (*vit).pt.y+=i*grid.hCell;
+            }
+        });
 
-                    if(vKeysCell.empty())
-                    {
-                        FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                             vKeysCell,minThFAST,true);
-                        /*if(bRight && j <= 13){
-                            FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                                 vKeysCell,5,true);
-                        }
-                        else if(!bRight && j >= 16){
-                            FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                                 vKeysCell,5,true);
-                        }
-                        else{
-                            FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                                 vKeysCell,minThFAST,true);
-                        }*/
-                    }
+        ParallelFor(0, nlevels, [&](int level)
+        {
+            const LevelGrid &grid = vGrids[level];
 
-                    if(!vKeysCell.empty())
-                    {
-                        for(vector<cv::KeyPoint>::iterator vit=vKeysCell.begin(); vit!=vKeysCell.end();vit++)
-                        {
-                            (*vit).pt.x+=j*wCell;
-                            (*vit).pt.y+=i*hCell;
-                            vToDistributeKeys.push_back(*vit);
-                        }
-                    }
+            vector<cv::KeyPoint> vToDistributeKeys;
+            vToDistributeKeys.reserve(nfeatures*10);
 
-                }
-            }
+            const int endCell = grid.firstCell + grid.nRows*grid.nCols;
+            for(int cell=grid.firstCell; cell<endCell; cell++)
+                vToDistributeKeys.insert(vToDistributeKeys.end(), vCellKeys[cell].begin(), vCellKeys[cell].end());
 
             vector<KeyPoint> & keypoints = allKeypoints[level];
             keypoints.reserve(nfeatures);
 
-            keypoints = DistributeOctTree(vToDistributeKeys, minBorderX, maxBorderX,
-                                          minBorderY, maxBorderY,mnFeaturesPerLevel[level], level);
+            keypoints = DistributeOctTree(vToDistributeKeys, grid.minBorderX, grid.maxBorderX,
+                                          grid.minBorderY, grid.maxBorderY,mnFeaturesPerLevel[level], level);
 
             const int scaledPatchSize = PATCH_SIZE*mvScaleFactor[level];
 
@@ -865,23 +1023,22 @@ namespace ORB_SLAM3
             const int nkps = keypoints.size();
             for(int i=0; i<nkps ; i++)
             {
-                keypoints[i].pt.x+=minBorderX;
-                keypoints[i].pt.y+=minBorderY;
+                keypoints[i].pt.x+=grid.minBorderX;
+                keypoints[i].pt.y+=grid.minBorderY;
                 keypoints[i].octave=level;
                 keypoints[i].size = scaledPatchSize;
             }
-        }
 
-        // compute orientations
-        for (int level = 0; level < nlevels; ++level)
-            computeOrientation(mvImagePyramid[level], allKeypoints[level], umax);
+            // compute orientations
+            computeOrientation(mImagePyramid[level], keypoints, umax);
+        });
     }
 
     void ORBextractor::ComputeKeyPointsOld(std::vector<std::vector<KeyPoint> > &allKeypoints)
     {
         allKeypoints.resize(nlevels);
 
-        float imageRatio = (float)mvImagePyramid[0].cols/mvImagePyramid[0].rows;
+        float imageRatio = (float)mImagePyramid[0].cols/mImagePyramid[0].rows;
 
         for (int level = 0; level < nlevels; ++level)
         {
@@ -892,8 +1049,8 @@ namespace ORB_SLAM3
 
             const int minBorderX = EDGE_THRESHOLD;
             const int minBorderY = minBorderX;
-            const int maxBorderX = mvImagePyramid[level].cols-EDGE_THRESHOLD;
-            const int maxBorderY = mvImagePyramid[level].rows-EDGE_THRESHOLD;
+            const int maxBorderX = mImagePyramid[level].cols-EDGE_THRESHOLD;
+            const int maxBorderY = mImagePyramid[level].rows-EDGE_THRESHOLD;
 
             const int W = maxBorderX - minBorderX;
             const int H = maxBorderY - minBorderY;
@@ -953,7 +1110,7 @@ namespace ORB_SLAM3
                     }
 
 
-                    Mat cellImage = mvImagePyramid[level].rowRange(iniY,iniY+hY).colRange(iniX,iniX+hX);
+                    Mat cellImage = mImagePyramid[level].rowRange(iniY,iniY+hY).colRange(iniX,iniX+hX);
 
                     cellKeyPoints[i][j].reserve(nfeaturesCell*5);
 
@@ -1053,7 +1210,7 @@ namespace ORB_SLAM3
 
         // and compute orientations
         for (int level = 0; level < nlevels; ++level)
-            computeOrientation(mvImagePyramid[level], allKeypoints[level], umax);
+            computeOrientation(mImagePyramid[level], allKeypoints[level], umax);
     }
 
     static void computeDescriptors(const Mat& image, vector<KeyPoint>& keypoints, Mat& descriptors,
@@ -1061,10 +1218,29 @@ namespace ORB_SLAM3
     {
         descriptors = Mat::zeros((int)keypoints.size(), 32, CV_8UC1);
 
-        for (size_t i = 0; i < keypoints.size(); i++)
+        size_t i = 0;
+#ifdef ORB_KERNELS_X86
+        static const bool bAVX2 = __builtin_cpu_supports("avx2");
+        if(bAVX2 && bVectorKernels)
+        {
+            for (; i + 8 <= keypoints.size(); i += 8)
+                computeOrbDescriptorsAVX2(&keypoints[i], image, &pattern[0], descriptors.ptr((int)i));
+        }
+#endif
+        for (; i < keypoints.size(); i++)
             computeOrbDescriptor(keypoints[i], image, &pattern[0], descriptors.ptr((int)i));
     }
 
+    void ORBextractor::SetVectorKernels(bool bEnable)
+    {
+        bVectorKernels = bEnable;
+    }
+
+    bool ORBextractor::GetVectorKernels()
+    {
+        return bVectorKernels;
+    }
+
     int ORBextractor::operator()( InputArray _image, InputArray _mask, vector<KeyPoint>& _keypoints,
                                   OutputArray _descriptors, std::vector<int> &vLappingArea)
     {
@@ -1100,6 +1276,22 @@ namespace ORB_SLAM3
         //_keypoints.reserve(nkeypoints);
         _keypoints = vector<cv::KeyPoint>(nkeypoints);
 
+        // Descriptors of every level, the levels are independent
+        vector<Mat> vLevelDescriptors(nlevels);
+        ParallelFor(0, nlevels, [&](int level)
+        {
+            vector<KeyPoint>& keypoints = allKeypoints[level];
+            if(keypoints.empty())
+                return;
+
+            // preprocess the resized image, isolated from its border as the level was blurred on its own
+            Mat &workingMat = mBlurredPyramid[level];
+            GaussianBlur(mImagePyramid[level], workingMat, Size(7, 7), 2, 2, BORDER_REFLECT_101+BORDER_ISOLATED);
+
+            // Compute the descriptors
+            computeDescriptors(workingMat, keypoints, vLevelDescriptors[level], pattern);
+        });
+
         int offset = 0;
         //Modified for speeding up stereo fisheye matching
         int monoIndex = 0, stereoIndex = nkeypoints-1;
@@ -1111,14 +1303,7 @@ namespace ORB_SLAM3
             if(nkeypointsLevel==0)
                 continue;
 
-            // preprocess the resized image
-            Mat workingMat = mvImagePyramid[level].clone();
-            GaussianBlur(workingMat, workingMat, Size(7, 7), 2, 2, BORDER_REFLECT_101);
-
-            // Compute the descriptors
-            //Mat desc = descriptors.rowRange(offset, offset + nkeypointsLevel);
-            Mat desc = cv::Mat(nkeypointsLevel, 32, CV_8U);
-            computeDescriptors(workingMat, keypoints, desc, pattern);
+            const Mat &desc = vLevelDescriptors[level];
 
             offset += nkeypointsLevel;
 
@@ -1153,31 +1338,90 @@ namespace ORB_SLAM3
         return monoIndex;
     }
 
+    void ORBextractor::SetThreadPool(ThreadPool* pThreadPool)
+    {
+        mpThreadPool = pThreadPool;
+    }
+
+    ThreadPool* ORBextractor::GetThreadPool()
+    {
+        return mpThreadPool;
+    }
+
+    void ORBextractor::ParallelFor(int begin, int end, const std::function<void(int)> &f)
+    {
+        if(mpThreadPool)
+        {
+            mpThreadPool->ParallelFor(begin, end, f);
+        }
+        else
+        {
+            for(int i=begin; i<end; i++)
+                f(i);
+        }
+    }
+
     void ORBextractor::ComputePyramid(cv::Mat image)
     {
+        mImagePyramid.Compute(image);
+        mBlurredPyramid.Allocate(image.size(), image.type());
+    }
+
+    ImagePyramid::ImagePyramid(const std::vector<float> &vInvScaleFactor, int border):
+            mvInvScaleFactor(vInvScaleFactor), mnBorder(border)
+    {
+    }
+
+    void ImagePyramid::Allocate(const cv::Size &sz, int type)
+    {
+        const int nlevels = (int)mvInvScaleFactor.size();
+        if(!mvLevels.empty() && mvLevels[0].size()==sz && mBlock.type()==type)
+            return;
+
+        // Levels stacked on top of each other, all of them with the row stride of the first one
+        vector<Size> vSizes(nlevels);
+        int blockRows = 0;
         for (int level = 0; level < nlevels; ++level)
         {
             float scale = mvInvScaleFactor[level];
-            Size sz(cvRound((float)image.cols*scale), cvRound((float)image.rows*scale));
-            Size wholeSize(sz.width + EDGE_THRESHOLD*2, sz.height + EDGE_THRESHOLD*2);
-            Mat temp(wholeSize, image.type()), masktemp;
-            mvImagePyramid[level] = temp(Rect(EDGE_THRESHOLD, EDGE_THRESHOLD, sz.width, sz.height));
+            vSizes[level] = Size(cvRound((float)sz.width*scale), cvRound((float)sz.height*scale));
+            blockRows += vSizes[level].height + mnBorder*2;
+        }
 
-            // Compute the resized image
+        mBlock.create(blockRows, sz.width + mnBorder*2, type);
+        mvPaddedLevels.resize(nlevels);
+        mvLevels.resize(nlevels);
+
+        int row = 0;
+        for (int level = 0; level < nlevels; ++level)
+        {
+            Size wholeSize(vSizes[level].width + mnBorder*2, vSizes[level].height + mnBorder*2);
+            mvPaddedLevels[level] = mBlock(Rect(0, row, wholeSize.width, wholeSize.height));
+            mvLevels[level] = mvPaddedLevels[level](Rect(mnBorder, mnBorder, vSizes[level].width, vSizes[level].height));
+            row += wholeSize.height;
+        }
+    }
+
+    void ImagePyramid::Compute(const cv::Mat &image)
+    {
+        Allocate(image.size(), image.type());
+
+        // The destinations already have the right size, so resize and copyMakeBorder write in place
+        for (int level = 0; level < (int)mvLevels.size(); ++level)
+        {
             if( level != 0 )
             {
-                resize(mvImagePyramid[level-1], mvImagePyramid[level], sz, 0, 0, INTER_LINEAR);
+                resize(mvLevels[level-1], mvLevels[level], mvLevels[level].size(), 0, 0, INTER_LINEAR);
 
-                copyMakeBorder(mvImagePyramid[level], temp, EDGE_THRESHOLD, EDGE_THRESHOLD, EDGE_THRESHOLD, EDGE_THRESHOLD,
+                copyMakeBorder(mvLevels[level], mvPaddedLevels[level], mnBorder, mnBorder, mnBorder, mnBorder,
                                BORDER_REFLECT_101+BORDER_ISOLATED);
             }
             else
             {
-                copyMakeBorder(image, temp, EDGE_THRESHOLD, EDGE_THRESHOLD, EDGE_THRESHOLD, EDGE_THRESHOLD,
+                copyMakeBorder(image, mvPaddedLevels[level], mnBorder, mnBorder, mnBorder, mnBorder,
                                BORDER_REFLECT_101);
             }
         }
-
     }
 
 } //namespace ORB_SLAM
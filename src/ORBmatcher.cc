@@ -18,8 +18,10 @@
 
 
 #include "ORBmatcher.h"
+#include "HammingDistance.h"
 
 #include<limits.h>
+#include<cstring>
 
 #include<opencv2/core/core.hpp>
 #include<opencv2/features2d/features2d.hpp>
@@ -41,12 +43,58 @@ ORBmatcher::ORBmatcher(float nnratio, bool checkOri): mfNNratio(nnratio), mbChec
 {
 }
 
+void DescriptorBatch::Clear()
+{
+    mvQueries.clear();
+    mvOffsets.clear();
+    mvIndices.clear();
+    mvCandidates.clear();
+    mvDistances.clear();
+}
+
+size_t DescriptorBatch::AddQuery(const ORBDescriptor &query)
+{
+    mvQueries.push_back(query);
+    mvOffsets.push_back(mvIndices.size());
+    return mvQueries.size()-1;
+}
+
+void DescriptorBatch::AddCandidate(const size_t idx, const ORBDescriptor &descriptor)
+{
+    mvIndices.push_back(idx);
+    mvCandidates.push_back(descriptor);
+}
+
+void DescriptorBatch::ComputeDistances()
+{
+    mvDistances.resize(mvIndices.size());
+    for(size_t q=0; q<mvQueries.size(); q++)
+    {
+        const size_t begin = Begin(q);
+        HammingDistance::OneToMany(mvQueries[q], mvCandidates.data()+begin, End(q)-begin, mvDistances.data()+begin);
+    }
+}
+
 int ORBmatcher::SearchByProjection(Frame &F, const vector<boost::interprocess::offset_ptr<MapPoint> > &vpMapPoints, const float th, const bool bFarPoints, const float thFarPoints)
 {
+    const DescriptorSpan vDescF(F.mDescriptors);
+
     int nmatches=0, left = 0, right = 0;
 
     const bool bFactor = th!=1.0;
 
+    // The candidates of all the map points are gathered first and their distances computed in one batch.
+    // Matches are then selected in map point order, as a keypoint taken by a map point is no longer a
+    // candidate for the next ones.
+    static thread_local DescriptorBatch batch;
+    batch.Clear();
+
+    vector<boost::interprocess::offset_ptr<MapPoint> > vpBatchMPs;
+    vector<int> vnLeftQuery, vnRightQuery;
+    vpBatchMPs.reserve(vpMapPoints.size());
+    vnLeftQuery.reserve(vpMapPoints.size());
+    vnRightQuery.reserve(vpMapPoints.size());
+
     for(size_t iMP=0; iMP<vpMapPoints.size(); iMP++)
     {
         boost::interprocess::offset_ptr<MapPoint>  pMP = vpMapPoints[iMP];
@@ -59,6 +107,9 @@ int ORBmatcher::SearchByProjection(Frame &F, const vector<boost::interprocess::o
         if(pMP->isBad())
             continue;
 
+        vector<size_t> vIndicesLeft, vIndicesRight;
+        float radiusLeft = 0;
+
         if(pMP->mbTrackInView)
         {
             const int &nPredictedLevel = pMP->mnTrackScaleLevel;
@@ -69,147 +120,178 @@ int ORBmatcher::SearchByProjection(Frame &F, const vector<boost::interprocess::o
             if(bFactor)
                 r*=th;
 
-            const vector<size_t> vIndices =
-                    F.GetFeaturesInArea(pMP->mTrackProjX,pMP->mTrackProjY,r*F.mvScaleFactors[nPredictedLevel],nPredictedLevel-1,nPredictedLevel);
+            radiusLeft = r*F.mvScaleFactors[nPredictedLevel];
+            vIndicesLeft = F.GetFeaturesInArea(pMP->mTrackProjX,pMP->mTrackProjY,radiusLeft,nPredictedLevel-1,nPredictedLevel);
+        }
 
-            if(!vIndices.empty()){
-                const cv::Mat MPdescriptor = pMP->GetDescriptor();
+        if(F.Nleft != -1 && pMP->mbTrackInViewR && pMP->mnTrackScaleLevelR != -1)
+        {
+            const int &nPredictedLevel = pMP->mnTrackScaleLevelR;
+            float r = RadiusByViewingCos(pMP->mTrackViewCosR);
 
-                int bestDist=256;
-                int bestLevel= -1;
-                int bestDist2=256;
-                int bestLevel2 = -1;
-                int bestIdx =-1 ;
+            vIndicesRight = F.GetFeaturesInArea(pMP->mTrackProjXR,pMP->mTrackProjYR,r*F.mvScaleFactors[nPredictedLevel],nPredictedLevel-1,nPredictedLevel,true);
+        }
 
-                // Get best and second matches with near keypoints
-                for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
+        if(vIndicesLeft.empty() && vIndicesRight.empty())
+            continue;
+
+        const ORBDescriptor MPdescriptor = pMP->GetDescriptor256();
+
+        int nLeftQuery = -1;
+        if(!vIndicesLeft.empty())
+        {
+            nLeftQuery = batch.AddQuery(MPdescriptor);
+            for(vector<size_t>::const_iterator vit=vIndicesLeft.begin(), vend=vIndicesLeft.end(); vit!=vend; vit++)
+            {
+                const size_t idx = *vit;
+
+                if(F.Nleft == -1 && F.mvuRight[idx]>0)
                 {
-                    const size_t idx = *vit;
+                    const float er = fabs(pMP->mTrackProjXR-F.mvuRight[idx]);
+                    if(er>radiusLeft)
+                        continue;
+                }
 
-                    if(F.mvpMapPoints[idx])
-                        if(F.mvpMapPoints[idx]->Observations()>0)
-                            continue;
+                batch.AddCandidate(idx, vDescF[idx]);
+            }
+        }
 
-                    if(F.Nleft == -1 && F.mvuRight[idx]>0)
-                    {
-                        const float er = fabs(pMP->mTrackProjXR-F.mvuRight[idx]);
-                        if(er>r*F.mvScaleFactors[nPredictedLevel])
-                            continue;
-                    }
+        int nRightQuery = -1;
+        if(!vIndicesRight.empty())
+        {
+            nRightQuery = batch.AddQuery(MPdescriptor);
+            for(vector<size_t>::const_iterator vit=vIndicesRight.begin(), vend=vIndicesRight.end(); vit!=vend; vit++)
+                batch.AddCandidate(*vit, vDescF[*vit + F.Nleft]);
+        }
 
-                    const cv::Mat &d = F.mDescriptors.row(idx);
+        vpBatchMPs.push_back(pMP);
+        vnLeftQuery.push_back(nLeftQuery);
+        vnRightQuery.push_back(nRightQuery);
+    }
 
-                    const int dist = DescriptorDistance(MPdescriptor,d);
+    batch.ComputeDistances();
 
-                    if(dist<bestDist)
-                    {
-                        bestDist2=bestDist;
-                        bestDist=dist;
-                        bestLevel2 = bestLevel;
-                        bestLevel = (F.Nleft == -1) ? F.mvKeysUn[idx].octave
-                                                    : (idx < F.Nleft) ? F.mvKeys[idx].octave
-                                                                      : F.mvKeysRight[idx - F.Nleft].octave;
-                        bestIdx=idx;
-                    }
-                    else if(dist<bestDist2)
-                    {
-                        bestLevel2 = (F.Nleft == -1) ? F.mvKeysUn[idx].octave
-                                                     : (idx < F.Nleft) ? F.mvKeys[idx].octave
-                                                                       : F.mvKeysRight[idx - F.Nleft].octave;
-                        bestDist2=dist;
-                    }
-                }
+    for(size_t iMP=0; iMP<vpBatchMPs.size(); iMP++)
+    {
+        boost::interprocess::offset_ptr<MapPoint>  pMP = vpBatchMPs[iMP];
 
-                // Apply ratio to second match (only if best and second are in the same scale level)
-                if(bestDist<=TH_HIGH)
-                {
-                    if(bestLevel==bestLevel2 && bestDist>mfNNratio*bestDist2)
+        if(vnLeftQuery[iMP] != -1)
+        {
+            const size_t q = vnLeftQuery[iMP];
+
+            int bestDist=256;
+            int bestLevel= -1;
+            int bestDist2=256;
+            int bestLevel2 = -1;
+            int bestIdx =-1 ;
+
+            // Get best and second matches with near keypoints
+            for(size_t k=batch.Begin(q), kend=batch.End(q); k<kend; k++)
+            {
+                const size_t idx = batch.Index(k);
+
+                if(F.mvpMapPoints[idx])
+                    if(F.mvpMapPoints[idx]->Observations()>0)
                         continue;
 
-                    if(bestLevel!=bestLevel2 || bestDist<=mfNNratio*bestDist2){
-                        F.mvpMapPoints[bestIdx]=pMP;
+                const int dist = batch.Distance(k);
 
-                        if(F.Nleft != -1 && F.mvLeftToRightMatch[bestIdx] != -1){ //Also match with the stereo observation at right camera
-                            F.mvpMapPoints[F.mvLeftToRightMatch[bestIdx] + F.Nleft] = pMP;
-                            nmatches++;
-                            right++;
-                        }
+                if(dist<bestDist)
+                {
+                    bestDist2=bestDist;
+                    bestDist=dist;
+                    bestLevel2 = bestLevel;
+                    bestLevel = (F.Nleft == -1) ? F.mvKeysUn[idx].octave
+                                                : (idx < F.Nleft) ? F.mvKeys[idx].octave
+                                                                  : F.mvKeysRight[idx - F.Nleft].octave;
+                    bestIdx=idx;
+                }
+                else if(dist<bestDist2)
+                {
+                    bestLevel2 = (F.Nleft == -1) ? F.mvKeysUn[idx].octave
+                                                 : (idx < F.Nleft) ? F.mvKeys[idx].octave
+                                                                   : F.mvKeysRight[idx - F.Nleft].octave;
+                    bestDist2=dist;
+                }
+            }
+
+            // Apply ratio to second match (only if best and second are in the same scale level)
+            if(bestDist<=TH_HIGH)
+            {
+                if(bestLevel==bestLevel2 && bestDist>mfNNratio*bestDist2)
+                    continue;
+
+                if(bestLevel!=bestLevel2 || bestDist<=mfNNratio*bestDist2){
+                    F.mvpMapPoints[bestIdx]=pMP;
 
+                    if(F.Nleft != -1 && F.mvLeftToRightMatch[bestIdx] != -1){ //Also match with the stereo observation at right camera
+                        F.mvpMapPoints[F.mvLeftToRightMatch[bestIdx] + F.Nleft] = pMP;
                         nmatches++;
-                        left++;
+                        right++;
                     }
+
+                    nmatches++;
+                    left++;
                 }
             }
         }
 
-        if(F.Nleft != -1 && pMP->mbTrackInViewR){
-            const int &nPredictedLevel = pMP->mnTrackScaleLevelR;
-            if(nPredictedLevel != -1){
-                float r = RadiusByViewingCos(pMP->mTrackViewCosR);
+        if(vnRightQuery[iMP] != -1)
+        {
+            const size_t q = vnRightQuery[iMP];
 
-                const vector<size_t> vIndices =
-                        F.GetFeaturesInArea(pMP->mTrackProjXR,pMP->mTrackProjYR,r*F.mvScaleFactors[nPredictedLevel],nPredictedLevel-1,nPredictedLevel,true);
+            int bestDist=256;
+            int bestLevel= -1;
+            int bestDist2=256;
+            int bestLevel2 = -1;
+            int bestIdx =-1 ;
 
-                if(vIndices.empty())
-                    continue;
+            // Get best and second matches with near keypoints
+            for(size_t k=batch.Begin(q), kend=batch.End(q); k<kend; k++)
+            {
+                const size_t idx = batch.Index(k);
 
-                const cv::Mat MPdescriptor = pMP->GetDescriptor();
+                if(F.mvpMapPoints[idx + F.Nleft])
+                    if(F.mvpMapPoints[idx + F.Nleft]->Observations()>0)
+                        continue;
 
-                int bestDist=256;
-                int bestLevel= -1;
-                int bestDist2=256;
-                int bestLevel2 = -1;
-                int bestIdx =-1 ;
+                const int dist = batch.Distance(k);
 
-                // Get best and second matches with near keypoints
-                for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
+                if(dist<bestDist)
                 {
-                    const size_t idx = *vit;
-
-                    if(F.mvpMapPoints[idx + F.Nleft])
-                        if(F.mvpMapPoints[idx + F.Nleft]->Observations()>0)
-                            continue;
-
-
-                    const cv::Mat &d = F.mDescriptors.row(idx + F.Nleft);
-
-                    const int dist = DescriptorDistance(MPdescriptor,d);
-
-                    if(dist<bestDist)
-                    {
-                        bestDist2=bestDist;
-                        bestDist=dist;
-                        bestLevel2 = bestLevel;
-                        bestLevel = F.mvKeysRight[idx].octave;
-                        bestIdx=idx;
-                    }
-                    else if(dist<bestDist2)
-                    {
-                        bestLevel2 = F.mvKeysRight[idx].octave;
-                        bestDist2=dist;
-                    }
+                    bestDist2=bestDist;
+                    bestDist=dist;
+                    bestLevel2 = bestLevel;
+                    bestLevel = F.mvKeysRight[idx].octave;
+                    bestIdx=idx;
                 }
-
-                // Apply ratio to second match (only if best and second are in the same scale level)
-                if(bestDist<=TH_HIGH)
+                else if(dist<bestDist2)
                 {
-                    if(bestLevel==bestLevel2 && bestDist>mfNNratio*bestDist2)
-                        continue;
-
-                    if(F.Nleft != -1 && F.mvRightToLeftMatch[bestIdx] != -1){ //Also match with the stereo observation at right camera
-                        F.mvpMapPoints[F.mvRightToLeftMatch[bestIdx]] = pMP;
-                        nmatches++;
-                        left++;
-                    }
+                    bestLevel2 = F.mvKeysRight[idx].octave;
+                    bestDist2=dist;
+                }
+            }
 
+            // Apply ratio to second match (only if best and second are in the same scale level)
+            if(bestDist<=TH_HIGH)
+            {
+                if(bestLevel==bestLevel2 && bestDist>mfNNratio*bestDist2)
+                    continue;
 
-                    F.mvpMapPoints[bestIdx + F.Nleft]=pMP;
+                if(F.Nleft != -1 && F.mvRightToLeftMatch[bestIdx] != -1){ //Also match with the stereo observation at right camera
+                    F.mvpMapPoints[F.mvRightToLeftMatch[bestIdx]] = pMP;
                     nmatches++;
-                    right++;
+                    left++;
                 }
+
+
+                F.mvpMapPoints[bestIdx + F.Nleft]=pMP;
+                nmatches++;
+                right++;
             }
         }
     }
+
     return nmatches;
 }
 
@@ -272,6 +354,9 @@ bool ORBmatcher::CheckDistEpipolarLine2(const cv::KeyPoint &kp1, const cv::KeyPo
 
 int ORBmatcher::SearchByBoW(boost::interprocess::offset_ptr<KeyFrame>  pKF,Frame &F, vector<boost::interprocess::offset_ptr<MapPoint> > &vpMapPointMatches)
 {
+    const DescriptorSpan vDescKF = pKF->GetDescriptors();
+    const DescriptorSpan vDescF(F.mDescriptors);
+
     std::cout<<"SearchByBow: Fails instantly\n";
     const vector<boost::interprocess::offset_ptr<MapPoint> > vpMapPointsKF = pKF->GetMapPointMatches();
     std::cout<<"SearchByBow: after GetMapPointMatches"<<std::endl;
@@ -290,9 +375,9 @@ int ORBmatcher::SearchByBoW(boost::interprocess::offset_ptr<KeyFrame>  pKF,Frame
 
     // We perform the matching over ORB that belong to the same vocabulary node (at a certain level)
     //DBoW2::FeatureVector::const_iterator KFit = vFeatVecKF.begin();
-    ORB_SLAM3::KeyFrame::featMap::const_iterator KFit = pKF->mFeatVec->begin();
+    SharedFeatureVector::const_iterator KFit = pKF->mFeatVec->begin();
     DBoW2::FeatureVector::const_iterator Fit = F.mFeatVec.begin();
-    ORB_SLAM3::KeyFrame::featMap::const_iterator KFend =  vFeatVecKF->end();
+    SharedFeatureVector::const_iterator KFend =  vFeatVecKF->end();
     //DBoW2::FeatureVector::const_iterator KFend = vFeatVecKF.end();
     DBoW2::FeatureVector::const_iterator Fend = F.mFeatVec.end();
 
@@ -320,7 +405,7 @@ int ORBmatcher::SearchByBoW(boost::interprocess::offset_ptr<KeyFrame>  pKF,Frame
                 if(pMP->isBad())
                     continue;
 
-                const cv::Mat &dKF= pKF->mDescriptors.row(realIdxKF);
+                const ORBDescriptor &dKF = vDescKF[realIdxKF];
 
                 int bestDist1=256;
                 int bestIdxF =-1 ;
@@ -338,7 +423,7 @@ int ORBmatcher::SearchByBoW(boost::interprocess::offset_ptr<KeyFrame>  pKF,Frame
                         if(vpMapPointMatches[realIdxF])
                             continue;
 
-                        const cv::Mat &dF = F.mDescriptors.row(realIdxF);
+                        const ORBDescriptor &dF = vDescF[realIdxF];
 
                         const int dist =  DescriptorDistance(dKF,dF);
 
@@ -359,7 +444,7 @@ int ORBmatcher::SearchByBoW(boost::interprocess::offset_ptr<KeyFrame>  pKF,Frame
                         if(vpMapPointMatches[realIdxF])
                             continue;
 
-                        const cv::Mat &dF = F.mDescriptors.row(realIdxF);
+                        const ORBDescriptor &dF = vDescF[realIdxF];
 
                         const int dist =  DescriptorDistance(dKF,dF);
 
@@ -488,6 +573,8 @@ int ORBmatcher::SearchByBoW(boost::interprocess::offset_ptr<KeyFrame>  pKF,Frame
 int ORBmatcher::SearchByProjection(boost::interprocess::offset_ptr<KeyFrame>  pKF, cv::Mat Scw, const vector<boost::interprocess::offset_ptr<MapPoint> > &vpPoints,
                                    vector<boost::interprocess::offset_ptr<MapPoint> > &vpMatched, int th, float ratioHamming)
 {
+    const DescriptorSpan vDescKF = pKF->GetDescriptors();
+
     // Get Calibration Parameters for later projection
     const float &fx = pKF->fx;
     const float &fy = pKF->fy;
@@ -565,7 +652,7 @@ int ORBmatcher::SearchByProjection(boost::interprocess::offset_ptr<KeyFrame>  pK
             continue;
 
         // Match to the most similar keypoint in the radius
-        const cv::Mat dMP = pMP->GetDescriptor();
+        const ORBDescriptor dMP = pMP->GetDescriptor256();
 
         int bestDist = 256;
         int bestIdx = -1;
@@ -580,7 +667,7 @@ int ORBmatcher::SearchByProjection(boost::interprocess::offset_ptr<KeyFrame>  pK
             if(kpLevel<nPredictedLevel-1 || kpLevel>nPredictedLevel)
                 continue;
 
-            const cv::Mat &dKF = pKF->mDescriptors.row(idx);
+            const ORBDescriptor &dKF = vDescKF[idx];
 
             const int dist = DescriptorDistance(dMP,dKF);
 
@@ -605,6 +692,8 @@ int ORBmatcher::SearchByProjection(boost::interprocess::offset_ptr<KeyFrame>  pK
 int ORBmatcher::SearchByProjection(boost::interprocess::offset_ptr<KeyFrame>  pKF, cv::Mat Scw, const std::vector<boost::interprocess::offset_ptr<MapPoint> > &vpPoints, const std::vector<boost::interprocess::offset_ptr<KeyFrame> > &vpPointsKFs,
                        std::vector<boost::interprocess::offset_ptr<MapPoint> > &vpMatched, std::vector<boost::interprocess::offset_ptr<KeyFrame> > &vpMatchedKF, int th, float ratioHamming)
 {
+    const DescriptorSpan vDescKF = pKF->GetDescriptors();
+
     // Get Calibration Parameters for later projection
     const float &fx = pKF->fx;
     const float &fy = pKF->fy;
@@ -682,7 +771,7 @@ int ORBmatcher::SearchByProjection(boost::interprocess::offset_ptr<KeyFrame>  pK
             continue;
 
         // Match to the most similar keypoint in the radius
-        const cv::Mat dMP = pMP->GetDescriptor();
+        const ORBDescriptor dMP = pMP->GetDescriptor256();
 
         int bestDist = 256;
         int bestIdx = -1;
@@ -697,7 +786,7 @@ int ORBmatcher::SearchByProjection(boost::interprocess::offset_ptr<KeyFrame>  pK
             if(kpLevel<nPredictedLevel-1 || kpLevel>nPredictedLevel)
                 continue;
 
-            const cv::Mat &dKF = pKF->mDescriptors.row(idx);
+            const ORBDescriptor &dKF = vDescKF[idx];
 
             const int dist = DescriptorDistance(dMP,dKF);
 
@@ -722,6 +811,9 @@ int ORBmatcher::SearchByProjection(boost::interprocess::offset_ptr<KeyFrame>  pK
 
 int ORBmatcher::SearchForInitialization(Frame &F1, Frame &F2, vector<cv::Point2f> &vbPrevMatched, vector<int> &vnMatches12, int windowSize)
 {
+    const DescriptorSpan vDescF1(F1.mDescriptors);
+    const DescriptorSpan vDescF2(F2.mDescriptors);
+
     int nmatches=0;
     vnMatches12 = vector<int>(F1.mvKeysUn.size(),-1);
 
@@ -745,7 +837,7 @@ int ORBmatcher::SearchForInitialization(Frame &F1, Frame &F2, vector<cv::Point2f
         if(vIndices2.empty())
             continue;
 
-        cv::Mat d1 = F1.mDescriptors.row(i1);
+        const ORBDescriptor &d1 = vDescF1[i1];
 
         int bestDist = INT_MAX;
         int bestDist2 = INT_MAX;
@@ -755,7 +847,7 @@ int ORBmatcher::SearchForInitialization(Frame &F1, Frame &F2, vector<cv::Point2f
         {
             size_t i2 = *vit;
 
-            cv::Mat d2 = F2.mDescriptors.row(i2);
+            const ORBDescriptor &d2 = vDescF2[i2];
 
             int dist = DescriptorDistance(d1,d2);
 
@@ -846,7 +938,7 @@ int ORBmatcher::SearchByBoW(boost::interprocess::offset_ptr<KeyFrame> pKF1, boos
     //const DBoW2::FeatureVector &vFeatVec1 = pKF1->mFeatVec;
     const auto vFeatVec1 = pKF1->mFeatVec;
     const vector<boost::interprocess::offset_ptr<MapPoint> > vpMapPoints1 = pKF1->GetMapPointMatches();
-    const cv::Mat &Descriptors1 = pKF1->mDescriptors;
+    const DescriptorSpan Descriptors1 = pKF1->GetDescriptors();
     //std::cout<<"First keyframe belongs to: "<<pKF1->GetMap()->map_name<<std::endl;
 
     //vector<cv::KeyPoint> temp_vec2;
@@ -855,7 +947,7 @@ int ORBmatcher::SearchByBoW(boost::interprocess::offset_ptr<KeyFrame> pKF1, boos
     //const DBoW2::FeatureVector &vFeatVec2 = pKF2->mFeatVec;
     const auto vFeatVec2 = pKF2->mFeatVec;
     const vector<boost::interprocess::offset_ptr<MapPoint> > vpMapPoints2 = pKF2->GetMapPointMatches();
-    const cv::Mat &Descriptors2 = pKF2->mDescriptors;
+    const DescriptorSpan Descriptors2 = pKF2->GetDescriptors();
     //std::cout<<"First keyframe belongs to: "<<pKF2->GetMap()->map_name<<std::endl;
 
     //std::cout<<"ORBmatcher:: Another SearchByBow\n";
@@ -903,7 +995,7 @@ int ORBmatcher::SearchByBoW(boost::interprocess::offset_ptr<KeyFrame> pKF1, boos
                 if(pMP1->isBad())
                     continue;
 
-                const cv::Mat &d1 = Descriptors1.row(idx1);
+                const ORBDescriptor &d1 = Descriptors1[idx1];
 
                 int bestDist1=256;
                 int bestIdx2 =-1 ;
@@ -925,7 +1017,7 @@ int ORBmatcher::SearchByBoW(boost::interprocess::offset_ptr<KeyFrame> pKF1, boos
                     if(pMP2->isBad())
                         continue;
 
-                    const cv::Mat &d2 = Descriptors2.row(idx2);
+                    const ORBDescriptor &d2 = Descriptors2[idx2];
 
                     int dist = DescriptorDistance(d1,d2);
 
@@ -1028,6 +1120,9 @@ int ORBmatcher::SearchByBoW(boost::interprocess::offset_ptr<KeyFrame> pKF1, boos
 int ORBmatcher::SearchForTriangulation(boost::interprocess::offset_ptr<KeyFrame> pKF1, boost::interprocess::offset_ptr<KeyFrame> pKF2, cv::Mat F12,
                                        vector<pair<size_t, size_t> > &vMatchedPairs, const bool bOnlyStereo, const bool bCoarse)
 {    
+    const DescriptorSpan vDescKF1 = pKF1->GetDescriptors();
+    const DescriptorSpan vDescKF2 = pKF2->GetDescriptors();
+
     //const DBoW2::FeatureVector &vFeatVec1 = pKF1->mFeatVec;
     //const DBoW2::FeatureVector &vFeatVec2 = pKF2->mFeatVec;
     const auto &vFeatVec1 = pKF1->mFeatVec;
@@ -1124,7 +1219,7 @@ int ORBmatcher::SearchForTriangulation(boost::interprocess::offset_ptr<KeyFrame>
                 const bool bRight1 = (pKF1 -> NLeft == -1 || idx1 < pKF1 -> NLeft) ? false
                                                                                    : true;
                 //if(bRight1) continue;
-                const cv::Mat &d1 = pKF1->mDescriptors.row(idx1);
+                const ORBDescriptor &d1 = vDescKF1[idx1];
                 
                 int bestDist = TH_LOW;
                 int bestIdx2 = -1;
@@ -1145,7 +1240,7 @@ int ORBmatcher::SearchForTriangulation(boost::interprocess::offset_ptr<KeyFrame>
                         if(!bStereo2)
                             continue;
                     
-                    const cv::Mat &d2 = pKF2->mDescriptors.row(idx2);
+                    const ORBDescriptor &d2 = vDescKF2[idx2];
                     
                     const int dist = DescriptorDistance(d1,d2);
                     
@@ -1282,6 +1377,9 @@ int ORBmatcher::SearchForTriangulation(boost::interprocess::offset_ptr<KeyFrame>
     int ORBmatcher::SearchForTriangulation_(boost::interprocess::offset_ptr<KeyFrame> pKF1, boost::interprocess::offset_ptr<KeyFrame> pKF2, cv::Matx33f F12,
                                            vector<pair<size_t, size_t> > &vMatchedPairs, const bool bOnlyStereo, const bool bCoarse)
     {
+        const DescriptorSpan vDescKF1 = pKF1->GetDescriptors();
+        const DescriptorSpan vDescKF2 = pKF2->GetDescriptors();
+
         //std::cout<<"SearchForTriangulation_1\n";
         //const DBoW2::FeatureVector &vFeatVec1 = pKF1->mFeatVec;
         //const DBoW2::FeatureVector &vFeatVec2 = pKF2->mFeatVec;
@@ -1384,7 +1482,7 @@ int ORBmatcher::SearchForTriangulation(boost::interprocess::offset_ptr<KeyFrame>
                     const bool bRight1 = (pKF1 -> NLeft == -1 || idx1 < pKF1 -> NLeft) ? false
                                                                                        : true;
                     //if(bRight1) continue;
-                    const cv::Mat &d1 = pKF1->mDescriptors.row(idx1);
+                    const ORBDescriptor &d1 = vDescKF1[idx1];
 
                     int bestDist = TH_LOW;
                     int bestIdx2 = -1;
@@ -1405,7 +1503,7 @@ int ORBmatcher::SearchForTriangulation(boost::interprocess::offset_ptr<KeyFrame>
                             if(!bStereo2)
                                 continue;
 
-                        const cv::Mat &d2 = pKF2->mDescriptors.row(idx2);
+                        const ORBDescriptor &d2 = vDescKF2[idx2];
 
                         const int dist = DescriptorDistance(d1,d2);
 
@@ -1550,6 +1648,9 @@ int ORBmatcher::SearchForTriangulation(boost::interprocess::offset_ptr<KeyFrame>
     int ORBmatcher::SearchForTriangulation(boost::interprocess::offset_ptr<KeyFrame> pKF1, boost::interprocess::offset_ptr<KeyFrame> pKF2, cv::Mat F12,
                                            vector<pair<size_t, size_t> > &vMatchedPairs, const bool bOnlyStereo, vector<cv::Mat> &vMatchedPoints)
     {
+        const DescriptorSpan vDescKF1 = pKF1->GetDescriptors();
+        const DescriptorSpan vDescKF2 = pKF2->GetDescriptors();
+
         //const DBoW2::FeatureVector &vFeatVec1 = pKF1->mFeatVec;
         //const DBoW2::FeatureVector &vFeatVec2 = pKF2->mFeatVec;
         const auto &vFeatVec1 = pKF1->mFeatVec;
@@ -1620,7 +1721,7 @@ int ORBmatcher::SearchForTriangulation(boost::interprocess::offset_ptr<KeyFrame>
                                                                                        : true;
 
 
-                    const cv::Mat &d1 = pKF1->mDescriptors.row(idx1);
+                    const ORBDescriptor &d1 = vDescKF1[idx1];
 
                     int bestDist = TH_LOW;
                     int bestIdx2 = -1;
@@ -1637,7 +1738,7 @@ int ORBmatcher::SearchForTriangulation(boost::interprocess::offset_ptr<KeyFrame>
                         if(vbMatched2[idx2] || pMP2)
                             continue;
 
-                        const cv::Mat &d2 = pKF2->mDescriptors.row(idx2);
+                        const ORBDescriptor &d2 = vDescKF2[idx2];
 
                         const int dist = DescriptorDistance(d1,d2);
 
@@ -1753,6 +1854,8 @@ int ORBmatcher::SearchForTriangulation(boost::interprocess::offset_ptr<KeyFrame>
 
 int ORBmatcher::Fuse(boost::interprocess::offset_ptr<KeyFrame> pKF, const vector<boost::interprocess::offset_ptr<MapPoint> > &vpMapPoints, const float th, const bool bRight)
 {
+    const DescriptorSpan vDescKF = pKF->GetDescriptors();
+
     cv::Mat Rcw,tcw, Ow;
     GeometricCamera* pCamera;
 
@@ -1867,7 +1970,7 @@ int ORBmatcher::Fuse(boost::interprocess::offset_ptr<KeyFrame> pKF, const vector
 
         // Match to the most similar keypoint in the radius
 
-        const cv::Mat dMP = pMP->GetDescriptor();
+        const ORBDescriptor dMP = pMP->GetDescriptor256();
 
         int bestDist = 256;
         int bestIdx = -1;
@@ -1911,7 +2014,7 @@ int ORBmatcher::Fuse(boost::interprocess::offset_ptr<KeyFrame> pKF, const vector
 
             if(bRight) idx += pKF->NLeft;
 
-            const cv::Mat &dKF = pKF->mDescriptors.row(idx);
+            const ORBDescriptor &dKF = vDescKF[idx];
 
             const int dist = DescriptorDistance(dMP,dKF);
 
@@ -1953,6 +2056,8 @@ int ORBmatcher::Fuse(boost::interprocess::offset_ptr<KeyFrame> pKF, const vector
 
 int ORBmatcher::Fuse(boost::interprocess::offset_ptr<KeyFrame> pKF, cv::Mat Scw, const vector<boost::interprocess::offset_ptr<MapPoint> > &vpPoints, float th, vector<boost::interprocess::offset_ptr<MapPoint> > &vpReplacePoint)
 {
+    const DescriptorSpan vDescKF = pKF->GetDescriptors();
+
     // Get Calibration Parameters for later projection
     const float &fx = pKF->fx;
     const float &fy = pKF->fy;
@@ -2031,7 +2136,7 @@ int ORBmatcher::Fuse(boost::interprocess::offset_ptr<KeyFrame> pKF, cv::Mat Scw,
 
         // Match to the most similar keypoint in the radius
 
-        const cv::Mat dMP = pMP->GetDescriptor();
+        const ORBDescriptor dMP = pMP->GetDescriptor256();
 
         int bestDist = INT_MAX;
         int bestIdx = -1;
@@ -2043,7 +2148,7 @@ int ORBmatcher::Fuse(boost::interprocess::offset_ptr<KeyFrame> pKF, cv::Mat Scw,
             if(kpLevel<nPredictedLevel-1 || kpLevel>nPredictedLevel)
                 continue;
 
-            const cv::Mat &dKF = pKF->mDescriptors.row(idx);
+            const ORBDescriptor &dKF = vDescKF[idx];
 
             int dist = DescriptorDistance(dMP,dKF);
 
@@ -2078,6 +2183,9 @@ int ORBmatcher::Fuse(boost::interprocess::offset_ptr<KeyFrame> pKF, cv::Mat Scw,
 int ORBmatcher::SearchBySim3(boost::interprocess::offset_ptr<KeyFrame> pKF1, boost::interprocess::offset_ptr<KeyFrame> pKF2, vector<boost::interprocess::offset_ptr<MapPoint> > &vpMatches12,
                              const float &s12, const cv::Mat &R12, const cv::Mat &t12, const float th)
 {
+    const DescriptorSpan vDescKF1 = pKF1->GetDescriptors();
+    const DescriptorSpan vDescKF2 = pKF2->GetDescriptors();
+
     const float &fx = pKF1->fx;
     const float &fy = pKF1->fy;
     const float &cx = pKF1->cx;
@@ -2170,7 +2278,7 @@ int ORBmatcher::SearchBySim3(boost::interprocess::offset_ptr<KeyFrame> pKF1, boo
             continue;
 
         // Match to the most similar keypoint in the radius
-        const cv::Mat dMP = pMP->GetDescriptor();
+        const ORBDescriptor dMP = pMP->GetDescriptor256();
 
         int bestDist = INT_MAX;
         int bestIdx = -1;
@@ -2183,7 +2291,7 @@ int ORBmatcher::SearchBySim3(boost::interprocess::offset_ptr<KeyFrame> pKF1, boo
             if(kp.octave<nPredictedLevel-1 || kp.octave>nPredictedLevel)
                 continue;
 
-            const cv::Mat &dKF = pKF2->mDescriptors.row(idx);
+            const ORBDescriptor &dKF = vDescKF2[idx];
 
             const int dist = DescriptorDistance(dMP,dKF);
 
@@ -2250,7 +2358,7 @@ int ORBmatcher::SearchBySim3(boost::interprocess::offset_ptr<KeyFrame> pKF1, boo
             continue;
 
         // Match to the most similar keypoint in the radius
-        const cv::Mat dMP = pMP->GetDescriptor();
+        const ORBDescriptor dMP = pMP->GetDescriptor256();
 
         int bestDist = INT_MAX;
         int bestIdx = -1;
@@ -2263,7 +2371,7 @@ int ORBmatcher::SearchBySim3(boost::interprocess::offset_ptr<KeyFrame> pKF1, boo
             if(kp.octave<nPredictedLevel-1 || kp.octave>nPredictedLevel)
                 continue;
 
-            const cv::Mat &dKF = pKF1->mDescriptors.row(idx);
+            const ORBDescriptor &dKF = vDescKF1[idx];
 
             const int dist = DescriptorDistance(dMP,dKF);
 
@@ -2303,6 +2411,8 @@ int ORBmatcher::SearchBySim3(boost::interprocess::offset_ptr<KeyFrame> pKF1, boo
 
     int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame, const float th, const bool bMono)
     {
+        const DescriptorSpan vDescCF(CurrentFrame.mDescriptors);
+
         int nmatches = 0;
 
         // Rotation Histogram (to check rotation consistency)
@@ -2367,7 +2477,7 @@ int ORBmatcher::SearchBySim3(boost::interprocess::offset_ptr<KeyFrame> pKF1, boo
                     if(vIndices2.empty())
                         continue;
 
-                    const cv::Mat dMP = pMP->GetDescriptor();
+                    const ORBDescriptor dMP = pMP->GetDescriptor256();
 
                     int bestDist = 256;
                     int bestIdx2 = -1;
@@ -2388,7 +2498,7 @@ int ORBmatcher::SearchBySim3(boost::interprocess::offset_ptr<KeyFrame> pKF1, boo
                                 continue;
                         }
 
-                        const cv::Mat &d = CurrentFrame.mDescriptors.row(i2);
+                        const ORBDescriptor &d = vDescCF[i2];
 
                         const int dist = DescriptorDistance(dMP,d);
 
@@ -2443,7 +2553,7 @@ int ORBmatcher::SearchBySim3(boost::interprocess::offset_ptr<KeyFrame> pKF1, boo
                         else
                             vIndices2 = CurrentFrame.GetFeaturesInArea(uv.x,uv.y, radius, nLastOctave-1, nLastOctave+1, true);
 
-                        const cv::Mat dMP = pMP->GetDescriptor();
+                        const ORBDescriptor dMP = pMP->GetDescriptor256();
 
                         int bestDist = 256;
                         int bestIdx2 = -1;
@@ -2455,7 +2565,7 @@ int ORBmatcher::SearchBySim3(boost::interprocess::offset_ptr<KeyFrame> pKF1, boo
                                 if(CurrentFrame.mvpMapPoints[i2 + CurrentFrame.Nleft]->Observations()>0)
                                     continue;
 
-                            const cv::Mat &d = CurrentFrame.mDescriptors.row(i2 + CurrentFrame.Nleft);
+                            const ORBDescriptor &d = vDescCF[i2 + CurrentFrame.Nleft];
 
                             const int dist = DescriptorDistance(dMP,d);
 
@@ -2521,6 +2631,8 @@ int ORBmatcher::SearchBySim3(boost::interprocess::offset_ptr<KeyFrame> pKF1, boo
 
 int ORBmatcher::SearchByProjection(Frame &CurrentFrame, boost::interprocess::offset_ptr<KeyFrame> pKF, const set<boost::interprocess::offset_ptr<MapPoint> > &sAlreadyFound, const float th , const int ORBdist)
 {
+    const DescriptorSpan vDescCF(CurrentFrame.mDescriptors);
+
     int nmatches = 0;
 
     const cv::Mat Rcw = CurrentFrame.mTcw.rowRange(0,3).colRange(0,3);
@@ -2575,7 +2687,7 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, boost::interprocess::off
                 if(vIndices2.empty())
                     continue;
 
-                const cv::Mat dMP = pMP->GetDescriptor();
+                const ORBDescriptor dMP = pMP->GetDescriptor256();
 
                 int bestDist = 256;
                 int bestIdx2 = -1;
@@ -2586,7 +2698,7 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, boost::interprocess::off
                     if(CurrentFrame.mvpMapPoints[i2])
                         continue;
 
-                    const cv::Mat &d = CurrentFrame.mDescriptors.row(i2);
+                    const ORBDescriptor &d = vDescCF[i2];
 
                     const int dist = DescriptorDistance(dMP,d);
 
@@ -2687,24 +2799,14 @@ void ORBmatcher::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1,
 }
 
 
-// Bit set count operation from
-// http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetParallel
 int ORBmatcher::DescriptorDistance(const cv::Mat &a, const cv::Mat &b)
 {
-    const int *pa = a.ptr<int32_t>();
-    const int *pb = b.ptr<int32_t>();
-
-    int dist=0;
-
-    for(int i=0; i<8; i++, pa++, pb++)
-    {
-        unsigned  int v = *pa ^ *pb;
-        v = v - ((v >> 1) & 0x55555555);
-        v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
-        dist += (((v + (v >> 4)) & 0xF0F0F0F) * 0x1010101) >> 24;
-    }
+    // Rows of a descriptor matrix are not necessarily aligned
+    ORBDescriptor da, db;
+    memcpy(da.bits, a.ptr(), ORBDescriptor::bytes);
+    memcpy(db.bits, b.ptr(), ORBDescriptor::bytes);
 
-    return dist;
+    return HammingDistance::Distance(da, db);
 }
 
 } //namespace ORB_SLAM
@@ -51,16 +51,142 @@ bool sortByVal(const pair<boost::interprocess::offset_ptr<MapPoint> , int> &a, c
     return (a.second < b.second);
 }
 
-void Optimizer::GlobalBundleAdjustemnt(boost::interprocess::offset_ptr<Map>  pMap, int nIterations, bool* pbStopFlag, const unsigned long nLoopKF, const bool bRobust)
+bool Optimizer::sbUseBundleAdjuster = false;
+std::string Optimizer::sstrExportDir;
+
+void Optimizer::SetBundleAdjuster(bool bUse, const std::string &strExportDir)
+{
+    sbUseBundleAdjuster = bUse;
+    sstrExportDir = strExportDir;
+}
+
+// Adds to the adjuster the observations of map point nMP in keyframe nKF, as the edges of the g2o graphs.
+// Right observations are always robust.
+static int AddBundleAdjusterObservations(BundleAdjuster &adjuster, boost::interprocess::offset_ptr<KeyFrame> pKF, const int nKF, const int nMP,
+                                         const tuple<int,int> &indexes, const float thHuberMono, const float thHuberStereo, const bool bRobust)
+{
+    int nAdded = 0;
+    const int leftIndex = get<0>(indexes);
+
+    if(leftIndex != -1)
+    {
+        const cv::KeyPoint &kpUn = (*pKF->mvKeysUn)[leftIndex];
+        const float &invSigma2 = pKF->mvInvLevelSigma2->at(kpUn.octave);
+        const float kp_ur = pKF->mvuRight->at(leftIndex);
+
+        if(kp_ur<0)
+            adjuster.AddMonoObservation(nKF, nMP, Eigen::Vector2d(kpUn.pt.x, kpUn.pt.y), invSigma2, bRobust ? thHuberMono : 0.0,
+                                        pKF->mpCamera);
+        else
+            adjuster.AddStereoObservation(nKF, nMP, Eigen::Vector3d(kpUn.pt.x, kpUn.pt.y, kp_ur), invSigma2, bRobust ? thHuberStereo : 0.0,
+                                          pKF->fx, pKF->fy, pKF->cx, pKF->cy, pKF->mbf);
+        nAdded++;
+    }
+
+    if(pKF->mpCamera2)
+    {
+        int rightIndex = get<1>(indexes);
+
+        if(rightIndex != -1 && rightIndex < (*pKF->mvKeysRight).size())
+        {
+            rightIndex -= pKF->NLeft;
+
+            const cv::KeyPoint &kp = (*pKF->mvKeysRight)[rightIndex];
+            const float &invSigma2 = pKF->mvInvLevelSigma2->at(kp.octave);
+            adjuster.AddRightObservation(nKF, nMP, Eigen::Vector2d(kp.pt.x, kp.pt.y), invSigma2, thHuberMono,
+                                         pKF->mpCamera2, Converter::toSE3Quat(pKF->mTrl));
+            nAdded++;
+        }
+    }
+
+    return nAdded;
+}
+
+// Runs f(i) for every i in [begin, end) on pThreadPool, or sequentially without it
+static void ParallelFor(ThreadPool* pThreadPool, int begin, int end, const std::function<void(int)> &f)
+{
+    if(pThreadPool)
+    {
+        pThreadPool->ParallelFor(begin, end, f);
+    }
+    else
+    {
+        for(int i=begin; i<end; i++)
+            f(i);
+    }
+}
+
+// Writes the estimate of a BundleAdjustment graph to the keyframes and points, directly or to their GBA
+// variables for the map update of LoopClosing
+static void RecoverBundleAdjustment(g2o::SparseOptimizer &optimizer, const vector<boost::interprocess::offset_ptr<KeyFrame> > &vpKFs,
+                                    const vector<boost::interprocess::offset_ptr<MapPoint> > &vpMP, const vector<bool> &vbNotIncludedMP,
+                                    const long unsigned int maxKFid, const unsigned long nLoopKF)
+{
+    boost::interprocess::offset_ptr<Map>  pMap = vpKFs[0]->GetMap();
+
+    //Keyframes
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        boost::interprocess::offset_ptr<KeyFrame>  pKF = vpKFs[i];
+        if(pKF->isBad())
+            continue;
+        g2o::VertexSE3Expmap* vSE3 = static_cast<g2o::VertexSE3Expmap*>(optimizer.vertex(pKF->mnId));
+
+        g2o::SE3Quat SE3quat = vSE3->estimate();
+        if(nLoopKF==pMap->GetOriginKF()->mnId)
+        {
+            pKF->SetPose(Converter::toCvMat(SE3quat));
+        }
+        else
+        {
+            cv::Mat temp = cv::Mat(4,4,CV_32F);
+            pKF->mTcwGBA = temp;
+            pKF->mTcwGBA = Converter::toCvMat(SE3quat);
+            pKF->mnBAGlobalForKF = nLoopKF;
+        }
+    }
+
+    //Points
+    for(size_t i=0; i<vpMP.size(); i++)
+    {
+        if(vbNotIncludedMP[i])
+            continue;
+
+        boost::interprocess::offset_ptr<MapPoint>  pMP = vpMP[i];
+
+        if(pMP->isBad())
+            continue;
+        g2o::VertexSBAPointXYZ* vPoint = static_cast<g2o::VertexSBAPointXYZ*>(optimizer.vertex(pMP->mnId+maxKFid+1));
+
+        if(nLoopKF==pMap->GetOriginKF()->mnId)
+        {
+            pMP->SetWorldPos(Converter::toCvMat(vPoint->estimate()));
+            pMP->UpdateNormalAndDepth();
+        }
+        else
+        {
+            //Rather than creating a new matrix here. we will make a memory buffer for the 
+            // matrix that resides in shared memory.
+            pMP->mPosGBA = Converter::toCvMat(vPoint->estimate());
+            pMP->mnBAGlobalForKF = nLoopKF;
+        }
+    }
+}
+
+void Optimizer::GlobalBundleAdjustemnt(boost::interprocess::offset_ptr<Map>  pMap, int nIterations, bool* pbStopFlag, const unsigned long nLoopKF, const bool bRobust,
+                                       int nChunkIterations, const ChunkCallback &chunkCallback)
 {
     vector<boost::interprocess::offset_ptr<KeyFrame> > vpKFs = pMap->GetAllKeyFrames();
     vector<boost::interprocess::offset_ptr<MapPoint> > vpMP = pMap->GetAllMapPoints();
-    BundleAdjustment(vpKFs,vpMP,nIterations,pbStopFlag, nLoopKF, bRobust);
+    BundleAdjustment(vpKFs,vpMP,nIterations,pbStopFlag, nLoopKF, bRobust, set<boost::interprocess::offset_ptr<KeyFrame> >(),
+                     nChunkIterations, chunkCallback);
 }
 
 
 void Optimizer::BundleAdjustment(const vector<boost::interprocess::offset_ptr<KeyFrame> > &vpKFs, const vector<boost::interprocess::offset_ptr<MapPoint> > &vpMP,
-                                 int nIterations, bool* pbStopFlag, const unsigned long nLoopKF, const bool bRobust)
+                                 int nIterations, bool* pbStopFlag, const unsigned long nLoopKF, const bool bRobust,
+                                 const set<boost::interprocess::offset_ptr<KeyFrame> > &spFixedKFs,
+                                 int nChunkIterations, const ChunkCallback &chunkCallback)
 {
     vector<bool> vbNotIncludedMP;
     vbNotIncludedMP.resize(vpMP.size());
@@ -123,7 +249,7 @@ void Optimizer::BundleAdjustment(const vector<boost::interprocess::offset_ptr<Ke
         g2o::VertexSE3Expmap * vSE3 = new g2o::VertexSE3Expmap();
         vSE3->setEstimate(Converter::toSE3Quat(pKF->GetPose()));
         vSE3->setId(pKF->mnId);
-        vSE3->setFixed(pKF->mnId==pMap->GetInitKFid());
+        vSE3->setFixed(pKF->mnId==pMap->GetInitKFid() || spFixedKFs.count(pKF));
         optimizer.addVertex(vSE3);
         if(pKF->mnId>maxKFid)
             maxKFid=pKF->mnId;
@@ -278,126 +404,141 @@ void Optimizer::BundleAdjustment(const vector<boost::interprocess::offset_ptr<Ke
     // Optimize!
     optimizer.setVerbose(false);
     optimizer.initializeOptimization();
-    optimizer.optimize(nIterations);
-    Verbose::PrintMess("BA: End of the optimization", Verbose::VERBOSITY_NORMAL);
-
-    // Recover optimized data
 
-    //Keyframes
-    for(size_t i=0; i<vpKFs.size(); i++)
+    // In chunks of iterations, the estimate is recovered after each one
+    const int nChunk = nChunkIterations>0 ? nChunkIterations : nIterations;
+    int nIterationsDone = 0;
+    while(true)
     {
-        boost::interprocess::offset_ptr<KeyFrame>  pKF = vpKFs[i];
-        if(pKF->isBad())
-            continue;
-        g2o::VertexSE3Expmap* vSE3 = static_cast<g2o::VertexSE3Expmap*>(optimizer.vertex(pKF->mnId));
+        const int nIt = min(nChunk, nIterations-nIterationsDone);
+        const int nDone = optimizer.optimize(nIt);
+        nIterationsDone += max(nDone,0);
 
-        g2o::SE3Quat SE3quat = vSE3->estimate();
-        if(nLoopKF==pMap->GetOriginKF()->mnId)
-        {
-            pKF->SetPose(Converter::toCvMat(SE3quat));
-        }
-        else
-        {
-            cv::Mat temp = cv::Mat(4,4,CV_32F);
-            temp.copyTo(pKF->mTcwGBA);
-            //pKF->mTcwGBA.create(4,4,CV_32F);
-            //pKF->mTcwGBA.create(4,4,CV_32F,ORB_SLAM3::region.get_address());
-            Converter::toCvMat(SE3quat).copyTo(pKF->mTcwGBA);
-            pKF->mnBAGlobalForKF = nLoopKF;
+        // Recover optimized data
+        RecoverBundleAdjustment(optimizer, vpKFs, vpMP, vbNotIncludedMP, maxKFid, nLoopKF);
 
-            cv::Mat mTwc = pKF->GetPoseInverse();
-            cv::Mat mTcGBA_c = pKF->mTcwGBA * mTwc;
-            cv::Vec3d vector_dist =  mTcGBA_c.rowRange(0, 3).col(3);
-            double dist = cv::norm(vector_dist);
-            if(dist > 1)
-            {
-                int numMonoBadPoints = 0, numMonoOptPoints = 0;
-                int numStereoBadPoints = 0, numStereoOptPoints = 0;
-                vector<boost::interprocess::offset_ptr<MapPoint> > vpMonoMPsOpt, vpStereoMPsOpt;
-
-                for(size_t i=0, iend=vpEdgesMono.size(); i<iend;i++)
-                {
-                    ORB_SLAM3::EdgeSE3ProjectXYZ* e = vpEdgesMono[i];
-                    boost::interprocess::offset_ptr<MapPoint>  pMP = vpMapPointEdgeMono[i];
-                    boost::interprocess::offset_ptr<KeyFrame>  pKFedge = vpEdgeKFMono[i];
-
-                    if(pKF != pKFedge)
-                    {
-                        continue;
-                    }
-
-                    if(pMP->isBad())
-                        continue;
-
-                    if(e->chi2()>5.991 || !e->isDepthPositive())
-                    {
-                        numMonoBadPoints++;
-
-                    }
-                    else
-                    {
-                        numMonoOptPoints++;
-                        vpMonoMPsOpt.push_back(pMP);
-                    }
+        if(nDone<nIt || nIterationsDone>=nIterations || (pbStopFlag && *pbStopFlag))
+            break;
 
-                }
+        if(chunkCallback)
+        {
+            optimizer.computeActiveErrors();
+            if(!chunkCallback(nIterationsDone, optimizer.activeRobustChi2()))
+                break;
+        }
+    }
+    Verbose::PrintMess("BA: End of the optimization", Verbose::VERBOSITY_NORMAL);
+}
 
-                for(size_t i=0, iend=vpEdgesStereo.size(); i<iend;i++)
-                {
-                    g2o::EdgeStereoSE3ProjectXYZ* e = vpEdgesStereo[i];
-                    boost::interprocess::offset_ptr<MapPoint>  pMP = vpMapPointEdgeStereo[i];
-                    boost::interprocess::offset_ptr<KeyFrame>  pKFedge = vpEdgeKFMono[i];
+void Optimizer::IncrementalBundleAdjustment(boost::interprocess::offset_ptr<Map>  pMap, const vector<boost::interprocess::offset_ptr<KeyFrame> > &vpSeedKFs,
+                                            int nLevels, int nIterations, bool* pbStopFlag, const unsigned long nLoopKF, const bool bRobust,
+                                            int nChunkIterations, const ChunkCallback &chunkCallback)
+{
+    // Affected keyframes: breadth first search in the covisibility graph from the seeds
+    set<boost::interprocess::offset_ptr<KeyFrame> > spRegionKFs;
+    vector<boost::interprocess::offset_ptr<KeyFrame> > vpFrontier;
+    for(size_t i=0; i<vpSeedKFs.size(); i++)
+    {
+        boost::interprocess::offset_ptr<KeyFrame>  pKFi = vpSeedKFs[i];
+        if(pKFi && !pKFi->isBad() && pKFi->GetMap() == pMap && spRegionKFs.insert(pKFi).second)
+            vpFrontier.push_back(pKFi);
+    }
 
-                    if(pKF != pKFedge)
-                    {
-                        continue;
-                    }
+    for(int level=0; level<nLevels && !vpFrontier.empty(); level++)
+    {
+        vector<boost::interprocess::offset_ptr<KeyFrame> > vpNext;
+        for(size_t i=0; i<vpFrontier.size(); i++)
+        {
+            const vector<boost::interprocess::offset_ptr<KeyFrame> > vpCovKFs = vpFrontier[i]->GetVectorCovisibleKeyFrames();
+            for(size_t j=0; j<vpCovKFs.size(); j++)
+            {
+                boost::interprocess::offset_ptr<KeyFrame>  pKFj = vpCovKFs[j];
+                if(pKFj && !pKFj->isBad() && pKFj->GetMap() == pMap && spRegionKFs.insert(pKFj).second)
+                    vpNext.push_back(pKFj);
+            }
+        }
+        vpFrontier.swap(vpNext);
+    }
 
-                    if(pMP->isBad())
-                        continue;
+    if(spRegionKFs.empty())
+        return;
 
-                    if(e->chi2()>7.815 || !e->isDepthPositive())
-                    {
-                        numStereoBadPoints++;
-                    }
-                    else
-                    {
-                        numStereoOptPoints++;
-                        vpStereoMPsOpt.push_back(pMP);
-                    }
-                }
-            }
+    // Points seen in the region
+    set<boost::interprocess::offset_ptr<MapPoint> > spRegionMPs;
+    for(set<boost::interprocess::offset_ptr<KeyFrame> >::iterator sit=spRegionKFs.begin(); sit!=spRegionKFs.end(); sit++)
+    {
+        const vector<boost::interprocess::offset_ptr<MapPoint> > vpMPs = (*sit)->GetMapPointMatches();
+        for(size_t i=0; i<vpMPs.size(); i++)
+        {
+            boost::interprocess::offset_ptr<MapPoint>  pMP = vpMPs[i];
+            if(pMP && !pMP->isBad() && pMP->GetMap() == pMap)
+                spRegionMPs.insert(pMP);
         }
     }
 
-    //Points
-    for(size_t i=0; i<vpMP.size(); i++)
+    // Keyframes outside the region that see its points constrain it without being optimized
+    set<boost::interprocess::offset_ptr<KeyFrame> > spFixedKFs;
+    for(set<boost::interprocess::offset_ptr<MapPoint> >::iterator sit=spRegionMPs.begin(); sit!=spRegionMPs.end(); sit++)
     {
-        if(vbNotIncludedMP[i])
-            continue;
+        const map<boost::interprocess::offset_ptr<KeyFrame> ,tuple<int,int>> observations = (*sit)->GetObservations();
+        for(map<boost::interprocess::offset_ptr<KeyFrame> ,tuple<int,int>>::const_iterator mit=observations.begin(); mit!=observations.end(); mit++)
+        {
+            boost::interprocess::offset_ptr<KeyFrame>  pKFi = mit->first;
+            if(!pKFi->isBad() && pKFi->GetMap() == pMap && !spRegionKFs.count(pKFi))
+                spFixedKFs.insert(pKFi);
+        }
+    }
 
-        boost::interprocess::offset_ptr<MapPoint>  pMP = vpMP[i];
+    Verbose::PrintMess("Incremental BA: " + to_string(spRegionKFs.size()) + " KFs optimized, " + to_string(spFixedKFs.size()) + " fixed, "
+                       + to_string(spRegionMPs.size()) + " MPs, of " + to_string(pMap->KeyFramesInMap()) + " KFs in the map", Verbose::VERBOSITY_NORMAL);
 
-        if(pMP->isBad())
-            continue;
-        g2o::VertexSBAPointXYZ* vPoint = static_cast<g2o::VertexSBAPointXYZ*>(optimizer.vertex(pMP->mnId+maxKFid+1));
+    vector<boost::interprocess::offset_ptr<KeyFrame> > vpKFs(spRegionKFs.begin(), spRegionKFs.end());
+    vpKFs.insert(vpKFs.end(), spFixedKFs.begin(), spFixedKFs.end());
+    const vector<boost::interprocess::offset_ptr<MapPoint> > vpMPs(spRegionMPs.begin(), spRegionMPs.end());
 
-        if(nLoopKF==pMap->GetOriginKF()->mnId)
+    const bool bOrigin = nLoopKF==pMap->GetOriginKF()->mnId;
+
+    // The rest of the map keeps its estimate. Only keyframes created after this point are corrected through
+    // the spanning tree by the map update.
+    auto flagOutside = [&]()
+    {
+        const vector<boost::interprocess::offset_ptr<KeyFrame> > vpAllKFs = pMap->GetAllKeyFrames();
+        for(size_t i=0; i<vpAllKFs.size(); i++)
         {
-            pMP->SetWorldPos(Converter::toCvMat(vPoint->estimate()));
-            pMP->UpdateNormalAndDepth();
+            boost::interprocess::offset_ptr<KeyFrame>  pKFi = vpAllKFs[i];
+            if(pKFi->isBad() || spRegionKFs.count(pKFi) || spFixedKFs.count(pKFi))
+                continue;
+            pKFi->mTcwGBA = pKFi->GetPose();
+            pKFi->mnBAGlobalForKF = nLoopKF;
         }
-        else
-        {
-            //Rather than creating a new matrix here. we will make a memory buffer for the 
-            // matrix that resides in shared memory.
-            
 
-            //pMP->mPosGBA.create(3,1,CV_32F);
-            Converter::toCvMat(vPoint->estimate()).copyTo(pMP->mPosGBA);
+        const vector<boost::interprocess::offset_ptr<MapPoint> > vpAllMPs = pMap->GetAllMapPoints();
+        for(size_t i=0; i<vpAllMPs.size(); i++)
+        {
+            boost::interprocess::offset_ptr<MapPoint>  pMP = vpAllMPs[i];
+            if(pMP->isBad() || spRegionMPs.count(pMP))
+                continue;
+            pMP->mPosGBA = pMP->GetWorldPos();
             pMP->mnBAGlobalForKF = nLoopKF;
         }
+    };
+
+    // Every chunk committed by the callback has to see the rest of the map flagged as well
+    ChunkCallback regionCallback;
+    if(chunkCallback)
+    {
+        regionCallback = [&](int nIt, double chi2)
+        {
+            if(!bOrigin)
+                flagOutside();
+            return chunkCallback(nIt, chi2);
+        };
     }
+
+    BundleAdjustment(vpKFs, vpMPs, nIterations, pbStopFlag, nLoopKF, bRobust, spFixedKFs, nChunkIterations, regionCallback);
+
+    if(!bOrigin)
+        flagOutside();
 }
 
 void Optimizer::FullInertialBA(boost::interprocess::offset_ptr<Map> pMap, int its, const bool bFixLocal, const long unsigned int nLoopId, bool *pbStopFlag, bool bInit, float priorG, float priorA, Eigen::VectorXd *vSingVal, bool *bHess)
@@ -823,8 +964,7 @@ void Optimizer::FullInertialBA(boost::interprocess::offset_ptr<Map> pMap, int it
         }
         else
         {
-            pMP->mPosGBA.create(3,1,CV_32F);
-            Converter::toCvMat(vPoint->estimate()).copyTo(pMP->mPosGBA);
+            pMP->mPosGBA = Converter::toCvMat(vPoint->estimate());
             pMP->mnBAGlobalForKF = nLoopId;
         }
 
@@ -1637,7 +1777,7 @@ void Optimizer::LocalBundleAdjustment(boost::interprocess::offset_ptr<KeyFrame>
     pCurrentMap->IncreaseChangeIndex();
 }
 
-void Optimizer::LocalBundleAdjustment(boost::interprocess::offset_ptr<KeyFrame> pKF, bool* pbStopFlag, boost::interprocess::offset_ptr<Map>  pMap, int& num_fixedKF, int& num_OptKF, int& num_MPs, int& num_edges)
+void Optimizer::LocalBundleAdjustment(boost::interprocess::offset_ptr<KeyFrame> pKF, bool* pbStopFlag, boost::interprocess::offset_ptr<Map>  pMap, int& num_fixedKF, int& num_OptKF, int& num_MPs, int& num_edges, int nThreads)
 {    
     //Aditya... fix the KF to be able to read the matrices.
     //pKF->FixMatrices(pKF);
@@ -1763,6 +1903,13 @@ void Optimizer::LocalBundleAdjustment(boost::interprocess::offset_ptr<KeyFrame>
         return;
     }
 
+    if(sbUseBundleAdjuster)
+    {
+        num_OptKF = lLocalKeyFrames.size();
+        LocalBundleAdjustmentSchur(pKF, pbStopFlag, pMap, lLocalKeyFrames, lFixedCameras, lLocalMapPoints, num_edges);
+        return;
+    }
+
     // Setup optimizer
     g2o::SparseOptimizer optimizer;
     g2o::BlockSolver_6_3::LinearSolverType * linearSolver;
@@ -1777,6 +1924,7 @@ void Optimizer::LocalBundleAdjustment(boost::interprocess::offset_ptr<KeyFrame>
 
     optimizer.setAlgorithm(solver);
     optimizer.setVerbose(false);
+    optimizer.setNumThreads(nThreads);
 
     if(pbStopFlag)
         optimizer.setForceStopFlag(pbStopFlag);
@@ -2158,10 +2306,124 @@ list_of_available_ids.reserve(500);
 }
 
 
+void Optimizer::LocalBundleAdjustmentSchur(boost::interprocess::offset_ptr<KeyFrame> pKF, bool* pbStopFlag, boost::interprocess::offset_ptr<Map>  pMap,
+                                           const list<boost::interprocess::offset_ptr<KeyFrame> > &lLocalKeyFrames,
+                                           const list<boost::interprocess::offset_ptr<KeyFrame> > &lFixedCameras,
+                                           const list<boost::interprocess::offset_ptr<MapPoint> > &lLocalMapPoints, int& num_edges)
+{
+    boost::interprocess::offset_ptr<Map>  pCurrentMap = pKF->GetMap();
+
+    BundleAdjuster adjuster;
+    if (pMap->IsInertial())
+        adjuster.SetInitialLambda(100.0);
+
+    // Set Local and Fixed KeyFrame variables
+    vector<boost::interprocess::offset_ptr<KeyFrame> > vpKFs;
+    map<boost::interprocess::offset_ptr<KeyFrame> ,int> mKFIndex;
+    for(list<boost::interprocess::offset_ptr<KeyFrame> >::const_iterator lit=lLocalKeyFrames.begin(), lend=lLocalKeyFrames.end(); lit!=lend; lit++)
+    {
+        boost::interprocess::offset_ptr<KeyFrame>  pKFi = *lit;
+        mKFIndex[pKFi] = adjuster.AddKeyFrame(Converter::toSE3Quat(pKFi->GetPose()), pKFi->mnId==pMap->GetInitKFid());
+        vpKFs.push_back(pKFi);
+    }
+    for(list<boost::interprocess::offset_ptr<KeyFrame> >::const_iterator lit=lFixedCameras.begin(), lend=lFixedCameras.end(); lit!=lend; lit++)
+    {
+        boost::interprocess::offset_ptr<KeyFrame>  pKFi = *lit;
+        if(!pKFi || mKFIndex.count(pKFi))
+            continue;
+        mKFIndex[pKFi] = adjuster.AddKeyFrame(Converter::toSE3Quat(pKFi->GetPose()), true);
+        vpKFs.push_back(pKFi);
+    }
+
+    const float thHuberMono = sqrt(5.991);
+    const float thHuberStereo = sqrt(7.815);
+
+    // Set MapPoint variables and observations
+    vector<boost::interprocess::offset_ptr<MapPoint> > vpMPs(lLocalMapPoints.begin(), lLocalMapPoints.end());
+    for(size_t i=0; i<vpMPs.size(); i++)
+    {
+        boost::interprocess::offset_ptr<MapPoint>  pMP = vpMPs[i];
+        const int nMP = adjuster.AddMapPoint(Converter::toVector3d(pMP->GetWorldPos()));
+
+        const map<boost::interprocess::offset_ptr<KeyFrame> ,tuple<int,int>> observations = pMP->GetObservations();
+        for(map<boost::interprocess::offset_ptr<KeyFrame> ,tuple<int,int>>::const_iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
+        {
+            boost::interprocess::offset_ptr<KeyFrame>  pKFi = mit->first;
+            map<boost::interprocess::offset_ptr<KeyFrame> ,int>::const_iterator kit = mKFIndex.find(pKFi);
+            if(pKFi->isBad() || pKFi->GetMap() != pCurrentMap || kit==mKFIndex.end())
+                continue;
+            AddBundleAdjusterObservations(adjuster, pKFi, kit->second, nMP, mit->second, thHuberMono, thHuberStereo, true);
+        }
+    }
+
+    num_edges = adjuster.NumObservations();
+
+    if(pbStopFlag)
+        if(*pbStopFlag)
+            return;
+
+    if(!sstrExportDir.empty())
+        adjuster.Save(sstrExportDir + "/lba_" + to_string(pKF->mnId) + ".txt");
+
+    adjuster.Optimize(5, pbStopFlag);
+
+    bool bDoMore= true;
+
+    if(pbStopFlag)
+        if(*pbStopFlag)
+            bDoMore = false;
+
+    // Optimize again
+    if(bDoMore)
+        adjuster.Optimize(10, pbStopFlag);
+
+    vector<pair<boost::interprocess::offset_ptr<KeyFrame> ,boost::interprocess::offset_ptr<MapPoint> > > vToErase;
+    vToErase.reserve(adjuster.NumObservations());
+
+    // Check inlier observations
+    for(int i=0, iend=adjuster.NumObservations(); i<iend; i++)
+    {
+        const BundleAdjuster::Observation obs = adjuster.GetObservation(i);
+        boost::interprocess::offset_ptr<MapPoint>  pMP = vpMPs[obs.nMP];
+
+        if(pMP->isBad())
+            continue;
+
+        if(adjuster.GetChi2(i)>(obs.nDim==3 ? 7.815 : 5.991) || !adjuster.IsDepthPositive(i))
+            vToErase.push_back(make_pair(vpKFs[obs.nKF],pMP));
+    }
+
+    // Get Map Mutex
+    std::unique_lock<mutex> lock(pMap->mMutexMapUpdate);
+
+    for(size_t i=0;i<vToErase.size();i++)
+    {
+        boost::interprocess::offset_ptr<KeyFrame>  pKFi = vToErase[i].first;
+        boost::interprocess::offset_ptr<MapPoint>  pMPi = vToErase[i].second;
+        pKFi->EraseMapPointMatch(pMPi);
+        pMPi->EraseObservation(pKFi);
+    }
+
+    // Recover optimized data
+    //Keyframes
+    for(size_t i=0; i<lLocalKeyFrames.size(); i++)
+        vpKFs[i]->SetPose(Converter::toCvMat(adjuster.GetPose(i)));
+
+    //Points
+    for(size_t i=0; i<vpMPs.size(); i++)
+    {
+        vpMPs[i]->SetWorldPos(Converter::toCvMat(adjuster.GetMapPoint(i)));
+        vpMPs[i]->UpdateNormalAndDepth();
+    }
+
+    pMap->IncreaseChangeIndex();
+}
+
 void Optimizer::OptimizeEssentialGraph(boost::interprocess::offset_ptr<Map>  pMap, boost::interprocess::offset_ptr<KeyFrame>  pLoopKF, boost::interprocess::offset_ptr<KeyFrame>  pCurKF,
                                        const LoopClosing::KeyFrameAndPose &NonCorrectedSim3,
                                        const LoopClosing::KeyFrameAndPose &CorrectedSim3,
-                                       const map<boost::interprocess::offset_ptr<KeyFrame> , set<boost::interprocess::offset_ptr<KeyFrame> > > &LoopConnections, const bool &bFixScale)
+                                       const map<boost::interprocess::offset_ptr<KeyFrame> , set<boost::interprocess::offset_ptr<KeyFrame> > > &LoopConnections, const bool &bFixScale,
+                                       ThreadPool* pThreadPool)
 {   
     // Setup optimizer
     g2o::SparseOptimizer optimizer;
@@ -2409,7 +2671,7 @@ void Optimizer::OptimizeEssentialGraph(boost::interprocess::offset_ptr<Map>  pMa
     std::unique_lock<mutex> lock(pMap->mMutexMapUpdate);
 
     // SE3 Pose Recovering. Sim3:[sR t;0 1] -> SE3:[R t/s;0 1]
-    for(size_t i=0;i<vpKFs.size();i++)
+    ParallelFor(pThreadPool, 0, vpKFs.size(), [&](int i)
     {
         boost::interprocess::offset_ptr<KeyFrame>  pKFi = vpKFs[i];
 
@@ -2428,15 +2690,15 @@ void Optimizer::OptimizeEssentialGraph(boost::interprocess::offset_ptr<Map>  pMa
 
         pKFi->SetPose(Tiw);
 
-    }
+    });
 
     // Correct points. Transform to "non-optimized" reference keyframe pose and transform back with optimized pose
-    for(size_t i=0, iend=vpMPs.size(); i<iend; i++)
+    ParallelFor(pThreadPool, 0, vpMPs.size(), [&](int i)
     {
         boost::interprocess::offset_ptr<MapPoint>  pMP = vpMPs[i];
 
         if(pMP->isBad())
-            continue;
+            return;
 
         int nIDr;
         if(pMP->mnCorrectedByKF==pCurKF->mnId)
@@ -2461,7 +2723,7 @@ void Optimizer::OptimizeEssentialGraph(boost::interprocess::offset_ptr<Map>  pMa
         pMP->SetWorldPos(cvCorrectedP3Dw);
 
         pMP->UpdateNormalAndDepth();
-    }
+    });
 
     pMap->IncreaseChangeIndex();
 }
@@ -2745,8 +3007,8 @@ void Optimizer::OptimizeEssentialGraph6DoF(boost::interprocess::offset_ptr<KeyFr
         //Aditya-edited
         //pKFi->mTcwBefMerge = pKFi->GetPose();
         //pKFi->mTwcBefMerge = pKFi->GetPoseInverse();
-        pKFi->GetPose().copyTo(pKFi->mTcwBefMerge);
-        pKFi->GetPoseInverse().copyTo(pKFi->mTwcBefMerge);
+        pKFi->mTcwBefMerge = pKFi->GetPose();
+        pKFi->mTwcBefMerge = pKFi->GetPoseInverse();
         pKFi->SetPose(Tiw);
     }
 
@@ -3028,8 +3290,8 @@ void Optimizer::OptimizeEssentialGraph(boost::interprocess::offset_ptr<KeyFrame>
 
         //pKFi->mTcwBefMerge = pKFi->GetPose();
         //pKFi->mTwcBefMerge = pKFi->GetPoseInverse();
-        pKFi->GetPose().copyTo(pKFi->mTcwBefMerge);
-        pKFi->GetPoseInverse().copyTo(pKFi->mTwcBefMerge);
+        pKFi->mTcwBefMerge = pKFi->GetPose();
+        pKFi->mTwcBefMerge = pKFi->GetPoseInverse();
         
         pKFi->SetPose(Tiw);
     }
@@ -4019,7 +4281,7 @@ int Optimizer::OptimizeSim3(boost::interprocess::offset_ptr<KeyFrame> pKF1, boos
 }
 
 
-void Optimizer::LocalInertialBA(boost::interprocess::offset_ptr<KeyFrame> pKF, bool *pbStopFlag, boost::interprocess::offset_ptr<Map> pMap, int& num_fixedKF, int& num_OptKF, int& num_MPs, int& num_edges, bool bLarge, bool bRecInit)
+void Optimizer::LocalInertialBA(boost::interprocess::offset_ptr<KeyFrame> pKF, bool *pbStopFlag, boost::interprocess::offset_ptr<Map> pMap, int& num_fixedKF, int& num_OptKF, int& num_MPs, int& num_edges, bool bLarge, bool bRecInit, int nThreads)
 {
     boost::interprocess::offset_ptr<Map>  pCurrentMap = pKF->GetMap();
 
@@ -4161,6 +4423,7 @@ void Optimizer::LocalInertialBA(boost::interprocess::offset_ptr<KeyFrame> pKF, b
         solver->setUserLambdaInit(1e0);
         optimizer.setAlgorithm(solver);
     }
+    optimizer.setNumThreads(nThreads);
 
 
     // Set Local temporal KeyFrame vertices
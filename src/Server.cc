@@ -1,124 +1,265 @@
 #include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
 
-#include <boost/asio/read_until.hpp>
-#include <boost/filesystem.hpp>
+#include <boost/asio/read.hpp>
 #include <boost/log/trivial.hpp>
 
 #include "Server.h"
 
+using namespace ORB_SLAM3;
 
-Session::Session(TcpSocket t_socket)
-    : m_socket(std::move(t_socket))
+
+Session::Session(TcpSocket t_socket, MapSegment::Settings const& t_segmentSettings)
+    : m_socket(std::move(t_socket)),
+    m_segmentSettings(t_segmentSettings),
+    m_nextSequence(0),
+    m_batchEnd(0),
+    m_clientId(-1),
+    m_replicaSize(0)
 {
 }
 
 
-void Session::doRead()
+void Session::doReadHeader()
 {
     auto self = shared_from_this();
-    async_read_until(m_socket, m_requestBuf_, "\n\n",
-        [this, self](boost::system::error_code ec, size_t bytes)
+    boost::asio::async_read(m_socket, boost::asio::buffer(&m_header, sizeof(m_header)),
+        [this, self](boost::system::error_code ec, size_t)
         {
             if (!ec)
-                processRead(bytes);
+                processHeader();
             else
                 handleError(__FUNCTION__, ec);
         });
 }
 
 
-void Session::processRead(size_t t_bytesTransferred)
+void Session::processHeader()
 {
-    BOOST_LOG_TRIVIAL(trace) << __FUNCTION__ << "(" << t_bytesTransferred << ")" 
-        << ", in_avail = " << m_requestBuf_.in_avail() << ", size = " 
-        << m_requestBuf_.size() << ", max_size = " << m_requestBuf_.max_size() << ".";
-
-    std::istream requestStream(&m_requestBuf_);
-    readData(requestStream);
+    if (m_header.magic != Replication::MAGIC || m_header.version != Replication::VERSION) {
+        handleProtocolError("not a replication frame");
+        return;
+    }
+    if (m_header.sequence != m_nextSequence++) {
+        handleProtocolError("frame " + std::to_string(m_header.sequence) + " out of sequence");
+        return;
+    }
+    if (m_header.payloadBytes > Replication::MAX_PAYLOAD) {
+        handleProtocolError("payload of " + std::to_string(m_header.payloadBytes) + " bytes");
+        return;
+    }
+    if (m_header.type != Replication::HELLO && (m_replicaName.empty() || m_header.clientId != m_clientId)) {
+        handleProtocolError("frame before HELLO");
+        return;
+    }
 
-    auto pos = m_fileName.find_last_of('\\');
-    if (pos != std::string::npos)
-        m_fileName = m_fileName.substr(pos + 1);
+    m_payload.resize(m_header.payloadBytes);
+    if (m_payload.empty()) {
+        processFrame();
+        return;
+    }
 
-    createFile();
+    doReadPayload();
+}
 
-    // write extra bytes to file
-    do {
-        requestStream.read(m_buf.data(), m_buf.size());
-        BOOST_LOG_TRIVIAL(trace) << __FUNCTION__ << " write " << requestStream.gcount() << " bytes.";
-        m_outputFile.write(m_buf.data(), requestStream.gcount());
-    } while (requestStream.gcount() > 0);
 
+void Session::doReadPayload()
+{
     auto self = shared_from_this();
-    m_socket.async_read_some(boost::asio::buffer(m_buf.data(), m_buf.size()),
-        [this, self](boost::system::error_code ec, size_t bytes)
+    boost::asio::async_read(m_socket, boost::asio::buffer(m_payload.data(), m_payload.size()),
+        [this, self](boost::system::error_code ec, size_t)
         {
             if (!ec)
-                doReadFileContent(bytes);
+                processFrame();
             else
                 handleError(__FUNCTION__, ec);
         });
 }
 
 
-void Session::readData(std::istream &stream)
+void Session::processFrame()
 {
-    stream >> m_fileName;
-    stream >> m_fileSize;
-    stream.read(m_buf.data(), 2);
+    switch (m_header.type) {
+    case Replication::HELLO:
+    {
+        Replication::SegmentInfo info;
+        if (m_payload.size() != sizeof(info)) {
+            handleProtocolError("HELLO without segment info");
+            return;
+        }
+        memcpy(&info, m_payload.data(), sizeof(info));
+        m_clientId = m_header.clientId;
+        if (!startReplica(info))
+            return;
+        break;
+    }
+    case Replication::PAGES:
+        // Written so that no sum of values from the frame can wrap around
+        if (m_header.offset % Replication::PAGE_SIZE != 0 || m_header.offset > m_segmentSettings.maxSize
+            || m_payload.size() > m_segmentSettings.maxSize - m_header.offset) {
+            handleProtocolError("pages outside of the segment");
+            return;
+        }
+        // A batch sends every page once, in increasing order, so it never holds more than the segment
+        if (m_header.offset < m_batchEnd) {
+            handleProtocolError("pages out of order");
+            return;
+        }
+        m_batchEnd = m_header.offset + m_payload.size();
+        m_batchRuns.emplace_back(m_header.offset, m_payload.size());
+        m_batchData.insert(m_batchData.end(), m_payload.begin(), m_payload.end());
+        break;
+    case Replication::COMMIT:
+        if (!applyBatch(m_header.offset))
+            return;
+        break;
+    default:
+        handleProtocolError("unknown frame type " + std::to_string(m_header.type));
+        return;
+    }
 
-    BOOST_LOG_TRIVIAL(trace) << m_fileName << " size is " << m_fileSize
-        << ", tellg = " << stream.tellg();
+    doReadHeader();
 }
 
 
-void Session::createFile()
+bool Session::startReplica(Replication::SegmentInfo const& t_info)
 {
-    m_outputFile.open(m_fileName, std::ios_base::binary);
-    if (!m_outputFile) {
-        BOOST_LOG_TRIVIAL(error) << __LINE__ << ": Failed to create: " << m_fileName;
-        return;
+    if (m_clientId < 0) {
+        handleProtocolError("client id " + std::to_string(m_clientId));
+        return false;
     }
+
+    // Pointers in the pages are only valid at the address the client maps its segment
+    MapSegment::Settings clientSettings = m_segmentSettings.ForClient(m_clientId);
+    if (t_info.baseAddress != reinterpret_cast<uint64_t>(clientSettings.baseAddress)
+        || t_info.maxSize != clientSettings.maxSize || t_info.pageSize != Replication::PAGE_SIZE) {
+        handleProtocolError("client " + std::to_string(m_clientId) + " uses other SharedMemory settings");
+        return false;
+    }
+
+    // The replica is opened by the first COMMIT, so it is never created empty. A replica left by a previous
+    // connection is kept: the merge server may have it mapped already.
+    boost::interprocess::mapped_region().swap(m_replicaRegion);
+    boost::interprocess::shared_memory_object().swap(m_replicaShm);
+    m_replicaName = clientSettings.name;
+    m_replicaSize = 0;
+
+    m_batchData.clear();
+    m_batchRuns.clear();
+    m_batchEnd = 0;
+
+    std::cout << "Replicating the segment of client " << m_clientId << " into \"" << m_replicaName << "\"" << std::endl;
+    return true;
 }
 
 
-void Session::doReadFileContent(size_t t_bytesTransferred)
+bool Session::resizeReplica(uint64_t t_size)
 {
-    if (t_bytesTransferred > 0) {
-        m_outputFile.write(m_buf.data(), static_cast<std::streamsize>(t_bytesTransferred));
+    if (t_size > m_segmentSettings.maxSize) {
+        handleProtocolError("segment of " + std::to_string(t_size) + " bytes");
+        return false;
+    }
+    // Segments never shrink
+    if (t_size <= m_replicaSize)
+        return true;
+
+    try {
+        if (m_replicaSize == 0) {
+            boost::interprocess::shared_memory_object shm(boost::interprocess::open_or_create, m_replicaName.c_str(),
+                                                          boost::interprocess::read_write);
+            m_replicaShm.swap(shm);
+
+            // The pages a new connection does not send are zeros in the client. Those of a previous connection
+            // are dropped without truncating the object, which would fault the processes that map it.
+            boost::interprocess::offset_t previousSize = 0;
+            m_replicaShm.get_size(previousSize);
+            if (previousSize > 0 && fallocate(m_replicaShm.get_mapping_handle().handle,
+                                              FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 0, previousSize) != 0) {
+                BOOST_LOG_TRIVIAL(error) << "Failed to clear replica " << m_replicaName << ": " << strerror(errno);
+                return false;
+            }
+            if (static_cast<uint64_t>(previousSize) > t_size)
+                t_size = previousSize;
+        }
+        m_replicaShm.truncate(t_size);
+        boost::interprocess::mapped_region region(m_replicaShm, boost::interprocess::read_write, 0, t_size);
+        m_replicaRegion.swap(region);
+    }
+    catch (boost::interprocess::interprocess_exception& ex) {
+        BOOST_LOG_TRIVIAL(error) << "Failed to resize replica " << m_replicaName << ": " << ex.what();
+        return false;
+    }
 
-        BOOST_LOG_TRIVIAL(trace) << __FUNCTION__ << " recv " << m_outputFile.tellp() << " bytes";
+    m_replicaSize = t_size;
+    return true;
+}
 
-        if (m_outputFile.tellp() >= static_cast<std::streamsize>(m_fileSize)) {
-            std::cout << "Received file: " << m_fileName << std::endl;
-            return;
+
+bool Session::applyBatch(uint64_t t_size)
+{
+    // Readers of the replica never see part of a batch
+    std::unique_ptr<Replication::ReplicaLock> lock;
+    try {
+        lock.reset(new Replication::ReplicaLock(m_replicaName));
+    }
+    catch (boost::interprocess::interprocess_exception& ex) {
+        BOOST_LOG_TRIVIAL(error) << "Failed to lock replica " << m_replicaName << ": " << ex.what();
+        return false;
+    }
+
+    if (!resizeReplica(t_size))
+        return false;
+
+    char* replica = static_cast<char*>(m_replicaRegion.get_address());
+    size_t pos = 0;
+    for (auto const& run : m_batchRuns) {
+        if (run.first > m_replicaSize || run.second > m_replicaSize - run.first) {
+            handleProtocolError("pages past the end of the segment");
+            return false;
         }
+        memcpy(replica + run.first, m_batchData.data() + pos, run.second);
+        pos += run.second;
     }
-    auto self = shared_from_this();
-    m_socket.async_read_some(boost::asio::buffer(m_buf.data(), m_buf.size()),
-        [this, self](boost::system::error_code ec, size_t bytes)
-        {
-            doReadFileContent(bytes);
-        });
+
+    BOOST_LOG_TRIVIAL(trace) << __FUNCTION__ << " client " << m_clientId << ": " << pos / Replication::PAGE_SIZE
+        << " pages, segment of " << m_replicaSize << " bytes.";
+
+    m_batchData.clear();
+    m_batchRuns.clear();
+    m_batchEnd = 0;
+    return true;
 }
 
 
 void Session::handleError(std::string const& t_functionName, boost::system::error_code const& t_ec)
 {
+    if (t_ec == boost::asio::error::eof) {
+        std::cout << "Client " << m_clientId << " disconnected" << std::endl;
+        return;
+    }
     BOOST_LOG_TRIVIAL(error) << __FUNCTION__ << " in " << t_functionName << " due to " 
         << t_ec << " " << t_ec.message() << std::endl;
 }
 
 
-Server::Server(IoService& t_ioService, short t_port, std::string const& t_workDirectory)
+void Session::handleProtocolError(std::string const& t_message)
+{
+    // Nothing more is read, the session ends with the socket
+    BOOST_LOG_TRIVIAL(error) << "Replication from client " << m_clientId << " stopped: " << t_message;
+    boost::system::error_code ec;
+    m_socket.close(ec);
+}
+
+
+Server::Server(IoService& t_ioService, short t_port, MapSegment::Settings const& t_segmentSettings)
     : m_socket(t_ioService),
     m_acceptor(t_ioService, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), t_port)),
-    m_workDirectory(t_workDirectory)
+    m_segmentSettings(t_segmentSettings)
 {
     std::cout << "Server started\n";
 
-    createWorkDirectory();
-
     doAccept();
 }
 
@@ -129,18 +270,8 @@ void Server::doAccept()
         [this](boost::system::error_code ec)
     {
         if (!ec)
-            std::make_shared<Session>(std::move(m_socket))->start();
+            std::make_shared<Session>(std::move(m_socket), m_segmentSettings)->start();
 
         doAccept();
     });
 }
-
-
-void Server::createWorkDirectory()
-{
-    using namespace boost::filesystem;
-    auto currentPath = path(m_workDirectory);
-    if (!exists(currentPath) && !create_directory(currentPath))
-        BOOST_LOG_TRIVIAL(error) << "Coudn't create working directory: " << m_workDirectory;
-    current_path(currentPath);
-}
\ No newline at end of file
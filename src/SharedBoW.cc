@@ -0,0 +1,77 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2020 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SharedBoW.h"
+#include "MapSegment.h"
+
+#include <new>
+
+namespace ORB_SLAM3
+{
+
+void SharedBowVector::Assign(const DBoW2::BowVector &v, uint64_t fingerprint)
+{
+    Entry* pEntries = NULL;
+    if(!v.empty())
+    {
+        pEntries = reinterpret_cast<Entry*>(map_segment.Allocate(v.size()*sizeof(Entry), alignof(Entry)).get());
+        Entry* pEntry = pEntries;
+        for(DBoW2::BowVector::const_iterator it=v.begin(), itend=v.end(); it!=itend; it++, pEntry++)
+        {
+            pEntry->first = it->first;
+            pEntry->second = it->second;
+        }
+    }
+
+    mpEntries = pEntries;
+    mnSize = v.size();
+    mnFingerprint = fingerprint;
+}
+
+void SharedFeatureVector::Assign(const DBoW2::FeatureVector &fv, uint64_t fingerprint)
+{
+    Entry* pEntries = NULL;
+    if(!fv.empty())
+    {
+        size_t nIndices = 0;
+        for(DBoW2::FeatureVector::const_iterator it=fv.begin(), itend=fv.end(); it!=itend; it++)
+            nIndices += it->second.size();
+
+        unsigned int* pIndices = NULL;
+        if(nIndices > 0)
+            pIndices = reinterpret_cast<unsigned int*>(map_segment.Allocate(nIndices*sizeof(unsigned int), alignof(unsigned int)).get());
+        pEntries = reinterpret_cast<Entry*>(map_segment.Allocate(fv.size()*sizeof(Entry), alignof(Entry)).get());
+
+        // The entries hold offset pointers, so they are constructed where they live
+        Entry* pEntry = pEntries;
+        for(DBoW2::FeatureVector::const_iterator it=fv.begin(), itend=fv.end(); it!=itend; it++, pEntry++)
+        {
+            std::copy(it->second.begin(), it->second.end(), pIndices);
+            new(pEntry) Entry();
+            pEntry->first = it->first;
+            pEntry->second = Indices(pIndices, it->second.size());
+            pIndices += it->second.size();
+        }
+    }
+
+    mpEntries = pEntries;
+    mnSize = fv.size();
+    mnFingerprint = fingerprint;
+}
+
+} //namespace ORB_SLAM3
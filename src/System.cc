@@ -20,6 +20,11 @@
 
 #include "System.h"
 #include "Converter.h"
+#include "HammingDistance.h"
+#include "TrackingFrontEnd.h"
+#include "Optimizer.h"
+#include "MapReplication.h"
+#include "Server.h"
 #include <thread>
 #include <pangolin/pangolin.h>
 #include <iomanip>
@@ -38,16 +43,10 @@ namespace ORB_SLAM3
 {
    
     //Shared memory variables
-    boost::interprocess::managed_shared_memory segment(boost::interprocess::open_or_create, "MySharedMemory",10737418240,(void*)0x30000000);
+    //The map segment is no longer mapped at static-init time. System::System opens ORB_SLAM3::map_segment
+    //with the SharedMemory.* entries of the settings file (see MapSegment.h).
     //boost::interprocess::fixed_managed_shared_memory segment(boost::interprocess::open_only, "MySharedMemory",(void*)0x300000000);
-    // TODO: Uncomment this part -- 1 line below
-    // boost::interprocess::managed_shared_memory segment(boost::interprocess::open_only, "MySharedMemory");//,(void*)0x30000000);
     //boost::interprocess::mapped_region region(segment, boost::interprocess::read_write);
-    
-    //Create an allocator that allocates ints from the managed segment
-    //boost::interprocess::allocator<char, boost::interprocess::fixed_managed_shared_memory::segment_manager> allocator_instance(segment.get_segment_manager());
-    // TODO: Uncomment this part -- one line below
-    boost::interprocess::allocator<char, boost::interprocess::managed_shared_memory::segment_manager> allocator_instance(segment.get_segment_manager());
 
     //cout<<"Installing Shared memory "<<endl;
 
@@ -57,8 +56,12 @@ Verbose::eLevel Verbose::th = Verbose::VERBOSITY_DEBUG;
 
 System::System(const string &strVocFile, const string &strSettingsFile, const eSensor sensor,
                const bool bUseViewer, const int initFr, const string &strSequence, const string &strLoadingFile):
-    mSensor(sensor), mpViewer(static_cast<Viewer*>(NULL)), mbReset(false), mbResetActiveMap(false),
-    mbActivateLocalizationMode(false), mbDeactivateLocalizationMode(false)//,segment(boost::interprocess::open_or_create, "MySharedMemory",10737418240)
+    mSensor(sensor), mpViewer(static_cast<Viewer*>(NULL)), mpFrontEnd(static_cast<TrackingFrontEnd*>(NULL)),
+    mnFrontEndQueueSize(2), mbReset(false), mbResetActiveMap(false),
+    mbActivateLocalizationMode(false), mbDeactivateLocalizationMode(false), mbReplayMode(false),
+    mpReplicator(static_cast<MapReplicator*>(NULL)), mptReplicator(static_cast<std::thread*>(NULL)),
+    mpReplicationIo(static_cast<boost::asio::io_context*>(NULL)), mpReplicationServer(static_cast<Server*>(NULL)),
+    mptReplicationServer(static_cast<std::thread*>(NULL))//,segment(boost::interprocess::open_or_create, "MySharedMemory",10737418240)
 {
     // Output welcome message
     cout << endl <<
@@ -68,14 +71,34 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
     "This is free software, and you are welcome to redistribute it" << endl <<
     "under certain conditions. See LICENSE.txt." << endl << endl;
 
-    if (!segment.check_sanity()) {
-        std::cerr << "Shared memory check failed";
+    //Check settings file
+    cv::FileStorage fsSettings(strSettingsFile.c_str(), cv::FileStorage::READ);
+    if(!fsSettings.isOpened())
+    {
+       cerr << "Failed to open settings file at: " << strSettingsFile << endl;
+       exit(-1);
+    }
 
+    //Map the shared memory segment that holds the Atlas
+    MapSegment::Settings segmentSettings = MapSegment::ReadSettings(fsSettings);
+    const bool bOwnSegment = segmentSettings.bMergeServer || segmentSettings.clientId >= 0;
+    if(segmentSettings.bMergeServer)
+        segmentSettings = segmentSettings.ForServer();
+    else if(segmentSettings.clientId >= 0)
+        segmentSettings = segmentSettings.ForClient(segmentSettings.clientId);
+
+    // A client (or the merge server) is the only writer of its segment, drop what a previous run left
+    if(bOwnSegment)
+        boost::interprocess::shared_memory_object::remove(segmentSettings.name.c_str());
+
+    if(!map_segment.Open(segmentSettings))
+    {
         throw std::runtime_error("Shared memory check failed");
     }
     
     cout << "Input sensor was set to: ";
-    boost::interprocess::shared_memory_object::remove("MySharedMemory");
+    if(!bOwnSegment)
+        boost::interprocess::shared_memory_object::remove(segmentSettings.name.c_str());
     if(mSensor==MONOCULAR)
         cout << "Monocular" << endl;
     else if(mSensor==STEREO)
@@ -87,22 +110,21 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
     else if(mSensor==IMU_STEREO)
         cout << "Stereo-Inertial" << endl;
 
-    //Check settings file
-    cv::FileStorage fsSettings(strSettingsFile.c_str(), cv::FileStorage::READ);
-    if(!fsSettings.isOpened())
-    {
-       cerr << "Failed to open settings file at: " << strSettingsFile << endl;
-       exit(-1);
-    }
+    cout << "Hamming distance kernel: " << HammingDistance::GetKernelName(HammingDistance::GetKernel()) << endl;
 
     bool loadedAtlas = false;
 
     //----
     //Load ORB Vocabulary
-    cout << endl << "Loading ORB Vocabulary. This could take a while..." << endl;
+    // A binary vocabulary (.bin, see Examples/Vocabulary/bin_vocabulary) is mapped instead of parsed
+    const bool bBinaryVoc = strVocFile.size() > 4 && strVocFile.compare(strVocFile.size()-4, 4, ".bin") == 0;
+    if(bBinaryVoc)
+        cout << endl << "Loading ORB Vocabulary..." << endl;
+    else
+        cout << endl << "Loading ORB Vocabulary. This could take a while..." << endl;
 
     mpVocabulary = new ORBVocabulary();
-    bool bVocLoad = mpVocabulary->loadFromTextFile(strVocFile);
+    bool bVocLoad = bBinaryVoc ? mpVocabulary->loadFromBinaryFile(strVocFile) : mpVocabulary->loadFromTextFile(strVocFile);
     if(!bVocLoad)
     {
         cerr << "Wrong path to vocabulary. " << endl;
@@ -131,8 +153,14 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
     if(ret.first == 0)
     {
         int newnum = 2;
+        // With one segment per client the process number comes from the client id:
+        // the merge server is 2 and client i is 3+i once incremented below
+        if(segmentSettings.bMergeServer)
+            newnum = 1;
+        else if(segmentSettings.clientId >= 0)
+            newnum = 2 + segmentSettings.clientId;
         std::cout<<"First pointer is 0; First process"<<std::endl;
-        magic_num = ORB_SLAM3::segment.construct<int>("magic-num")(newnum);
+        magic_num = ORB_SLAM3::map_segment.FindOrConstruct<int>("magic-num", newnum);
         *magic_num = newnum;
         std::cout<<"Made the magic-num memory. Value: "<<*magic_num<<std::endl;
         
@@ -155,19 +183,11 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
     //Create the Atlas
     //mpAtlas = new Atlas(0);
 
-    char atlasname[7];
-    char otherAtlasname[7];
+    // The process number grows with the client id, so it can take any number of digits
+    char atlasname[16];
+    char otherAtlasname[16];
 
-    atlasname[0] = 'a';
-    atlasname[1] = 't';
-    atlasname[2] = 'l';
-    atlasname[3] = 'a';
-    atlasname[4] = 's';
-    atlasname[6] = '\0';
-
-    memcpy(otherAtlasname,atlasname,sizeof(atlasname));
-
-    sprintf(&atlasname[5],"%d",*magic_num);
+    snprintf(atlasname,sizeof(atlasname),"atlas%d",*magic_num);
     mpAtlas = (segment.find<Atlas>(atlasname)).first;
 
     //mpAtlas = (segment.find<Atlas>("Atlas")).first;
@@ -176,11 +196,11 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
     if(0 == mpAtlas){
         std::cout<<"Atlas did not exist"<<std::endl;
         //mpAtlas = segment.construct<Atlas>("Atlas")(0);
-        mpAtlas = segment.construct<Atlas>(atlasname)(*magic_num*200);
-        sprintf(&otherAtlasname[5],"%d",(*magic_num)-1);
+        mpAtlas = map_segment.FindOrConstruct<Atlas>(atlasname, *magic_num*200);
+        snprintf(otherAtlasname,sizeof(otherAtlasname),"atlas%d",(*magic_num)-1);
         KeyFrame::nNextId = *magic_num*1000;
         MapPoint::nNextId = *magic_num*100000;
-        Atlas* otherAtlas = (segment.find<Atlas>(otherAtlasname)).first;
+        Atlas* otherAtlas = FindAtlas((*magic_num)-1);
 
         if(otherAtlas!=0){
             //mpAtlas->AddMap(otherAtlas->currentMapPtr);
@@ -195,6 +215,13 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
         std::cout<<"Atlas EXISTED!! Using the same Atlas."<<std::endl;
     }
     mpAtlas->segment = &segment;
+
+    // The merge server maps the segments of all the clients that are already running
+    if(segmentSettings.bMergeServer)
+    {
+        for(int i=0; i<segmentSettings.nClients; i++)
+            OpenClientSegment(i);
+    }
     //mpAtlas->processnum = *magic_num;
     //processnum = *magic_num;
 
@@ -221,6 +248,11 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
 
     offset_tracker = mpTracker;
 
+    // Frames the asynchronous calls extract ahead of the one being tracked
+    cv::FileNode node = fsSettings["FrontEnd.queueSize"];
+    if(!node.empty() && node.isInt())
+        mnFrontEndQueueSize = std::max((int)node,1);
+
     //Initialize the Local Mapping thread and launch
     mpLocalMapper = new LocalMapping(this, mpAtlas, mSensor==MONOCULAR || mSensor==IMU_MONOCULAR, mSensor==IMU_MONOCULAR || mSensor==IMU_STEREO, strSequence);
     mptLocalMapping = new thread(&ORB_SLAM3::LocalMapping::Run,mpLocalMapper);
@@ -233,10 +265,41 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
     else
         mpLocalMapper->mbFarPoints = false;
 
+    node = fsSettings["LocalMapping.nBAThreads"];
+    if(!node.empty() && node.isInt())
+        mpLocalMapper->mnBAThreads = std::max((int)node,1);
+
+    node = fsSettings["Optimizer.bundleAdjuster"];
+    if(!node.empty() && node.isInt())
+    {
+        string strExportDir;
+        cv::FileNode nodeDir = fsSettings["Optimizer.exportDir"];
+        if(!nodeDir.empty() && nodeDir.isString())
+            strExportDir = nodeDir.string();
+        Optimizer::SetBundleAdjuster((int)node!=0, strExportDir);
+    }
+
     //Initialize the Loop Closing thread and launch
     mpLoopCloser = new LoopClosing(mpAtlas, mpKeyFrameDatabase, mpVocabulary, mSensor!=MONOCULAR); // mSensor!=MONOCULAR);
+
+    node = fsSettings["LoopClosing.nThreads"];
+    if(!node.empty() && node.isInt())
+        mpLoopCloser->SetNumThreads((int)node);
+
     mptLoopClosing = new thread(&ORB_SLAM3::LoopClosing::Run, mpLoopCloser);
 
+    node = fsSettings["LoopClosing.incrementalGBALevels"];
+    if(!node.empty() && node.isInt())
+        mpLoopCloser->mnIncrementalGBALevels = std::max((int)node,0);
+
+    node = fsSettings["LoopClosing.gbaChunkIterations"];
+    if(!node.empty() && node.isInt())
+        mpLoopCloser->mnGBAChunkIterations = std::max((int)node,0);
+
+    node = fsSettings["LoopClosing.verificationTimeMs"];
+    if(!node.empty() && node.isInt())
+        mpLoopCloser->mnVerificationTimeMs = std::max((int)node,0);
+
     //Initialize the Viewer thread and launch
     
     if(bUseViewer)
@@ -259,6 +322,28 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
     mpLoopCloser->SetTracker(mpTracker);
     mpLoopCloser->SetLocalMapper(mpLocalMapper);
 
+    //Stream the segment of a client to the merge server, or receive the segments of remote clients
+    node = fsSettings["Replication.server"];
+    if(segmentSettings.clientId >= 0 && !node.empty() && node.isString())
+    {
+        int periodMs = 200;
+        cv::FileNode nodePeriod = fsSettings["Replication.periodMs"];
+        if(!nodePeriod.empty() && nodePeriod.isInt())
+            periodMs = (int)nodePeriod;
+
+        cout << "Replicating the map segment to " << node.string() << " every " << periodMs << " ms" << endl;
+        mpReplicator = new MapReplicator(&map_segment, node.string(), periodMs);
+        mptReplicator = new thread(&ORB_SLAM3::MapReplicator::Run, mpReplicator);
+    }
+
+    node = fsSettings["Replication.port"];
+    if(segmentSettings.bMergeServer && !node.empty() && node.isInt())
+    {
+        mpReplicationIo = new boost::asio::io_context();
+        mpReplicationServer = new Server(*mpReplicationIo, (short)(int)node, segmentSettings);
+        mptReplicationServer = new thread([this]{ mpReplicationIo->run(); });
+    }
+
     // Fix verbosity
     Verbose::SetTh(Verbose::VERBOSITY_NORMAL);
 
@@ -286,46 +371,7 @@ cv::Mat System::TrackStereo(const cv::Mat &imLeft, const cv::Mat &imRight, const
         exit(-1);
     }   
 
-    // Check mode change
-    {
-        std::unique_lock<mutex> lock(mMutexMode);
-        if(mbActivateLocalizationMode)
-        {
-            mpLocalMapper->RequestStop();
-
-            // Wait until Local Mapping has effectively stopped
-            while(!mpLocalMapper->isStopped())
-            {
-                usleep(1000);
-            }
-
-            mpTracker->InformOnlyTracking(true);
-            mbActivateLocalizationMode = false;
-        }
-        if(mbDeactivateLocalizationMode)
-        {
-            mpTracker->InformOnlyTracking(false);
-            mpLocalMapper->Release();
-            mbDeactivateLocalizationMode = false;
-        }
-    }
-
-    // Check reset
-    {
-        std::unique_lock<mutex> lock(mMutexReset);
-        if(mbReset)
-        {
-            mpTracker->Reset();
-            cout << "Reset stereo..." << endl;
-            mbReset = false;
-            mbResetActiveMap = false;
-        }
-        else if(mbResetActiveMap)
-        {
-            mpTracker->ResetActiveMap();
-            mbResetActiveMap = false;
-        }
-    }
+    CheckModeAndReset();
 
     if (mSensor == System::IMU_STEREO)
         for(size_t i_imu = 0; i_imu < vImuMeas.size(); i_imu++)
@@ -337,10 +383,7 @@ cv::Mat System::TrackStereo(const cv::Mat &imLeft, const cv::Mat &imRight, const
 
     cv::Mat Tcw = mpTracker->GrabImageStereo(imLeft,imRight,timestamp,filename);
 
-    
-    mTrackingState = mpTracker->mState;
-    mTrackedMapPoints = mpTracker->mCurrentFrame.mvpMapPoints;
-    mTrackedKeyPointsUn = mpTracker->mCurrentFrame.mvKeysUn;
+    UpdateTrackingState();
 
     return Tcw;
 }
@@ -353,53 +396,12 @@ cv::Mat System::TrackRGBD(const cv::Mat &im, const cv::Mat &depthmap, const doub
         exit(-1);
     }    
 
-    // Check mode change
-    {
-        std::unique_lock<mutex> lock(mMutexMode);
-        if(mbActivateLocalizationMode)
-        {
-            mpLocalMapper->RequestStop();
-
-            // Wait until Local Mapping has effectively stopped
-            while(!mpLocalMapper->isStopped())
-            {
-                usleep(1000);
-            }
-
-            mpTracker->InformOnlyTracking(true);
-            mbActivateLocalizationMode = false;
-        }
-        if(mbDeactivateLocalizationMode)
-        {
-            mpTracker->InformOnlyTracking(false);
-            mpLocalMapper->Release();
-            mbDeactivateLocalizationMode = false;
-        }
-    }
-
-    // Check reset
-    {
-        std::unique_lock<mutex> lock(mMutexReset);
-        if(mbReset)
-        {
-            mpTracker->Reset();
-            mbReset = false;
-            mbResetActiveMap = false;
-        }
-        else if(mbResetActiveMap)
-        {
-            mpTracker->ResetActiveMap();
-            mbResetActiveMap = false;
-        }
-    }
+    CheckModeAndReset();
 
 
     cv::Mat Tcw = mpTracker->GrabImageRGBD(im,depthmap,timestamp,filename);
 
-    std::unique_lock<mutex> lock2(mMutexState);
-    mTrackingState = mpTracker->mState;
-    mTrackedMapPoints = mpTracker->mCurrentFrame.mvpMapPoints;
-    mTrackedKeyPointsUn = mpTracker->mCurrentFrame.mvKeysUn;
+    UpdateTrackingState();
     return Tcw;
 }
 
@@ -411,6 +413,26 @@ cv::Mat System::TrackMonocular(const cv::Mat &im, const double &timestamp, const
         exit(-1);
     }
 
+    CheckModeAndReset();
+
+    if (mSensor == System::IMU_MONOCULAR)
+        for(size_t i_imu = 0; i_imu < vImuMeas.size(); i_imu++)
+            mpTracker->GrabImuData(vImuMeas[i_imu]);
+
+    cv::Mat Tcw = mpTracker->GrabImageMonocular(im,timestamp,filename);
+
+    UpdateTrackingState();
+
+    return Tcw;
+}
+
+
+
+void System::CheckModeAndReset()
+{
+    if(mbReplayMode)
+        WaitForLocalMapping();
+
     // Check mode change
     {
         std::unique_lock<mutex> lock(mMutexMode);
@@ -441,32 +463,84 @@ cv::Mat System::TrackMonocular(const cv::Mat &im, const double &timestamp, const
         if(mbReset)
         {
             mpTracker->Reset();
+            if(mSensor==STEREO || mSensor==IMU_STEREO)
+                cout << "Reset stereo..." << endl;
             mbReset = false;
             mbResetActiveMap = false;
         }
         else if(mbResetActiveMap)
         {
-            cout << "SYSTEM-> Reseting active map in monocular case" << endl;
+            if(mSensor==MONOCULAR || mSensor==IMU_MONOCULAR)
+                cout << "SYSTEM-> Reseting active map in monocular case" << endl;
             mpTracker->ResetActiveMap();
             mbResetActiveMap = false;
         }
     }
+}
 
-    if (mSensor == System::IMU_MONOCULAR)
-        for(size_t i_imu = 0; i_imu < vImuMeas.size(); i_imu++)
-            mpTracker->GrabImuData(vImuMeas[i_imu]);
+void System::WaitForLocalMapping()
+{
+    // Local Mapping does not take keyframes while it is stopped (localization mode, loop correction)
+    while(!mpLocalMapper->isStopped() && !mpLocalMapper->isFinished() &&
+          (mpLocalMapper->KeyframesInQueue()>0 || !mpLocalMapper->AcceptKeyFrames()))
+    {
+        usleep(500);
+    }
+}
 
-    cv::Mat Tcw = mpTracker->GrabImageMonocular(im,timestamp,filename);
+void System::SetReplayMode(bool bReplay)
+{
+    mbReplayMode = bReplay;
+}
 
-    std::unique_lock<mutex> lock2(mMutexState);
+void System::UpdateTrackingState()
+{
+    std::unique_lock<mutex> lock(mMutexState);
     mTrackingState = mpTracker->mState;
     mTrackedMapPoints = mpTracker->mCurrentFrame.mvpMapPoints;
     mTrackedKeyPointsUn = mpTracker->mCurrentFrame.mvKeysUn;
+}
 
-    return Tcw;
+std::future<cv::Mat> System::TrackStereoAsync(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timestamp, const vector<IMU::Point>& vImuMeas, string filename)
+{
+    if(mSensor!=STEREO && mSensor!=IMU_STEREO)
+    {
+        cerr << "ERROR: you called TrackStereoAsync but input sensor was not set to Stereo nor Stereo-Inertial." << endl;
+        exit(-1);
+    }
+
+    return GetFrontEnd()->Submit(imLeft,imRight,timestamp,vImuMeas,filename);
 }
 
+std::future<cv::Mat> System::TrackRGBDAsync(const cv::Mat &im, const cv::Mat &depthmap, const double &timestamp, string filename)
+{
+    if(mSensor!=RGBD)
+    {
+        cerr << "ERROR: you called TrackRGBDAsync but input sensor was not set to RGBD." << endl;
+        exit(-1);
+    }
+
+    return GetFrontEnd()->Submit(im,depthmap,timestamp,vector<IMU::Point>(),filename);
+}
+
+std::future<cv::Mat> System::TrackMonocularAsync(const cv::Mat &im, const double &timestamp, const vector<IMU::Point>& vImuMeas, string filename)
+{
+    if(mSensor!=MONOCULAR && mSensor!=IMU_MONOCULAR)
+    {
+        cerr << "ERROR: you called TrackMonocularAsync but input sensor was not set to Monocular nor Monocular-Inertial." << endl;
+        exit(-1);
+    }
 
+    return GetFrontEnd()->Submit(im,cv::Mat(),timestamp,vImuMeas,filename);
+}
+
+TrackingFrontEnd* System::GetFrontEnd()
+{
+    // Started on the first asynchronous call, the synchronous ones do not need its threads
+    if(!mpFrontEnd)
+        mpFrontEnd = new TrackingFrontEnd(this,mpTracker,mnFrontEndQueueSize);
+    return mpFrontEnd;
+}
 
 void System::ActivateLocalizationMode()
 {
@@ -507,6 +581,13 @@ void System::ResetActiveMap()
 
 void System::Shutdown()
 {
+    // Track the frames still queued
+    if(mpFrontEnd)
+    {
+        delete mpFrontEnd;
+        mpFrontEnd = static_cast<TrackingFrontEnd*>(NULL);
+    }
+
     std::cout<<"Shutting down.... enter a number to continue shutdown\n";
     int aa;
     std::cin>>aa;
@@ -540,6 +621,20 @@ void System::Shutdown()
     if(mpViewer)
         pangolin::BindToContext("ORB-SLAM2: Map Viewer");
 
+    // The last batch sends the map as the threads left it
+    if(mpReplicator)
+    {
+        mpReplicator->RequestFinish();
+        mptReplicator->join();
+    }
+    if(mpReplicationIo)
+    {
+        mpReplicationIo->stop();
+        mptReplicationServer->join();
+    }
+
+    map_segment.PrintUsage();
+
 #ifdef REGISTER_TIMES
     mpTracker->PrintTimeStats();
 #endif
@@ -700,7 +795,6 @@ void System::SaveTrajectoryEuRoC(const string &filename)
 
 
         boost::interprocess::offset_ptr<KeyFrame>  pKF = *lRit;
-        pKF->FixMatrices(pKF);
 
         cv::Mat Trw = cv::Mat::eye(4,4,CV_32F);
 
@@ -825,16 +919,6 @@ void System::SaveTrajectoryKITTI(const string &filename)
     cin>>code;
 
 
-    if(code==2234)
-    {
-        for(int i =0; i<vpKFs.size(); i++){
-            vpKFs.at(i)->FixMatrices(vpKFs.at(i));
-        }
-        std::cout<<"We have fixed the matrices for the keyframes.\n";
-        
-    }
-
-
     // Transform all keyframes so that the first keyframe is at the origin.
     // After a loop closure the first keyframe might not be at the origin.
     cv::Mat Two = vpKFs[0]->GetPoseInverse();
@@ -949,7 +1033,84 @@ void System::InsertTrackTime(double& time)
 #endif
 
 
-void System::PostLoad(){
+Atlas* System::FindAtlas(int num)
+{
+    char atlasname[16];
+    snprintf(atlasname,sizeof(atlasname),"atlas%d",num);
+
+    // With a single segment every process keeps its atlas in it
+    const MapSegment::Settings &settings = map_segment.GetSettings();
+    if(settings.clientId < 0 && !settings.bMergeServer)
+        return segment.find<Atlas>(atlasname).first;
+
+    std::pair<int *,std::size_t> ret = segment.find<int>("magic-num");
+    if(ret.first && *ret.first == num)
+        return segment.find<Atlas>(atlasname).first;
+
+    // Process 3+i is client i
+    MapSegment* pClientSegment = OpenClientSegment(num-3);
+    if(!pClientSegment)
+        return nullptr;
+
+    return pClientSegment->Find<Atlas>(atlasname);
+}
+
+MapSegment* System::OpenClientSegment(int clientId)
+{
+    if(clientId < 0 || clientId == map_segment.GetSettings().clientId)
+        return nullptr;
+
+    std::map<int, MapSegment*>::iterator it = mmpClientSegments.find(clientId);
+    if(it != mmpClientSegments.end())
+        return it->second;
+
+    // The client may not have started yet, we try again on the next lookup. The replication server rewrites the
+    // replica of a remote client in place, so the view stays valid when the client reconnects.
+    MapSegment* pClientSegment = new MapSegment();
+    if(!pClientSegment->OpenReadOnly(map_segment.GetSettings().ForClient(clientId)))
+    {
+        delete pClientSegment;
+        return nullptr;
+    }
+
+    mmpClientSegments[clientId] = pClientSegment;
+    return pClientSegment;
+}
+
+std::unique_ptr<Replication::ReplicaLock> System::LockReplica(int num)
+{
+    std::unique_ptr<Replication::ReplicaLock> pLock;
+
+    // Same segments as FindAtlas: process 3+i is client i
+    const MapSegment::Settings &settings = map_segment.GetSettings();
+    std::pair<int *,std::size_t> ret = segment.find<int>("magic-num");
+    if((settings.clientId < 0 && !settings.bMergeServer) || num < 3 || (ret.first && *ret.first == num))
+        return pLock;
+
+    try
+    {
+        pLock.reset(new Replication::ReplicaLock(settings.ForClient(num-3).name));
+    }
+    catch(boost::interprocess::interprocess_exception &ex)
+    {
+        std::cerr<<"Failed to lock the replica of process "<<num<<": "<<ex.what()<<std::endl;
+    }
+    return pLock;
+}
+
+bool System::MergeClientMap(int clientId)
+{
+    if(!OpenClientSegment(clientId))
+    {
+        std::cerr<<"Segment of client "<<clientId<<" is not available"<<std::endl;
+        return false;
+    }
+
+    PostLoad(3+clientId);
+    return true;
+}
+
+void System::PostLoad(int otherNum){
     std::cout<<"---- Running PostLoad ----"<<std::endl;
     //first check if the atlas is first one or later one.
     std::pair<int *,std::size_t> ret = ORB_SLAM3::segment.find<int>("magic-num");
@@ -957,21 +1118,21 @@ void System::PostLoad(){
     Atlas *otherAtlas=nullptr;
 
     //now check. 3 is the starting process. 
-    if (*magic_num > 3)
+    if (otherNum >= 0 || *magic_num > 3)
     {
         //second process
-        int previous_num = *magic_num-1;
-        char atlasname[7];
-
-        atlasname[0] = 'a';
-        atlasname[1] = 't';
-        atlasname[2] = 'l';
-        atlasname[3] = 'a';
-        atlasname[4] = 's';
-        atlasname[6] = '\0';
-
-        sprintf(&atlasname[5],"%d",previous_num);
-        otherAtlas = (segment.find<Atlas>(atlasname)).first;
+        int previous_num = otherNum >= 0 ? otherNum : *magic_num-1;
+        char atlasname[16];
+
+        snprintf(atlasname,sizeof(atlasname),"atlas%d",previous_num);
+        // Held until the merge is done
+        std::unique_ptr<Replication::ReplicaLock> pReplicaLock = LockReplica(previous_num);
+        otherAtlas = FindAtlas(previous_num);
+        if(!otherAtlas)
+        {
+            std::cerr<<"PostLoad: "<<atlasname<<" not found, nothing to merge"<<std::endl;
+            return;
+        }
 
         std::cout<<"Printing the details form another atlas inside PostLoad!! OTHERNAME: "<<atlasname<<std::endl;
         std::cout<<"Check if the map is bad:"<<otherAtlas->currentMapPtr->IsBad()<<std::endl;
@@ -1054,7 +1215,6 @@ void System::PostLoad(){
         //fix all the mapppoints.
         for(auto& mapP: allmappoints){
             mapP->UpdateMap(mpAtlas->GetCurrentMap());
-            mapP->FixMatrices();
             //mapP->UpdateNormalAndDepth();
             mpAtlas->GetCurrentMap()->AddMapPoint(mapP);
         }
@@ -1071,7 +1231,6 @@ void System::PostLoad(){
             std::chrono::steady_clock::time_point pre_start = std::chrono::steady_clock::now();
         
         for(auto& keyf: allkeyframes){
-            keyf->FixMatrices(keyf);
             keyf->ResetCamera(mpAtlas->getCurrentCamera());
             keyf->UpdateMap(mpAtlas->GetCurrentMap());
             keyf->SetORBVocabulary(mpAtlas->GetORBVocabulary());
@@ -1184,7 +1343,6 @@ void System::PostLoad(){
         for(auto& mapP: allmappoints){
             mapP->UpdateMap(mpAtlas->currentMapPtr);
             mpAtlas->currentMapPtr->AddMapPoint(mapP);
-            mapP->FixMatrices();
 
         }
 
@@ -1204,7 +1362,6 @@ void System::PostLoad(){
         std::cout<<"---- ===== adding the keyframe to new map ----- ==== \n";
         //the keyframes from the other atlas
         for(auto& keyf: allkeyframes){
-            keyf->FixMatrices(keyf);
             keyf->ResetCamera(mpAtlas->getCurrentCamera());
             keyf->UpdateMap(mpAtlas->currentMapPtr);
             keyf->SetORBVocabulary(mpAtlas->GetORBVocabulary());
@@ -1248,7 +1405,7 @@ void System::PostLoad(){
             usleep(1000);
         }
         std::cout<<"****** GlobalBundleAdjustemnt started\n";
-        mpLoopCloser->RunGlobalBundleAdjustment(mpAtlas->currentMapPtr,600);
+        mpLoopCloser->RunGlobalBundleAdjustment(mpAtlas->currentMapPtr,600,allkeyframes);
         std::cout<<"------ GlobalBundleAdjustemnt finished\n";
 
         
@@ -1306,16 +1463,9 @@ void System::PostLoad(){
     } 
     else{
         int previous_num = *magic_num;
-        char atlasname[7];
-
-        atlasname[0] = 'a';
-        atlasname[1] = 't';
-        atlasname[2] = 'l';
-        atlasname[3] = 'a';
-        atlasname[4] = 's';
-        atlasname[6] = '\0';
+        char atlasname[16];
 
-        sprintf(&atlasname[5],"%d",previous_num);
+        snprintf(atlasname,sizeof(atlasname),"atlas%d",previous_num);
         otherAtlas = (segment.find<Atlas>(atlasname)).first;
         std::cout<<"--- Still in First process. No need to merge\n";
         // print the number of keyframes.
@@ -1342,17 +1492,17 @@ void System::PostLoad2(){
     {
         //second process
         int previous_num = *magic_num;
-        char atlasname[7];
+        char atlasname[16];
 
-        atlasname[0] = 'a';
-        atlasname[1] = 't';
-        atlasname[2] = 'l';
-        atlasname[3] = 'a';
-        atlasname[4] = 's';
-        atlasname[6] = '\0';
-
-        sprintf(&atlasname[5],"%d",previous_num);
-        otherAtlas = (segment.find<Atlas>(atlasname)).first;
+        snprintf(atlasname,sizeof(atlasname),"atlas%d",previous_num);
+        // Held until the merge is done
+        std::unique_ptr<Replication::ReplicaLock> pReplicaLock = LockReplica(previous_num);
+        otherAtlas = FindAtlas(previous_num);
+        if(!otherAtlas)
+        {
+            std::cerr<<"PostLoad2: "<<atlasname<<" not found, nothing to merge"<<std::endl;
+            return;
+        }
 
         std::cout<<"Printing the details form another atlas inside PostLoad!! OTHERNAME: "<<atlasname<<std::endl;
         std::cout<<"Check if the map is bad:"<<otherAtlas->currentMapPtr->IsBad()<<std::endl;
@@ -1435,7 +1585,6 @@ void System::PostLoad2(){
         //fix all the mapppoints.
         for(auto& mapP: allmappoints){
             mapP->UpdateMap(mpAtlas->GetCurrentMap());
-            mapP->FixMatrices();
             //mapP->UpdateNormalAndDepth();
             mpAtlas->GetCurrentMap()->AddMapPoint(mapP);
         }
@@ -1452,7 +1601,6 @@ void System::PostLoad2(){
             std::chrono::steady_clock::time_point pre_start = std::chrono::steady_clock::now();
         
         for(auto& keyf: allkeyframes){
-            keyf->FixMatrices(keyf);
             keyf->ResetCamera(mpAtlas->getCurrentCamera());
             keyf->UpdateMap(mpAtlas->GetCurrentMap());
             keyf->SetORBVocabulary(mpAtlas->GetORBVocabulary());
@@ -1561,7 +1709,6 @@ void System::PostLoad2(){
         for(auto& mapP: allmappoints){
             mapP->UpdateMap(mpAtlas->currentMapPtr);
             mpAtlas->currentMapPtr->AddMapPoint(mapP);
-            mapP->FixMatrices();
 
         }
 
@@ -1581,7 +1728,6 @@ void System::PostLoad2(){
         std::cout<<"---- ===== adding the keyframe to new map ----- ==== \n";
         //the keyframes from the other atlas
         for(auto& keyf: allkeyframes){
-            keyf->FixMatrices(keyf);
             keyf->ResetCamera(mpAtlas->getCurrentCamera());
             keyf->UpdateMap(mpAtlas->currentMapPtr);
             keyf->SetORBVocabulary(mpAtlas->GetORBVocabulary());
@@ -1625,7 +1771,7 @@ void System::PostLoad2(){
             usleep(1000);
         }
         std::cout<<"****** GlobalBundleAdjustemnt started\n";
-        mpLoopCloser->RunGlobalBundleAdjustment(mpAtlas->currentMapPtr,600);
+        mpLoopCloser->RunGlobalBundleAdjustment(mpAtlas->currentMapPtr,600,allkeyframes);
         std::cout<<"------ GlobalBundleAdjustemnt finished\n";
 
         
@@ -1683,16 +1829,9 @@ void System::PostLoad2(){
     } 
     else{
         int previous_num = *magic_num;
-        char atlasname[7];
-
-        atlasname[0] = 'a';
-        atlasname[1] = 't';
-        atlasname[2] = 'l';
-        atlasname[3] = 'a';
-        atlasname[4] = 's';
-        atlasname[6] = '\0';
+        char atlasname[16];
 
-        sprintf(&atlasname[5],"%d",previous_num);
+        snprintf(atlasname,sizeof(atlasname),"atlas%d",previous_num);
         otherAtlas = (segment.find<Atlas>(atlasname)).first;
         std::cout<<"--- Still in First process. No need to merge\n";
         // print the number of keyframes.
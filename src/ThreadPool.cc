@@ -0,0 +1,138 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2020 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace ORB_SLAM3
+{
+
+ThreadPool::ThreadPool(int nThreads): mbStop(false)
+{
+    for(int i=0; i<nThreads; i++)
+        mvThreads.push_back(std::thread(&ThreadPool::Run, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutexTasks);
+        mbStop = true;
+    }
+    mcvTasks.notify_all();
+
+    for(size_t i=0; i<mvThreads.size(); i++)
+        mvThreads[i].join();
+}
+
+int ThreadPool::GetNumThreads() const
+{
+    return mvThreads.size();
+}
+
+void ThreadPool::ParallelFor(int begin, int end, const std::function<void(int)> &f)
+{
+    const int n = end-begin;
+    if(n <= 0)
+        return;
+
+    if(mvThreads.empty() || n == 1)
+    {
+        for(int i=begin; i<end; i++)
+            f(i);
+        return;
+    }
+
+    // Shared with the workers. A worker that starts after every index was taken only touches the
+    // counters, never f, so the call can return as soon as all the indices are done.
+    struct State
+    {
+        std::atomic<int> next;
+        std::atomic<int> nDone;
+        int end;
+        int n;
+        const std::function<void(int)>* pF;
+        std::mutex mutex;
+        std::condition_variable cvDone;
+    };
+
+    std::shared_ptr<State> pState = std::make_shared<State>();
+    pState->next = begin;
+    pState->nDone = 0;
+    pState->end = end;
+    pState->n = n;
+    pState->pF = &f;
+
+    auto work = [pState]()
+    {
+        int nDone = 0;
+        for(int i=pState->next++; i<pState->end; i=pState->next++)
+        {
+            (*pState->pF)(i);
+            nDone++;
+        }
+
+        if(nDone>0 && pState->nDone.fetch_add(nDone)+nDone == pState->n)
+        {
+            std::unique_lock<std::mutex> lock(pState->mutex);
+            pState->cvDone.notify_all();
+        }
+    };
+
+    const int nHelpers = std::min<int>(mvThreads.size(), n-1);
+    for(int i=0; i<nHelpers; i++)
+        Enqueue(work);
+
+    work();
+
+    std::unique_lock<std::mutex> lock(pState->mutex);
+    pState->cvDone.wait(lock, [&pState]{ return pState->nDone == pState->n; });
+}
+
+void ThreadPool::Enqueue(std::function<void()> task)
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutexTasks);
+        mqTasks.push(std::move(task));
+    }
+    mcvTasks.notify_one();
+}
+
+void ThreadPool::Run()
+{
+    while(true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mMutexTasks);
+            mcvTasks.wait(lock, [this]{ return mbStop || !mqTasks.empty(); });
+            if(mbStop && mqTasks.empty())
+                return;
+            task = std::move(mqTasks.front());
+            mqTasks.pop();
+        }
+        task();
+    }
+}
+
+} //namespace ORB_SLAM3
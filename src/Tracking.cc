@@ -48,7 +48,7 @@ Tracking::Tracking(System *pSys, ORBVocabulary* pVoc, FrameDrawer *pFrameDrawer,
     mbOnlyTracking(false), mbMapUpdated(false), mbVO(false), mpORBVocabulary(pVoc), mpKeyFrameDB(pKFDB),
     mpInitializer(static_cast<Initializer*>(NULL)), mpSystem(pSys), mpViewer(NULL),
     mpFrameDrawer(pFrameDrawer), mpMapDrawer(pMapDrawer), mpAtlas(pAtlas), mnLastRelocFrameId(0), time_recently_lost(5.0), time_recently_lost_visual(2.0),
-    mnInitialFrameId(0), mbCreatedMap(false), mnFirstFrameId(0), mpCamera2(nullptr)
+    mnInitialFrameId(0), mbCreatedMap(false), mnFirstFrameId(0), mpCamera2(nullptr), mpExtractorPool(nullptr)
 {
 
     //boost::interprocess::managed_shared_memory segment(boost::interprocess::open_or_create, "MySharedMemory",10737418240);
@@ -110,6 +110,7 @@ Tracking::Tracking(System *pSys, ORBVocabulary* pVoc, FrameDrawer *pFrameDrawer,
     vdPosePred_ms.clear();
     vdLMTrack_ms.clear();
     vdNewKF_ms.clear();
+    vdKFCreation_ms.clear();
     vdTrackTotal_ms.clear();
 
     vdUpdatedLM_ms.clear();
@@ -322,6 +323,14 @@ void Tracking::PrintTimeStats()
     std::cout << "New KF decision: " << average << "$\\pm$" << deviation << std::endl;
     f << "New KF decision: " << average << "$\\pm$" << deviation << std::endl;
 
+    if(!vdKFCreation_ms.empty())
+    {
+        average = calcAverage(vdKFCreation_ms);
+        deviation = calcDeviation(vdKFCreation_ms, average);
+        std::cout << "KF Creation: " << average << "$\\pm$" << deviation << std::endl;
+        f << "KF Creation: " << average << "$\\pm$" << deviation << std::endl;
+    }
+
     average = calcAverage(vdTrackTotal_ms);
     deviation = calcDeviation(vdTrackTotal_ms, average);
     std::cout << "Total Tracking: " << average << "$\\pm$" << deviation << std::endl;
@@ -445,6 +454,18 @@ void Tracking::PrintTimeStats()
         std::cout << "Loop Closing (mean$\\pm$std)" << std::endl << std::endl;
         f << std::endl << "Loop Closing (mean$\\pm$std)" << std::endl << std::endl;
 
+        average = calcAverage(mpLoopClosing->vTimeLoopCorrection_ms);
+        deviation = calcDeviation(mpLoopClosing->vTimeLoopCorrection_ms, average);
+        std::cout << "Sim3 Propagation: " << average << "$\\pm$" << deviation << std::endl;
+        f << "Sim3 Propagation: " << average << "$\\pm$" << deviation << std::endl;
+        average = calcAverage(mpLoopClosing->vTimeLoopFusion_ms);
+        deviation = calcDeviation(mpLoopClosing->vTimeLoopFusion_ms, average);
+        std::cout << "Loop Fusion: " << average << "$\\pm$" << deviation << std::endl;
+        f << "Loop Fusion: " << average << "$\\pm$" << deviation << std::endl;
+        average = calcAverage(mpLoopClosing->vTimeLoopEssent_ms);
+        deviation = calcDeviation(mpLoopClosing->vTimeLoopEssent_ms, average);
+        std::cout << "Essential Graph: " << average << "$\\pm$" << deviation << std::endl;
+        f << "Essential Graph: " << average << "$\\pm$" << deviation << std::endl;
         average = calcAverage(mpLoopClosing->vTimeLoopTotal_ms);
         deviation = calcDeviation(mpLoopClosing->vTimeLoopTotal_ms, average);
         std::cout << "Total Loop Closing: " << average << "$\\pm$" << deviation << std::endl;
@@ -458,6 +479,26 @@ void Tracking::PrintTimeStats()
         std::cout << "Map Merging (mean$\\pm$std)" << std::endl << std::endl;
         f << std::endl << "Map Merging (mean$\\pm$std)" << std::endl << std::endl;
 
+        // Phases of the visual merge, the inertial one is only timed as a whole
+        if(!mpLoopClosing->vTimeMergeCorrection_ms.empty())
+        {
+            average = calcAverage(mpLoopClosing->vTimeMergeCorrection_ms);
+            deviation = calcDeviation(mpLoopClosing->vTimeMergeCorrection_ms, average);
+            std::cout << "Sim3 Propagation: " << average << "$\\pm$" << deviation << std::endl;
+            f << "Sim3 Propagation: " << average << "$\\pm$" << deviation << std::endl;
+            average = calcAverage(mpLoopClosing->vTimeMergeFusion_ms);
+            deviation = calcDeviation(mpLoopClosing->vTimeMergeFusion_ms, average);
+            std::cout << "Merge Fusion: " << average << "$\\pm$" << deviation << std::endl;
+            f << "Merge Fusion: " << average << "$\\pm$" << deviation << std::endl;
+            average = calcAverage(mpLoopClosing->vTimeMergeBA_ms);
+            deviation = calcDeviation(mpLoopClosing->vTimeMergeBA_ms, average);
+            std::cout << "Welding BA: " << average << "$\\pm$" << deviation << std::endl;
+            f << "Welding BA: " << average << "$\\pm$" << deviation << std::endl;
+            average = calcAverage(mpLoopClosing->vTimeMergeMapUpdate_ms);
+            deviation = calcDeviation(mpLoopClosing->vTimeMergeMapUpdate_ms, average);
+            std::cout << "Map Update: " << average << "$\\pm$" << deviation << std::endl;
+            f << "Map Update: " << average << "$\\pm$" << deviation << std::endl;
+        }
         average = calcAverage(mpLoopClosing->vTimeMergeTotal_ms);
         deviation = calcDeviation(mpLoopClosing->vTimeMergeTotal_ms, average);
         std::cout << "Total Map Merging: " << average << "$\\pm$" << deviation << std::endl;
@@ -494,7 +535,7 @@ void Tracking::PrintTimeStats()
 
 Tracking::~Tracking()
 {
-
+    delete mpExtractorPool;
 }
 
 bool Tracking::ParseCamParamFile(cv::FileStorage &fSettings)
@@ -1096,6 +1137,14 @@ bool Tracking::ParseORBParamFile(cv::FileStorage &fSettings)
         return false;
     }
 
+    // Optional, the extractors are sequential by default
+    int nExtractorThreads = 0;
+    node = fSettings["ORBextractor.nThreads"];
+    if(!node.empty() && node.isInt())
+    {
+        nExtractorThreads = node.operator int();
+    }
+
     mpORBextractorLeft = new ORBextractor(nFeatures,fScaleFactor,nLevels,fIniThFAST,fMinThFAST);
 
     if(mSensor==System::STEREO || mSensor==System::IMU_STEREO)
@@ -1104,12 +1153,29 @@ bool Tracking::ParseORBParamFile(cv::FileStorage &fSettings)
     if(mSensor==System::MONOCULAR || mSensor==System::IMU_MONOCULAR)
         mpIniORBextractor = new ORBextractor(5*nFeatures,fScaleFactor,nLevels,fIniThFAST,fMinThFAST);
 
+    // Left and right images are always extracted at the same time, on the pool instead of two new threads
+    // per frame
+    if(mSensor==System::STEREO || mSensor==System::IMU_STEREO)
+        nExtractorThreads = max(nExtractorThreads,2);
+
+    // The calling thread takes part in the extraction, so it counts as one of the threads
+    if(nExtractorThreads > 1)
+    {
+        mpExtractorPool = new ThreadPool(nExtractorThreads-1);
+        mpORBextractorLeft->SetThreadPool(mpExtractorPool);
+        if(mSensor==System::STEREO || mSensor==System::IMU_STEREO)
+            mpORBextractorRight->SetThreadPool(mpExtractorPool);
+        if(mSensor==System::MONOCULAR || mSensor==System::IMU_MONOCULAR)
+            mpIniORBextractor->SetThreadPool(mpExtractorPool);
+    }
+
     cout << endl << "ORB Extractor Parameters: " << endl;
     cout << "- Number of Features: " << nFeatures << endl;
     cout << "- Scale Levels: " << nLevels << endl;
     cout << "- Scale Factor: " << fScaleFactor << endl;
     cout << "- Initial Fast Threshold: " << fIniThFAST << endl;
     cout << "- Minimum Fast Threshold: " << fMinThFAST << endl;
+    cout << "- Extraction Threads: " << max(nExtractorThreads,1) << endl;
 
     return true;
 }
@@ -1243,146 +1309,162 @@ cv::Mat Tracking::GrabImageStereo(const cv::Mat &imRectLeft, const cv::Mat &imRe
 {
     //added a mutex lock
     std::unique_lock<mutex> lock(mMutexTracks);   
-    
-    mImGray = imRectLeft;
+
+    cv::Mat imGray = imRectLeft;
     cv::Mat imGrayRight = imRectRight;
-    mImRight = imRectRight;
+    Frame frame = CreateFrameStereo(imGray,imGrayRight,timestamp);
 
-    if(mImGray.channels()==3)
+    return GrabFrame(frame,imGray,imRectRight,filename);
+}
+
+
+cv::Mat Tracking::GrabImageRGBD(const cv::Mat &imRGB,const cv::Mat &imD, const double &timestamp, string filename)
+{
+    cv::Mat imGray = imRGB;
+    cv::Mat imDepth = imD;
+    Frame frame = CreateFrameRGBD(imGray,imDepth,timestamp);
+
+    return GrabFrame(frame,imGray,cv::Mat(),filename);
+}
+
+
+cv::Mat Tracking::GrabImageMonocular(const cv::Mat &im, const double &timestamp, string filename)
+{
+    cv::Mat imGray = im;
+    Frame frame = CreateFrameMonocular(imGray,timestamp,GetMonocularExtractor());
+
+    return GrabFrame(frame,imGray,cv::Mat(),filename);
+}
+
+Frame Tracking::CreateFrameStereo(cv::Mat &imGray, cv::Mat &imGrayRight, const double &timestamp)
+{
+    if(imGray.channels()==3)
     {
         if(mbRGB)
         {
-            cvtColor(mImGray,mImGray,cv::COLOR_RGB2GRAY);
+            cvtColor(imGray,imGray,cv::COLOR_RGB2GRAY);
             cvtColor(imGrayRight,imGrayRight,cv::COLOR_RGB2GRAY);
         }
         else
         {
-            cvtColor(mImGray,mImGray,cv::COLOR_BGR2GRAY);
+            cvtColor(imGray,imGray,cv::COLOR_BGR2GRAY);
             cvtColor(imGrayRight,imGrayRight,cv::COLOR_BGR2GRAY);
         }
     }
-    else if(mImGray.channels()==4)
+    else if(imGray.channels()==4)
     {
         if(mbRGB)
         {
-            cvtColor(mImGray,mImGray,cv::COLOR_RGBA2GRAY);
+            cvtColor(imGray,imGray,cv::COLOR_RGBA2GRAY);
             cvtColor(imGrayRight,imGrayRight,cv::COLOR_RGBA2GRAY);
         }
         else
         {
-            cvtColor(mImGray,mImGray,cv::COLOR_BGRA2GRAY);
+            cvtColor(imGray,imGray,cv::COLOR_BGRA2GRAY);
             cvtColor(imGrayRight,imGrayRight,cv::COLOR_BGRA2GRAY);
         }
     }
 
     if (mSensor == System::STEREO && !mpCamera2)
-        mCurrentFrame = Frame(mImGray,imGrayRight,timestamp,mpORBextractorLeft,mpORBextractorRight,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mpCamera);
+        return Frame(imGray,imGrayRight,timestamp,mpORBextractorLeft,mpORBextractorRight,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mpCamera);
     else if(mSensor == System::STEREO && mpCamera2)
-        mCurrentFrame = Frame(mImGray,imGrayRight,timestamp,mpORBextractorLeft,mpORBextractorRight,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mpCamera,mpCamera2,mTlr);
+        return Frame(imGray,imGrayRight,timestamp,mpORBextractorLeft,mpORBextractorRight,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mpCamera,mpCamera2,mTlr);
     else if(mSensor == System::IMU_STEREO && !mpCamera2)
-        mCurrentFrame = Frame(mImGray,imGrayRight,timestamp,mpORBextractorLeft,mpORBextractorRight,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mpCamera,&mLastFrame,*mpImuCalib);
-    else if(mSensor == System::IMU_STEREO && mpCamera2)
-        mCurrentFrame = Frame(mImGray,imGrayRight,timestamp,mpORBextractorLeft,mpORBextractorRight,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mpCamera,mpCamera2,mTlr,&mLastFrame,*mpImuCalib);
-
-    mCurrentFrame.mNameFile = filename;
-    mCurrentFrame.mnDataset = mnNumDataset;
-
-#ifdef REGISTER_TIMES
-    vdORBExtract_ms.push_back(mCurrentFrame.mTimeORB_Ext);
-    vdStereoMatch_ms.push_back(mCurrentFrame.mTimeStereoMatch);
-#endif
-
-    Track();
-
-    return mCurrentFrame.mTcw.clone();
+        return Frame(imGray,imGrayRight,timestamp,mpORBextractorLeft,mpORBextractorRight,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mpCamera,static_cast<Frame*>(NULL),*mpImuCalib);
+    else
+        return Frame(imGray,imGrayRight,timestamp,mpORBextractorLeft,mpORBextractorRight,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mpCamera,mpCamera2,mTlr,static_cast<Frame*>(NULL),*mpImuCalib);
 }
 
-
-cv::Mat Tracking::GrabImageRGBD(const cv::Mat &imRGB,const cv::Mat &imD, const double &timestamp, string filename)
+Frame Tracking::CreateFrameRGBD(cv::Mat &imGray, cv::Mat &imDepth, const double &timestamp)
 {
-    mImGray = imRGB;
-    cv::Mat imDepth = imD;
-
-    if(mImGray.channels()==3)
+    if(imGray.channels()==3)
     {
         if(mbRGB)
-            cvtColor(mImGray,mImGray,cv::COLOR_RGB2GRAY);
+            cvtColor(imGray,imGray,cv::COLOR_RGB2GRAY);
         else
-            cvtColor(mImGray,mImGray,cv::COLOR_BGR2GRAY);
+            cvtColor(imGray,imGray,cv::COLOR_BGR2GRAY);
     }
-    else if(mImGray.channels()==4)
+    else if(imGray.channels()==4)
     {
         if(mbRGB)
-            cvtColor(mImGray,mImGray,cv::COLOR_RGBA2GRAY);
+            cvtColor(imGray,imGray,cv::COLOR_RGBA2GRAY);
         else
-            cvtColor(mImGray,mImGray,cv::COLOR_BGRA2GRAY);
+            cvtColor(imGray,imGray,cv::COLOR_BGRA2GRAY);
     }
 
     if((fabs(mDepthMapFactor-1.0f)>1e-5) || imDepth.type()!=CV_32F)
         imDepth.convertTo(imDepth,CV_32F,mDepthMapFactor);
 
-    mCurrentFrame = Frame(mImGray,imDepth,timestamp,mpORBextractorLeft,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mpCamera);
-
-    mCurrentFrame.mNameFile = filename;
-    mCurrentFrame.mnDataset = mnNumDataset;
-
-#ifdef REGISTER_TIMES
-    vdORBExtract_ms.push_back(mCurrentFrame.mTimeORB_Ext);
-#endif
-
-    Track();
-
-    return mCurrentFrame.mTcw.clone();
+    return Frame(imGray,imDepth,timestamp,mpORBextractorLeft,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mpCamera);
 }
 
-
-cv::Mat Tracking::GrabImageMonocular(const cv::Mat &im, const double &timestamp, string filename)
+Frame Tracking::CreateFrameMonocular(cv::Mat &imGray, const double &timestamp, ORBextractor* pExtractor)
 {
-    mImGray = im;
-
-    if(mImGray.channels()==3)
+    if(imGray.channels()==3)
     {
         if(mbRGB)
-            cvtColor(mImGray,mImGray,cv::COLOR_RGB2GRAY);
+            cvtColor(imGray,imGray,cv::COLOR_RGB2GRAY);
         else
-            cvtColor(mImGray,mImGray,cv::COLOR_BGR2GRAY);
+            cvtColor(imGray,imGray,cv::COLOR_BGR2GRAY);
     }
-    else if(mImGray.channels()==4)
+    else if(imGray.channels()==4)
     {
         if(mbRGB)
-            cvtColor(mImGray,mImGray,cv::COLOR_RGBA2GRAY);
+            cvtColor(imGray,imGray,cv::COLOR_RGBA2GRAY);
         else
-            cvtColor(mImGray,mImGray,cv::COLOR_BGRA2GRAY);
+            cvtColor(imGray,imGray,cv::COLOR_BGRA2GRAY);
     }
 
+    if (mSensor == System::MONOCULAR)
+        return Frame(imGray,timestamp,pExtractor,mpORBVocabulary,mpCamera,mDistCoef,mbf,mThDepth);
+    else
+        return Frame(imGray,timestamp,pExtractor,mpORBVocabulary,mpCamera,mDistCoef,mbf,mThDepth,static_cast<Frame*>(NULL),*mpImuCalib);
+}
+
+ORBextractor* Tracking::GetMonocularExtractor()
+{
+    // More features to initialize the map
     if (mSensor == System::MONOCULAR)
     {
         if(mState==NOT_INITIALIZED || mState==NO_IMAGES_YET ||(lastID - initID) < mMaxFrames)
-            mCurrentFrame = Frame(mImGray,timestamp,mpIniORBextractor,mpORBVocabulary,mpCamera,mDistCoef,mbf,mThDepth);
-        else
-            mCurrentFrame = Frame(mImGray,timestamp,mpORBextractorLeft,mpORBVocabulary,mpCamera,mDistCoef,mbf,mThDepth);
+            return mpIniORBextractor;
     }
-    else if(mSensor == System::IMU_MONOCULAR)
+    else if(mState==NOT_INITIALIZED || mState==NO_IMAGES_YET)
+        return mpIniORBextractor;
+
+    return mpORBextractorLeft;
+}
+
+cv::Mat Tracking::GrabFrame(const Frame &frame, const cv::Mat &imGray, const cv::Mat &imRight, string filename)
+{
+    mImGray = imGray;
+    if(!imRight.empty())
+        mImRight = imRight;
+
+    mCurrentFrame = frame;
+
+    // The frame was built without the previous one, link it now that mLastFrame is up to date
+    if (mSensor == System::IMU_MONOCULAR || mSensor == System::IMU_STEREO)
     {
-        if(mState==NOT_INITIALIZED || mState==NO_IMAGES_YET)
-        {
-            mCurrentFrame = Frame(mImGray,timestamp,mpIniORBextractor,mpORBVocabulary,mpCamera,mDistCoef,mbf,mThDepth,&mLastFrame,*mpImuCalib);
-        }
-        else
-            mCurrentFrame = Frame(mImGray,timestamp,mpORBextractorLeft,mpORBVocabulary,mpCamera,mDistCoef,mbf,mThDepth,&mLastFrame,*mpImuCalib);
+        mCurrentFrame.mpPrevFrame = &mLastFrame;
+        if(mSensor == System::IMU_MONOCULAR || !mpCamera2)
+            mCurrentFrame.mVw = mLastFrame.mVw.empty() ? cv::Mat() : mLastFrame.mVw.clone();
     }
 
-    if (mState==NO_IMAGES_YET)
-        t0=timestamp;
+    if ((mSensor == System::MONOCULAR || mSensor == System::IMU_MONOCULAR) && mState==NO_IMAGES_YET)
+        t0=mCurrentFrame.mTimeStamp;
 
     mCurrentFrame.mNameFile = filename;
     mCurrentFrame.mnDataset = mnNumDataset;
 
 #ifdef REGISTER_TIMES
     vdORBExtract_ms.push_back(mCurrentFrame.mTimeORB_Ext);
+    if (mSensor == System::STEREO || mSensor == System::IMU_STEREO)
+        vdStereoMatch_ms.push_back(mCurrentFrame.mTimeStereoMatch);
 #endif
 
-    lastID = mCurrentFrame.mnId;
+    if (mSensor == System::MONOCULAR || mSensor == System::IMU_MONOCULAR)
+        lastID = mCurrentFrame.mnId;
     Track();
 
     return mCurrentFrame.mTcw.clone();
@@ -1671,6 +1753,9 @@ void Tracking::Track()
         mbStep = false;
     }
 
+    // The map replicator copies the segment between frames, see MapSegment::WriteScope
+    MapSegment::WriteScope writeScope(map_segment, MapSegment::FRAME_UNIT);
+
     if(mpLocalMapper->mbBadImu)
     {
         cout << "TRACK: Reset map because local mapper set the bad imu flag " << endl;
@@ -2115,11 +2200,11 @@ void Tracking::Track()
                     }
             }
 
-            // Delete temporal MapPoints
+            // Delete temporal MapPoints, made with ConstructTemporary in UpdateLastFrame
             for(list<boost::interprocess::offset_ptr<MapPoint> >::iterator lit = mlpTemporalPoints.begin(), lend =  mlpTemporalPoints.end(); lit!=lend; lit++)
             {
                 boost::interprocess::offset_ptr<MapPoint>  pMP = *lit;
-                delete pMP.get();
+                ORB_SLAM3::map_segment.Destroy(pMP.get());
             }
             mlpTemporalPoints.clear();
 
@@ -2264,7 +2349,7 @@ void Tracking::StereoInitialization()
         //cout<<"Tracking, check current map (ID): "<<mpCurrentMap->GetId()<<endl;
         //cout<<"Tracking, check current map (ID): "<<(mpAtlas->GetCurrentMap())->GetId()<<endl;
         //boost::interprocess::offset_ptr<KeyFrame>  pKFini = new KeyFrame(mCurrentFrame,mpAtlas->GetCurrentMap(),mpKeyFrameDB);
-        boost::interprocess::offset_ptr<KeyFrame>  pKFini = mpAtlas->segment->find_or_construct<KeyFrame>(boost::interprocess::anonymous_instance)(mCurrentFrame,mpAtlas->GetCurrentMap(),mpKeyFrameDB);
+        boost::interprocess::offset_ptr<KeyFrame>  pKFini = ORB_SLAM3::map_segment.Construct<KeyFrame>(mCurrentFrame,mpAtlas->GetCurrentMap(),mpKeyFrameDB);
 
 
         // Insert KeyFrame in the map
@@ -2279,7 +2364,7 @@ void Tracking::StereoInitialization()
                 {
                     cv::Mat x3D = mCurrentFrame.UnprojectStereo(i);
                     //boost::interprocess::offset_ptr<MapPoint>  pNewMP = new MapPoint(x3D,pKFini,mpAtlas->GetCurrentMap());
-                    boost::interprocess::offset_ptr<MapPoint>  pNewMP = mpAtlas->segment->find_or_construct<MapPoint>(boost::interprocess::anonymous_instance)(x3D,pKFini,mpAtlas->GetCurrentMap());
+                    boost::interprocess::offset_ptr<MapPoint>  pNewMP = ORB_SLAM3::map_segment.Construct<MapPoint>(x3D,pKFini,mpAtlas->GetCurrentMap());
                     
                     pNewMP->AddObservation(pKFini,i);
                     pKFini->AddMapPoint(pNewMP,i);
@@ -2297,7 +2382,7 @@ void Tracking::StereoInitialization()
                     cv::Mat x3D = mCurrentFrame.mvStereo3Dpoints[i];
 
                     //boost::interprocess::offset_ptr<MapPoint>  pNewMP = new MapPoint(x3D,pKFini,mpAtlas->GetCurrentMap());
-                    boost::interprocess::offset_ptr<MapPoint>  pNewMP =  mpAtlas->segment->find_or_construct<MapPoint>(boost::interprocess::anonymous_instance)(x3D,pKFini,mpAtlas->GetCurrentMap());
+                    boost::interprocess::offset_ptr<MapPoint>  pNewMP =  ORB_SLAM3::map_segment.Construct<MapPoint>(x3D,pKFini,mpAtlas->GetCurrentMap());
 
                     pNewMP->AddObservation(pKFini,i);
                     pNewMP->AddObservation(pKFini,rightIndex + mCurrentFrame.Nleft);
@@ -2443,8 +2528,8 @@ void Tracking::CreateInitialMapMonocular()
     //boost::interprocess::offset_ptr<KeyFrame>  pKFini = new KeyFrame(mInitialFrame,mpAtlas->GetCurrentMap(),mpKeyFrameDB);
     //boost::interprocess::offset_ptr<KeyFrame>  pKFcur = new KeyFrame(mCurrentFrame,mpAtlas->GetCurrentMap(),mpKeyFrameDB);
 
-    boost::interprocess::offset_ptr<KeyFrame>  pKFini = mpAtlas->segment->find_or_construct<KeyFrame>(boost::interprocess::anonymous_instance)(mInitialFrame,mpAtlas->GetCurrentMap(),mpKeyFrameDB);
-    boost::interprocess::offset_ptr<KeyFrame>  pKFcur = mpAtlas->segment->find_or_construct<KeyFrame>(boost::interprocess::anonymous_instance)(mCurrentFrame,mpAtlas->GetCurrentMap(),mpKeyFrameDB);
+    boost::interprocess::offset_ptr<KeyFrame>  pKFini = ORB_SLAM3::map_segment.Construct<KeyFrame>(mInitialFrame,mpAtlas->GetCurrentMap(),mpKeyFrameDB);
+    boost::interprocess::offset_ptr<KeyFrame>  pKFcur = ORB_SLAM3::map_segment.Construct<KeyFrame>(mCurrentFrame,mpAtlas->GetCurrentMap(),mpKeyFrameDB);
 
     if(mSensor == System::IMU_MONOCULAR)
         pKFini->mpImuPreintegrated = (IMU::Preintegrated*)(NULL);
@@ -2465,7 +2550,7 @@ void Tracking::CreateInitialMapMonocular()
         //Create MapPoint.
         cv::Mat worldPos(mvIniP3D[i]);
         //boost::interprocess::offset_ptr<MapPoint>  pMP = new MapPoint(worldPos,pKFcur,mpAtlas->GetCurrentMap());
-        boost::interprocess::offset_ptr<MapPoint>  pMP = mpAtlas->segment->find_or_construct<MapPoint>(boost::interprocess::anonymous_instance)(worldPos,pKFcur,mpAtlas->GetCurrentMap());
+        boost::interprocess::offset_ptr<MapPoint>  pMP = ORB_SLAM3::map_segment.Construct<MapPoint>(worldPos,pKFcur,mpAtlas->GetCurrentMap());
 
         pKFini->AddMapPoint(pMP,i);
         pKFcur->AddMapPoint(pMP,mvIniMatches[i]);
@@ -2755,7 +2840,8 @@ void Tracking::UpdateLastFrame()
             cv::Mat x3D = mLastFrame.UnprojectStereo(i);
             //mpAtlas->segment->find_or_construct<MapPoint>(boost::interprocess::anonymous_instance)
             //boost::interprocess::offset_ptr<MapPoint>  pNewMP = new MapPoint(x3D,mpAtlas->GetCurrentMap(),&mLastFrame,i);
-            boost::interprocess::offset_ptr<MapPoint>  pNewMP = mpAtlas->segment->find_or_construct<MapPoint>(boost::interprocess::anonymous_instance)(x3D,mpAtlas->GetCurrentMap(),&mLastFrame,i);
+            // Deleted after the frame is tracked, so it is not placed in a slab
+            boost::interprocess::offset_ptr<MapPoint>  pNewMP = ORB_SLAM3::map_segment.ConstructTemporary<MapPoint>(x3D,mpAtlas->GetCurrentMap(),&mLastFrame,i);
 
             mLastFrame.mvpMapPoints[i]=pNewMP;
 
@@ -3158,7 +3244,16 @@ void Tracking::CreateNewKeyFrame()
         return;
 
     //boost::interprocess::offset_ptr<KeyFrame>  pKF = new KeyFrame(mCurrentFrame,mpAtlas->GetCurrentMap(),mpKeyFrameDB);
-    boost::interprocess::offset_ptr<KeyFrame>  pKF = mpAtlas->segment->construct<KeyFrame>(boost::interprocess::anonymous_instance)(mCurrentFrame,mpAtlas->GetCurrentMap(),mpKeyFrameDB);
+#ifdef REGISTER_TIMES
+    std::chrono::steady_clock::time_point time_StartKFCreation = std::chrono::steady_clock::now();
+#endif
+    boost::interprocess::offset_ptr<KeyFrame>  pKF = ORB_SLAM3::map_segment.Construct<KeyFrame>(mCurrentFrame,mpAtlas->GetCurrentMap(),mpKeyFrameDB);
+#ifdef REGISTER_TIMES
+    std::chrono::steady_clock::time_point time_EndKFCreation = std::chrono::steady_clock::now();
+
+    double timeKFCreation = std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(time_EndKFCreation - time_StartKFCreation).count();
+    vdKFCreation_ms.push_back(timeKFCreation);
+#endif
 
     if(mpAtlas->isImuInitialized())
         pKF->bImu = true;
@@ -3236,7 +3331,7 @@ void Tracking::CreateNewKeyFrame()
                     }
                     //mpAtlas->segment->find_or_construct<MapPoint>(boost::interprocess::anonymous_instance)
                     //boost::interprocess::offset_ptr<MapPoint>  pNewMP = new MapPoint(x3D,pKF,mpAtlas->GetCurrentMap());
-                    boost::interprocess::offset_ptr<MapPoint>  pNewMP = mpAtlas->segment->find_or_construct<MapPoint>(boost::interprocess::anonymous_instance)(x3D,pKF,mpAtlas->GetCurrentMap());
+                    boost::interprocess::offset_ptr<MapPoint>  pNewMP = ORB_SLAM3::map_segment.Construct<MapPoint>(x3D,pKF,mpAtlas->GetCurrentMap());
                     pNewMP->AddObservation(pKF,i);
 
                     //Check if it is a stereo observation in order to not
@@ -4256,7 +4351,7 @@ void Tracking::CreateNewMapPoints()
 
             // Triangulation is succesfull
             //boost::interprocess::offset_ptr<MapPoint>  pMP = new MapPoint(x3D,mpLastKeyFrame,mpAtlas->GetCurrentMap());
-            boost::interprocess::offset_ptr<MapPoint>  pMP = mpAtlas->segment->find_or_construct<MapPoint>(boost::interprocess::anonymous_instance)(x3D,mpLastKeyFrame,mpAtlas->GetCurrentMap());
+            boost::interprocess::offset_ptr<MapPoint>  pMP = ORB_SLAM3::map_segment.Construct<MapPoint>(x3D,mpLastKeyFrame,mpAtlas->GetCurrentMap());
 
             pMP->AddObservation(mpLastKeyFrame,idx1);
             pMP->AddObservation(pKF2,idx2);
@@ -0,0 +1,182 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2020 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TrackingFrontEnd.h"
+
+#include <algorithm>
+
+#include "System.h"
+#include "Tracking.h"
+
+namespace ORB_SLAM3
+{
+
+TrackingFrontEnd::TrackingFrontEnd(System* pSys, Tracking* pTracker, int nQueueSize):
+    mpSystem(pSys), mpTracker(pTracker), mSensor(pTracker->mSensor), mnQueueSize(std::max(nQueueSize,1)),
+    mbFinish(false), mpNextExtractor(pTracker->GetMonocularExtractor())
+{
+    mtFeatures = std::thread(&TrackingFrontEnd::RunFeatures, this);
+    mtTracking = std::thread(&TrackingFrontEnd::RunTracking, this);
+}
+
+TrackingFrontEnd::~TrackingFrontEnd()
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutexQueue);
+        mbFinish = true;
+    }
+    mcvQueue.notify_all();
+
+    mtFeatures.join();
+    mtTracking.join();
+}
+
+std::future<cv::Mat> TrackingFrontEnd::Submit(const cv::Mat &im, const cv::Mat &im2, const double &timestamp,
+                                              const std::vector<IMU::Point> &vImuMeas, const std::string &filename)
+{
+    Request* pRequest = new Request();
+    // Copies, the caller may reuse its buffers (as a video capture does) before the frame is built
+    pRequest->im = im.clone();
+    pRequest->im2 = im2.clone();
+    pRequest->timestamp = timestamp;
+    pRequest->vImuMeas = vImuMeas;
+    pRequest->filename = filename;
+    pRequest->pExtractor = static_cast<ORBextractor*>(NULL);
+
+    std::future<cv::Mat> future = pRequest->promise.get_future();
+
+    {
+        std::unique_lock<std::mutex> lock(mMutexQueue);
+        mcvQueue.wait(lock, [&]{return mlpRequests.size() < mnQueueSize;});
+        mlpRequests.push_back(pRequest);
+    }
+    mcvQueue.notify_all();
+
+    return future;
+}
+
+void TrackingFrontEnd::RunFeatures()
+{
+    // Ids are given by the tracking thread, in the order the frames are tracked
+    Frame::sbDeferId = true;
+
+    while(true)
+    {
+        Request* pRequest;
+        {
+            std::unique_lock<std::mutex> lock(mMutexQueue);
+            mcvQueue.wait(lock, [&]{return (!mlpRequests.empty() && mlpFrames.size() < mnQueueSize) ||
+                                           (mbFinish && mlpRequests.empty());});
+            if(mlpRequests.empty())
+                break;
+            pRequest = mlpRequests.front();
+            mlpRequests.pop_front();
+        }
+        mcvQueue.notify_all();
+
+        BuildFrame(pRequest);
+
+        {
+            std::unique_lock<std::mutex> lock(mMutexQueue);
+            mlpFrames.push_back(pRequest);
+        }
+        mcvQueue.notify_all();
+    }
+
+    // Wakes up the tracking thread, which finishes once every frame has been tracked
+    {
+        std::unique_lock<std::mutex> lock(mMutexQueue);
+        mlpFrames.push_back(static_cast<Request*>(NULL));
+    }
+    mcvQueue.notify_all();
+}
+
+void TrackingFrontEnd::RunTracking()
+{
+    while(true)
+    {
+        Request* pRequest;
+        {
+            std::unique_lock<std::mutex> lock(mMutexQueue);
+            mcvQueue.wait(lock, [&]{return !mlpFrames.empty();});
+            pRequest = mlpFrames.front();
+            mlpFrames.pop_front();
+        }
+        mcvQueue.notify_all();
+
+        if(!pRequest)
+            break;
+
+        TrackFrame(pRequest);
+        delete pRequest;
+    }
+}
+
+void TrackingFrontEnd::BuildFrame(Request* pRequest)
+{
+    std::unique_lock<std::mutex> lock(mMutexExtraction);
+
+    if(mSensor==System::STEREO || mSensor==System::IMU_STEREO)
+    {
+        pRequest->imRight = pRequest->im2;
+        pRequest->frame = mpTracker->CreateFrameStereo(pRequest->im,pRequest->im2,pRequest->timestamp);
+    }
+    else if(mSensor==System::RGBD)
+    {
+        pRequest->frame = mpTracker->CreateFrameRGBD(pRequest->im,pRequest->im2,pRequest->timestamp);
+    }
+    else
+    {
+        pRequest->pExtractor = mpNextExtractor;
+        pRequest->frame = mpTracker->CreateFrameMonocular(pRequest->im,pRequest->timestamp,pRequest->pExtractor);
+    }
+}
+
+void TrackingFrontEnd::TrackFrame(Request* pRequest)
+{
+    // Same steps as System::Track*, the frame being already built
+    mpSystem->CheckModeAndReset();
+
+    if(mSensor==System::IMU_MONOCULAR || mSensor==System::IMU_STEREO)
+        for(size_t i_imu = 0; i_imu < pRequest->vImuMeas.size(); i_imu++)
+            mpTracker->GrabImuData(pRequest->vImuMeas[i_imu]);
+
+    const bool bMonocular = mSensor==System::MONOCULAR || mSensor==System::IMU_MONOCULAR;
+    ORBextractor* pExtractor = bMonocular ? mpTracker->GetMonocularExtractor() : pRequest->pExtractor;
+    if(pExtractor != pRequest->pExtractor)
+    {
+        // The tracking state changed the extractor (initialization or a new map), built as GrabImageMonocular
+        std::unique_lock<std::mutex> lock(mMutexExtraction);
+        pRequest->frame = mpTracker->CreateFrameMonocular(pRequest->im,pRequest->timestamp,pExtractor);
+    }
+    else
+    {
+        pRequest->frame.AssignId();
+    }
+
+    cv::Mat Tcw = mpTracker->GrabFrame(pRequest->frame,pRequest->im,pRequest->imRight,pRequest->filename);
+
+    if(bMonocular)
+        mpNextExtractor = mpTracker->GetMonocularExtractor();
+
+    mpSystem->UpdateTrackingState();
+
+    pRequest->promise.set_value(Tcw);
+}
+
+} //namespace ORB_SLAM3